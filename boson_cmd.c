@@ -0,0 +1,553 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/* Boson commands are framed as
+ *
+ *   0x8E | channel | sequence | function ID | status | payload | CRC16 | 0xAE
+ *
+ * with 32-bit big endian fields and the CRC (CCITT, seed 0x1D0F) over
+ * channel through payload. 0x8E, 0x9E and 0xAE inside the frame are sent
+ * as 0x9E followed by 0x81, 0x91 or 0xA1. The serializer bridge takes the
+ * frame one byte at a time in its data register between a begin and a
+ * send strobe on its control register, and returns the camera response
+ * through the same data register.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "boson_cmd.h"
+#include "i2cCommands.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+#include "os_common.h"
+#include "shutdown.h"
+
+#define BOSON_START_FRAME               0x8E
+#define BOSON_ESCAPE                    0x9E
+#define BOSON_END_FRAME                 0xAE
+#define BOSON_ESCAPED_START_FRAME       0x81
+#define BOSON_ESCAPED_ESCAPE            0x91
+#define BOSON_ESCAPED_END_FRAME         0xA1
+#define BOSON_CHANNEL                   0x00
+#define BOSON_CRC_SEED                  0x1D0F
+#define BOSON_STATUS_REQUEST            0xFFFFFFFF
+
+#define BOSON_PACKET_HEADER_SIZE        12      /* sequence, function ID, status */
+#define BOSON_MAX_FRAME_SIZE            (1 + BOSON_PACKET_HEADER_SIZE + BOSON_CMD_MAX_PAYLOAD + 2)
+
+
+typedef struct {
+    NvMediaBool                 done;
+    NvMediaBool                 abandoned;
+    BosonCmdResponse            response;
+} BosonCmdWaiter;
+
+static pthread_mutex_t waiterMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t waiterCond = PTHREAD_COND_INITIALIZER;
+
+static uint16_t
+_Crc16(const uint8_t *data,
+       uint32_t size)
+{
+    uint16_t crc = BOSON_CRC_SEED;
+    uint32_t i, bit;
+
+    for (i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static void
+_PutBE32(uint8_t *dst,
+         uint32_t value)
+{
+    dst[0] = value >> 24;
+    dst[1] = value >> 16;
+    dst[2] = value >> 8;
+    dst[3] = value;
+}
+
+static uint32_t
+_GetBE32(const uint8_t *src)
+{
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) |
+           ((uint32_t)src[2] << 8) | src[3];
+}
+
+static NvMediaStatus
+_WriteBridge(NvBosonCmdEngine *engine,
+             uint8_t reg,
+             uint8_t value)
+{
+    uint8_t instruction[2] = { reg, value };
+
+    if (testutil_i2c_write_subaddr(engine->handle, engine->address, instruction, 2)) {
+        LOG_ERR("%s: Failed to write to I2C %02x %02x %02x\n", __func__,
+                engine->address, reg, value);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    return NVMEDIA_STATUS_OK;
+}
+
+static uint32_t
+_PutEscaped(uint8_t *dst,
+            uint8_t value)
+{
+    switch (value) {
+        case BOSON_START_FRAME:
+            dst[1] = BOSON_ESCAPED_START_FRAME;
+            break;
+        case BOSON_ESCAPE:
+            dst[1] = BOSON_ESCAPED_ESCAPE;
+            break;
+        case BOSON_END_FRAME:
+            dst[1] = BOSON_ESCAPED_END_FRAME;
+            break;
+        default:
+            dst[0] = value;
+            return 1;
+    }
+
+    dst[0] = BOSON_ESCAPE;
+    return 2;
+}
+
+NvMediaStatus
+BosonCmdEncode(uint32_t sequence,
+               uint32_t functionId,
+               const uint8_t *payload,
+               uint32_t payloadSize,
+               uint8_t *frame,
+               uint32_t *frameSize)
+{
+    uint8_t packet[BOSON_MAX_FRAME_SIZE];
+    uint32_t size = 0, i, n = 0;
+    uint16_t crc;
+
+    if (payloadSize > BOSON_CMD_MAX_PAYLOAD || (payloadSize && !payload))
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    packet[size++] = BOSON_CHANNEL;
+    _PutBE32(&packet[size], sequence);
+    _PutBE32(&packet[size + 4], functionId);
+    _PutBE32(&packet[size + 8], BOSON_STATUS_REQUEST);
+    size += BOSON_PACKET_HEADER_SIZE;
+    if (payloadSize)
+        memcpy(&packet[size], payload, payloadSize);
+    size += payloadSize;
+    crc = _Crc16(packet, size);
+    packet[size++] = crc >> 8;
+    packet[size++] = crc & 0xFF;
+
+    frame[n++] = BOSON_START_FRAME;
+    for (i = 0; i < size; i++)
+        n += _PutEscaped(&frame[n], packet[i]);
+    frame[n++] = BOSON_END_FRAME;
+
+    *frameSize = n;
+    return NVMEDIA_STATUS_OK;
+}
+
+static NvMediaStatus
+_SendFrame(NvBosonCmdEngine *engine,
+           const BosonCmdRequest *request)
+{
+    uint8_t frame[BOSON_CMD_MAX_FRAME_SIZE];
+    uint32_t size = 0, i;
+
+    if (BosonCmdEncode(request->sequence, request->functionId, request->payload,
+                       request->payloadSize, frame, &size) != NVMEDIA_STATUS_OK)
+        return NVMEDIA_STATUS_ERROR;
+
+    if (_WriteBridge(engine, BOSON_BRIDGE_CTRL_REG, BOSON_BRIDGE_CTRL_BEGIN) != NVMEDIA_STATUS_OK)
+        return NVMEDIA_STATUS_ERROR;
+
+    for (i = 0; i < size; i++) {
+        if (_WriteBridge(engine, BOSON_BRIDGE_DATA_REG, frame[i]) != NVMEDIA_STATUS_OK)
+            return NVMEDIA_STATUS_ERROR;
+    }
+
+    return _WriteBridge(engine, BOSON_BRIDGE_CTRL_REG, BOSON_BRIDGE_CTRL_SEND);
+}
+
+/* Validates an unescaped frame and fills the response if it answers request */
+static NvMediaStatus
+_ParseFrame(const uint8_t *frame,
+            uint32_t size,
+            const BosonCmdRequest *request,
+            BosonCmdResponse *response)
+{
+    uint32_t sequence;
+
+    if (size < 1 + BOSON_PACKET_HEADER_SIZE + 2) {
+        LOG_DBG("%s: Dropping short frame of %u bytes\n", __func__, size);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (_Crc16(frame, size - 2) != (((uint16_t)frame[size - 2] << 8) | frame[size - 1])) {
+        LOG_WARN("%s: Dropping frame with bad CRC\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    sequence = _GetBE32(&frame[1]);
+    if (sequence != request->sequence || _GetBE32(&frame[5]) != request->functionId) {
+        LOG_DBG("%s: Dropping stale response %u\n", __func__, sequence);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    response->cameraStatus = _GetBE32(&frame[9]);
+    response->payloadSize = size - (1 + BOSON_PACKET_HEADER_SIZE + 2);
+    memcpy(response->payload, &frame[1 + BOSON_PACKET_HEADER_SIZE], response->payloadSize);
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Reads the bridge until the response to request arrives or it times out.
+ * Responses to earlier, timed out requests are skipped. */
+static NvMediaStatus
+_ReceiveResponse(NvBosonCmdEngine *engine,
+                 const BosonCmdRequest *request,
+                 BosonCmdResponse *response)
+{
+    uint8_t frame[BOSON_MAX_FRAME_SIZE];
+    uint8_t reg = BOSON_BRIDGE_DATA_REG, value;
+    uint32_t size = 0;
+    uint64_t start = 0, now = 0;
+    NvMediaBool inFrame = NVMEDIA_FALSE, escaped = NVMEDIA_FALSE;
+
+    GetTimeMicroSec(&start);
+    while (!engine->stop) {
+        GetTimeMicroSec(&now);
+        if (now - start > (uint64_t)BOSON_CMD_TIMEOUT * 1000)
+            return NVMEDIA_STATUS_TIMED_OUT;
+
+        if (testutil_i2c_read_subaddr(engine->handle, engine->address, &reg, 1, &value, 1) < 0) {
+            LOG_ERR("%s: Failed to read from I2C %02x\n", __func__, engine->address);
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (value == BOSON_START_FRAME) {
+            inFrame = NVMEDIA_TRUE;
+            escaped = NVMEDIA_FALSE;
+            size = 0;
+        } else if (!inFrame) {
+            /* Nothing to read yet */
+            nvsleep(BOSON_CMD_POLL_INTERVAL);
+        } else if (value == BOSON_END_FRAME) {
+            inFrame = NVMEDIA_FALSE;
+            if (_ParseFrame(frame, size, request, response) == NVMEDIA_STATUS_OK)
+                return NVMEDIA_STATUS_OK;
+        } else if (value == BOSON_ESCAPE) {
+            escaped = NVMEDIA_TRUE;
+        } else if (size == sizeof(frame)) {
+            LOG_WARN("%s: Dropping oversized frame\n", __func__);
+            inFrame = NVMEDIA_FALSE;
+        } else {
+            if (escaped) {
+                value = (value == BOSON_ESCAPED_START_FRAME) ? BOSON_START_FRAME :
+                        (value == BOSON_ESCAPED_END_FRAME) ? BOSON_END_FRAME : BOSON_ESCAPE;
+                escaped = NVMEDIA_FALSE;
+            }
+            frame[size++] = value;
+        }
+    }
+
+    return NVMEDIA_STATUS_ERROR;
+}
+
+static void
+_Complete(const BosonCmdRequest *request,
+          BosonCmdResponse *response)
+{
+    if (request->callback)
+        request->callback(response, request->callbackData);
+}
+
+static uint32_t
+_BosonCmdThreadFunc(void *data)
+{
+    NvBosonCmdEngine *engine = (NvBosonCmdEngine *)data;
+    BosonCmdRequest request;
+    BosonCmdResponse response;
+
+    testutil_i2c_open(engine->i2cDevice, &engine->handle);
+    if (!engine->handle)
+        LOG_ERR("%s: Failed to open handle with id %u, Boson commands will fail\n",
+                __func__, engine->i2cDevice);
+
+    while (!engine->stop) {
+        if (NvQueueGet(engine->requestQueue, &request, BOSON_CMD_DEQUEUE_TIMEOUT) !=
+            NVMEDIA_STATUS_OK)
+            continue;
+
+        memset(&response, 0, sizeof(response));
+        response.functionId = request.functionId;
+        response.sequence = request.sequence;
+
+        if (!engine->handle || _SendFrame(engine, &request) != NVMEDIA_STATUS_OK)
+            response.result = NVMEDIA_STATUS_ERROR;
+        else
+            response.result = _ReceiveResponse(engine, &request, &response);
+
+        if (response.result == NVMEDIA_STATUS_OK) {
+            engine->numCompleted++;
+            if (response.cameraStatus != BOSON_STATUS_OK)
+                LOG_WARN("%s: Command 0x%08x returned status 0x%08x\n", __func__,
+                         request.functionId, response.cameraStatus);
+        } else if (response.result == NVMEDIA_STATUS_TIMED_OUT) {
+            engine->numTimedOut++;
+            LOG_WARN("%s: Command 0x%08x (sequence %u) timed out\n", __func__,
+                     request.functionId, request.sequence);
+        } else {
+            engine->numFailed++;
+        }
+
+        _Complete(&request, &response);
+    }
+
+    if (engine->handle)
+        testutil_i2c_close(engine->handle);
+    engine->handle = NULL;
+
+    LOG_INFO("%s: Boson command thread exited\n", __func__);
+    ShutdownThreadExited(&engine->exitedFlag);
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+BosonCmdCreate(uint32_t i2cDevice,
+               uint32_t address,
+               NvBosonCmdEngine **engine)
+{
+    NvBosonCmdEngine *ctx = NULL;
+    NvMediaStatus status;
+
+    ctx = calloc(1, sizeof(NvBosonCmdEngine));
+    if (!ctx) {
+        LOG_ERR("%s: Failed to allocate memory for Boson command engine\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    ctx->i2cDevice = i2cDevice;
+    ctx->address = address;
+    ctx->exitedFlag = NVMEDIA_TRUE;
+    ctx->nextSequence = 1;
+
+    /* Every byte written to the FIFO port is part of a command, and the
+     * control register acts on every write */
+    BosonCmdSetVolatile(i2cDevice, address);
+
+    status = NvQueueCreate(&ctx->requestQueue,
+                           BOSON_CMD_QUEUE_SIZE,
+                           sizeof(BosonCmdRequest));
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create Boson command queue\n", __func__);
+        goto failed;
+    }
+
+    ctx->exitedFlag = NVMEDIA_FALSE;
+    status = NvThreadCreate(&ctx->commandThread,
+                            &_BosonCmdThreadFunc,
+                            (void *)ctx,
+                            NV_THREAD_PRIORITY_NORMAL);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create Boson command thread\n", __func__);
+        ctx->exitedFlag = NVMEDIA_TRUE;
+        goto failed;
+    }
+
+    *engine = ctx;
+    return NVMEDIA_STATUS_OK;
+failed:
+    BosonCmdDestroy(ctx);
+    return status;
+}
+
+void
+BosonCmdSetVolatile(uint32_t i2cDevice,
+                    uint32_t address)
+{
+    I2cShadowSetVolatile(i2cDevice, address, BOSON_BRIDGE_DATA_REG, BOSON_BRIDGE_DATA_REG);
+    I2cShadowSetVolatile(i2cDevice, address, BOSON_BRIDGE_CTRL_REG, BOSON_BRIDGE_CTRL_REG);
+}
+
+void
+BosonCmdDestroy(NvBosonCmdEngine *engine)
+{
+    BosonCmdRequest request;
+    BosonCmdResponse response;
+    NvMediaStatus status;
+
+    if (!engine)
+        return;
+
+    engine->stop = NVMEDIA_TRUE;
+    if (engine->commandThread) {
+        /* A thread stuck in I2C still uses the engine */
+        if (IsFailed(ShutdownWaitExit(&engine->exitedFlag, "Boson command thread")))
+            return;
+        status = NvThreadDestroy(engine->commandThread);
+        if (status != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to destroy Boson command thread\n", __func__);
+    }
+
+    if (engine->requestQueue) {
+        while (NvQueueGet(engine->requestQueue, &request, 0) == NVMEDIA_STATUS_OK) {
+            memset(&response, 0, sizeof(response));
+            response.result = NVMEDIA_STATUS_ERROR;
+            response.functionId = request.functionId;
+            response.sequence = request.sequence;
+            _Complete(&request, &response);
+        }
+        NvQueueDestroy(engine->requestQueue);
+    }
+
+    LOG_DBG("%s: %u commands completed, %u timed out, %u failed\n", __func__,
+            engine->numCompleted, engine->numTimedOut, engine->numFailed);
+    free(engine);
+}
+
+NvMediaStatus
+BosonCmdSubmit(NvBosonCmdEngine *engine,
+               uint32_t functionId,
+               const uint8_t *payload,
+               uint32_t payloadSize,
+               BosonCmdCallback callback,
+               void *data)
+{
+    BosonCmdRequest request;
+
+    if (!engine || payloadSize > BOSON_CMD_MAX_PAYLOAD || (payloadSize && !payload))
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    request.functionId = functionId;
+    request.sequence = __atomic_fetch_add(&engine->nextSequence, 1, __ATOMIC_RELAXED);
+    request.payloadSize = payloadSize;
+    if (payloadSize)
+        memcpy(request.payload, payload, payloadSize);
+    request.callback = callback;
+    request.callbackData = data;
+
+    if (NvQueuePut(engine->requestQueue, &request, 0) != NVMEDIA_STATUS_OK) {
+        LOG_WARN("%s: Boson command queue is full, dropping 0x%08x\n", __func__, functionId);
+        return NVMEDIA_STATUS_INSUFFICIENT_BUFFERING;
+    }
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+_ExecuteDone(const BosonCmdResponse *response,
+             void *data)
+{
+    BosonCmdWaiter *waiter = (BosonCmdWaiter *)data;
+
+    pthread_mutex_lock(&waiterMutex);
+    if (waiter->abandoned) {
+        free(waiter);
+    } else {
+        waiter->response = *response;
+        waiter->done = NVMEDIA_TRUE;
+        pthread_cond_broadcast(&waiterCond);
+    }
+    pthread_mutex_unlock(&waiterMutex);
+}
+
+NvMediaStatus
+BosonCmdExecute(NvBosonCmdEngine *engine,
+                uint32_t functionId,
+                const uint8_t *payload,
+                uint32_t payloadSize,
+                BosonCmdResponse *response)
+{
+    BosonCmdWaiter *waiter;
+    struct timespec deadline;
+    NvMediaStatus status;
+
+    /* The waiter outlives this call if the command completes after we gave up */
+    waiter = calloc(1, sizeof(BosonCmdWaiter));
+    if (!waiter)
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+
+    status = BosonCmdSubmit(engine, functionId, payload, payloadSize, &_ExecuteDone, waiter);
+    if (status != NVMEDIA_STATUS_OK) {
+        free(waiter);
+        return status;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += BOSON_CMD_EXECUTE_TIMEOUT / 1000;
+    deadline.tv_nsec += (BOSON_CMD_EXECUTE_TIMEOUT % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&waiterMutex);
+    while (!waiter->done) {
+        if (pthread_cond_timedwait(&waiterCond, &waiterMutex, &deadline))
+            break;
+    }
+    if (waiter->done) {
+        *response = waiter->response;
+        status = response->result;
+        free(waiter);
+    } else {
+        waiter->abandoned = NVMEDIA_TRUE;
+        status = NVMEDIA_STATUS_TIMED_OUT;
+    }
+    pthread_mutex_unlock(&waiterMutex);
+
+    return status;
+}
+
+/* Runs a command whose payload is one 32-bit value */
+static NvMediaStatus
+_ExecuteU32(NvBosonCmdEngine *engine,
+            uint32_t functionId,
+            uint32_t value,
+            BosonCmdResponse *response)
+{
+    uint8_t payload[4];
+
+    _PutBE32(payload, value);
+    return BosonCmdExecute(engine, functionId, payload, sizeof(payload), response);
+}
+
+NvMediaStatus
+BosonCmdSetAgcMode(NvBosonCmdEngine *engine,
+                   BosonAgcMode mode,
+                   BosonCmdResponse *response)
+{
+    if (mode >= BOSON_AGC_MODE_END)
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    return _ExecuteU32(engine, BOSON_FN_AGC_SET_MODE, mode, response);
+}
+
+NvMediaStatus
+BosonCmdSetGainMode(NvBosonCmdEngine *engine,
+                    BosonGainMode mode,
+                    BosonCmdResponse *response)
+{
+    if (mode >= BOSON_GAIN_MODE_END)
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    return _ExecuteU32(engine, BOSON_FN_SET_GAIN_MODE, mode, response);
+}
+
+NvMediaStatus
+BosonCmdSetTelemetry(NvBosonCmdEngine *engine,
+                     NvMediaBool enable,
+                     BosonCmdResponse *response)
+{
+    return _ExecuteU32(engine, BOSON_FN_TELEMETRY_SET_STATE, enable ? 1 : 0, response);
+}
@@ -0,0 +1,175 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __BOSON_CMD_H__
+#define __BOSON_CMD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "nvmedia_core.h"
+#include "thread_utils.h"
+#include "testutil_i2c.h"
+
+#define BOSON_CMD_QUEUE_SIZE            16
+#define BOSON_CMD_DEQUEUE_TIMEOUT       100     /* ms */
+#define BOSON_CMD_TIMEOUT               1000    /* ms, camera response */
+#define BOSON_CMD_EXECUTE_TIMEOUT       (4 * BOSON_CMD_TIMEOUT) /* ms, including queueing */
+#define BOSON_CMD_POLL_INTERVAL         1000    /* us between reads of an idle bridge */
+#define BOSON_CMD_MAX_PAYLOAD           128
+/* Start, escaped channel through CRC, end */
+#define BOSON_CMD_MAX_FRAME_SIZE        (2 + 2 * (1 + 12 + BOSON_CMD_MAX_PAYLOAD + 2))
+
+/* Serializer bridge registers, at the sensor address of the script.
+ * Frames are streamed through the data register one byte at a time. */
+#define BOSON_BRIDGE_DATA_REG           0x00
+#define BOSON_BRIDGE_CTRL_REG           0x09
+#define BOSON_BRIDGE_CTRL_BEGIN         0x02
+#define BOSON_BRIDGE_CTRL_SEND          0x00
+
+/* Function IDs from the Boson SDK command table */
+#define BOSON_FN_GET_CAMERA_SN          0x00050002
+#define BOSON_FN_RUN_FFC                0x00050007
+#define BOSON_FN_COLORLUT_SET_CONTROL   0x000B0001
+#define BOSON_FN_COLORLUT_SET_ID        0x000B0003
+#define BOSON_FN_TELEMETRY_SET_STATE    0x00040001
+#define BOSON_FN_SET_GAIN_MODE          0x00050014
+#define BOSON_FN_AGC_SET_MODE           0x000A0017
+
+typedef enum {
+    BOSON_AGC_MODE_NORMAL = 0,
+    BOSON_AGC_MODE_HOLD,
+    BOSON_AGC_MODE_THRESHOLD,
+    BOSON_AGC_MODE_AUTO_BRIGHT,
+    BOSON_AGC_MODE_AUTO_LINEAR,
+    BOSON_AGC_MODE_MANUAL,
+    BOSON_AGC_MODE_END
+} BosonAgcMode;
+
+typedef enum {
+    BOSON_GAIN_MODE_HIGH = 0,
+    BOSON_GAIN_MODE_LOW,
+    BOSON_GAIN_MODE_AUTO,
+    BOSON_GAIN_MODE_DUAL,
+    BOSON_GAIN_MODE_MANUAL,
+    BOSON_GAIN_MODE_END
+} BosonGainMode;
+
+/* Camera status returned with a response; anything else is an error code */
+#define BOSON_STATUS_OK                 0x00000000
+
+typedef struct {
+    NvMediaStatus               result;         /* OK, TIMED_OUT or ERROR for transport failures */
+    uint32_t                    functionId;
+    uint32_t                    sequence;
+    uint32_t                    cameraStatus;   /* valid when result is OK */
+    uint32_t                    payloadSize;
+    uint8_t                     payload[BOSON_CMD_MAX_PAYLOAD];
+} BosonCmdResponse;
+
+/* Runs on the command thread once the command completed or failed */
+typedef void (*BosonCmdCallback)(const BosonCmdResponse *response, void *data);
+
+typedef struct {
+    uint32_t                    functionId;
+    uint32_t                    sequence;
+    uint32_t                    payloadSize;
+    uint8_t                     payload[BOSON_CMD_MAX_PAYLOAD];
+    BosonCmdCallback            callback;
+    void                       *callbackData;
+} BosonCmdRequest;
+
+typedef struct {
+    NvQueue                    *requestQueue;
+    NvThread                   *commandThread;
+    NvMediaBool                 exitedFlag;
+    volatile NvMediaBool        stop;
+
+    /* I2C params, the handle is owned by the command thread */
+    I2cHandle                   handle;
+    uint32_t                    i2cDevice;
+    uint32_t                    address;
+
+    /* statistics */
+    uint32_t                    nextSequence;
+    volatile uint32_t           numCompleted;
+    volatile uint32_t           numTimedOut;
+    volatile uint32_t           numFailed;
+} NvBosonCmdEngine;
+
+NvMediaStatus
+BosonCmdCreate(uint32_t i2cDevice,
+               uint32_t address,
+               NvBosonCmdEngine **engine);
+
+/* Keeps the register shadow from skipping repeated writes to the bridge
+ * registers of the camera at address. Done by BosonCmdCreate. */
+void
+BosonCmdSetVolatile(uint32_t i2cDevice,
+                    uint32_t address);
+
+/* Fails every command still queued with NVMEDIA_STATUS_ERROR */
+void
+BosonCmdDestroy(NvBosonCmdEngine *engine);
+
+/* Queues a command without blocking. The callback may be NULL for fire
+ * and forget. Returns NVMEDIA_STATUS_INSUFFICIENT_BUFFERING if the queue
+ * is full. */
+NvMediaStatus
+BosonCmdSubmit(NvBosonCmdEngine *engine,
+               uint32_t functionId,
+               const uint8_t *payload,
+               uint32_t payloadSize,
+               BosonCmdCallback callback,
+               void *data);
+
+/* Builds the wire bytes of a command, start and end markers included, for
+ * callers that send it through a register script instead of the engine.
+ * frame must hold BOSON_CMD_MAX_FRAME_SIZE bytes. The engine numbers its
+ * commands from 1, so responses to sequence 0 are never mistaken for its own. */
+NvMediaStatus
+BosonCmdEncode(uint32_t sequence,
+               uint32_t functionId,
+               const uint8_t *payload,
+               uint32_t payloadSize,
+               uint8_t *frame,
+               uint32_t *frameSize);
+
+/* Queues a command and waits for its response. Must not be called from a
+ * frame processing thread. */
+NvMediaStatus
+BosonCmdExecute(NvBosonCmdEngine *engine,
+                uint32_t functionId,
+                const uint8_t *payload,
+                uint32_t payloadSize,
+                BosonCmdResponse *response);
+
+/* Typed commands, run like BosonCmdExecute */
+NvMediaStatus
+BosonCmdSetAgcMode(NvBosonCmdEngine *engine,
+                   BosonAgcMode mode,
+                   BosonCmdResponse *response);
+
+NvMediaStatus
+BosonCmdSetGainMode(NvBosonCmdEngine *engine,
+                    BosonGainMode mode,
+                    BosonCmdResponse *response);
+
+/* The telemetry line is the first line of every frame while enabled */
+NvMediaStatus
+BosonCmdSetTelemetry(NvBosonCmdEngine *engine,
+                     NvMediaBool enable,
+                     BosonCmdResponse *response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __BOSON_CMD_H__
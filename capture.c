@@ -15,6 +15,9 @@
 #include "capture.h"
 #include "save.h"
 #include "os_common.h"
+#include "shutdown.h"
+#include "sensorInfo_boson.h"
+#include "image_time.h"
 
 /* each 4bit 0 or 1 --> 1bit 0 or 1. eg. 0x1101 --> 0xD */
 #define CAMMAP_4BITSTO_1BIT(a) \
@@ -80,13 +83,17 @@ _WriteCommandsToFile(FILE *fp,
     uint32_t i = 0;
 
     for (i = 0; i < allCommands->numCommands; i++) {
-        Command *cmd = &allCommands->commands[i];
+        Command *cmd = I2C_COMMAND(allCommands, i);
         switch (cmd->commandType) {
             case DELAY:
             case I2C_DEVICE:
             case I2C_ERR:
             case SECTION_START:
             case SECTION_STOP:
+            case WRITE_DELAY:
+            case POLL_REG_1:
+            case POLL_REG_2:
+            case VOLATILE_REG:
                 /* Do nothing */
                 break;
             case WRITE_REG_1:
@@ -122,6 +129,9 @@ _ReadSensorRegisters(NvCaptureContext *ctx,
         return NVMEDIA_STATUS_ERROR;
     }
 
+    /* The dump shows what the device holds, not what was written */
+    I2cShadowEnable(NVMEDIA_FALSE);
+
     /* Get register values from I2C for parsed commands */
     status = I2cProcessCommands(&ctx->parsedCommands,
                                 I2C_READ,
@@ -518,7 +528,11 @@ _CreateImageQueue(NvMediaDevice *device,
             goto failed;
         }
 
-        image->tag = *queue;
+        status = ImageContextCreate(image, *queue);
+        if (IsFailed(status)) {
+            NvMediaImageDestroy(image);
+            goto failed;
+        }
 
         if (IsFailed(NvQueuePut(*queue,
                                 (void *)&image,
@@ -567,13 +581,15 @@ _CaptureThreadFunc(void *data)
                                          threadCtx->numMiniburstFrames);
         if (status != NVMEDIA_STATUS_OK) {
             LOG_ERR("%s: CaptureDetermineStatus failed\n", __func__);
-            *threadCtx->quit = NVMEDIA_TRUE;
+            ShutdownRequest(__func__);
             goto done;
         }
 
         /* Set current frame to be an offset by frames to skip */
-        if (startCapture)
+        if (startCapture) {
             threadCtx->currentFrame = i - threadCtx->numFramesToSkip;
+            FrameEventPublish(&threadCtx->frameEvent, threadCtx->currentFrame);
+        }
 
         /* Feed all images to image capture object from the input Queue */
         while (NvQueueGet(threadCtx->inputQueue,
@@ -585,16 +601,16 @@ _CaptureThreadFunc(void *data)
                                          CAPTURE_FEED_FRAME_TIMEOUT);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: %d: NvMediaICPFeedFrame failed\n", __func__, __LINE__);
-                if (NvQueuePut((NvQueue *)feedImage->tag,
+                if (NvQueuePut(IMAGE_QUEUE(feedImage),
                                (void *)&feedImage,
                                0) != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to put image back into capture input queue", __func__);
-                    *threadCtx->quit = NVMEDIA_TRUE;
+                    ShutdownRequest(__func__);
                     status = NVMEDIA_STATUS_ERROR;
                     goto done;
                 }
                 feedImage = NULL;
-                *threadCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
                 goto done;
             }
             feedImage = NULL;
@@ -632,11 +648,13 @@ _CaptureThreadFunc(void *data)
             case NVMEDIA_STATUS_ERROR:
             default:
                 LOG_ERR("%s: NvMediaICPGetFrameEx failed\n", __func__);
-                *threadCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
                 goto done;
         }
 
         GetTimeMicroSec(&tend);
+        /* Travels with the image for the latency of the later stages */
+        ImageTimeSet(capturedImage, tend);
         uint64_t td = tend - tbegin;
         if (td > 3000000) {
             fps = (int)(totalCapturedFrames-lastCapturedFrame)*(1000000.0/td);
@@ -654,17 +672,26 @@ _CaptureThreadFunc(void *data)
                                 CAPTURE_ENQUEUE_TIMEOUT);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_INFO("%s: Failed to put image onto capture output queue", __func__);
+                threadCtx->numDropped++;
                 goto done;
             }
 
+            /* Goes after the image so the consumer can tell what the
+             * sensor was set to when the frame was captured */
+            if (threadCtx->outputFrameQueue &&
+                NvQueuePut(threadCtx->outputFrameQueue,
+                           (void *)&threadCtx->currentFrame,
+                           0) != NVMEDIA_STATUS_OK)
+                LOG_ERR("%s: Failed to put frame number onto output queue\n", __func__);
+
             totalCapturedFrames++;
         } else {
-            status = NvQueuePut((NvQueue *)capturedImage->tag,
+            status = NvQueuePut(IMAGE_QUEUE(capturedImage),
                                 (void *)&capturedImage,
                                 0);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back into capture input queue", __func__);
-                *threadCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
                 goto done;
             }
 
@@ -672,12 +699,12 @@ _CaptureThreadFunc(void *data)
         capturedImage = NULL;
 done:
         if (capturedImage) {
-            status = NvQueuePut((NvQueue *)capturedImage->tag,
+            status = NvQueuePut(IMAGE_QUEUE(capturedImage),
                                 (void *)&capturedImage,
                                 0);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back into capture input queue", __func__);
-                *threadCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
             }
             capturedImage = NULL;
         }
@@ -692,7 +719,7 @@ done:
     /* Release all the frames which are fed */
     while (NvMediaICPReleaseFrame(icpInst, &capturedImage) == NVMEDIA_STATUS_OK) {
         if (capturedImage) {
-            status = NvQueuePut((NvQueue *)capturedImage->tag,
+            status = NvQueuePut(IMAGE_QUEUE(capturedImage),
                                 (void *)&capturedImage,
                                 0);
             if (status != NVMEDIA_STATUS_OK) {
@@ -705,7 +732,7 @@ done:
     NvMediaICPStop(icpInst);
 
     LOG_INFO("%s: Capture thread exited\n", __func__);
-    threadCtx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&threadCtx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -751,12 +778,26 @@ CaptureInit(NvMainContext *mainCtx)
             LOG_ERR("%s: Failed to parse register file\n",__func__);
             goto failed;
         }
+        /* The register dump needs one command per register */
+        if (!testArgs->disableI2cBurst && !testArgs->rdregs.isUsed)
+            I2cCoalesceWrites(&captureCtx->parsedCommands);
     }
     captureCtx->i2cDeviceNum = captureCtx->captureParams.i2cDevice.uIntValue;
     captureCtx->calParams.i2cDevice = captureCtx->i2cDeviceNum;
     captureCtx->calParams.sensorAddress = captureCtx->captureParams.sensorAddress.uIntValue;
     captureCtx->calParams.crystalFrequency = captureCtx->crystalFrequency;
 
+    /* Only nvraw files need the sensor state with each frame */
+    if (captureCtx->useNvRawFormat) {
+        status = SensorStateInit(&captureCtx->sensorState,
+                                 captureCtx->sensorInfo,
+                                 &captureCtx->calParams);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create sensor state\n", __func__);
+            goto failed;
+        }
+    }
+
     /* Create NvMedia Device */
     captureCtx->device = NvMediaDeviceCreate();
     if (!captureCtx->device) {
@@ -795,6 +836,60 @@ CaptureInit(NvMainContext *mainCtx)
         }
     }
 
+    /* Create Input Queues and set data for capture threads */
+    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
+
+        captureCtx->threadCtx[i].quit = captureCtx->quit;
+        captureCtx->threadCtx[i].exitedFlag = NVMEDIA_TRUE;
+        captureCtx->threadCtx[i].virtualGroupIndex = i;
+        captureCtx->threadCtx[i].numFramesToCapture = (testArgs->frames.isUsed)?
+                                                       testArgs->frames.uIntValue : 0;
+        captureCtx->threadCtx[i].numFramesToSkip = testArgs->numFramesToSkip;
+        captureCtx->threadCtx[i].numFramesToWait = testArgs->numFramesToWait;
+        captureCtx->threadCtx[i].numMiniburstFrames = 1;
+        captureCtx->threadCtx[i].width  = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0)->width;
+        captureCtx->threadCtx[i].height = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0)->height;
+        captureCtx->threadCtx[i].settings = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0);
+        captureCtx->threadCtx[i].numBuffers = captureCtx->inputQueueSize;
+
+        status = FrameEventInit(&captureCtx->threadCtx[i].frameEvent);
+        if (status != NVMEDIA_STATUS_OK)
+            goto failed;
+
+        /* Create inputQueue for storing captured Images */
+        status = _CreateImageQueue(captureCtx->device,
+                                   &captureCtx->threadCtx[i].inputQueue,
+                                   captureCtx->inputQueueSize,
+                                   captureCtx->threadCtx[i].width,
+                                   captureCtx->threadCtx[i].height,
+                                   captureCtx->threadCtx[i].surfType,
+                                   captureCtx->threadCtx[i].surfAllocAttrs,
+                                   captureCtx->threadCtx[i].numSurfAllocAttrs);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: capture InputQueue %d creation failed\n", __func__, i);
+            goto failed;
+        }
+
+        LOG_DBG("%s: Capture Input Queue %d: %ux%u, images: %u \n",
+                __func__, i, captureCtx->threadCtx[i].width,
+                captureCtx->threadCtx[i].height,
+                captureCtx->inputQueueSize);
+    }
+
+    return NVMEDIA_STATUS_OK;
+failed:
+    LOG_ERR("%s: Failed to initialize Capture\n", __func__);
+    return status;
+}
+
+NvMediaStatus
+CaptureSensorInit(NvMainContext *mainCtx)
+{
+    NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    TestArgs *testArgs = mainCtx->testArgs;
+    NvMediaStatus status;
+    uint32_t i = 0;
+
     /* Power up SER-DES and Cameras, it makes CSI lanes to LP mode */
     if (!testArgs->disablePwrCtrl) {
         /* Create NvMediaISC object to power on cameras */
@@ -829,6 +924,8 @@ CaptureInit(NvMainContext *mainCtx)
         status = NVMEDIA_STATUS_ERROR;
         goto failed;
     }
+    for (i = 0; i < captureCtx->numVirtualChannels; i++)
+        captureCtx->threadCtx[i].icpExCtx = captureCtx->icpExCtx;
 
     /* Write registers from script file over i2c */
     status = I2cProcessCommands(&captureCtx->parsedCommands,
@@ -871,46 +968,28 @@ CaptureInit(NvMainContext *mainCtx)
         }
     }
 
-    /* Create Input Queues and set data for capture threads */
-    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
-
-        captureCtx->threadCtx[i].icpExCtx = captureCtx->icpExCtx;
-        captureCtx->threadCtx[i].quit = captureCtx->quit;
-        captureCtx->threadCtx[i].exitedFlag = NVMEDIA_TRUE;
-        captureCtx->threadCtx[i].virtualGroupIndex = i;
-        captureCtx->threadCtx[i].numFramesToCapture = (testArgs->frames.isUsed)?
-                                                       testArgs->frames.uIntValue : 0;
-        captureCtx->threadCtx[i].numFramesToSkip = testArgs->numFramesToSkip;
-        captureCtx->threadCtx[i].numFramesToWait = testArgs->numFramesToWait;
-        captureCtx->threadCtx[i].numMiniburstFrames = 1;
-        captureCtx->threadCtx[i].width  = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0)->width;
-        captureCtx->threadCtx[i].height = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0)->height;
-        captureCtx->threadCtx[i].settings = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0);
-        captureCtx->threadCtx[i].numBuffers = captureCtx->inputQueueSize;
-
-        /* Create inputQueue for storing captured Images */
-        status = _CreateImageQueue(captureCtx->device,
-                                   &captureCtx->threadCtx[i].inputQueue,
-                                   captureCtx->inputQueueSize,
-                                   captureCtx->threadCtx[i].width,
-                                   captureCtx->threadCtx[i].height,
-                                   captureCtx->threadCtx[i].surfType,
-                                   captureCtx->threadCtx[i].surfAllocAttrs,
-                                   captureCtx->threadCtx[i].numSurfAllocAttrs);
+    /* Camera commands are sent from their own thread, never from a stage.
+     * Only a Boson takes them, at the sensor address of the script. */
+    if (captureCtx->sensorInfo == GetSensorInfo_boson()) {
+        status = BosonCmdCreate(captureCtx->i2cDeviceNum,
+                                captureCtx->calParams.sensorAddress,
+                                &captureCtx->bosonCmd);
         if (status != NVMEDIA_STATUS_OK) {
-            LOG_ERR("%s: capture InputQueue %d creation failed\n", __func__, i);
+            LOG_ERR("%s: Failed to create Boson command engine\n", __func__);
             goto failed;
         }
-
-        LOG_DBG("%s: Capture Input Queue %d: %ux%u, images: %u \n",
-                __func__, i, captureCtx->threadCtx[i].width,
-                captureCtx->threadCtx[i].height,
-                captureCtx->inputQueueSize);
     }
 
+    /* Later writes change a known register state */
+    I2cShadowEnable(NVMEDIA_TRUE);
+
+    status = SensorStateRefresh(&captureCtx->sensorState, 0, NULL);
+    if (status != NVMEDIA_STATUS_OK)
+        goto failed;
+
     return NVMEDIA_STATUS_OK;
 failed:
-    LOG_ERR("%s: Failed to initialize Capture\n", __func__);
+    LOG_ERR("%s: Failed to bring up sensors\n", __func__);
     return status;
 }
 
@@ -932,15 +1011,15 @@ CaptureFini(NvMainContext *mainCtx)
     /* Wait for threads to exit */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
         if (captureCtx->captureThread[i]) {
-            while (!captureCtx->threadCtx[i].exitedFlag) {
-                LOG_DBG("%s: Waiting for capture thread %d to quit\n",
+            if (IsFailed(ShutdownWaitExit(&captureCtx->threadCtx[i].exitedFlag,
+                                          "Capture thread"))) {
+                LOG_ERR("%s: Capture thread %d still running, not releasing resources\n",
                         __func__, i);
+                return NVMEDIA_STATUS_TIMED_OUT;
             }
         }
     }
 
-    *captureCtx->quit = NVMEDIA_TRUE;
-
     /* Destroy threads */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
         if (captureCtx->captureThread[i]) {
@@ -951,12 +1030,15 @@ CaptureFini(NvMainContext *mainCtx)
         }
     }
 
+    BosonCmdDestroy(captureCtx->bosonCmd);
+
     /* Destroy input queues */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
         if (captureCtx->threadCtx[i].inputQueue) {
             while ((NvQueueGet(captureCtx->threadCtx[i].inputQueue, &image,
                         0)) == NVMEDIA_STATUS_OK) {
                 if (image) {
+                    ImageContextDestroy(image);
                     NvMediaImageDestroy(image);
                     image = NULL;
                 }
@@ -964,6 +1046,7 @@ CaptureFini(NvMainContext *mainCtx)
             LOG_DBG("%s: Destroying capture input queue %d \n", __func__, i);
             NvQueueDestroy(captureCtx->threadCtx[i].inputQueue);
         }
+        FrameEventDestroy(&captureCtx->threadCtx[i].frameEvent);
     }
 
     /* Destroy sensor properties */
@@ -993,6 +1076,11 @@ CaptureFini(NvMainContext *mainCtx)
     if (captureCtx->device)
         NvMediaDeviceDestroy(captureCtx->device);
 
+    I2cFreeCommands(&captureCtx->parsedCommands);
+    I2cFreeCommands(&captureCtx->settingsCommands);
+    I2cShadowFini();
+    SensorStateDestroy(&captureCtx->sensorState);
+
     if (captureCtx)
         free(captureCtx);
 
@@ -1018,8 +1106,10 @@ CaptureProc(NvMainContext *mainCtx)
     /* Setting the queues */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
         CaptureThreadCtx *threadCtx = &captureCtx->threadCtx[i];
-        if (threadCtx)
+        if (threadCtx) {
             threadCtx->outputQueue = saveCtx->threadCtx[i].inputQueue;
+            threadCtx->outputFrameQueue = saveCtx->threadCtx[i].inputFrameQueue;
+        }
     }
 
     /* Create capture threads */
@@ -21,6 +21,9 @@ extern "C" {
 #include "nvmedia_isc.h"
 #include "nvmedia_icp.h"
 #include "nvmedia_surface.h"
+#include "boson_cmd.h"
+#include "frame_event.h"
+#include "sensor_state.h"
 
 #define CAPTURE_INPUT_QUEUE_SIZE             5     /* min no. of buffers needed to capture without any frame drops */
 #define CAPTURE_DEQUEUE_TIMEOUT              1000
@@ -33,6 +36,7 @@ typedef struct {
     NvMediaICPEx               *icpExCtx;
     NvQueue                    *inputQueue;
     NvQueue                    *outputQueue;
+    NvQueue                    *outputFrameQueue;   // currentFrame of each output image, if set
     volatile NvMediaBool       *quit;
     NvMediaBool                 exitedFlag;
     NvMediaICPSettings         *settings;
@@ -42,6 +46,8 @@ typedef struct {
     uint32_t                    height;
     uint32_t                    virtualGroupIndex;
     uint32_t                    currentFrame;
+    NvFrameEvent                frameEvent;     // published with currentFrame
+    volatile uint32_t           numDropped;     // captured, but the output queue stayed full
     uint32_t                    numFramesToSkip;
     uint32_t                    numFramesToCapture;
     uint32_t                    numFramesToWait;
@@ -69,6 +75,7 @@ typedef struct {
     CaptureConfigParams         captureParams;
     SensorInfo                 *sensorInfo;
     MapInfo                    *camMap;
+    NvBosonCmdEngine           *bosonCmd;
 
     /* General Variables */
     volatile NvMediaBool       *quit;
@@ -80,6 +87,7 @@ typedef struct {
     I2cCommands                 parsedCommands;
     I2cCommands                 settingsCommands;
     CalibrationParameters       calParams;
+    NvSensorStateStore          sensorState;    // for nvraw, refreshed on settings changes
     NvMediaICPInterfaceType     interfaceType;
     NvMediaICPCsiPhyMode        phyMode;
     uint32_t                    crystalFrequency;
@@ -89,6 +97,11 @@ typedef struct {
 NvMediaStatus
 CaptureInit(NvMainContext *mainCtx);
 
+/* Powers the cameras and writes the register script. Separate from
+ * CaptureInit so that it can overlap the other stages' initialization. */
+NvMediaStatus
+CaptureSensorInit(NvMainContext *mainCtx);
+
 NvMediaStatus
 CaptureFini(NvMainContext *mainCtx);
 
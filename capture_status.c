@@ -10,6 +10,7 @@
 #include "capture_status.h"
 #include "capture.h"
 #include "os_common.h"
+#include "shutdown.h"
 
 static uint32_t
 _CaptureStatusThreadFunc(void *data)
@@ -24,7 +25,7 @@ _CaptureStatusThreadFunc(void *data)
         nvsleep(500);
     }
 
-    ctx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&ctx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -67,10 +68,9 @@ CaptureStatusFini(NvMainContext *mainCtx)
         return NVMEDIA_STATUS_OK;
 
     /* wait for thread to exit */
-    while (!capStatusCtx->exitedFlag) {
-        LOG_DBG("%s: Waiting for capture status thread to quit\n",
-                __func__);
-    }
+    if (capStatusCtx->capStatusThread &&
+        IsFailed(ShutdownWaitExit(&capStatusCtx->exitedFlag, "Capture status thread")))
+        return NVMEDIA_STATUS_TIMED_OUT;
 
     /* Destroy the thread */
     if (capStatusCtx->capStatusThread) {
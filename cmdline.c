@@ -14,6 +14,12 @@
 
 #include "log_utils.h"
 #include "cmdline.h"
+#include "frame_server_shm.h"
+#include "control.h"
+#include "profiler.h"
+#include "raw_compress.h"
+#include "segment_recorder.h"
+#include "trigger_ring.h"
 
 static void
 PrintUsage(void)
@@ -40,12 +46,29 @@ PrintUsage(void)
     LOG_MSG("-w [n]            Set display window ID [0-2]\n");
     LOG_MSG("-z [n]            Set display window depth [0-255]\n");
     LOG_MSG("-p [position]     Window position. Default: full screen size\n");
+    LOG_MSG("--display-fps [n] Convert and display at most n frames per second per channel.\n");
+    LOG_MSG("                  n = 0 paces to the display (frames are dropped while it is busy).\n");
+    LOG_MSG("                  Recording is not affected. Default: every frame is displayed\n");
+    LOG_MSG("--overlay         Show FPS, latency, temperature and drop counters on the display\n");
+    LOG_MSG("--crosshair       Draw a crosshair at the center of each channel\n");
+    LOG_MSG("--spotmeter       Draw the spot-meter box at the center of each channel\n");
+    LOG_MSG("--shm [name]      Publish captured frames to other processes in shared memory\n");
+    LOG_MSG("                  Default name: %s\n", FRAME_SERVER_DEFAULT_NAME);
+    LOG_MSG("--control [path]  Accept commands on a UNIX domain socket (ffc, palette n, agc mode,\n");
+    LOG_MSG("                  boson fn [bytes], record start|stop, trigger, settings n, stats,\n");
+    LOG_MSG("                  quit, help; one per line)\n");
+    LOG_MSG("                  Default path: %s\n", CONTROL_DEFAULT_SOCKET);
+    LOG_MSG("--profile [file]  Time initialization and every script command; print a report\n");
+    LOG_MSG("                  on exit and write a Chrome trace to file\n");
+    LOG_MSG("                  Default file: %s\n", PROFILER_DEFAULT_TRACE);
     LOG_MSG("-s [n]            Set frame number to start capturing images\n");
     LOG_MSG("-b [n]            Set buffer pool size\n");
     LOG_MSG("                  Default: %d Maximum: %d\n",MIN_BUFFER_POOL_SIZE,NVMEDIA_MAX_CAPTURE_FRAME_BUFFERS);
     LOG_MSG("-wrregs [file]    File name of register script to write to sensor\n");
     LOG_MSG("-rdregs [file]    File name of register dump from sensor\n");
     LOG_MSG("--pwr_ctrl-off    Disable powering on the camera sensors\n");
+    LOG_MSG("--no-i2c-burst    Write script registers one at a time instead of merging\n");
+    LOG_MSG("                  consecutive registers into auto-increment bursts\n");
     LOG_MSG("--cam_enable [n]  Enable or disable camera[3210]; enable:1, disable 0\n");
     LOG_MSG("                  Default: n = 0001\n");
     LOG_MSG("--cam_mask [n]    Mask or unmask camera[3210]; mask:1, unmask:0\n");
@@ -60,12 +83,44 @@ PrintUsage(void)
     LOG_MSG("                  Valid only for RAW capture and when -sensor is used\n");
     LOG_MSG("                  NvRaw file format currently supports only RAW12-CombinedCompressed\n");
     LOG_MSG("                  and Raw12-Linear input formats\n");
+    LOG_MSG("--nvraw-images [n] Number of images (int) in each NvRaw file\n");
+    LOG_MSG("                  Default = 1\n");
+    LOG_MSG("--packed          Save captured Raw10/12/14 images bit-packed in .praw files,\n");
+    LOG_MSG("                  or in the segments with --segment-size. Cannot be used with --nvraw\n");
+    LOG_MSG("--compress [n]    Save captured Raw images losslessly compressed in .zraw files,\n");
+    LOG_MSG("                  using n (int) compression threads, at most %u\n", RAW_COMPRESS_MAX_WORKERS);
+    LOG_MSG("                  Default = 2. Cannot be used with --nvraw or --packed\n");
+    LOG_MSG("--segment-size [MB] Record captured Raw images circularly in preallocated\n");
+    LOG_MSG("                  .rseg segments of MB (int) megabytes, overwriting the oldest\n");
+    LOG_MSG("                  Cannot be used with --nvraw or --compress\n");
+    LOG_MSG("--disk-budget [MB] Disk space (int) in megabytes for all segments\n");
+    LOG_MSG("                  Default = %u segments per channel\n", SEGMENT_DEFAULT_SLOTS);
+    LOG_MSG("--pretrigger [s]  Keep the captured Raw images of the last s (int) seconds in memory\n");
+    LOG_MSG("                  and write them with those that follow to an .rseg file on a trigger\n");
+    LOG_MSG("                  (control command trigger, --trigger-ffc or --trigger-temp)\n");
+    LOG_MSG("--posttrigger [s] Seconds (int) written after a trigger\n");
+    LOG_MSG("                  Default = %u\n", TRIGGER_RING_DEFAULT_POST_SECONDS);
+    LOG_MSG("--trigger-memory [MB] Memory (int) in megabytes for the images of all channels\n");
+    LOG_MSG("                  Default = %u\n", TRIGGER_RING_DEFAULT_MEMORY_MB);
+    LOG_MSG("--trigger-ffc     Trigger when the sensor starts a flat field correction, automatic\n");
+    LOG_MSG("                  or run by the ffc command, as reported in its telemetry\n");
+    LOG_MSG("--trigger-temp [C] Trigger when the sensor temperature rises above C (float) degrees\n");
+    LOG_MSG("                  Valid only with sensors reporting it in each frame (boson)\n");
     LOG_MSG("--wait [n]        Wait for n frames before capturing the next frame(s)\n");
     LOG_MSG("--miniburst [n]   Capture n frames between wait periods.\n");
     LOG_MSG("                  Default = 1\n");
     LOG_MSG("                  Valid only when --wait is used\n");
     LOG_MSG("\nValid Script File Commands:\n");
     LOG_MSG("; Delay [n](ms|us)         Delay between register writes in ms/us\n");
+    LOG_MSG("; Write delay [dev] [n](ms|us)  Delay before every write to device dev (default %dus)\n",
+            DEFAULT_WRITE_DELAY);
+    LOG_MSG("; Poll [dev] [reg] [mask] [value] [timeout](ms|us) [interval](ms|us)\n");
+    LOG_MSG("                           Reads reg until (data & mask) == value, for at most timeout\n");
+    LOG_MSG("                           Interval between reads is optional (default %dus)\n",
+            DEFAULT_POLL_INTERVAL);
+    LOG_MSG("; Volatile [dev] [reg] [last reg]\n");
+    LOG_MSG("                           Registers reg to last reg are always read from and\n");
+    LOG_MSG("                           written to the device, never answered by the shadow\n");
     LOG_MSG("; I2C [channel]            Open I2C channel for writing registers\n");
     LOG_MSG("; Wait for frame [i]       Waits for frame i to be captured before writing subsequent registers\n");
     LOG_MSG("; End frame [i] registers  Marks the end of registers to write after frame i has been captured\n");
@@ -73,7 +128,7 @@ PrintUsage(void)
     LOG_MSG("# [comment]                Symbol for using comments in the script file\n");
     LOG_MSG("\nSensor Calibration Commands:\n");
     LOG_MSG("-sensor [name]    Sensor name which used for sensor calibration\n");
-    LOG_MSG("                  Valid names are ov10640, or ar0231\n");
+    LOG_MSG("                  Valid names are ov10640, ar0231, or boson\n");
     LOG_MSG(" To get specific sensor calibration commads, please specify '-sensor [name] -h'\n");
     LOG_MSG(" To get log info about sensor calibration actual setting, please specify '-v 2'\n");
 }
@@ -100,12 +155,22 @@ ParseArgs(int argc,
     allArgs->crystalFrequency = 24;
     allArgs->bufferPoolSize = MIN_BUFFER_POOL_SIZE;
     allArgs->useNvRawFormat = NVMEDIA_FALSE;
+    allArgs->nvrawImagesPerFile = 1;
+    allArgs->usePackedFormat = NVMEDIA_FALSE;
+    allArgs->compressWorkers = 0;
+    allArgs->segmentSizeMB = 0;
+    allArgs->diskBudgetMB = 0;
+    allArgs->preTriggerSeconds = 0;
+    allArgs->postTriggerSeconds = TRIGGER_RING_DEFAULT_POST_SECONDS;
+    allArgs->triggerMemoryMB = TRIGGER_RING_DEFAULT_MEMORY_MB;
+    allArgs->triggerOnFfc = NVMEDIA_FALSE;
     allArgs->useVirtualChannels = NVMEDIA_TRUE;
 
     allArgs->camMap.enable = CAM_ENABLE_DEFAULT;
     allArgs->camMap.mask   = CAM_MASK_DEFAULT;
     allArgs->camMap.csiOut = CSI_OUT_DEFAULT;
     allArgs->disablePwrCtrl = NVMEDIA_FALSE;
+    allArgs->disableI2cBurst = NVMEDIA_FALSE;
 
     if (argc < 2) {
         PrintUsage();
@@ -260,6 +325,44 @@ ParseArgs(int argc,
                     LOG_ERR("-p must be followed by window position x0:x1:W:H\n");
                     return NVMEDIA_STATUS_ERROR;
                 }
+            } else if (!strcasecmp(argv[i], "--display-fps")) {
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->displayFps.uIntValue) != 1)) {
+                        LOG_ERR("Bad display frame rate: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                    allArgs->displayFps.isUsed = NVMEDIA_TRUE;
+                } else {
+                    LOG_ERR("--display-fps must be followed by target display frame rate\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--overlay")) {
+                allArgs->overlayEnabled = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--crosshair")) {
+                allArgs->crosshairEnabled = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--spotmeter")) {
+                allArgs->spotMeterEnabled = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--shm")) {
+                allArgs->shmName.isUsed = NVMEDIA_TRUE;
+                if (bDataAvailable) {
+                    strncpy(allArgs->shmName.stringValue, argv[++i], MAX_STRING_SIZE - 1);
+                } else {
+                    strncpy(allArgs->shmName.stringValue, FRAME_SERVER_DEFAULT_NAME, MAX_STRING_SIZE - 1);
+                }
+            } else if (!strcasecmp(argv[i], "--control")) {
+                allArgs->controlSocket.isUsed = NVMEDIA_TRUE;
+                if (bDataAvailable) {
+                    strncpy(allArgs->controlSocket.stringValue, argv[++i], MAX_STRING_SIZE - 1);
+                } else {
+                    strncpy(allArgs->controlSocket.stringValue, CONTROL_DEFAULT_SOCKET, MAX_STRING_SIZE - 1);
+                }
+            } else if (!strcasecmp(argv[i], "--profile")) {
+                allArgs->profileTrace.isUsed = NVMEDIA_TRUE;
+                if (bDataAvailable) {
+                    strncpy(allArgs->profileTrace.stringValue, argv[++i], MAX_STRING_SIZE - 1);
+                } else {
+                    strncpy(allArgs->profileTrace.stringValue, PROFILER_DEFAULT_TRACE, MAX_STRING_SIZE - 1);
+                }
             } else if (!strcasecmp(argv[i], "-s")) {
                 if (bDataAvailable) {
                     char *arg = argv[++i];
@@ -311,6 +414,96 @@ ParseArgs(int argc,
                 }
             } else if (!strcasecmp(argv[i], "--nvraw")) {
                 allArgs->useNvRawFormat = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--packed")) {
+                allArgs->usePackedFormat = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--compress")) {
+                allArgs->compressWorkers = 2;
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->compressWorkers) != 1) ||
+                        !allArgs->compressWorkers ||
+                        allArgs->compressWorkers > RAW_COMPRESS_MAX_WORKERS) {
+                        LOG_ERR("Bad number of compression threads: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                }
+            } else if (!strcasecmp(argv[i], "--segment-size")) {
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->segmentSizeMB) != 1) ||
+                        !allArgs->segmentSizeMB) {
+                        LOG_ERR("Bad segment size: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                } else {
+                    LOG_ERR("--segment-size must be followed by the segment size in MB\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--disk-budget")) {
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->diskBudgetMB) != 1) ||
+                        !allArgs->diskBudgetMB) {
+                        LOG_ERR("Bad disk budget: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                } else {
+                    LOG_ERR("--disk-budget must be followed by the disk budget in MB\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--pretrigger")) {
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->preTriggerSeconds) != 1) ||
+                        !allArgs->preTriggerSeconds) {
+                        LOG_ERR("Bad pre-trigger time: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                } else {
+                    LOG_ERR("--pretrigger must be followed by the seconds kept before a trigger\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--posttrigger")) {
+                if (bDataAvailable) {
+                    if (sscanf(argv[++i], "%u", &allArgs->postTriggerSeconds) != 1) {
+                        LOG_ERR("Bad post-trigger time: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                } else {
+                    LOG_ERR("--posttrigger must be followed by the seconds written after a trigger\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--trigger-memory")) {
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->triggerMemoryMB) != 1) ||
+                        !allArgs->triggerMemoryMB) {
+                        LOG_ERR("Bad trigger memory: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                } else {
+                    LOG_ERR("--trigger-memory must be followed by the memory in MB\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--trigger-ffc")) {
+                allArgs->triggerOnFfc = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--trigger-temp")) {
+                if (bDataAvailable) {
+                    if (sscanf(argv[++i], "%f", &allArgs->triggerTemperature.floatValue) != 1) {
+                        LOG_ERR("Bad trigger temperature: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                    allArgs->triggerTemperature.isUsed = NVMEDIA_TRUE;
+                } else {
+                    LOG_ERR("--trigger-temp must be followed by the temperature in degrees Celsius\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--nvraw-images")) {
+                if (bDataAvailable) {
+                    if ((sscanf(argv[++i], "%u", &allArgs->nvrawImagesPerFile) != 1) ||
+                        !allArgs->nvrawImagesPerFile) {
+                        LOG_ERR("Bad number of images per NvRaw file: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                } else {
+                    LOG_ERR("--nvraw-images must be followed by number of images per file\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
             } else if (!strcasecmp(argv[i], "--aggregate")) {
                 allArgs->useAggregationFlag = NVMEDIA_TRUE;
                 if (bDataAvailable) {
@@ -352,6 +545,8 @@ ParseArgs(int argc,
                 LOG_INFO("%s: csi_outmap %x\n", __func__, allArgs->camMap.csiOut);
             } else if (!strcasecmp(argv[i], "--pwr_ctrl-off")) {
                 allArgs->disablePwrCtrl = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "--no-i2c-burst")) {
+                allArgs->disableI2cBurst = NVMEDIA_TRUE;
             } else if (!strcasecmp(argv[i], "--settings")) {
                 if (argv[i + 1] && argv[i + 1][0] != '-') {
                     allArgs->rtSettings.isUsed = NVMEDIA_TRUE;
@@ -401,6 +596,46 @@ ParseArgs(int argc,
             LOG_ERR("--nvraw cannot be used without -sensor [name] option\n");
             return NVMEDIA_STATUS_ERROR;
         }
+
+        if (allArgs->useNvRawFormat && allArgs->usePackedFormat) {
+            LOG_ERR("--packed cannot be used with --nvraw\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (allArgs->compressWorkers &&
+            (allArgs->useNvRawFormat || allArgs->usePackedFormat)) {
+            LOG_ERR("--compress cannot be used with --nvraw or --packed\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (allArgs->segmentSizeMB &&
+            (allArgs->useNvRawFormat || allArgs->compressWorkers)) {
+            LOG_ERR("--segment-size cannot be used with --nvraw or --compress\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (allArgs->diskBudgetMB && !allArgs->segmentSizeMB) {
+            LOG_ERR("--disk-budget cannot be used without --segment-size\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if ((allArgs->triggerOnFfc || allArgs->triggerTemperature.isUsed) &&
+            !allArgs->preTriggerSeconds) {
+            LOG_ERR("--trigger-ffc and --trigger-temp cannot be used without --pretrigger\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (allArgs->triggerTemperature.isUsed &&
+            (!allArgs->sensorInfo || !allArgs->sensorInfo->ParseFrameInfo)) {
+            LOG_ERR("--trigger-temp needs a -sensor reporting its temperature in each frame\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (allArgs->triggerOnFfc &&
+            (!allArgs->sensorInfo || !allArgs->sensorInfo->ParseFrameInfo)) {
+            LOG_ERR("--trigger-ffc needs a -sensor reporting its FFC state in each frame\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
     }
 
     if (allArgs->numSensors > NVMEDIA_MAX_AGGREGATE_IMAGES) {
@@ -77,8 +77,25 @@ typedef struct {
     uint32_t                    depth;
     NvMediaBool                 positionSpecifiedFlag;
     NvMediaRect                 position;
+    CmdlineParameter            displayFps;
+    NvMediaBool                 overlayEnabled;
+    NvMediaBool                 crosshairEnabled;
+    NvMediaBool                 spotMeterEnabled;
+    CmdlineParameter            shmName;
+    CmdlineParameter            controlSocket;
+    CmdlineParameter            profileTrace;
     NvMediaBool                 useFilePrefix;
     NvMediaBool                 useNvRawFormat;
+    uint32_t                    nvrawImagesPerFile;
+    NvMediaBool                 usePackedFormat;
+    uint32_t                    compressWorkers;    // 0: not compressing
+    uint32_t                    segmentSizeMB;      // 0: a file per frame
+    uint32_t                    diskBudgetMB;       // 0: default number of segments
+    uint32_t                    preTriggerSeconds;  // 0: no pre-trigger ring
+    uint32_t                    postTriggerSeconds;
+    uint32_t                    triggerMemoryMB;
+    NvMediaBool                 triggerOnFfc;
+    CmdlineParameter            triggerTemperature;
     char                        filePrefix[MAX_STRING_SIZE];
     uint32_t                    crystalFrequency;
     uint32_t                    numFramesToSkip;
@@ -92,6 +109,7 @@ typedef struct {
     NvMediaBool                 useVirtualChannels;
     MapInfo                     camMap;
     NvMediaBool                 disablePwrCtrl;
+    NvMediaBool                 disableI2cBurst;
     CmdlineParameter            config[NVMEDIA_ICP_MAX_VIRTUAL_CHANNELS];
 } TestArgs;
 
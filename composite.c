@@ -13,6 +13,8 @@
 #include "composite.h"
 #include "save.h"
 #include "display.h"
+#include "shutdown.h"
+#include "image_time.h"
 
 static NvMediaStatus
 _CreateImageQueue(NvMediaDevice *device,
@@ -49,7 +51,11 @@ _CreateImageQueue(NvMediaDevice *device,
             goto failed;
         }
 
-        image->tag = *queue;
+        status = ImageContextCreate(image, *queue);
+        if (IsFailed(status)) {
+            NvMediaImageDestroy(image);
+            goto failed;
+        }
 
         if (IsFailed(NvQueuePut(*queue,
                                 (void *)&image,
@@ -74,6 +80,7 @@ _CompositeThreadFunc(void *data)
     uint32_t i = 0;
     NvMediaStatus status;
     NvMediaRect dstRect;
+    uint64_t captureTime, now;
 
     while (!(*compCtx->quit)) {
         /* Acquire all the images from capture queues */
@@ -87,6 +94,14 @@ _CompositeThreadFunc(void *data)
                     goto loop_done;
                 }
             }
+            /* NULL is the shutdown wakeup */
+            if (!imageIn[i])
+                goto loop_done;
+            if (compCtx->latencyEnabled &&
+                ImageTimeGet(imageIn[i], &captureTime) == NVMEDIA_STATUS_OK) {
+                GetTimeMicroSec(&now);
+                OverlayAddLatency(compCtx->overlayCtx, now - captureTime);
+            }
         }
 
         /* Acquire image for storing composited images */
@@ -114,7 +129,21 @@ _CompositeThreadFunc(void *data)
                                      NULL);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: NvMedia2DBlitEx failed\n", __func__);
-                *compCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
+                goto loop_done;
+            }
+        }
+
+        if (compCtx->overlayCtx) {
+            status = OverlayApply(compCtx->overlayCtx,
+                                  compCtx->i2d,
+                                  &compCtx->blitParams,
+                                  compImage,
+                                  imageIn[0]->width,
+                                  imageIn[0]->height);
+            if (status != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: OverlayApply failed\n", __func__);
+                ShutdownRequest(__func__);
                 goto loop_done;
             }
         }
@@ -132,7 +161,7 @@ _CompositeThreadFunc(void *data)
     loop_done:
         for (i = 0; i < compCtx->numVirtualChannels; i++) {
             if (imageIn[i]) {
-                if (NvQueuePut((NvQueue *)imageIn[i]->tag,
+                if (NvQueuePut(IMAGE_QUEUE(imageIn[i]),
                                (void *)&imageIn[i],
                                0) != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to put the image back to queue\n", __func__);
@@ -141,7 +170,7 @@ _CompositeThreadFunc(void *data)
             imageIn[i] = NULL;
         }
         if (compImage) {
-            if (NvQueuePut((NvQueue *) compImage->tag,
+            if (NvQueuePut(IMAGE_QUEUE(compImage),
                            (void *) &compImage,
                            0) != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put the image back to compositeQueue\n", __func__);
@@ -150,7 +179,7 @@ _CompositeThreadFunc(void *data)
         }
     }
     LOG_INFO("%s: Composite thread exited\n", __func__);
-    compCtx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&compCtx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -210,6 +239,10 @@ CompositeInit(NvMainContext *mainCtx)
             status = NVMEDIA_STATUS_ERROR;
             goto failed;
         }
+        if (ShutdownRegisterQueue(compCtx->inputQueue[i]) != NVMEDIA_STATUS_OK) {
+            status = NVMEDIA_STATUS_ERROR;
+            goto failed;
+        }
     }
 
     /* Get the output width and height for composition */
@@ -254,6 +287,17 @@ CompositeInit(NvMainContext *mainCtx)
     LOG_DBG("%s: Composite Queue: %ux%u, images: %u \n",
         __func__, width, height, COMPOSITE_QUEUE_SIZE);
 
+    if (testArgs->overlayEnabled || testArgs->crosshairEnabled ||
+        testArgs->spotMeterEnabled) {
+        status = OverlayCreate(mainCtx, compCtx->device, &compCtx->overlayCtx);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create overlay\n", __func__);
+            goto failed;
+        }
+
+        compCtx->latencyEnabled = testArgs->overlayEnabled;
+    }
+
     return NVMEDIA_STATUS_OK;
 failed:
     LOG_ERR("%s: Failed to initialize Composite\n", __func__);
@@ -276,11 +320,9 @@ CompositeFini(NvMainContext *mainCtx)
         return NVMEDIA_STATUS_OK;
 
     /* Wait for composite thread to exit */
-    while (!compCtx->exitedFlag) {
-        LOG_DBG("%s: Waiting for composite thread to quit\n", __func__);
-    }
-
-    *compCtx->quit = NVMEDIA_TRUE;
+    if (compCtx->compositeThread &&
+        IsFailed(ShutdownWaitExit(&compCtx->exitedFlag, "Composite thread")))
+        return NVMEDIA_STATUS_TIMED_OUT;
 
     /* Destroy thread */
     if (compCtx->compositeThread) {
@@ -296,6 +338,7 @@ CompositeFini(NvMainContext *mainCtx)
                            &image,
                            0)) == NVMEDIA_STATUS_OK) {
             if (image) {
+                ImageContextDestroy(image);
                 NvMediaImageDestroy(image);
                 image = NULL;
             }
@@ -310,9 +353,9 @@ CompositeFini(NvMainContext *mainCtx)
             LOG_DBG("%s: Flushing the composite input queue %d", __func__, i);
             while (IsSucceed(NvQueueGet(compCtx->inputQueue[i],
                                         &image,
-                                        COMPOSITE_DEQUEUE_TIMEOUT))) {
+                                        0))) {
                 if (image) {
-                    if (NvQueuePut((NvQueue *)image->tag,
+                    if (NvQueuePut(IMAGE_QUEUE(image),
                                    (void *)&image,
                                    0) != NVMEDIA_STATUS_OK) {
                         LOG_ERR("%s: Failed to put image back in queue\n", __func__);
@@ -321,10 +364,13 @@ CompositeFini(NvMainContext *mainCtx)
                 }
                 image=NULL;
             }
+            ShutdownUnregisterQueue(compCtx->inputQueue[i]);
             NvQueueDestroy(compCtx->inputQueue[i]);
         }
     }
 
+    OverlayDestroy(compCtx->overlayCtx);
+
     if (compCtx->i2d)
         NvMedia2DDestroy(compCtx->i2d);
 
@@ -19,6 +19,7 @@ extern "C" {
 #include "thread_utils.h"
 #include "nvmedia_2d.h"
 #include "nvmedia_icp.h"
+#include "overlay.h"
 
 #define COMPOSITE_QUEUE_SIZE                 3     /* min no. of buffers to be in circulation at any point */
 #define COMPOSITE_DEQUEUE_TIMEOUT            1000
@@ -35,6 +36,8 @@ typedef struct {
     NvMedia2DBlitParameters     blitParams;
     volatile NvMediaBool       *quit;
     NvMediaBool                 exitedFlag;
+    NvOverlayContext           *overlayCtx;
+    NvMediaBool                 latencyEnabled; /* capture-to-composite, per input image */
 
     /* General processing params */
     uint32_t                    numVirtualChannels;
@@ -0,0 +1,568 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/* Control protocol: one request per line, one response line per request.
+ *
+ *   ffc                    Run flat field correction
+ *   palette <n>            Select color LUT n
+ *   agc <mode>             Set the camera AGC to normal, hold, threshold,
+ *                          auto-bright, auto-linear or manual
+ *   boson <function> [bytes...]
+ *                          Send any Boson command, e.g. "boson 0x00050002"
+ *                          for the serial number; returns status and payload
+ *   record start|stop      Start or stop saving frames (needs -f)
+ *   trigger                Write the frames before and after now to an event
+ *                          file (needs --pretrigger)
+ *   settings <n>           Apply runtime settings set n now (needs -rtsettings)
+ *   stats                  Frame counters and state of every channel, and
+ *                          completed/timed out/failed camera commands
+ *   quit                   Stop the application
+ *   help                   List the commands
+ *
+ * Responses start with "OK" or "ERR" followed by details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+#include "capture.h"
+#include "mailbox.h"
+#include "runtime_settings.h"
+#include "save.h"
+#include "shutdown.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const char *agcModeNames[] = {
+    "normal",
+    "hold",
+    "threshold",
+    "auto-bright",
+    "auto-linear",
+    "manual",
+};
+
+/* Returns the Boson command engine, or NULL after answering that there is none */
+static NvBosonCmdEngine *
+_BosonEngine(NvMainContext *mainCtx, char *response, uint32_t size)
+{
+    NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+
+    if (!captureCtx || !captureCtx->bosonCmd) {
+        snprintf(response, size, "ERR camera commands need -sensor boson");
+        return NULL;
+    }
+    return captureCtx->bosonCmd;
+}
+
+/* Reports the result of a camera command run on the Boson command thread */
+static void
+_BosonReport(NvMediaStatus status, const BosonCmdResponse *reply,
+             char *response, uint32_t size)
+{
+    uint32_t i, len;
+
+    if (status == NVMEDIA_STATUS_TIMED_OUT) {
+        snprintf(response, size, "ERR camera did not respond");
+        return;
+    } else if (status != NVMEDIA_STATUS_OK) {
+        snprintf(response, size, "ERR camera command failed");
+        return;
+    } else if (reply->cameraStatus != BOSON_STATUS_OK) {
+        snprintf(response, size, "ERR camera status 0x%08x", reply->cameraStatus);
+        return;
+    }
+
+    len = snprintf(response, size, "OK");
+    for (i = 0; i < reply->payloadSize && len < size; i++)
+        len += snprintf(response + len, size - len, " %02x", reply->payload[i]);
+}
+
+/* Runs a camera command on the Boson command thread and reports its result */
+static void
+_BosonExecute(NvMainContext *mainCtx, uint32_t functionId, const uint8_t *payload,
+              uint32_t payloadSize, char *response, uint32_t size)
+{
+    NvBosonCmdEngine *engine = _BosonEngine(mainCtx, response, size);
+    BosonCmdResponse reply;
+
+    if (!engine)
+        return;
+
+    _BosonReport(BosonCmdExecute(engine, functionId, payload, payloadSize, &reply),
+                 &reply, response, size);
+}
+
+/* Returns NVMEDIA_FALSE if there is no pre-trigger ring */
+static NvMediaBool
+_PostTrigger(NvMainContext *mainCtx, TriggerSource source)
+{
+    NvSaveContext *saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
+    uint32_t i;
+
+    if (!saveCtx || !mainCtx->testArgs->preTriggerSeconds)
+        return NVMEDIA_FALSE;
+
+    for (i = 0; i < saveCtx->numVirtualChannels; i++)
+        MailboxPost(&saveCtx->threadCtx[i].mailbox, MAILBOX_MSG_TRIGGER, source);
+    return NVMEDIA_TRUE;
+}
+
+/* --trigger-ffc sees this FFC in the telemetry like the automatic ones */
+static void
+_CmdFfc(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    _BosonExecute(mainCtx, BOSON_FN_RUN_FFC, NULL, 0, response, size);
+}
+
+static void
+_CmdPalette(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    uint8_t payload[4];
+    uint32_t index;
+
+    if (!args || sscanf(args, "%u", &index) != 1) {
+        snprintf(response, size, "ERR usage: palette <n>");
+        return;
+    }
+
+    payload[0] = index >> 24;
+    payload[1] = index >> 16;
+    payload[2] = index >> 8;
+    payload[3] = index;
+    _BosonExecute(mainCtx, BOSON_FN_COLORLUT_SET_ID, payload, sizeof(payload), response, size);
+}
+
+static void
+_CmdAgc(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    NvBosonCmdEngine *engine;
+    BosonCmdResponse reply;
+    uint32_t mode;
+
+    for (mode = 0; args && mode < BOSON_AGC_MODE_END; mode++) {
+        if (!strcasecmp(args, agcModeNames[mode]))
+            break;
+    }
+    if (!args || mode == BOSON_AGC_MODE_END) {
+        snprintf(response, size, "ERR usage: agc normal|hold|threshold|auto-bright|"
+                 "auto-linear|manual");
+        return;
+    }
+
+    engine = _BosonEngine(mainCtx, response, size);
+    if (!engine)
+        return;
+
+    _BosonReport(BosonCmdSetAgcMode(engine, mode, &reply), &reply, response, size);
+}
+
+static void
+_CmdBoson(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    uint8_t payload[BOSON_CMD_MAX_PAYLOAD];
+    uint32_t functionId, value, payloadSize = 0;
+    char *token, *save = NULL;
+
+    token = args ? strtok_r(args, " \t", &save) : NULL;
+    if (!token || sscanf(token, "%x", &functionId) != 1) {
+        snprintf(response, size, "ERR usage: boson <function> [bytes...]");
+        return;
+    }
+
+    while ((token = strtok_r(NULL, " \t", &save))) {
+        if (payloadSize == BOSON_CMD_MAX_PAYLOAD || sscanf(token, "%x", &value) != 1 ||
+            value > 0xFF) {
+            snprintf(response, size, "ERR bad payload byte %s", token);
+            return;
+        }
+        payload[payloadSize++] = value;
+    }
+
+    _BosonExecute(mainCtx, functionId, payload, payloadSize, response, size);
+}
+
+static void
+_CmdRecord(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    NvSaveContext *saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
+    uint32_t i, start;
+
+    if (args && !strcasecmp(args, "start")) {
+        start = 1;
+    } else if (args && !strcasecmp(args, "stop")) {
+        start = 0;
+    } else {
+        snprintf(response, size, "ERR usage: record start|stop");
+        return;
+    }
+
+    if (!saveCtx || !mainCtx->testArgs->useFilePrefix) {
+        snprintf(response, size, "ERR recording needs a file prefix (-f)");
+        return;
+    }
+
+    for (i = 0; i < saveCtx->numVirtualChannels; i++)
+        MailboxPost(&saveCtx->threadCtx[i].mailbox, MAILBOX_MSG_RECORD, start);
+    snprintf(response, size, "OK");
+}
+
+static void
+_CmdTrigger(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    if (!_PostTrigger(mainCtx, TRIGGER_SOURCE_COMMAND)) {
+        snprintf(response, size, "ERR no pre-trigger ring (--pretrigger)");
+        return;
+    }
+    snprintf(response, size, "OK");
+}
+
+static void
+_CmdSettings(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    NvRuntimeSettingsContext *runtimeCtx = mainCtx->ctxs[RUNTIME_SETTINGS_ELEMENT];
+    uint32_t index;
+
+    if (!runtimeCtx || !runtimeCtx->runtimeSettingsThread) {
+        snprintf(response, size, "ERR no runtime settings loaded");
+        return;
+    }
+
+    if (!args || sscanf(args, "%u", &index) != 1 || index >= runtimeCtx->numRtSettings) {
+        snprintf(response, size, "ERR usage: settings <0-%u>",
+                 runtimeCtx->numRtSettings - 1);
+        return;
+    }
+
+    MailboxPost(&runtimeCtx->mailbox, MAILBOX_MSG_SELECT_SETTINGS, index);
+    snprintf(response, size, "OK");
+}
+
+static void
+_CmdStats(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    NvSaveContext *saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
+    NvRuntimeSettingsContext *runtimeCtx = mainCtx->ctxs[RUNTIME_SETTINGS_ELEMENT];
+    uint32_t i, len;
+
+    len = snprintf(response, size, "OK");
+    for (i = 0; i < mainCtx->testArgs->numVirtualChannels && len < size; i++) {
+        len += snprintf(response + len, size - len, " vc%u:frames=%u,dropped=%u", i,
+                        captureCtx ? captureCtx->threadCtx[i].currentFrame : 0,
+                        captureCtx ? captureCtx->threadCtx[i].numDropped : 0);
+        if (saveCtx && len < size)
+            len += snprintf(response + len, size - len, ",recording=%d,skipped=%u",
+                            saveCtx->threadCtx[i].saveEnabled ? 1 : 0,
+                            saveCtx->threadCtx[i].numDisplaySkipped);
+        if (saveCtx && saveCtx->threadCtx[i].triggerRing.valid && len < size)
+            len += snprintf(response + len, size - len, ",events=%u,eventdropped=%u",
+                            saveCtx->threadCtx[i].triggerRing.numEvents,
+                            saveCtx->threadCtx[i].triggerRing.numDropped);
+    }
+    if (runtimeCtx && runtimeCtx->numRtSettings && len < size)
+        len += snprintf(response + len, size - len, " settings=%u",
+                        runtimeCtx->currentRtSettings);
+    if (captureCtx && captureCtx->bosonCmd && len < size)
+        snprintf(response + len, size - len, " camera=%u/%u/%u",
+                 captureCtx->bosonCmd->numCompleted, captureCtx->bosonCmd->numTimedOut,
+                 captureCtx->bosonCmd->numFailed);
+}
+
+static void
+_CmdQuit(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    ShutdownRequest("control command");
+    snprintf(response, size, "OK");
+}
+
+static void
+_CmdHelp(NvMainContext *mainCtx, char *args, char *response, uint32_t size);
+
+static const struct {
+    const char *name;
+    const char *alias;
+    void (*handler)(NvMainContext *mainCtx, char *args, char *response, uint32_t size);
+} controlCommands[] = {
+    { "ffc",        "f",    _CmdFfc },
+    { "record",     NULL,   _CmdRecord },
+    { "trigger",    "t",    _CmdTrigger },
+    { "settings",   NULL,   _CmdSettings },
+    { "stats",      NULL,   _CmdStats },
+    { "palette",    NULL,   _CmdPalette },
+    { "agc",        NULL,   _CmdAgc },
+    { "boson",      NULL,   _CmdBoson },
+    { "quit",       "q",    _CmdQuit },
+    { "help",       NULL,   _CmdHelp },
+};
+
+#define NUM_CONTROL_COMMANDS (sizeof(controlCommands) / sizeof(controlCommands[0]))
+
+static void
+_CmdHelp(NvMainContext *mainCtx, char *args, char *response, uint32_t size)
+{
+    uint32_t i, len;
+
+    len = snprintf(response, size, "OK");
+    for (i = 0; i < NUM_CONTROL_COMMANDS && len < size; i++)
+        len += snprintf(response + len, size - len, " %s", controlCommands[i].name);
+}
+
+void
+ControlExecute(NvMainContext *mainCtx,
+               const char *request,
+               char *response,
+               uint32_t responseSize)
+{
+    char line[CONTROL_MAX_REQUEST];
+    char *name, *args, *save = NULL;
+    uint32_t i;
+
+    strncpy(line, request, sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+
+    name = strtok_r(line, " \t\r\n", &save);
+    if (!name) {
+        snprintf(response, responseSize, "ERR empty request");
+        return;
+    }
+    args = strtok_r(NULL, "\r\n", &save);
+    while (args && (*args == ' ' || *args == '\t'))
+        args++;
+
+    for (i = 0; i < NUM_CONTROL_COMMANDS; i++) {
+        if (!strcasecmp(name, controlCommands[i].name) ||
+            (controlCommands[i].alias && !strcasecmp(name, controlCommands[i].alias))) {
+            controlCommands[i].handler(mainCtx, args, response, responseSize);
+            LOG_DBG("%s: %s -> %s\n", __func__, request, response);
+            return;
+        }
+    }
+
+    snprintf(response, responseSize, "ERR unknown command %s", name);
+}
+
+static void
+_CloseClient(ControlClient *client)
+{
+    close(client->fd);
+    client->fd = -1;
+    client->length = 0;
+}
+
+static ControlClient *
+_FindClient(NvControlContext *ctx,
+            int fd)
+{
+    uint32_t i;
+
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (ctx->clients[i].fd == fd)
+            return &ctx->clients[i];
+    }
+    return NULL;
+}
+
+static NvMediaStatus _ServeClient(int fd, void *data);
+
+/* Event loop handler of the listening socket */
+static NvMediaStatus
+_AcceptClient(int listenFd,
+              void *data)
+{
+    static const char busy[] = "ERR too many clients\n";
+    NvControlContext *ctx = (NvControlContext *)data;
+    ControlClient *client;
+    int fd;
+
+    fd = accept(listenFd, NULL, NULL);
+    if (fd < 0)
+        return NVMEDIA_STATUS_OK;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    client = _FindClient(ctx, -1);
+    if (client &&
+        EventLoopAddSource(ctx->eventLoop, fd, &_ServeClient, ctx) == NVMEDIA_STATUS_OK) {
+        client->fd = fd;
+        client->length = 0;
+        return NVMEDIA_STATUS_OK;
+    }
+
+    send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL);
+    close(fd);
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Event loop handler of a client: reads from it and answers every complete
+ * line received so far. Fails once the client is closed, which removes it
+ * from the loop. */
+static NvMediaStatus
+_ServeClient(int fd,
+             void *data)
+{
+    NvControlContext *ctx = (NvControlContext *)data;
+    ControlClient *client = _FindClient(ctx, fd);
+    char response[CONTROL_MAX_RESPONSE];
+    char *line, *end;
+    uint32_t len;
+    ssize_t bytes;
+
+    if (!client)
+        return NVMEDIA_STATUS_ERROR;
+
+    bytes = recv(client->fd, client->buffer + client->length,
+                 sizeof(client->buffer) - 1 - client->length, 0);
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return NVMEDIA_STATUS_OK;
+    if (bytes <= 0)
+        goto failed;
+    client->length += bytes;
+    client->buffer[client->length] = '\0';
+
+    line = client->buffer;
+    while ((end = strchr(line, '\n'))) {
+        *end = '\0';
+        ControlExecute(ctx->mainCtx, line, response, sizeof(response) - 1);
+        len = strlen(response);
+        response[len++] = '\n';
+        if (send(client->fd, response, len, MSG_NOSIGNAL) != (ssize_t)len)
+            goto failed;
+        line = end + 1;
+    }
+
+    /* Keep the partial line; a line that fills the buffer is not a request */
+    client->length -= line - client->buffer;
+    memmove(client->buffer, line, client->length);
+    if (client->length == sizeof(client->buffer) - 1) {
+        LOG_WARN("%s: Dropping client sending an oversized request\n", __func__);
+        goto failed;
+    }
+
+    return NVMEDIA_STATUS_OK;
+failed:
+    _CloseClient(client);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+NvMediaStatus
+ControlInit(NvMainContext *mainCtx)
+{
+    NvControlContext *ctx = NULL;
+    TestArgs *testArgs = mainCtx->testArgs;
+    struct sockaddr_un addr;
+    uint32_t i;
+
+    if (!testArgs->controlSocket.isUsed)
+        return NVMEDIA_STATUS_OK;
+
+    mainCtx->ctxs[CONTROL_ELEMENT] = calloc(1, sizeof(NvControlContext));
+    if (!mainCtx->ctxs[CONTROL_ELEMENT]) {
+        LOG_ERR("%s: Failed to allocate memory for control context\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    ctx = mainCtx->ctxs[CONTROL_ELEMENT];
+    ctx->mainCtx = mainCtx;
+    ctx->listenFd = -1;
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+        ctx->clients[i].fd = -1;
+    strncpy(ctx->socketPath, testArgs->controlSocket.stringValue, MAX_STRING_SIZE - 1);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(ctx->socketPath) >= sizeof(addr.sun_path)) {
+        LOG_ERR("%s: Control socket path %s is too long\n", __func__, ctx->socketPath);
+        goto failed;
+    }
+    strcpy(addr.sun_path, ctx->socketPath);
+
+    ctx->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ctx->listenFd < 0) {
+        LOG_ERR("%s: Failed to create control socket\n", __func__);
+        goto failed;
+    }
+    fcntl(ctx->listenFd, F_SETFD, FD_CLOEXEC);
+    fcntl(ctx->listenFd, F_SETFL, O_NONBLOCK);
+
+    /* A socket file left behind by a previous run would make bind fail */
+    unlink(ctx->socketPath);
+    if (bind(ctx->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(ctx->listenFd, CONTROL_MAX_CLIENTS) < 0) {
+        LOG_ERR("%s: Failed to listen on %s (%s)\n", __func__, ctx->socketPath,
+                strerror(errno));
+        goto failed;
+    }
+
+    LOG_INFO("%s: Listening for commands on %s\n", __func__, ctx->socketPath);
+    return NVMEDIA_STATUS_OK;
+failed:
+    ControlFini(mainCtx);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+NvMediaStatus
+ControlFini(NvMainContext *mainCtx)
+{
+    NvControlContext *ctx = NULL;
+    uint32_t i;
+
+    if (!mainCtx)
+        return NVMEDIA_STATUS_OK;
+
+    ctx = mainCtx->ctxs[CONTROL_ELEMENT];
+    if (!ctx)
+        return NVMEDIA_STATUS_OK;
+
+    /* Called once the event loop stopped dispatching; closing the
+     * descriptors also takes them out of its epoll set */
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (ctx->clients[i].fd >= 0)
+            _CloseClient(&ctx->clients[i]);
+    }
+
+    if (ctx->listenFd >= 0) {
+        close(ctx->listenFd);
+        unlink(ctx->socketPath);
+    }
+
+    free(ctx);
+    mainCtx->ctxs[CONTROL_ELEMENT] = NULL;
+
+    LOG_INFO("%s: ControlFini done\n", __func__);
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+ControlProc(NvMainContext *mainCtx,
+            NvEventLoop *eventLoop)
+{
+    NvControlContext *ctx = mainCtx->ctxs[CONTROL_ELEMENT];
+    NvMediaStatus status;
+
+    if (!ctx)
+        return NVMEDIA_STATUS_OK;
+
+    /* Requests are served on the main thread, between the other events */
+    ctx->eventLoop = eventLoop;
+    status = EventLoopAddSource(eventLoop, ctx->listenFd, &_AcceptClient, ctx);
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: Failed to watch the control socket\n", __func__);
+    return status;
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "cmdline.h"
+#include "event_loop.h"
+
+#define CONTROL_DEFAULT_SOCKET          "/tmp/nvmimg_cc.sock"
+#define CONTROL_MAX_CLIENTS             4
+#define CONTROL_MAX_REQUEST             256
+#define CONTROL_MAX_RESPONSE            1024
+
+typedef struct {
+    int                         fd;
+    uint32_t                    length;
+    char                        buffer[CONTROL_MAX_REQUEST];
+} ControlClient;
+
+typedef struct {
+    /* control context */
+    NvMainContext              *mainCtx;
+    NvEventLoop                *eventLoop;
+
+    /* control params */
+    int                         listenFd;
+    char                        socketPath[MAX_STRING_SIZE];
+    ControlClient               clients[CONTROL_MAX_CLIENTS];
+} NvControlContext;
+
+NvMediaStatus
+ControlInit(NvMainContext *mainCtx);
+
+NvMediaStatus
+ControlFini(NvMainContext *mainCtx);
+
+/* Serves the control socket and its clients from eventLoop */
+NvMediaStatus
+ControlProc(NvMainContext *mainCtx,
+            NvEventLoop *eventLoop);
+
+/* Executes one request line and writes a one line response starting with
+ * "OK" or "ERR". Shared by the socket and the terminal. */
+void
+ControlExecute(NvMainContext *mainCtx,
+               const char *request,
+               char *response,
+               uint32_t responseSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CONTROL_H__
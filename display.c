@@ -15,38 +15,9 @@
 #include <limits.h>
 #include <math.h>
 
-#include "testutil_i2c.h"
 #include "display.h"
-
-static void
-_SendFFC() {
-    I2cHandle handle = NULL;
-    // hard code i2c device and sensor address for now
-    int i2cDevice = 0;
-    int i = 0;
-    int sensorAddress = 0xD8 / 2;
-
-    testutil_i2c_open(i2cDevice, &handle);
-
-    uint16_t cmd[19] = {0x0902, 0x8E, 0x00, 0x12, 0xC0, 0xFF, 0xEE, 0x00, 0x05, 
-        0x00, 0x07, 0xFF, 0xFF, 0xFF, 0xFF, 0x6C, 0x5E, 0xAE, 0x0900};
-
-    for (i = 0; i < 19; i++) {
-        uint8_t instruction[2] = {cmd[i] >> 8, cmd[i] & 0xFF};
-
-        if(testutil_i2c_write_subaddr(handle, sensorAddress, 
-            &instruction, 2)) 
-        {
-            LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
-                __func__, sensorAddress,
-                instruction[0],
-                instruction[1]);
-            break;
-        }
-    }
-
-    testutil_i2c_close(handle);
-}
+#include "image_time.h"
+#include "shutdown.h"
 
 static uint32_t
 _DisplayThreadFunc(void* data)
@@ -66,15 +37,9 @@ _DisplayThreadFunc(void* data)
             if (*displayCtx->quit)
                 goto loop_done;
         }
-
-        // check for ffc command
-        if(displayCtx->cmd[0] != '\0') {
-            if(!strcasecmp(displayCtx->cmd, "f")) {
-                _SendFFC();
-            }
-
-            sprintf(displayCtx->cmd, "");
-        }
+        /* NULL is the shutdown wakeup */
+        if (!image)
+            goto loop_done;
 
         /* Display to screen */
         if (displayCtx->displayEnabled) {
@@ -92,11 +57,11 @@ _DisplayThreadFunc(void* data)
 
             while (*releaseList) {
                 image = *releaseList;
-                if (NvQueuePut((NvQueue *)image->tag,
+                if (NvQueuePut(IMAGE_QUEUE(image),
                                (void *)&image,
                                0) != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to put image back in queue\n", __func__);
-                    *displayCtx->quit = NVMEDIA_TRUE;
+                    ShutdownRequest(__func__);
                     goto loop_done;
                 }
                 releaseList++;
@@ -106,18 +71,18 @@ _DisplayThreadFunc(void* data)
 
     loop_done:
         if (image) {
-            if (NvQueuePut((NvQueue *)image->tag,
+            if (NvQueuePut(IMAGE_QUEUE(image),
                            (void *)&image,
                            0) != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back in queue\n", __func__);
-                *displayCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
             }
             image = NULL;
         }
     }
 
     LOG_INFO("%s: Display thread exited\n", __func__);
-    displayCtx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&displayCtx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -151,7 +116,6 @@ DisplayInit(NvMainContext *mainCtx)
     displayCtx->displayEnabled = testArgs->displayEnabled;
     displayCtx->positionSpecifiedFlag = testArgs->positionSpecifiedFlag;
     displayCtx->exitedFlag = NVMEDIA_TRUE;
-    displayCtx->cmd = mainCtx->cmd;
 
     isDisplayIdProvided = testArgs->displayIdUsed;
     displayId = testArgs->displayId;
@@ -168,6 +132,10 @@ DisplayInit(NvMainContext *mainCtx)
         status = NVMEDIA_STATUS_ERROR;
         goto failed;
     }
+    if (IsFailed(ShutdownRegisterQueue(displayCtx->inputQueue))) {
+        status = NVMEDIA_STATUS_ERROR;
+        goto failed;
+    }
 
     if (displayCtx->displayEnabled) {
         status = NvMediaIDPQuery(&outputDevicesNum, outputs);
@@ -246,11 +214,9 @@ DisplayFini(NvMainContext *mainCtx)
         return NVMEDIA_STATUS_OK;
 
     /* Wait for display thread to exit */
-    while (!displayCtx->exitedFlag) {
-        LOG_DBG("%s: Waiting for display thread to quit\n", __func__);
-    }
-
-    *displayCtx->quit = NVMEDIA_TRUE;
+    if (displayCtx->displayThread &&
+        IsFailed(ShutdownWaitExit(&displayCtx->exitedFlag, "Display thread")))
+        return NVMEDIA_STATUS_TIMED_OUT;
 
     /* Destroy thread */
     if (displayCtx->displayThread) {
@@ -275,7 +241,7 @@ DisplayFini(NvMainContext *mainCtx)
 
             while (*releaseList) {
                 image = *releaseList;
-                if (NvQueuePut((NvQueue *)image->tag,
+                if (NvQueuePut(IMAGE_QUEUE(image),
                                (void *)&image,
                                0) != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to put image back in queue\n", __func__);
@@ -295,7 +261,7 @@ DisplayFini(NvMainContext *mainCtx)
         LOG_DBG("%s: Flushing the Display input queue\n", __func__);
         while (IsSucceed(NvQueueGet(displayCtx->inputQueue, &image, 0))) {
             if (image) {
-                if (NvQueuePut((NvQueue *)image->tag,
+                if (NvQueuePut(IMAGE_QUEUE(image),
                                (void *)&image,
                                0) != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to put image back in queue\n", __func__);
@@ -304,6 +270,7 @@ DisplayFini(NvMainContext *mainCtx)
                 image = NULL;
             }
         }
+        ShutdownUnregisterQueue(displayCtx->inputQueue);
         NvQueueDestroy(displayCtx->inputQueue);
     }
 
@@ -32,7 +32,6 @@ typedef struct {
     NvMediaDevice              *device;
     volatile NvMediaBool       *quit;
     NvThread                   *displayThread;
-    char                       *cmd;
 
     /* Display related params */
     NvMediaBool                 exitedFlag;
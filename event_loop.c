@@ -0,0 +1,384 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#ifndef NVMEDIA_QNX
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "event_loop.h"
+#include "log_utils.h"
+#include "shutdown.h"
+
+/* Write side of the wakeup channel of the running loop, for EventLoopWakeup */
+static volatile int wakeupFd = -1;
+
+#ifdef NVMEDIA_QNX
+/* QNX has no epoll, signalfd, timerfd or eventfd: the loop falls back to
+ * poll() on a self-pipe, and main() keeps handling signals with sigaction */
+static int wakeupReadFd = -1;
+static uint64_t timerDeadlineUs[EVENT_LOOP_MAX_SOURCES + EVENT_LOOP_MAX_TIMERS];
+static uint32_t timerPeriodMs[EVENT_LOOP_MAX_SOURCES + EVENT_LOOP_MAX_TIMERS];
+#endif
+
+static void
+_DrainFd(int fd)
+{
+    uint8_t buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+NvMediaStatus
+EventLoopCreate(NvMainContext *mainCtx,
+                NvEventLoop **eventLoop)
+{
+    NvEventLoop *loop = NULL;
+#ifndef NVMEDIA_QNX
+    struct epoll_event event;
+    sigset_t set;
+#else
+    int pipeFds[2];
+#endif
+
+    loop = calloc(1, sizeof(NvEventLoop));
+    if (!loop) {
+        LOG_ERR("%s: Failed to allocate memory for event loop\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    loop->mainCtx = mainCtx;
+    loop->pollFd = -1;
+    loop->signalFd = -1;
+    loop->wakeFd = -1;
+
+#ifndef NVMEDIA_QNX
+    loop->pollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->pollFd < 0) {
+        LOG_ERR("%s: epoll_create1 failed\n", __func__);
+        goto failed;
+    }
+
+    /* The termination signals are blocked in every thread; they are
+     * consumed here instead of interrupting whichever thread gets them */
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGHUP);
+    loop->signalFd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (loop->signalFd < 0) {
+        LOG_ERR("%s: signalfd failed\n", __func__);
+        goto failed;
+    }
+
+    loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wakeFd < 0) {
+        LOG_ERR("%s: eventfd failed\n", __func__);
+        goto failed;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = loop->signalFd;
+    if (epoll_ctl(loop->pollFd, EPOLL_CTL_ADD, loop->signalFd, &event) < 0)
+        goto failed;
+    event.data.fd = loop->wakeFd;
+    if (epoll_ctl(loop->pollFd, EPOLL_CTL_ADD, loop->wakeFd, &event) < 0)
+        goto failed;
+#else
+    if (pipe(pipeFds) < 0) {
+        LOG_ERR("%s: pipe failed\n", __func__);
+        goto failed;
+    }
+    fcntl(pipeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(pipeFds[1], F_SETFL, O_NONBLOCK);
+    wakeupReadFd = pipeFds[0];
+    loop->wakeFd = pipeFds[1];
+#endif
+
+    wakeupFd = loop->wakeFd;
+    *eventLoop = loop;
+    return NVMEDIA_STATUS_OK;
+failed:
+    EventLoopDestroy(loop);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+void
+EventLoopDestroy(NvEventLoop *eventLoop)
+{
+    uint32_t i;
+
+    if (!eventLoop)
+        return;
+
+    wakeupFd = -1;
+    for (i = 0; i < eventLoop->numSources; i++) {
+        /* Timer descriptors belong to the loop, other sources to their owners */
+        if (eventLoop->sources[i].timerHandler && eventLoop->sources[i].fd >= 0)
+            close(eventLoop->sources[i].fd);
+    }
+    if (eventLoop->signalFd >= 0)
+        close(eventLoop->signalFd);
+    if (eventLoop->wakeFd >= 0)
+        close(eventLoop->wakeFd);
+    if (eventLoop->pollFd >= 0)
+        close(eventLoop->pollFd);
+#ifdef NVMEDIA_QNX
+    if (wakeupReadFd >= 0)
+        close(wakeupReadFd);
+    wakeupReadFd = -1;
+#endif
+
+    free(eventLoop);
+}
+
+static NvMediaStatus
+_AddSource(NvEventLoop *eventLoop,
+           int fd,
+           EventLoopHandler handler,
+           EventLoopTimerHandler timerHandler,
+           void *data)
+{
+    EventLoopSource *source;
+#ifndef NVMEDIA_QNX
+    struct epoll_event event;
+#endif
+
+    if (eventLoop->numSources >= EVENT_LOOP_MAX_SOURCES + EVENT_LOOP_MAX_TIMERS) {
+        LOG_ERR("%s: Too many event sources\n", __func__);
+        return NVMEDIA_STATUS_INSUFFICIENT_BUFFERING;
+    }
+
+    source = &eventLoop->sources[eventLoop->numSources];
+    source->fd = fd;
+    source->handler = handler;
+    source->timerHandler = timerHandler;
+    source->data = data;
+
+#ifndef NVMEDIA_QNX
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(eventLoop->pollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        LOG_ERR("%s: Failed to watch fd %d\n", __func__, fd);
+        return NVMEDIA_STATUS_ERROR;
+    }
+#endif
+
+    eventLoop->numSources++;
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+_RemoveSource(NvEventLoop *eventLoop,
+              uint32_t index)
+{
+#ifndef NVMEDIA_QNX
+    epoll_ctl(eventLoop->pollFd, EPOLL_CTL_DEL, eventLoop->sources[index].fd, NULL);
+#endif
+    eventLoop->numSources--;
+    if (index != eventLoop->numSources) {
+        eventLoop->sources[index] = eventLoop->sources[eventLoop->numSources];
+#ifdef NVMEDIA_QNX
+        timerPeriodMs[index] = timerPeriodMs[eventLoop->numSources];
+        timerDeadlineUs[index] = timerDeadlineUs[eventLoop->numSources];
+#endif
+    }
+}
+
+NvMediaStatus
+EventLoopAddSource(NvEventLoop *eventLoop,
+                   int fd,
+                   EventLoopHandler handler,
+                   void *data)
+{
+    return _AddSource(eventLoop, fd, handler, NULL, data);
+}
+
+NvMediaStatus
+EventLoopAddTimer(NvEventLoop *eventLoop,
+                  uint32_t periodMs,
+                  EventLoopTimerHandler handler,
+                  void *data)
+{
+#ifndef NVMEDIA_QNX
+    struct itimerspec spec;
+    int fd;
+    NvMediaStatus status;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERR("%s: timerfd_create failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    spec.it_interval.tv_sec = periodMs / 1000;
+    spec.it_interval.tv_nsec = (periodMs % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+        LOG_ERR("%s: timerfd_settime failed\n", __func__);
+        close(fd);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    status = _AddSource(eventLoop, fd, NULL, handler, data);
+    if (status != NVMEDIA_STATUS_OK)
+        close(fd);
+    return status;
+#else
+    uint64_t now = 0;
+
+    GetTimeMicroSec(&now);
+    timerPeriodMs[eventLoop->numSources] = periodMs;
+    timerDeadlineUs[eventLoop->numSources] = now + (uint64_t)periodMs * 1000;
+    return _AddSource(eventLoop, -1, NULL, handler, data);
+#endif
+}
+
+static void
+_Dispatch(NvEventLoop *eventLoop,
+          int fd)
+{
+    EventLoopSource *source;
+    uint64_t expirations;
+    uint32_t i;
+
+    for (i = 0; i < eventLoop->numSources; i++) {
+        source = &eventLoop->sources[i];
+        if (source->fd != fd)
+            continue;
+
+        if (source->timerHandler) {
+            if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                source->timerHandler(source->data);
+        } else if (source->handler(fd, source->data) != NVMEDIA_STATUS_OK) {
+            _RemoveSource(eventLoop, i);
+        }
+        return;
+    }
+}
+
+#ifndef NVMEDIA_QNX
+NvMediaStatus
+EventLoopRun(NvEventLoop *eventLoop)
+{
+    NvMainContext *mainCtx = eventLoop->mainCtx;
+    struct epoll_event events[EVENT_LOOP_MAX_SOURCES + EVENT_LOOP_MAX_TIMERS + 2];
+    struct signalfd_siginfo info;
+    int i, numEvents, fd;
+
+    while (!mainCtx->quit) {
+        numEvents = epoll_wait(eventLoop->pollFd,
+                               events,
+                               sizeof(events) / sizeof(events[0]),
+                               -1);
+        if (numEvents < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERR("%s: epoll_wait failed\n", __func__);
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        for (i = 0; i < numEvents && !mainCtx->quit; i++) {
+            fd = events[i].data.fd;
+            if (fd == eventLoop->signalFd) {
+                while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+                    LOG_INFO("%s: Received signal %u\n", __func__, info.ssi_signo);
+                    ShutdownRequest("signal");
+                }
+            } else if (fd == eventLoop->wakeFd) {
+                _DrainFd(fd);
+            } else {
+                _Dispatch(eventLoop, fd);
+            }
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+#else
+NvMediaStatus
+EventLoopRun(NvEventLoop *eventLoop)
+{
+    NvMainContext *mainCtx = eventLoop->mainCtx;
+    struct pollfd fds[EVENT_LOOP_MAX_SOURCES + EVENT_LOOP_MAX_TIMERS + 1];
+    uint64_t now = 0, next;
+    uint32_t i, numFds;
+    int timeout;
+
+    while (!mainCtx->quit) {
+        GetTimeMicroSec(&now);
+        next = now + 1000000;
+        numFds = 0;
+        fds[numFds].fd = wakeupReadFd;
+        fds[numFds++].events = POLLIN;
+        for (i = 0; i < eventLoop->numSources; i++) {
+            if (eventLoop->sources[i].timerHandler) {
+                if (timerDeadlineUs[i] < next)
+                    next = timerDeadlineUs[i];
+            } else {
+                fds[numFds].fd = eventLoop->sources[i].fd;
+                fds[numFds++].events = POLLIN;
+            }
+        }
+        timeout = (next > now) ? (int)((next - now) / 1000) : 0;
+
+        if (poll(fds, numFds, timeout) < 0 && errno != EINTR) {
+            LOG_ERR("%s: poll failed\n", __func__);
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (fds[0].revents & POLLIN)
+            _DrainFd(wakeupReadFd);
+        for (i = 1; i < numFds && !mainCtx->quit; i++) {
+            if (fds[i].revents & (POLLIN | POLLHUP))
+                _Dispatch(eventLoop, fds[i].fd);
+        }
+
+        GetTimeMicroSec(&now);
+        for (i = 0; i < eventLoop->numSources && !mainCtx->quit; i++) {
+            if (eventLoop->sources[i].timerHandler && timerDeadlineUs[i] <= now) {
+                timerDeadlineUs[i] += (uint64_t)timerPeriodMs[i] * 1000;
+                eventLoop->sources[i].timerHandler(eventLoop->sources[i].data);
+            }
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+#endif
+
+void
+EventLoopWakeup(void)
+{
+    int fd = wakeupFd;
+#ifndef NVMEDIA_QNX
+    uint64_t one = 1;
+#else
+    uint8_t one = 1;
+#endif
+
+    if (fd >= 0) {
+        if (write(fd, &one, sizeof(one)) < 0) {
+            /* Already pending; nothing to do */
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+
+#define EVENT_LOOP_MAX_SOURCES          8
+#define EVENT_LOOP_MAX_TIMERS           4
+
+/* Called when fd is readable. Returning anything but NVMEDIA_STATUS_OK
+ * removes the source from the loop. */
+typedef NvMediaStatus (*EventLoopHandler)(int fd, void *data);
+
+/* Called every time a periodic timer expires */
+typedef void (*EventLoopTimerHandler)(void *data);
+
+typedef struct {
+    int                         fd;
+    void                       *data;
+    EventLoopHandler            handler;
+    EventLoopTimerHandler       timerHandler;
+} EventLoopSource;
+
+typedef struct NvEventLoop {
+    NvMainContext              *mainCtx;
+    int                         pollFd;         /* epoll instance */
+    int                         signalFd;
+    int                         wakeFd;         /* written to break out of the wait */
+    EventLoopSource             sources[EVENT_LOOP_MAX_SOURCES + EVENT_LOOP_MAX_TIMERS];
+    uint32_t                    numSources;
+} NvEventLoop;
+
+NvMediaStatus
+EventLoopCreate(NvMainContext *mainCtx,
+                NvEventLoop **eventLoop);
+
+void
+EventLoopDestroy(NvEventLoop *eventLoop);
+
+NvMediaStatus
+EventLoopAddSource(NvEventLoop *eventLoop,
+                   int fd,
+                   EventLoopHandler handler,
+                   void *data);
+
+NvMediaStatus
+EventLoopAddTimer(NvEventLoop *eventLoop,
+                  uint32_t periodMs,
+                  EventLoopTimerHandler handler,
+                  void *data);
+
+/* Dispatches events until mainCtx->quit is set */
+NvMediaStatus
+EventLoopRun(NvEventLoop *eventLoop);
+
+/* Wakes the loop so that it re-checks the quit flag. Safe to call from any
+ * thread and from signal handlers; does nothing if no loop is running. */
+void
+EventLoopWakeup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __EVENT_LOOP_H__
@@ -0,0 +1,207 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifndef NVMEDIA_QNX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "frame_client.h"
+
+#define FRAME_CLIENT_POLL_US        1000
+#define FRAME_CLIENT_MAX_RETRY      16
+
+struct FrameClient {
+    int                         fd;
+    uint8_t                    *base;
+    uint64_t                    size;
+    FrameServerHeader          *header;
+};
+
+FrameClient *
+FrameClientOpen(const char *name)
+{
+    FrameClient *client;
+    struct stat st;
+
+    client = calloc(1, sizeof(FrameClient));
+    if (!client)
+        return NULL;
+
+    client->fd = shm_open(name ? name : FRAME_SERVER_DEFAULT_NAME, O_RDONLY, 0);
+    if (client->fd < 0)
+        goto failed;
+
+    if (fstat(client->fd, &st) < 0 || (uint64_t)st.st_size < sizeof(FrameServerHeader))
+        goto failed;
+    client->size = st.st_size;
+
+    client->base = mmap(NULL, client->size, PROT_READ, MAP_SHARED, client->fd, 0);
+    if (client->base == MAP_FAILED) {
+        client->base = NULL;
+        goto failed;
+    }
+    client->header = (FrameServerHeader *)client->base;
+
+    if (__atomic_load_n(&client->header->magic, __ATOMIC_ACQUIRE) != FRAME_SERVER_MAGIC ||
+        client->header->version != FRAME_SERVER_VERSION ||
+        client->header->segmentSize > client->size)
+        goto failed;
+
+    return client;
+failed:
+    FrameClientClose(client);
+    return NULL;
+}
+
+void
+FrameClientClose(FrameClient *client)
+{
+    if (!client)
+        return;
+
+    if (client->base)
+        munmap(client->base, client->size);
+    if (client->fd >= 0)
+        close(client->fd);
+    free(client);
+}
+
+uint32_t
+FrameClientNumChannels(FrameClient *client)
+{
+    return client->header->numChannels;
+}
+
+int
+FrameClientServerRunning(FrameClient *client)
+{
+    return __atomic_load_n(&client->header->serverRunning, __ATOMIC_ACQUIRE) != 0;
+}
+
+int
+FrameClientGetLatest(FrameClient *client,
+                     uint32_t channel,
+                     FrameView *view)
+{
+    FrameServerHeader *header = client->header;
+    FrameServerChannel *ch;
+    FrameServerSlot *slot;
+    uint64_t count;
+    uint32_t sequence, retry;
+
+    if (channel >= header->numChannels)
+        return -1;
+    ch = &header->channels[channel];
+
+    for (retry = 0; retry < FRAME_CLIENT_MAX_RETRY; retry++) {
+        count = __atomic_load_n(&ch->publishCount, __ATOMIC_ACQUIRE);
+        if (!count)
+            return -1;
+
+        slot = &ch->slots[(count - 1) % header->numSlots];
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+            continue;
+
+        view->channel = channel;
+        view->sequence = sequence;
+        view->publishIndex = count;
+        view->frameNumber = slot->frameNumber;
+        view->timestampUs = slot->timestampUs;
+        view->width = ch->width;
+        view->height = ch->height;
+        view->pitch = ch->pitch;
+        view->bytesPerPixel = ch->bytesPerPixel;
+        view->isRaw = ch->isRaw;
+        view->embeddedTopSize = slot->embeddedTopSize;
+        view->embeddedBottomSize = slot->embeddedBottomSize;
+        view->dataSize = slot->dataSize;
+        view->slot = slot;
+
+        if (slot->dataOffset + view->dataSize > client->size)
+            return -1;
+        view->data = client->base + slot->dataOffset;
+
+        /* The metadata must belong to the sequence sampled above, and a
+         * slot left without a frame by a failed write is skipped */
+        if (FrameClientFrameValid(client, view) && view->dataSize)
+            return 0;
+    }
+
+    return -1;
+}
+
+int
+FrameClientWaitFrame(FrameClient *client,
+                     uint32_t channel,
+                     uint64_t lastPublishIndex,
+                     uint32_t timeoutMs,
+                     FrameView *view)
+{
+    FrameServerChannel *ch;
+    struct timespec ts, now, deadline;
+    int64_t leftNs;
+    uint32_t wake;
+
+    if (channel >= client->header->numChannels)
+        return -1;
+    ch = &client->header->channels[channel];
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+
+    while (1) {
+        /* Sampled before the checks, so a publish after them changes it
+         * and the wait below returns at once */
+        wake = __atomic_load_n(&ch->publishWake, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ch->publishCount, __ATOMIC_ACQUIRE) > lastPublishIndex)
+            break;
+        if (!FrameClientServerRunning(client))
+            return -1;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        leftNs = (int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000 +
+                 (deadline.tv_nsec - now.tv_nsec);
+        if (leftNs <= 0)
+            return -1;
+#ifndef NVMEDIA_QNX
+        ts.tv_sec = leftNs / 1000000000;
+        ts.tv_nsec = leftNs % 1000000000;
+        syscall(SYS_futex, &ch->publishWake, FUTEX_WAIT, wake, &ts, NULL, 0);
+#else
+        /* No futex, poll */
+        (void)wake;
+        ts.tv_sec = 0;
+        ts.tv_nsec = leftNs < FRAME_CLIENT_POLL_US * 1000 ? leftNs : FRAME_CLIENT_POLL_US * 1000;
+        nanosleep(&ts, NULL);
+#endif
+    }
+
+    return FrameClientGetLatest(client, channel, view);
+}
+
+int
+FrameClientFrameValid(FrameClient *client,
+                      const FrameView *view)
+{
+    (void)client;
+
+    /* Order all reads of the frame before re-reading the sequence */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&view->slot->sequence, __ATOMIC_RELAXED) == view->sequence;
+}
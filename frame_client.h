@@ -0,0 +1,100 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/* Client library for the nvmimg_cc frame server.
+ *
+ * Typical use:
+ *
+ *     FrameClient *client = FrameClientOpen(NULL);
+ *     FrameView view;
+ *     uint64_t last = 0;
+ *     while (FrameClientWaitFrame(client, 0, last, 1000, &view) == 0) {
+ *         process(view.data, view.dataSize);
+ *         if (FrameClientFrameValid(client, &view))
+ *             consume result;    // otherwise the frame was overwritten meanwhile
+ *         last = view.publishIndex;
+ *     }
+ *     FrameClientClose(client);
+ *
+ * Frames are read in place from shared memory; nothing is copied. A view
+ * stays valid until the server has published numSlots more frames on that
+ * channel, which FrameClientFrameValid detects.
+ *
+ * Functions return 0 on success and -1 on failure.
+ */
+
+#ifndef __FRAME_CLIENT_H__
+#define __FRAME_CLIENT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "frame_server_shm.h"
+
+typedef struct FrameClient FrameClient;
+
+typedef struct {
+    uint32_t                    channel;
+    uint32_t                    sequence;           /* slot sequence sampled at acquire time */
+    uint64_t                    publishIndex;       /* 1-based index of the frame on its channel */
+    uint64_t                    frameNumber;
+    uint64_t                    timestampUs;
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    pitch;
+    uint32_t                    bytesPerPixel;
+    uint32_t                    isRaw;
+    uint32_t                    embeddedTopSize;
+    uint32_t                    embeddedBottomSize;
+    uint32_t                    dataSize;
+    const uint8_t              *data;               /* embedded top lines, pixels, embedded bottom lines */
+    const FrameServerSlot      *slot;
+} FrameView;
+
+/* Maps the segment published by the server; name may be NULL for the default */
+FrameClient *
+FrameClientOpen(const char *name);
+
+void
+FrameClientClose(FrameClient *client);
+
+uint32_t
+FrameClientNumChannels(FrameClient *client);
+
+/* Returns non-zero while the server is running */
+int
+FrameClientServerRunning(FrameClient *client);
+
+/* Gets the most recent complete frame of a channel */
+int
+FrameClientGetLatest(FrameClient *client,
+                     uint32_t channel,
+                     FrameView *view);
+
+/* Waits until a frame newer than lastPublishIndex is available */
+int
+FrameClientWaitFrame(FrameClient *client,
+                     uint32_t channel,
+                     uint64_t lastPublishIndex,
+                     uint32_t timeoutMs,
+                     FrameView *view);
+
+/* Returns non-zero if the frame was not overwritten since it was acquired.
+ * Call after using the data and discard the results if it returns 0. */
+int
+FrameClientFrameValid(FrameClient *client,
+                      const FrameView *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FRAME_CLIENT_H__
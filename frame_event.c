@@ -0,0 +1,97 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "frame_event.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+
+NvMediaStatus
+FrameEventInit(NvFrameEvent *event)
+{
+    pthread_condattr_t attr;
+
+    memset(event, 0, sizeof(NvFrameEvent));
+
+    if (pthread_mutex_init(&event->mutex, NULL)) {
+        LOG_ERR("%s: Failed to create mutex\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    /* Timeouts must not depend on wall clock changes */
+    if (pthread_condattr_init(&attr) ||
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) ||
+        pthread_cond_init(&event->cond, &attr)) {
+        LOG_ERR("%s: Failed to create condition variable\n", __func__);
+        pthread_mutex_destroy(&event->mutex);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    pthread_condattr_destroy(&attr);
+
+    event->valid = NVMEDIA_TRUE;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+FrameEventDestroy(NvFrameEvent *event)
+{
+    if (!event->valid)
+        return;
+
+    pthread_cond_destroy(&event->cond);
+    pthread_mutex_destroy(&event->mutex);
+    event->valid = NVMEDIA_FALSE;
+}
+
+void
+FrameEventPublish(NvFrameEvent *event,
+                  uint32_t frame)
+{
+    uint64_t now = 0;
+
+    GetTimeMicroSec(&now);
+
+    pthread_mutex_lock(&event->mutex);
+    event->frame = frame;
+    event->timestamp = now;
+    pthread_cond_broadcast(&event->cond);
+    pthread_mutex_unlock(&event->mutex);
+}
+
+uint32_t
+FrameEventWait(NvFrameEvent *event,
+               uint32_t frame,
+               uint32_t timeoutMs,
+               uint64_t *timestamp)
+{
+    struct timespec deadline;
+    uint32_t published;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    while (event->frame < frame) {
+        if (pthread_cond_timedwait(&event->cond, &event->mutex, &deadline))
+            break;
+    }
+    published = event->frame;
+    if (timestamp)
+        *timestamp = event->timestamp;
+    pthread_mutex_unlock(&event->mutex);
+
+    return published;
+}
@@ -0,0 +1,56 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __FRAME_EVENT_H__
+#define __FRAME_EVENT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+
+#include "nvmedia_core.h"
+
+/* Published by a capture thread at the start of every frame, so that
+ * stages which act on a given frame wake on it instead of polling the
+ * frame counter. Any number of threads can wait on one event. */
+typedef struct {
+    pthread_mutex_t             mutex;
+    pthread_cond_t              cond;
+    uint32_t                    frame;          // last frame published
+    uint64_t                    timestamp;      // us, when it was published
+    NvMediaBool                 valid;
+} NvFrameEvent;
+
+NvMediaStatus
+FrameEventInit(NvFrameEvent *event);
+
+/* Safe on a zeroed event */
+void
+FrameEventDestroy(NvFrameEvent *event);
+
+void
+FrameEventPublish(NvFrameEvent *event,
+                  uint32_t frame);
+
+/* Waits until frame or a later one is published, at most timeoutMs.
+ * Returns the last published frame, which is lower than frame on timeout,
+ * and when it was published if timestamp is not NULL. */
+uint32_t
+FrameEventWait(NvFrameEvent *event,
+               uint32_t frame,
+               uint32_t timeoutMs,
+               uint64_t *timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FRAME_EVENT_H__
@@ -0,0 +1,270 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifndef NVMEDIA_QNX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "frame_server.h"
+#include "capture.h"
+
+#define FRAME_SERVER_ALIGN(x)   (((x) + FRAME_SERVER_DATA_ALIGN - 1) & ~((uint64_t)FRAME_SERVER_DATA_ALIGN - 1))
+
+/* Advances the futex word of a channel and wakes its readers */
+static void
+_FrameServerWake(FrameServerChannel *channel,
+                 uint32_t value)
+{
+    __atomic_store_n(&channel->publishWake, value, __ATOMIC_RELEASE);
+#ifndef NVMEDIA_QNX
+    syscall(SYS_futex, &channel->publishWake, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#endif
+}
+
+/* A segment left by a run that did not stop cleanly can be replaced, one
+ * still served by a live process cannot */
+static NvMediaBool
+_FrameServerInUse(const char *name)
+{
+    FrameServerHeader *header;
+    struct stat st;
+    NvMediaBool inUse = NVMEDIA_FALSE;
+    pid_t pid;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NVMEDIA_FALSE;
+
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(FrameServerHeader)) {
+        header = mmap(NULL, sizeof(FrameServerHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (header != MAP_FAILED) {
+            pid = (pid_t)header->serverPid;
+            if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == FRAME_SERVER_MAGIC &&
+                header->version == FRAME_SERVER_VERSION &&
+                __atomic_load_n(&header->serverRunning, __ATOMIC_ACQUIRE) &&
+                pid > 0 && (kill(pid, 0) == 0 || errno == EPERM)) {
+                LOG_ERR("%s: %s is served by process %d\n", __func__, name, (int)pid);
+                inUse = NVMEDIA_TRUE;
+            }
+            munmap(header, sizeof(FrameServerHeader));
+        }
+    }
+    close(fd);
+
+    return inUse;
+}
+
+NvMediaStatus
+FrameServerCreate(NvMainContext *mainCtx,
+                  NvFrameServer **frameServer)
+{
+    NvFrameServer *server = NULL;
+    NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    TestArgs *testArgs = mainCtx->testArgs;
+    FrameServerHeader *header;
+    FrameServerChannel *channel;
+    CaptureThreadCtx *capThread;
+    uint64_t slotSize = 0, size, offset;
+    uint32_t i, j, bytesPerPixel, lines;
+
+    if (testArgs->numVirtualChannels > FRAME_SERVER_MAX_CHANNELS) {
+        LOG_ERR("%s: Frame server supports at most %d channels\n",
+                __func__, FRAME_SERVER_MAX_CHANNELS);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    server = calloc(1, sizeof(NvFrameServer));
+    if (!server) {
+        LOG_ERR("%s: Failed to allocate memory for frame server\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    server->fd = -1;
+    strncpy(server->name, testArgs->shmName.stringValue, MAX_STRING_SIZE - 1);
+
+    /* Size every slot for the largest frame any channel can deliver */
+    for (i = 0; i < testArgs->numVirtualChannels; i++) {
+        capThread = &captureCtx->threadCtx[i];
+        bytesPerPixel = capThread->rawBytesPerPixel ? capThread->rawBytesPerPixel : 4;
+        lines = capThread->height + 2 * capThread->settings->embeddedDataLines;
+        size = (uint64_t)capThread->width * bytesPerPixel * lines;
+        slotSize = (size > slotSize) ? size : slotSize;
+    }
+    slotSize = FRAME_SERVER_ALIGN(slotSize);
+    size = FRAME_SERVER_ALIGN(sizeof(FrameServerHeader)) +
+           slotSize * FRAME_SERVER_NUM_SLOTS * testArgs->numVirtualChannels;
+
+    /* A stale segment from a previous run would confuse clients. The fd
+     * stays -1 until the segment is ours, so failing never unlinks one
+     * another instance serves. */
+    if (_FrameServerInUse(server->name))
+        goto failed;
+    shm_unlink(server->name);
+    server->fd = shm_open(server->name, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (server->fd < 0) {
+        LOG_ERR("%s: shm_open(%s) failed\n", __func__, server->name);
+        goto failed;
+    }
+    if (ftruncate(server->fd, size) < 0) {
+        LOG_ERR("%s: Failed to size shared memory to %llu bytes\n",
+                __func__, (unsigned long long)size);
+        goto failed;
+    }
+    server->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, server->fd, 0);
+    if (server->base == MAP_FAILED) {
+        server->base = NULL;
+        LOG_ERR("%s: mmap failed\n", __func__);
+        goto failed;
+    }
+
+    header = server->header = (FrameServerHeader *)server->base;
+    memset(header, 0, sizeof(FrameServerHeader));
+    header->version = FRAME_SERVER_VERSION;
+    header->numChannels = testArgs->numVirtualChannels;
+    header->numSlots = FRAME_SERVER_NUM_SLOTS;
+    header->slotSize = slotSize;
+    header->segmentSize = size;
+
+    offset = FRAME_SERVER_ALIGN(sizeof(FrameServerHeader));
+    for (i = 0; i < header->numChannels; i++) {
+        capThread = &captureCtx->threadCtx[i];
+        channel = &header->channels[i];
+        channel->width = capThread->width;
+        channel->height = capThread->height;
+        channel->bytesPerPixel = capThread->rawBytesPerPixel ? capThread->rawBytesPerPixel : 4;
+        channel->pitch = channel->width * channel->bytesPerPixel;
+        channel->isRaw = (capThread->rawBytesPerPixel != 0);
+        for (j = 0; j < header->numSlots; j++) {
+            channel->slots[j].dataOffset = offset;
+            offset += slotSize;
+        }
+    }
+
+    header->serverPid = (uint32_t)getpid();
+    header->serverRunning = 1;
+    __atomic_store_n(&header->magic, FRAME_SERVER_MAGIC, __ATOMIC_RELEASE);
+
+    LOG_INFO("%s: Publishing %u channel(s) in %s, %u slots of %llu bytes\n",
+             __func__, header->numChannels, server->name, header->numSlots,
+             (unsigned long long)slotSize);
+
+    *frameServer = server;
+    return NVMEDIA_STATUS_OK;
+failed:
+    FrameServerDestroy(server);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+void
+FrameServerDestroy(NvFrameServer *frameServer)
+{
+    uint32_t i;
+
+    if (!frameServer)
+        return;
+
+    if (frameServer->header) {
+        __atomic_store_n(&frameServer->header->serverRunning, 0, __ATOMIC_RELEASE);
+        /* Waiting readers see the server gone without their timeout */
+        for (i = 0; i < frameServer->header->numChannels; i++)
+            _FrameServerWake(&frameServer->header->channels[i],
+                             frameServer->header->channels[i].publishWake + 1);
+        munmap(frameServer->base, frameServer->header->segmentSize);
+    }
+    if (frameServer->fd >= 0) {
+        close(frameServer->fd);
+        shm_unlink(frameServer->name);
+    }
+
+    free(frameServer);
+}
+
+NvMediaStatus
+FrameServerPublish(NvFrameServer *frameServer,
+                   uint32_t channel,
+                   NvMediaImage *image,
+                   uint64_t frameNumber)
+{
+    FrameServerHeader *header = frameServer->header;
+    FrameServerChannel *ch = &header->channels[channel];
+    FrameServerSlot *slot;
+    NvMediaImageSurfaceMap surfaceMap;
+    uint64_t count, now = 0;
+    uint32_t sequence, pitch, dataSize;
+    uint8_t *dst;
+    NvMediaStatus status;
+
+    dataSize = ch->pitch * ch->height + image->embeddedDataTopSize +
+               image->embeddedDataBottomSize;
+    if (dataSize > header->slotSize) {
+        if (!frameServer->sizeWarned[channel]) {
+            LOG_WARN("%s: Frame of %u bytes does not fit in a slot, not publishing\n",
+                     __func__, dataSize);
+            frameServer->sizeWarned[channel] = NVMEDIA_TRUE;
+        }
+        return NVMEDIA_STATUS_OK;
+    }
+
+    count = ch->publishCount;
+    slot = &ch->slots[count % header->numSlots];
+
+    /* Enter the write side of the seqlock */
+    sequence = slot->sequence;
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) !=
+        NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+        goto done;
+    }
+
+    dst = frameServer->base + slot->dataOffset;
+    pitch = ch->pitch;
+    status = NvMediaImageGetBits(image, NULL, (void **)&dst, &pitch);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+        goto done;
+    }
+
+    GetTimeMicroSec(&now);
+    slot->dataSize = dataSize;
+    slot->frameNumber = frameNumber;
+    slot->timestampUs = now;
+    slot->embeddedTopSize = image->embeddedDataTopSize;
+    slot->embeddedBottomSize = image->embeddedDataBottomSize;
+
+done:
+    /* The slot may hold part of the frame by now; a reader that sampled
+     * the publish count before the failure must not take it for the frame
+     * it held before */
+    if (status != NVMEDIA_STATUS_OK)
+        slot->dataSize = 0;
+
+    /* Leave the write side; only a completed frame is announced to readers */
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    if (status == NVMEDIA_STATUS_OK) {
+        __atomic_store_n(&ch->publishCount, count + 1, __ATOMIC_RELEASE);
+        _FrameServerWake(ch, (uint32_t)(count + 1));
+    }
+
+    return status;
+}
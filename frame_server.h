@@ -0,0 +1,51 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __FRAME_SERVER_H__
+#define __FRAME_SERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "cmdline.h"
+#include "nvmedia_image.h"
+#include "frame_server_shm.h"
+
+#define FRAME_SERVER_NUM_SLOTS          8
+
+typedef struct {
+    char                        name[MAX_STRING_SIZE];
+    int                         fd;
+    uint8_t                    *base;
+    FrameServerHeader          *header;
+    NvMediaBool                 sizeWarned[FRAME_SERVER_MAX_CHANNELS];
+} NvFrameServer;
+
+NvMediaStatus
+FrameServerCreate(NvMainContext *mainCtx,
+                  NvFrameServer **frameServer);
+
+void
+FrameServerDestroy(NvFrameServer *frameServer);
+
+/* Copies a captured image into the next slot of the channel ring.
+ * Called by the save thread that owns the channel. */
+NvMediaStatus
+FrameServerPublish(NvFrameServer *frameServer,
+                   uint32_t channel,
+                   NvMediaImage *image,
+                   uint64_t frameNumber);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FRAME_SERVER_H__
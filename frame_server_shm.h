@@ -0,0 +1,79 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/* Layout of the shared memory segment published by the frame server.
+ * This header is shared between nvmimg_cc and the client library and must
+ * not depend on NvMedia.
+ *
+ * Each channel owns a ring of slots. A slot is protected by a seqlock:
+ * its sequence is odd while the server writes it and is advanced to the
+ * next even value once the frame is complete. A reader samples the
+ * sequence, uses the frame in place and re-checks the sequence; if it
+ * changed, the slot was overwritten and the data must be discarded. A
+ * slot whose dataSize is 0 holds no frame, as after a failed write.
+ *
+ * publishWake follows the low 32 bits of publishCount and is also advanced
+ * when the server stops. On Linux it is a futex word, woken for every
+ * change, so readers can sleep on it rather than poll.
+ */
+
+#ifndef __FRAME_SERVER_SHM_H__
+#define __FRAME_SERVER_SHM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define FRAME_SERVER_MAGIC              0x4E564653  /* "NVFS" */
+#define FRAME_SERVER_VERSION            2
+#define FRAME_SERVER_MAX_CHANNELS       4
+#define FRAME_SERVER_MAX_SLOTS          16
+#define FRAME_SERVER_DEFAULT_NAME       "/nvmimg_cc_frames"
+#define FRAME_SERVER_DATA_ALIGN         4096
+
+typedef struct {
+    volatile uint32_t           sequence;           /* seqlock, odd while being written */
+    uint32_t                    dataSize;           /* valid bytes at dataOffset, 0 if none */
+    uint64_t                    frameNumber;
+    uint64_t                    timestampUs;
+    uint64_t                    dataOffset;         /* from the start of the segment */
+    uint32_t                    embeddedTopSize;    /* bytes of embedded data before the pixels */
+    uint32_t                    embeddedBottomSize; /* bytes of embedded data after the pixels */
+} FrameServerSlot;
+
+typedef struct {
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    pitch;
+    uint32_t                    bytesPerPixel;
+    uint32_t                    isRaw;
+    volatile uint32_t           publishWake;        /* futex word, see above */
+    volatile uint64_t           publishCount;       /* frames published so far */
+    FrameServerSlot             slots[FRAME_SERVER_MAX_SLOTS];
+} FrameServerChannel;
+
+typedef struct {
+    volatile uint32_t           magic;              /* written last, once the segment is ready */
+    uint32_t                    version;
+    uint32_t                    numChannels;
+    uint32_t                    numSlots;
+    uint64_t                    slotSize;
+    uint64_t                    segmentSize;
+    volatile uint32_t           serverRunning;
+    uint32_t                    serverPid;          /* owner, while serverRunning */
+    FrameServerChannel          channels[FRAME_SERVER_MAX_CHANNELS];
+} FrameServerHeader;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __FRAME_SERVER_SHM_H__
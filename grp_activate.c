@@ -10,6 +10,8 @@
 #include "grp_activate.h"
 #include "capture.h"
 #include "os_common.h"
+#include "misc_utils.h"
+#include "shutdown.h"
 
 static uint32_t
 _GrpActivationThreadFunc(void *data)
@@ -19,6 +21,8 @@ _GrpActivationThreadFunc(void *data)
     uint32_t currentGroup = 0;
     uint32_t triggerFrame = 0;
     uint32_t cmdIdx = 0;
+    uint32_t frame, appliedFrame;
+    uint64_t frameStart = 0, end = 0;
     Command *command = NULL;
     NvMediaStatus status;
 
@@ -29,46 +33,83 @@ _GrpActivationThreadFunc(void *data)
     if (!handle) {
         LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
                 ctx->i2cDeviceNum);
-        *ctx->quit = NVMEDIA_TRUE;
+        ShutdownRequest(__func__);
         goto done;
     }
 
     cmdIdx = ctx->allGroups.groups[currentGroup].firstCommand;
-    command = &ctx->parsedCommands->commands[cmdIdx];
+    command = I2C_COMMAND(ctx->parsedCommands, cmdIdx);
     triggerFrame = command->triggerFrame;
 
     while (!(*ctx->quit)) {
-        if (*ctx->currentFrame >= triggerFrame) {
+        frame = FrameEventWait(ctx->frameEvent, triggerFrame,
+                               GRP_ACTIVATION_WAIT_TIMEOUT, &frameStart);
+        if (frame >= triggerFrame) {
             // Write group registers
             status = I2cProcessGroup(handle,
+                                     ctx->i2cDeviceNum,
                                      ctx->parsedCommands,
                                      &ctx->allGroups.groups[currentGroup]);
             if(status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to write registers for frame %u\n",
                         __func__, triggerFrame);
-                *ctx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
                 goto done;
             }
 
+            // Writes which end during frame n apply to frame n at best
+            GetTimeMicroSec(&end);
+            appliedFrame = *ctx->currentFrame;
+            ctx->appliedFrame[currentGroup] = appliedFrame;
+            ctx->numApplied++;
+            if (appliedFrame > triggerFrame) {
+                LOG_WARN("%s: Frame %u registers applied %u frame(s) late, %llu us after frame %u started\n",
+                         __func__, triggerFrame, appliedFrame - triggerFrame,
+                         (unsigned long long)(end - frameStart), frame);
+            } else {
+                LOG_DBG("%s: Frame %u registers applied %llu us after the frame started\n",
+                        __func__, triggerFrame, (unsigned long long)(end - frameStart));
+            }
+            SensorStateRefresh(ctx->sensorState, appliedFrame, NULL);
+
             if (++currentGroup == ctx->allGroups.numGroups) {
                 goto done;
             } else {
                 cmdIdx = ctx->allGroups.groups[currentGroup].firstCommand;
-                command = &ctx->parsedCommands->commands[cmdIdx];
+                command = I2C_COMMAND(ctx->parsedCommands, cmdIdx);
                 triggerFrame = command->triggerFrame;
             }
         }
-        nvsleep(100);
     }
 
 done:
     if (handle)
         testutil_i2c_close(handle);
     LOG_INFO("%s: Group Activation thread exited\n", __func__);
-    ctx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&ctx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 }
 
+static void
+_GrpActivationReport(NvGrpActivationContext *ctx)
+{
+    uint32_t i, triggerFrame, numLate = 0;
+
+    if (!ctx->allGroups.numGroups)
+        return;
+
+    for (i = 0; i < ctx->numApplied; i++) {
+        triggerFrame = I2C_COMMAND(ctx->parsedCommands,
+                                   ctx->allGroups.groups[i].firstCommand)->triggerFrame;
+        if (ctx->appliedFrame[i] > triggerFrame)
+            numLate++;
+        LOG_INFO("%s: Frame %u registers applied on frame %u\n", __func__,
+                 triggerFrame, ctx->appliedFrame[i]);
+    }
+    LOG_MSG("Group registers: %u of %u applied, %u late\n", ctx->numApplied,
+            ctx->allGroups.numGroups, numLate);
+}
+
 NvMediaStatus
 GrpActivationInit(NvMainContext *mainCtx)
 {
@@ -91,8 +132,10 @@ GrpActivationInit(NvMainContext *mainCtx)
     grpActCtx->quit = &mainCtx->quit;
     grpActCtx->exitedFlag = NVMEDIA_TRUE;
     grpActCtx->currentFrame =  &captureCtx->threadCtx[0].currentFrame;
+    grpActCtx->frameEvent = &captureCtx->threadCtx[0].frameEvent;
     grpActCtx->i2cDeviceNum = captureCtx->i2cDeviceNum;
     grpActCtx->parsedCommands = &captureCtx->parsedCommands;
+    grpActCtx->sensorState = &captureCtx->sensorState;
 
     /* Setup group activation groups */
     if (mainCtx->testArgs->wrregs.isUsed) {
@@ -123,10 +166,9 @@ GrpActivationFini(NvMainContext *mainCtx)
         return NVMEDIA_STATUS_OK;
 
     /* wait for thread to exit */
-    while (!grpActCtx->exitedFlag) {
-        LOG_DBG("%s: Waiting for group activation thread to quit\n",
-                __func__);
-    }
+    if (grpActCtx->grpActThread &&
+        IsFailed(ShutdownWaitExit(&grpActCtx->exitedFlag, "Group activation thread")))
+        return NVMEDIA_STATUS_TIMED_OUT;
 
     /* Destroy the thread */
     if (grpActCtx->grpActThread) {
@@ -136,6 +178,8 @@ GrpActivationFini(NvMainContext *mainCtx)
                     __func__);
     }
 
+    _GrpActivationReport(grpActCtx);
+
     free(grpActCtx);
 
     LOG_INFO("%s: GrpActivationFini done\n", __func__);
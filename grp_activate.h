@@ -18,6 +18,10 @@ extern "C" {
 #include "cmdline.h"
 #include "thread_utils.h"
 #include "i2cCommands.h"
+#include "frame_event.h"
+#include "sensor_state.h"
+
+#define GRP_ACTIVATION_WAIT_TIMEOUT     100     /* ms between quit flag checks */
 
 typedef struct {
     /* grp activation context */
@@ -30,7 +34,13 @@ typedef struct {
 
     /* grp activation params */
     uint32_t                   *currentFrame;
+    NvFrameEvent               *frameEvent;
     uint32_t                    i2cDeviceNum;
+    NvSensorStateStore         *sensorState;
+
+    /* Frame each group took effect on, for the report at Fini */
+    uint32_t                    appliedFrame[MAX_NUM_GROUPS];
+    uint32_t                    numApplied;
 
 } NvGrpActivationContext;
 
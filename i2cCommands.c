@@ -7,8 +7,422 @@
  * license agreement from NVIDIA CORPORATION is strictly prohibited.
  */
 
+#include <pthread.h>
+
 #include "i2cCommands.h"
+#include "misc_utils.h"
 #include "os_common.h"
+#include "profiler.h"
+
+typedef struct {
+    uint32_t                    deviceAddress;
+    uint32_t                    delay;
+} WriteDelay;
+
+/* Set by WRITE_DELAY commands; they outlive one pass so that delays set
+ * by the main script also apply to group registers written later */
+static WriteDelay writeDelays[MAX_NUM_WRITE_DELAYS];
+static uint32_t numWriteDelays;
+
+static void
+SetWriteDelay(uint32_t deviceAddress, uint32_t delay)
+{
+    uint32_t i;
+
+    for (i = 0; i < numWriteDelays; i++) {
+        if (writeDelays[i].deviceAddress == deviceAddress)
+            break;
+    }
+    if (i == MAX_NUM_WRITE_DELAYS) {
+        LOG_WARN("%s: Too many write delays, ignoring %02x\n", __func__, deviceAddress << 1);
+        return;
+    }
+    if (i == numWriteDelays)
+        numWriteDelays++;
+    writeDelays[i].deviceAddress = deviceAddress;
+    writeDelays[i].delay = delay;
+    LOG_DBG("%s: %u us before writes to %02x\n", __func__, delay, deviceAddress << 1);
+}
+
+static void
+WaitBeforeWrite(uint32_t deviceAddress)
+{
+    uint32_t i, delay = DEFAULT_WRITE_DELAY;
+
+    for (i = 0; i < numWriteDelays; i++) {
+        if (writeDelays[i].deviceAddress == deviceAddress) {
+            delay = writeDelays[i].delay;
+            break;
+        }
+    }
+    if (delay)
+        nvsleep(delay);
+}
+
+#define SHADOW_VALID            (1 << 0)    // value holds the last write
+#define SHADOW_VOLATILE         (1 << 1)
+#define SHADOW_PAGE_SHIFT       8
+#define SHADOW_PAGE_SIZE        (1 << SHADOW_PAGE_SHIFT)
+#define SHADOW_NUM_PAGES        (0x10000 >> SHADOW_PAGE_SHIFT)
+
+typedef struct {
+    uint8_t                     value[SHADOW_PAGE_SIZE];
+    uint8_t                     flags[SHADOW_PAGE_SIZE];
+} ShadowPage;
+
+typedef struct {
+    int                         i2cDevice;
+    uint32_t                    deviceAddress;
+    ShadowPage                 *pages[SHADOW_NUM_PAGES];  // allocated on first use
+} ShadowDevice;
+
+/* Shared by the capture, group activation, runtime settings and save
+ * threads, which all go through ProcessCommands */
+static pthread_mutex_t shadowMutex = PTHREAD_MUTEX_INITIALIZER;
+static ShadowDevice shadowDevices[MAX_NUM_SHADOW_DEVICES];
+static uint32_t numShadowDevices;
+static volatile NvMediaBool shadowEnabled = NVMEDIA_FALSE;
+static uint32_t shadowReads, shadowWrites;
+
+/* Called with shadowMutex held */
+static ShadowPage *
+GetShadowPage(int i2cDevice, uint32_t deviceAddress, uint32_t reg, NvMediaBool create)
+{
+    ShadowDevice *device;
+    ShadowPage **page;
+    uint32_t i;
+
+    for (i = 0; i < numShadowDevices; i++) {
+        if (shadowDevices[i].i2cDevice == i2cDevice &&
+            shadowDevices[i].deviceAddress == deviceAddress)
+            break;
+    }
+    if (i == numShadowDevices) {
+        if (!create)
+            return NULL;
+        if (i == MAX_NUM_SHADOW_DEVICES) {
+            LOG_WARN("%s: Too many devices, not shadowing %02x\n", __func__,
+                     deviceAddress << 1);
+            return NULL;
+        }
+        shadowDevices[i].i2cDevice = i2cDevice;
+        shadowDevices[i].deviceAddress = deviceAddress;
+        numShadowDevices++;
+    }
+    device = &shadowDevices[i];
+
+    page = &device->pages[(reg >> SHADOW_PAGE_SHIFT) & (SHADOW_NUM_PAGES - 1)];
+    if (!*page && create) {
+        *page = calloc(1, sizeof(ShadowPage));
+        if (!*page)
+            LOG_WARN("%s: Out of memory, not shadowing %02x\n", __func__,
+                     deviceAddress << 1);
+    }
+    return *page;
+}
+
+static uint32_t
+RegisterAddress(const uint8_t *buffer, uint32_t addrLen)
+{
+    return (addrLen == 1) ? buffer[0] : ((buffer[0] << 8) | buffer[1]);
+}
+
+/* Records the data of a successful write starting at reg. Consecutive
+ * bytes go to the following registers, as with auto-increment writes. */
+static void
+ShadowWrite(int i2cDevice, uint32_t deviceAddress, uint32_t reg,
+            const uint8_t *data, uint32_t length)
+{
+    ShadowPage *page = NULL;
+    uint32_t i, offset;
+
+    pthread_mutex_lock(&shadowMutex);
+    for (i = 0; i < length; i++, reg++) {
+        offset = reg & (SHADOW_PAGE_SIZE - 1);
+        if (!page || !offset)
+            page = GetShadowPage(i2cDevice, deviceAddress, reg, NVMEDIA_TRUE);
+        if (!page)
+            break;
+        page->value[offset] = data[i];
+        page->flags[offset] |= SHADOW_VALID;
+    }
+    pthread_mutex_unlock(&shadowMutex);
+}
+
+/* Whether writing data at reg would leave every register as it is */
+static NvMediaBool
+ShadowUnchanged(int i2cDevice, uint32_t deviceAddress, uint32_t reg,
+                const uint8_t *data, uint32_t length)
+{
+    ShadowPage *page = NULL;
+    uint32_t i, offset;
+    NvMediaBool unchanged = NVMEDIA_FALSE;
+
+    if (!shadowEnabled || !length)
+        return NVMEDIA_FALSE;
+
+    pthread_mutex_lock(&shadowMutex);
+    for (i = 0; i < length; i++, reg++) {
+        offset = reg & (SHADOW_PAGE_SIZE - 1);
+        if (!page || !offset)
+            page = GetShadowPage(i2cDevice, deviceAddress, reg, NVMEDIA_FALSE);
+        if (!page ||
+            page->flags[offset] != SHADOW_VALID ||
+            page->value[offset] != data[i])
+            goto done;
+    }
+    unchanged = NVMEDIA_TRUE;
+    shadowWrites++;
+done:
+    pthread_mutex_unlock(&shadowMutex);
+    return unchanged;
+}
+
+/* Answers a one byte read from the shadow when the register was written */
+static NvMediaBool
+ShadowRead(int i2cDevice, uint32_t deviceAddress, uint32_t reg, uint8_t *data)
+{
+    ShadowPage *page;
+    uint32_t offset = reg & (SHADOW_PAGE_SIZE - 1);
+    NvMediaBool found = NVMEDIA_FALSE;
+
+    if (!shadowEnabled)
+        return NVMEDIA_FALSE;
+
+    pthread_mutex_lock(&shadowMutex);
+    page = GetShadowPage(i2cDevice, deviceAddress, reg, NVMEDIA_FALSE);
+    if (page && page->flags[offset] == SHADOW_VALID) {
+        *data = page->value[offset];
+        found = NVMEDIA_TRUE;
+        shadowReads++;
+    }
+    pthread_mutex_unlock(&shadowMutex);
+    return found;
+}
+
+/* A register which reads back other than written, like one with
+ * self-clearing bits, keeps what the device returned so that writing the
+ * old value again is not skipped */
+static void
+ShadowRefresh(int i2cDevice, uint32_t deviceAddress, uint32_t reg, uint8_t data)
+{
+    ShadowPage *page;
+    uint32_t offset = reg & (SHADOW_PAGE_SIZE - 1);
+
+    pthread_mutex_lock(&shadowMutex);
+    page = GetShadowPage(i2cDevice, deviceAddress, reg, NVMEDIA_FALSE);
+    if (page && (page->flags[offset] & SHADOW_VALID))
+        page->value[offset] = data;
+    pthread_mutex_unlock(&shadowMutex);
+}
+
+void
+I2cShadowEnable(NvMediaBool enable)
+{
+    pthread_mutex_lock(&shadowMutex);
+    shadowEnabled = enable;
+    pthread_mutex_unlock(&shadowMutex);
+    LOG_DBG("%s: Register shadow %s\n", __func__, enable ? "on" : "off");
+}
+
+void
+I2cShadowSetVolatile(int i2cDevice,
+                     uint32_t deviceAddress,
+                     uint32_t firstRegister,
+                     uint32_t lastRegister)
+{
+    ShadowPage *page = NULL;
+    uint32_t reg, offset;
+
+    pthread_mutex_lock(&shadowMutex);
+    for (reg = firstRegister; reg <= lastRegister && reg <= 0xFFFF; reg++) {
+        offset = reg & (SHADOW_PAGE_SIZE - 1);
+        if (!page || !offset)
+            page = GetShadowPage(i2cDevice, deviceAddress, reg, NVMEDIA_TRUE);
+        if (!page)
+            break;
+        page->flags[offset] |= SHADOW_VOLATILE;
+    }
+    pthread_mutex_unlock(&shadowMutex);
+    LOG_DBG("%s: %02x registers %04x-%04x are volatile\n", __func__,
+            deviceAddress << 1, firstRegister, lastRegister);
+}
+
+NvMediaBool
+I2cShadowIsVolatile(int i2cDevice,
+                    uint32_t deviceAddress,
+                    uint32_t reg)
+{
+    ShadowPage *page;
+    NvMediaBool isVolatile;
+
+    pthread_mutex_lock(&shadowMutex);
+    page = GetShadowPage(i2cDevice, deviceAddress, reg, NVMEDIA_FALSE);
+    isVolatile = (page && (page->flags[reg & (SHADOW_PAGE_SIZE - 1)] & SHADOW_VOLATILE)) ?
+                 NVMEDIA_TRUE : NVMEDIA_FALSE;
+    pthread_mutex_unlock(&shadowMutex);
+    return isVolatile;
+}
+
+void
+I2cShadowFini(void)
+{
+    uint32_t i, j;
+
+    pthread_mutex_lock(&shadowMutex);
+    LOG_DBG("%s: %u reads answered and %u writes skipped\n", __func__,
+            shadowReads, shadowWrites);
+    for (i = 0; i < numShadowDevices; i++) {
+        for (j = 0; j < SHADOW_NUM_PAGES; j++)
+            free(shadowDevices[i].pages[j]);
+    }
+    memset(shadowDevices, 0, sizeof(shadowDevices));
+    numShadowDevices = 0;
+    shadowEnabled = NVMEDIA_FALSE;
+    shadowReads = 0;
+    shadowWrites = 0;
+    pthread_mutex_unlock(&shadowMutex);
+}
+
+/* Reads the register of a POLL_REG_* command until its condition holds.
+ * Failed reads count as not ready, which covers devices that do not
+ * acknowledge until they are powered up. */
+static NvMediaStatus
+PollRegister(I2cHandle handle, Command *cmd, NvMediaBool checkI2cErr)
+{
+    PollCondition cond;
+    uint32_t addrLen = (cmd->commandType == POLL_REG_1) ? 1 : 2;
+    uint64_t start = 0, now = 0;
+    int err;
+
+    memcpy(&cond, &cmd->buffer[POLL_CONDITION_OFFSET], sizeof(cond));
+    GetTimeMicroSec(&start);
+
+    while (1) {
+        err = testutil_i2c_read_subaddr(handle,
+                                        cmd->deviceAddress,
+                                        cmd->buffer,
+                                        addrLen,
+                                        &cmd->buffer[addrLen],
+                                        sizeof(char));
+        GetTimeMicroSec(&now);
+        if (!err && (cmd->buffer[addrLen] & cond.mask) == cond.value) {
+            LOG_DBG("%s: %02x ready after %llu us\n", __func__,
+                    cmd->deviceAddress << 1, (unsigned long long)(now - start));
+            return NVMEDIA_STATUS_OK;
+        }
+        if (now - start >= cond.timeout)
+            break;
+        nvsleep(cond.interval);
+    }
+
+    if (addrLen == 1) {
+        LOG_ERR("%s: Timed out polling I2C %02x %02x (%02x & %02x != %02x)\n",
+                __func__, cmd->deviceAddress << 1, cmd->buffer[0],
+                cmd->buffer[1], cond.mask, cond.value);
+    } else {
+        LOG_ERR("%s: Timed out polling I2C %02x %02x%02x (%02x & %02x != %02x)\n",
+                __func__, cmd->deviceAddress << 1, cmd->buffer[0], cmd->buffer[1],
+                cmd->buffer[2], cond.mask, cond.value);
+    }
+    return checkI2cErr ? NVMEDIA_STATUS_TIMED_OUT : NVMEDIA_STATUS_OK;
+}
+
+static void
+ProfileCommand(Command *cmd, uint64_t start)
+{
+    switch (cmd->commandType) {
+        case(DELAY):
+            ProfilerRecord(PROFILER_CAT_DELAY, start, cmd->line,
+                           "line %u delay %u us", cmd->line, cmd->delay);
+            break;
+        case(POLL_REG_1):
+        case(POLL_REG_2):
+            ProfilerRecord(PROFILER_CAT_DELAY, start, cmd->line,
+                           "line %u poll %02x", cmd->line, cmd->deviceAddress << 1);
+            break;
+        case(WRITE_REG_1):
+        case(WRITE_REG_2):
+        case(READ_REG_1):
+        case(READ_REG_2):
+        case(READ_WRITE_REG_1):
+        case(READ_WRITE_REG_2):
+            ProfilerRecord(PROFILER_CAT_I2C, start, cmd->line,
+                           "dev %02x", cmd->deviceAddress << 1);
+            break;
+        default:
+            break;
+    }
+}
+
+Command *
+I2cNewCommand(I2cCommands *allCommands)
+{
+    Command **blocks;
+    Command *cmd;
+    uint32_t block = allCommands->numCommands >> I2C_COMMANDS_BLOCK_SHIFT;
+
+    if (block == allCommands->numBlocks) {
+        blocks = realloc(allCommands->blocks, (block + 1) * sizeof(Command *));
+        if (!blocks) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NULL;
+        }
+        allCommands->blocks = blocks;
+        blocks[block] = malloc(I2C_COMMANDS_BLOCK_SIZE * sizeof(Command));
+        if (!blocks[block]) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NULL;
+        }
+        allCommands->numBlocks++;
+    }
+
+    cmd = I2C_COMMAND(allCommands, allCommands->numCommands);
+    memset(cmd, 0, sizeof(Command));
+    return cmd;
+}
+
+void
+I2cFreeCommands(I2cCommands *allCommands)
+{
+    uint32_t i;
+
+    for (i = 0; i < allCommands->numBlocks; i++)
+        free(allCommands->blocks[i]);
+    free(allCommands->blocks);
+    memset(allCommands, 0, sizeof(I2cCommands));
+}
+
+NvMediaBool
+I2cFindLastWrite(I2cCommands *allCommands,
+                 uint32_t numCommands,
+                 uint32_t deviceAddress,
+                 uint32_t reg,
+                 uint8_t *value)
+{
+    Command *cmd;
+    uint32_t addrLen, first;
+
+    while (numCommands--) {
+        cmd = I2C_COMMAND(allCommands, numCommands);
+        if (cmd->commandType == WRITE_REG_1)
+            addrLen = 1;
+        else if (cmd->commandType == WRITE_REG_2)
+            addrLen = 2;
+        else
+            continue;
+
+        first = RegisterAddress(cmd->buffer, addrLen);
+        if (cmd->deviceAddress != deviceAddress ||
+            reg < first || reg >= first + cmd->dataLength)
+            continue;
+
+        *value = cmd->buffer[addrLen + reg - first];
+        return NVMEDIA_TRUE;
+    }
+
+    return NVMEDIA_FALSE;
+}
 
 NvMediaStatus
 I2cSetupGroups(I2cCommands *allCommands,
@@ -19,7 +433,7 @@ I2cSetupGroups(I2cCommands *allCommands,
     Command *command = NULL;
 
     for (i = 0; i < allCommands->numCommands; i++) {
-        command = &allCommands->commands[i];
+        command = I2C_COMMAND(allCommands, i);
         switch (command->processType) {
             case(GROUP_REG):
                 if (!groupRegisterActive && (command->commandType == SECTION_START)) {
@@ -51,21 +465,24 @@ I2cSetupGroups(I2cCommands *allCommands,
 }
 
 static NvMediaStatus
-ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
+ProcessCommands(I2cHandle handle, int i2cDevice, unsigned int startCmd, unsigned int stopCmd,
                 I2cCommands *allCommands, I2cOperation operation, ProcessType type)
 {
     Command *cmd = NULL;
     uint32_t  i = 0;
     NvMediaBool checkI2cErr = NVMEDIA_TRUE;
     uint8_t readWriteData = 0;
+    uint64_t start;
+    int err;
 
     for (i = startCmd; i < stopCmd; i++) {
-        cmd = &allCommands->commands[i];
+        cmd = I2C_COMMAND(allCommands, i);
 
         if(cmd->processType != type && operation == I2C_WRITE) {
             continue;
         }
 
+        start = ProfilerStart();
         switch (cmd->commandType) {
             case(I2C_DEVICE):
                 if (operation == I2C_WRITE) {
@@ -79,6 +496,7 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                     }
                     LOG_DBG("%s: Opening handle %u\n", __func__,
                             cmd->i2cDevice);
+                    i2cDevice = cmd->i2cDevice;
                 }
                 break;
             case(I2C_ERR):
@@ -90,13 +508,33 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                     nvsleep(cmd->delay);
                 }
                 break;
+            case(WRITE_DELAY):
+                if (operation == I2C_WRITE)
+                    SetWriteDelay(cmd->buffer[0], cmd->delay);
+                break;
+            case(VOLATILE_REG):
+                if (operation == I2C_WRITE)
+                    I2cShadowSetVolatile(i2cDevice, cmd->deviceAddress,
+                                         RegisterAddress(&cmd->buffer[0], 2),
+                                         RegisterAddress(&cmd->buffer[2], 2));
+                break;
+            case(POLL_REG_1):
+            case(POLL_REG_2):
+                if (operation == I2C_WRITE &&
+                    PollRegister(handle, cmd, checkI2cErr) != NVMEDIA_STATUS_OK)
+                    return NVMEDIA_STATUS_ERROR;
+                break;
             case(WRITE_REG_1):
                 if (operation == I2C_WRITE) {
-                    nvsleep(5);
-                    if (testutil_i2c_write_subaddr(handle,
+                    if (ShadowUnchanged(i2cDevice, cmd->deviceAddress, cmd->buffer[0],
+                                        &cmd->buffer[1], cmd->dataLength))
+                        break;
+                    WaitBeforeWrite(cmd->deviceAddress);
+                    err = testutil_i2c_write_subaddr(handle,
                        cmd->deviceAddress,
                        cmd->buffer,
-                       cmd->dataLength + 1) && checkI2cErr)
+                       cmd->dataLength + 1);
+                    if (err && checkI2cErr)
                     {
                         LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
                                 __func__, cmd->deviceAddress,
@@ -104,6 +542,9 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                                 cmd->buffer[1]);
                         return NVMEDIA_STATUS_ERROR;
                     }
+                    if (!err)
+                        ShadowWrite(i2cDevice, cmd->deviceAddress, cmd->buffer[0],
+                                    &cmd->buffer[1], cmd->dataLength);
 #ifndef DEBUG
                     break;
 #endif
@@ -111,19 +552,28 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 // Fall through to read if reading registers for dump
                 // or to read after a write (only in DEBUG mode)
             case(READ_REG_1):
+                // A read after a write (DEBUG only) checks the device itself
+                if (operation == I2C_READ &&
+                    ShadowRead(i2cDevice, cmd->deviceAddress, cmd->buffer[0],
+                               &cmd->buffer[1]))
+                    break;
                 // Reads one byte data ONLY
-                if (testutil_i2c_read_subaddr(handle,
+                err = testutil_i2c_read_subaddr(handle,
                             cmd->deviceAddress,
                             cmd->buffer,
                             sizeof(char),
                             &cmd->buffer[1],
-                            sizeof(char)) && checkI2cErr)
+                            sizeof(char));
+                if (err && checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to read I2C %02x %02x",
                             __func__, cmd->deviceAddress,
                             cmd->buffer[0]);
                     return NVMEDIA_STATUS_ERROR;
                 }
+                if (!err)
+                    ShadowRefresh(i2cDevice, cmd->deviceAddress, cmd->buffer[0],
+                                  cmd->buffer[1]);
 
                 LOG_INFO("%s: I2C Read: %02x %02x %02x", __func__,
                         cmd->deviceAddress,
@@ -133,11 +583,16 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 break;
             case(WRITE_REG_2):
                 if (operation == I2C_WRITE) {
-                    nvsleep(5);
-                    if (testutil_i2c_write_subaddr(handle,
+                    if (ShadowUnchanged(i2cDevice, cmd->deviceAddress,
+                                        RegisterAddress(cmd->buffer, 2),
+                                        &cmd->buffer[2], cmd->dataLength))
+                        break;
+                    WaitBeforeWrite(cmd->deviceAddress);
+                    err = testutil_i2c_write_subaddr(handle,
                                 cmd->deviceAddress,
                                 cmd->buffer,
-                                cmd->dataLength + 2) && checkI2cErr)
+                                cmd->dataLength + 2);
+                    if (err && checkI2cErr)
                     {
                         LOG_ERR("%s: Failed to write to I2C %02x %02x%02x %02x",
                                 __func__, cmd->deviceAddress,
@@ -146,6 +601,10 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                                 cmd->buffer[2]);
                         return NVMEDIA_STATUS_ERROR;
                     }
+                    if (!err)
+                        ShadowWrite(i2cDevice, cmd->deviceAddress,
+                                    RegisterAddress(cmd->buffer, 2),
+                                    &cmd->buffer[2], cmd->dataLength);
 #ifndef DEBUG
                     break;
 #endif
@@ -153,13 +612,18 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 // Fall through to read if reading registers for dump
                 // or to read after a write (only in DEBUG mode)
             case(READ_REG_2):
+                if (operation == I2C_READ &&
+                    ShadowRead(i2cDevice, cmd->deviceAddress,
+                               RegisterAddress(cmd->buffer, 2), &cmd->buffer[2]))
+                    break;
                 // Reads one byte data ONLY
-                if (testutil_i2c_read_subaddr(handle,
+                err = testutil_i2c_read_subaddr(handle,
                             cmd->deviceAddress,
                             cmd->buffer,
                             sizeof(char)*2,
                             &cmd->buffer[2],
-                            sizeof(char)) && checkI2cErr)
+                            sizeof(char));
+                if (err && checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to read I2C %02x %02x%02x",
                             __func__, cmd->deviceAddress,
@@ -167,6 +631,9 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                             cmd->buffer[1]);
                         return NVMEDIA_STATUS_ERROR;
                 }
+                if (!err)
+                    ShadowRefresh(i2cDevice, cmd->deviceAddress,
+                                  RegisterAddress(cmd->buffer, 2), cmd->buffer[2]);
 
                 LOG_INFO("%s: I2C Read: %02x %02x%02x %02x", __func__,
                         cmd->deviceAddress,
@@ -195,11 +662,12 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                         readWriteData);
 #endif
                 cmd->buffer[2] = readWriteData;
-                nvsleep(5);
-                if (testutil_i2c_write_subaddr(handle,
+                WaitBeforeWrite(cmd->deviceAddress);
+                err = testutil_i2c_write_subaddr(handle,
                    cmd->deviceAddress,
                    &cmd->buffer[1],
-                   cmd->dataLength + 1) && checkI2cErr)
+                   cmd->dataLength + 1);
+                if (err && checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
                             __func__, cmd->deviceAddress,
@@ -207,6 +675,9 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                             cmd->buffer[2]);
                     return NVMEDIA_STATUS_ERROR;
                 }
+                if (!err)
+                    ShadowWrite(i2cDevice, cmd->deviceAddress, cmd->buffer[1],
+                                &cmd->buffer[2], cmd->dataLength);
                 break;
             case(READ_WRITE_REG_2):
                 // Read-writes one byte data ONLY
@@ -231,11 +702,12 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                         readWriteData);
 #endif
                 cmd->buffer[4] = readWriteData;
-                nvsleep(5);
-                if (testutil_i2c_write_subaddr(handle,
+                WaitBeforeWrite(cmd->deviceAddress);
+                err = testutil_i2c_write_subaddr(handle,
                             cmd->deviceAddress,
                             &cmd->buffer[2],
-                            cmd->dataLength + 2) && checkI2cErr)
+                            cmd->dataLength + 2);
+                if (err && checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to write to I2C %02x %02x%02x %02x",
                             __func__, cmd->deviceAddress,
@@ -244,6 +716,10 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                             cmd->buffer[4]);
                     return NVMEDIA_STATUS_ERROR;
                 }
+                if (!err)
+                    ShadowWrite(i2cDevice, cmd->deviceAddress,
+                                RegisterAddress(&cmd->buffer[2], 2),
+                                &cmd->buffer[4], cmd->dataLength);
                 break;
             case(SECTION_START):
             case(SECTION_STOP):
@@ -253,6 +729,8 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 LOG_ERR("%s: Invalid command type encountered\n", __func__);
                 return NVMEDIA_STATUS_ERROR;
         }
+        if (start)
+            ProfileCommand(cmd, start);
     }
 
     return NVMEDIA_STATUS_OK;
@@ -263,6 +741,7 @@ I2cProcessInitialRegisters(I2cCommands *allCommands, int i2cDevice)
 {
     I2cHandle handle = NULL;
     NvMediaStatus status;
+    uint64_t start;
 
     testutil_i2c_open(i2cDevice, &handle);
     if (!handle) {
@@ -271,8 +750,10 @@ I2cProcessInitialRegisters(I2cCommands *allCommands, int i2cDevice)
         return NVMEDIA_STATUS_ERROR;
     }
 
-    status = ProcessCommands(handle, 0, allCommands->numCommands, allCommands,
+    start = ProfilerStart();
+    status = ProcessCommands(handle, i2cDevice, 0, allCommands->numCommands, allCommands,
                              I2C_WRITE, PRESET_REG);
+    ProfilerRecord(PROFILER_CAT_SECTION, start, 0, "preset registers");
     if (status != NVMEDIA_STATUS_OK) {
         goto done;
     }
@@ -285,13 +766,18 @@ done:
 }
 
 NvMediaStatus
-I2cProcessGroup(I2cHandle handle, I2cCommands *allCommands, GroupData *grpData)
+I2cProcessGroup(I2cHandle handle, int i2cDevice, I2cCommands *allCommands, GroupData *grpData)
 {
     NvMediaStatus status;
+    uint64_t start;
 
-    status = ProcessCommands(handle, grpData->firstCommand,
+    start = ProfilerStart();
+    status = ProcessCommands(handle, i2cDevice, grpData->firstCommand,
                              (grpData->firstCommand + grpData->numCommands),
                              allCommands, I2C_WRITE, GROUP_REG);
+    ProfilerRecord(PROFILER_CAT_SECTION, start,
+                   I2C_COMMAND(allCommands, grpData->firstCommand)->line, "frame %d registers",
+                   I2C_COMMAND(allCommands, grpData->firstCommand)->triggerFrame);
     if(status != NVMEDIA_STATUS_OK) {
         LOG_ERR("%s: Failed to write group registers\n", __func__);
     }
@@ -305,6 +791,7 @@ I2cProcessCommands(I2cCommands *allCommands, I2cOperation operation,
 {
     I2cHandle handle = NULL;
     NvMediaStatus status;
+    uint64_t start;
 
     testutil_i2c_open(i2cDevice, &handle);
     if(!handle) {
@@ -313,8 +800,11 @@ I2cProcessCommands(I2cCommands *allCommands, I2cOperation operation,
         return NVMEDIA_STATUS_ERROR;
     }
 
-    status = ProcessCommands(handle, 0, allCommands->numCommands,
+    start = ProfilerStart();
+    status = ProcessCommands(handle, i2cDevice, 0, allCommands->numCommands,
                              allCommands, operation, DEFAULT);
+    ProfilerRecord(PROFILER_CAT_SECTION, start, 0, "%s",
+                   (operation == I2C_WRITE) ? "default registers" : "register dump");
 
     testutil_i2c_close(handle);
 
@@ -332,11 +822,9 @@ I2cSetupRegister(I2cCommands *allCommands,
     Command *cmd = NULL;
     uint8_t *data = NULL;
 
-    if (allCommands->numCommands >= MAX_NUM_COMMANDS) {
-        LOG_ERR("%s: Maximum number of commands reached\n");
+    cmd = I2cNewCommand(allCommands);
+    if (!cmd)
         return NULL;
-    }
-    cmd = &(allCommands->commands[allCommands->numCommands]);
 
     switch (type) {
         case(WRITE_REG_1):
@@ -370,6 +858,10 @@ I2cSetupRegister(I2cCommands *allCommands,
         case(I2C_ERR):
         case(SECTION_START):
         case(SECTION_STOP):
+        case(WRITE_DELAY):
+        case(POLL_REG_1):
+        case(POLL_REG_2):
+        case(VOLATILE_REG):
             LOG_ERR("%s: Unsupported command type used. \n", __func__);
             return NULL;
         default:
@@ -383,10 +875,74 @@ I2cSetupRegister(I2cCommands *allCommands,
     cmd->commandType = type;
     cmd->processType = DEFAULT;
     cmd->dataLength = dataRegLen;
+    cmd->line = 0;
     allCommands->numCommands++;
     return data;
 }
 
+/* Checks whether next continues prev at the following register address */
+static NvMediaBool
+IsContiguousWrite(Command *prev, Command *next)
+{
+    uint32_t addrLen, prevAddr, nextAddr;
+
+    if (next->commandType != prev->commandType ||
+        next->processType != prev->processType ||
+        next->deviceAddress != prev->deviceAddress)
+        return NVMEDIA_FALSE;
+
+    if (prev->commandType == WRITE_REG_1) {
+        addrLen = 1;
+        prevAddr = prev->buffer[0];
+        nextAddr = next->buffer[0];
+    } else if (prev->commandType == WRITE_REG_2) {
+        addrLen = 2;
+        prevAddr = (prev->buffer[0] << 8) | prev->buffer[1];
+        nextAddr = (next->buffer[0] << 8) | next->buffer[1];
+    } else {
+        return NVMEDIA_FALSE;
+    }
+
+    if (!next->dataLength ||
+        prevAddr + prev->dataLength != nextAddr ||
+        addrLen + prev->dataLength + next->dataLength > MAX_BUF_LENGTH)
+        return NVMEDIA_FALSE;
+
+    return NVMEDIA_TRUE;
+}
+
+NvMediaStatus
+I2cCoalesceWrites(I2cCommands *allCommands)
+{
+    Command *prev = NULL, *cmd;
+    uint32_t i, numCommands = 0, addrLen;
+
+    for (i = 0; i < allCommands->numCommands; i++) {
+        cmd = I2C_COMMAND(allCommands, i);
+
+        // Anything but a write, delays and section markers included,
+        // ends a burst since prev is then not a write
+        if (prev && IsContiguousWrite(prev, cmd)) {
+            addrLen = (prev->commandType == WRITE_REG_1) ? 1 : 2;
+            memcpy(&prev->buffer[addrLen + prev->dataLength],
+                   &cmd->buffer[addrLen],
+                   cmd->dataLength);
+            prev->dataLength += cmd->dataLength;
+            continue;
+        }
+
+        if (numCommands != i)
+            *I2C_COMMAND(allCommands, numCommands) = *cmd;
+        prev = I2C_COMMAND(allCommands, numCommands);
+        numCommands++;
+    }
+
+    LOG_DBG("%s: Merged %u commands into %u\n", __func__,
+            allCommands->numCommands, numCommands);
+    allCommands->numCommands = numCommands;
+    return NVMEDIA_STATUS_OK;
+}
+
 uint32_t
 I2cGetNumCommands(I2cCommands *allCommands)
 {
@@ -397,8 +953,9 @@ void
 I2cSetNumCommands(I2cCommands *allCommands,
     uint32_t setNumCommands)
 {
-    if (setNumCommands >= MAX_NUM_COMMANDS) {
-        LOG_ERR("%s: Maximum number of commands reached\n");
+    if (setNumCommands > allCommands->numBlocks * I2C_COMMANDS_BLOCK_SIZE) {
+        LOG_ERR("%s: Only %u commands allocated\n", __func__,
+                allCommands->numBlocks * I2C_COMMANDS_BLOCK_SIZE);
         return;
     }
 
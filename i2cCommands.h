@@ -22,8 +22,14 @@
 #include "log_utils.h"
 
 #define MAX_BUF_LENGTH          34   // to handle 32 byte data + 2 bytes sub address
-#define MAX_NUM_COMMANDS        10000
+#define I2C_COMMANDS_BLOCK_SHIFT 8   // commands are allocated in blocks of 256
+#define I2C_COMMANDS_BLOCK_SIZE (1 << I2C_COMMANDS_BLOCK_SHIFT)
 #define MAX_NUM_GROUPS          10
+#define DEFAULT_WRITE_DELAY     5    // us before each register write, unless set per device
+#define MAX_NUM_WRITE_DELAYS    16
+#define DEFAULT_POLL_INTERVAL   1000 // us between register polls, unless set in the script
+#define POLL_CONDITION_OFFSET   4    // buffer offset of the PollCondition of a poll command
+#define MAX_NUM_SHADOW_DEVICES  16
 
 typedef enum {
     WRITE_REG_1 = 0,            // 1 byte register address to write
@@ -37,6 +43,10 @@ typedef enum {
     SECTION_STOP,               // Indicate the end of a group/preset registers section
     READ_WRITE_REG_1,           // 1 byte registers to read and write
     READ_WRITE_REG_2,           // 2 byte registers to read and write
+    WRITE_DELAY,                // Delay before each write to one device
+    POLL_REG_1,                 // Poll 1 byte register address until ready
+    POLL_REG_2,                 // Poll 2 byte register address until ready
+    VOLATILE_REG,               // Registers never served from or compared with the shadow
 } CommandType;
 
 typedef enum {
@@ -62,23 +72,59 @@ typedef struct {
         NvMediaBool             i2cErr;
     };
     uint8_t                     dataLength;   // support multiple bytes data for i2c write
+    uint32_t                    line;         // script line, 0 if not from a script
 } Command;
 
+/* Stored in the command buffer after the register address and the byte
+ * read back; polling stops once (data & mask) == value */
+typedef struct {
+    uint8_t                     mask;
+    uint8_t                     value;
+    uint32_t                    timeout;      // us
+    uint32_t                    interval;     // us
+} PollCondition;
+
 typedef struct {
     uint32_t                    firstCommand;
     uint32_t                    numCommands;
 } GroupData;
 
+/* Commands live in fixed size blocks which are never moved or freed until
+ * I2cFreeCommands, so pointers into a command, like the data pointer of
+ * I2cSetupRegister, stay valid while more commands are added. Lowering
+ * numCommands keeps the blocks for reuse. A zeroed I2cCommands is empty. */
 typedef struct {
-    Command                     commands[MAX_NUM_COMMANDS];
+    Command                   **blocks;
+    uint32_t                    numBlocks;
     uint32_t                    numCommands;
 } I2cCommands;
 
+#define I2C_COMMAND(allCommands, i) \
+    (&(allCommands)->blocks[(i) >> I2C_COMMANDS_BLOCK_SHIFT][(i) & (I2C_COMMANDS_BLOCK_SIZE - 1)])
+
 typedef struct {
     GroupData                   groups[MAX_NUM_GROUPS];
     uint32_t                    numGroups;
 } I2cGroups;
 
+/* Returns the zeroed command after the last one, allocating a block if
+ * needed. It becomes part of the list once numCommands is incremented. */
+Command *
+I2cNewCommand(I2cCommands *allCommands);
+
+void
+I2cFreeCommands(I2cCommands *allCommands);
+
+/* Finds the value last written to reg of deviceAddress by the first
+ * numCommands commands. Data written past the register address of a write
+ * command goes to the following registers. */
+NvMediaBool
+I2cFindLastWrite(I2cCommands *allCommands,
+                 uint32_t numCommands,
+                 uint32_t deviceAddress,
+                 uint32_t reg,
+                 uint8_t *value);
+
 NvMediaStatus
 I2cSetupGroups(I2cCommands *allCommands,
                I2cGroups   *allGroups);
@@ -98,6 +144,7 @@ I2cSetupRegister(I2cCommands *allCommands,
 
 NvMediaStatus
 I2cProcessGroup(I2cHandle handle,
+                int i2cDevice,
                 I2cCommands *allCommands,
                 GroupData *grpData);
 
@@ -105,9 +152,40 @@ NvMediaStatus
 I2cProcessInitialRegisters(I2cCommands *allCommands,
                            int i2cDevice);
 
+/* Merges writes to consecutive registers of a device into auto-increment
+ * burst writes. The register dump reads one register per command, so this
+ * is only for scripts which are written. */
+NvMediaStatus
+I2cCoalesceWrites(I2cCommands *allCommands);
+
 uint32_t
 I2cGetNumCommands(I2cCommands *allCommands);
 
+/* The register shadow keeps the last value written to each register of
+ * each device. Once enabled, reads of registers with a written value are
+ * answered from it and writes which would not change any register are
+ * skipped. Registers which change on their own or act on every write
+ * (status, self-clearing and FIFO port registers) must be marked volatile.
+ * It is off while the sensors are brought up, where every write counts. */
+void
+I2cShadowEnable(NvMediaBool enable);
+
+void
+I2cShadowSetVolatile(int i2cDevice,
+                     uint32_t deviceAddress,
+                     uint32_t firstRegister,
+                     uint32_t lastRegister);
+
+/* Whether writes to reg always count, as marked by I2cShadowSetVolatile.
+ * Holds whether or not the shadow is enabled. */
+NvMediaBool
+I2cShadowIsVolatile(int i2cDevice,
+                    uint32_t deviceAddress,
+                    uint32_t reg);
+
+void
+I2cShadowFini(void);
+
 void
 I2cSetNumCommands(I2cCommands *allCommands,
                   uint32_t setNumCommands);
@@ -0,0 +1,61 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+
+#include "image_time.h"
+#include "log_utils.h"
+
+/* The image is handed from stage to stage through the queues, so only one
+ * thread uses its context at a time. */
+
+NvMediaStatus
+ImageContextCreate(NvMediaImage *image,
+                   NvQueue *queue)
+{
+    ImageContext *ctx = calloc(1, sizeof(ImageContext));
+
+    if (!ctx) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    ctx->queue = queue;
+    image->tag = ctx;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+ImageContextDestroy(NvMediaImage *image)
+{
+    free(image->tag);
+    image->tag = NULL;
+}
+
+void
+ImageTimeSet(NvMediaImage *image,
+             uint64_t timeUs)
+{
+    ((ImageContext *)image->tag)->captureTimeUs = timeUs;
+}
+
+void
+ImageTimeCopy(NvMediaImage *dst,
+              NvMediaImage *src)
+{
+    ImageTimeSet(dst, ((ImageContext *)src->tag)->captureTimeUs);
+}
+
+NvMediaStatus
+ImageTimeGet(NvMediaImage *image,
+             uint64_t *timeUs)
+{
+    *timeUs = ((ImageContext *)image->tag)->captureTimeUs;
+    return *timeUs ? NVMEDIA_STATUS_OK : NVMEDIA_STATUS_ERROR;
+}
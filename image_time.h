@@ -0,0 +1,64 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __IMAGE_TIME_H__
+#define __IMAGE_TIME_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "nvmedia_image.h"
+#include "thread_utils.h"
+
+/* Context of an image buffer, hung off its tag: the pool queue the image
+ * goes back to and the capture time of the frame it holds. The time moves
+ * with the buffer through the stage queues and can never be paired with
+ * another frame. A stage that writes a frame into another image copies the
+ * time along with it. */
+typedef struct {
+    NvQueue                    *queue;          // pool of the image
+    uint64_t                    captureTimeUs;  // 0: not set
+} ImageContext;
+
+/* Pool queue of an image set up by ImageContextCreate */
+#define IMAGE_QUEUE(image)      (((ImageContext *)(image)->tag)->queue)
+
+/* Allocates the context of image, which returns to queue */
+NvMediaStatus
+ImageContextCreate(NvMediaImage *image,
+                   NvQueue *queue);
+
+/* Frees the context of image, before the image itself is destroyed */
+void
+ImageContextDestroy(NvMediaImage *image);
+
+/* Sets the capture time of image, in us of GetTimeMicroSec */
+void
+ImageTimeSet(NvMediaImage *image,
+             uint64_t timeUs);
+
+/* Gives dst the capture time of src */
+void
+ImageTimeCopy(NvMediaImage *dst,
+              NvMediaImage *src);
+
+/* Fails if no capture time was set for image */
+NvMediaStatus
+ImageTimeGet(NvMediaImage *image,
+             uint64_t *timeUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __IMAGE_TIME_H__
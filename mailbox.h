@@ -0,0 +1,66 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Control messages delivered to the stage threads */
+enum {
+    MAILBOX_MSG_RECORD = 0,         /* save: arg 1 starts, 0 stops recording */
+    MAILBOX_MSG_SELECT_SETTINGS,    /* runtime settings: arg is the set to apply */
+    MAILBOX_MSG_TRIGGER,            /* save: arg is the TriggerSource of an event */
+    MAILBOX_MAX_MESSAGES,
+};
+
+#define MAILBOX_BIT(msg)                (1u << (msg))
+
+/* Single consumer mailbox. Posting the same message again before it is
+ * taken coalesces into one delivery carrying the latest argument. Neither
+ * side ever blocks, so a stage can check it once per frame. */
+typedef struct {
+    volatile uint32_t           pending;
+    volatile uint32_t           args[MAILBOX_MAX_MESSAGES];
+} NvMailbox;
+
+static inline void
+MailboxPost(NvMailbox *mailbox,
+            uint32_t message,
+            uint32_t arg)
+{
+    __atomic_store_n(&mailbox->args[message], arg, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&mailbox->pending, MAILBOX_BIT(message), __ATOMIC_RELEASE);
+}
+
+/* Returns the MAILBOX_BIT set of pending messages and clears them */
+static inline uint32_t
+MailboxTake(NvMailbox *mailbox)
+{
+    if (!__atomic_load_n(&mailbox->pending, __ATOMIC_RELAXED))
+        return 0;
+    return __atomic_exchange_n(&mailbox->pending, 0, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t
+MailboxArg(NvMailbox *mailbox,
+           uint32_t message)
+{
+    return __atomic_load_n(&mailbox->args[message], __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MAILBOX_H__
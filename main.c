@@ -7,7 +7,10 @@
  * license agreement from NVIDIA CORPORATION is strictly prohibited.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include "main.h"
 #include "check_version.h"
@@ -17,11 +20,18 @@
 #include "display.h"
 #include "grp_activate.h"
 #include "capture_status.h"
+#include "control.h"
+#include "event_loop.h"
+#include "shutdown.h"
+#include "startup.h"
+#include "profiler.h"
+
+#define MAIN_STATS_PERIOD_MS    10000
 
 /* Quit flag. Out of context structure for sig handling */
 static volatile NvMediaBool *quit_flag;
-static char *cmd_listener;
 
+#ifdef NVMEDIA_QNX
 static void
 SigHandler(int signum)
 {
@@ -33,6 +43,7 @@ SigHandler(int signum)
     signal(SIGHUP, SIG_IGN);
 
     *quit_flag = NVMEDIA_TRUE;
+    EventLoopWakeup();
 
     signal(SIGINT, SIG_DFL);
     signal(SIGTERM, SIG_DFL);
@@ -57,35 +68,99 @@ SigSetup(void)
     sigaction(SIGSTOP, &action, NULL);
     sigaction(SIGHUP, &action, NULL);
 }
-static int
-ExecuteNextCommand(NvMainContext *ctx) {
-    char input[256] = { 0 };
+#endif
 
-    if (!fgets(input, 256, stdin)) {
-        if(*quit_flag != NVMEDIA_TRUE) {
-            LOG_ERR("%s: Failed to read command\n", __func__);
-        }
-    }
+/* Terminal input. stdin is read without stdio buffering, so that every
+ * line the loop is woken for is run at once and a partial line never
+ * blocks the loop. */
+typedef struct {
+    NvMainContext              *mainCtx;
+    uint32_t                    length;
+    char                        buffer[CONTROL_MAX_REQUEST];
+} MainInput;
+
+static void
+ExecuteCommand(NvMainContext *mainCtx,
+               const char *input)
+{
+    char response[CONTROL_MAX_RESPONSE];
+
+    /* Terminal input uses the control socket protocol */
+    if (strspn(input, " \t\r") == strlen(input))
+        return;
 
-    /* Remove new line character */
-    if (input[strlen(input) - 1] == '\n')
-        input[strlen(input) - 1] = '\0';
+    ControlExecute(mainCtx, input, response, sizeof(response));
+    LOG_MSG("%s\n", response);
+}
+
+static NvMediaStatus
+ExecuteNextCommand(int fd,
+                   void *data)
+{
+    MainInput *input = (MainInput *)data;
+    char *line, *end;
+    ssize_t bytes;
+
+    bytes = read(fd, input->buffer + input->length,
+                 sizeof(input->buffer) - 1 - input->length);
+    if (bytes < 0)
+        return (errno == EAGAIN || errno == EINTR) ? NVMEDIA_STATUS_OK : NVMEDIA_STATUS_ERROR;
+    if (bytes == 0) {
+        /* stdin closed (e.g. running headless); run what is left and stop
+         * watching it */
+        input->buffer[input->length] = '\0';
+        ExecuteCommand(input->mainCtx, input->buffer);
+        input->length = 0;
+        LOG_DBG("%s: No more commands on stdin\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    input->length += bytes;
+    input->buffer[input->length] = '\0';
+
+    line = input->buffer;
+    while ((end = strchr(line, '\n'))) {
+        *end = '\0';
+        ExecuteCommand(input->mainCtx, line);
+        line = end + 1;
+    }
 
-    if (!strcasecmp(input, "q") || !strcasecmp(input, "quit")) {
-        *quit_flag = NVMEDIA_TRUE;
-        return 0;
-    } else if(input[0] != '\0') {
-        sprintf(cmd_listener, input);
+    /* Keep the partial line; a line that fills the buffer is not a command */
+    input->length -= line - input->buffer;
+    memmove(input->buffer, line, input->length);
+    if (input->length == sizeof(input->buffer) - 1) {
+        LOG_WARN("%s: Dropping an oversized command\n", __func__);
+        input->length = 0;
     }
 
-    return 0;
+    return NVMEDIA_STATUS_OK;
 }
+
+static void
+PrintStats(void *data)
+{
+    NvMainContext *mainCtx = (NvMainContext *)data;
+    NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    static uint32_t lastFrame[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    uint32_t i, frame;
+
+    for (i = 0; i < mainCtx->testArgs->numVirtualChannels; i++) {
+        frame = captureCtx->threadCtx[i].currentFrame;
+        LOG_INFO("%s: VC:%d frames=%u fps=%.1f\n", __func__, i, frame,
+                 (frame - lastFrame[i]) * 1000.0 / MAIN_STATS_PERIOD_MS);
+        lastFrame[i] = frame;
+    }
+}
+
 int main(int argc,
          char *argv[])
 {
     TestArgs allArgs;
     NvMainContext mainCtx;
+    NvEventLoop *eventLoop = NULL;
+    MainInput input;
     sigset_t set;
+    int stdinFlags;
+    uint64_t startupStart;
     int status;
 
     /* prepare an empty signal set */
@@ -114,10 +189,10 @@ int main(int argc,
 
     memset(&allArgs, 0, sizeof(TestArgs));
     memset(&mainCtx, 0 , sizeof(NvMainContext));
+    memset(&input, 0, sizeof(input));
+    input.mainCtx = &mainCtx;
+    stdinFlags = fcntl(STDIN_FILENO, F_GETFL);
 
-    mainCtx.cmd = malloc(256);
-    strcpy(mainCtx.cmd, "");
-    
     if (CheckModulesVersion() != NVMEDIA_STATUS_OK) {
         return -1;
     }
@@ -126,48 +201,34 @@ int main(int argc,
         return -1;
     }
 
+    if (allArgs.profileTrace.isUsed &&
+        ProfilerInit(allArgs.profileTrace.stringValue) != NVMEDIA_STATUS_OK)
+        LOG_WARN("%s: Profiling is disabled\n", __func__);
+
     quit_flag = &mainCtx.quit;
-    cmd_listener = mainCtx.cmd;
+#ifdef NVMEDIA_QNX
     SigSetup();
+#endif
 
-    /* Initialize context */
-    mainCtx.testArgs = &allArgs;
-
-    /* Initialize all the components */
-    if (CaptureInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Capture\n", __func__);
-        goto done;
-    }
-
-    if (RuntimeSettingsInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize RuntimeSettings\n", __func__);
-        goto done;
-    }
-
-    if (SaveInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Save\n", __func__);
-        goto done;
-    }
-
-    if (CompositeInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Composite\n", __func__);
-        goto done;
-    }
+    if (ShutdownInit(&mainCtx) != NVMEDIA_STATUS_OK)
+        return -1;
 
-    if (DisplayInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Display\n", __func__);
-        goto done;
+    if (EventLoopCreate(&mainCtx, &eventLoop) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create event loop\n", __func__);
+        ShutdownFini();
+        return -1;
     }
 
-    if (GrpActivationInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize GrpActivation\n", __func__);
-        goto done;
-    }
+    /* Initialize context */
+    mainCtx.testArgs = &allArgs;
 
-    if (CaptureStatusInit(&mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize CaptureStatus\n", __func__);
+    /* Initialize all the components, concurrently where they are independent */
+    startupStart = ProfilerStart();
+    if (StartupInitComponents(&mainCtx) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to Initialize components\n", __func__);
         goto done;
     }
+    ProfilerRecord(PROFILER_CAT_INIT, startupStart, 0, "all components");
 
     /* Call Proc for each component */
     if (CaptureProc(&mainCtx) != NVMEDIA_STATUS_OK) {
@@ -205,20 +266,39 @@ int main(int argc,
         goto done;
     }
 
+    if (ControlProc(&mainCtx, eventLoop) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: ControlProc Failed\n", __func__);
+        goto done;
+    }
+
+#ifdef NVMEDIA_QNX
     /* unblock the signals, they will be handled only by the main thread */
     status = pthread_sigmask(SIG_UNBLOCK, &set, NULL);
     if (0 != status) {
         LOG_ERR("%s: Failed to unblock signals\n", __func__);
         goto done;
     }
+#endif
+
+    /* Signals stay blocked on Linux; the event loop reads them from a signalfd */
+    if (stdinFlags < 0 ||
+        fcntl(STDIN_FILENO, F_SETFL, stdinFlags | O_NONBLOCK) < 0 ||
+        EventLoopAddSource(eventLoop, STDIN_FILENO, &ExecuteNextCommand, &input) != NVMEDIA_STATUS_OK)
+        LOG_WARN("%s: stdin cannot be watched, terminal commands are disabled\n", __func__);
 
-    while (!mainCtx.quit) {
-        if (!allArgs.frames.isUsed) {
-            ExecuteNextCommand(&mainCtx);
-        }
+    if (EventLoopAddTimer(eventLoop, MAIN_STATS_PERIOD_MS, &PrintStats, &mainCtx) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to set up stats timer\n", __func__);
+        goto done;
     }
 
+    if (EventLoopRun(eventLoop) != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: Event loop failed\n", __func__);
+
 done:
+    /* Also covers a failed Init/Proc after some stages already started */
+    ShutdownRequest(__func__);
+
+    ControlFini(&mainCtx);
     CaptureStatusFini(&mainCtx);
     GrpActivationFini(&mainCtx);
     DisplayFini(&mainCtx);
@@ -226,5 +306,11 @@ done:
     SaveFini(&mainCtx);
     RuntimeSettingsFini(&mainCtx);
     CaptureFini(&mainCtx);
+    EventLoopDestroy(eventLoop);
+    /* The terminal is shared with the shell */
+    if (stdinFlags >= 0)
+        fcntl(STDIN_FILENO, F_SETFL, stdinFlags);
+    ShutdownFini();
+    ProfilerFini();
     return 0;
 }
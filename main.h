@@ -20,6 +20,7 @@ enum {
     GRP_ACTIVATION_ELEMENT,
     CAPTURE_STATUS_ELEMENT,
     RUNTIME_SETTINGS_ELEMENT,
+    CONTROL_ELEMENT,
     MAX_NUM_ELEMENTS,
 };
 
@@ -27,8 +28,6 @@ typedef struct {
     void                        *ctxs[MAX_NUM_ELEMENTS];
     TestArgs                    *testArgs;
     volatile NvMediaBool         quit;
-    char                        *cmd;
-
 } NvMainContext;
 
 #endif
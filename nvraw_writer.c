@@ -0,0 +1,198 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvraw_writer.h"
+#include "log_utils.h"
+
+NvMediaStatus
+NvRawWriterInit(NvRawWriter *writer,
+                uint32_t imagesPerFile)
+{
+    memset(writer, 0, sizeof(NvRawWriter));
+    writer->imagesPerFile = imagesPerFile ? imagesPerFile : 1;
+
+    writer->header = NvRawFileHeaderChunkCreate();
+    writer->capture = NvRawFileCaptureChunkCreate();
+    writer->cameraState = NvRawFileCameraStateChunkCreate();
+    writer->sensorInfo = NvRawFileSensorInfoChunkCreate();
+    writer->hdr = NvRawFileHDRChunkCreate();
+    if (!writer->header || !writer->capture || !writer->cameraState ||
+        !writer->sensorInfo || !writer->hdr) {
+        LOG_ERR("%s: Failed to create nvraw chunks\n", __func__);
+        writer->valid = NVMEDIA_TRUE;
+        NvRawWriterDestroy(writer);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    writer->valid = NVMEDIA_TRUE;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+NvRawWriterDestroy(NvRawWriter *writer)
+{
+    if (!writer->valid)
+        return;
+
+    NvRawWriterClose(writer);
+
+    NvRawFileHeaderChunkDelete(writer->header);
+    NvRawFileCaptureChunkDelete(writer->capture);
+    NvRawFileCameraStateChunkDelete(writer->cameraState);
+    NvRawFileSensorInfoChunkDelete(writer->sensorInfo);
+    NvRawFileHDRChunkDelete(writer->hdr);
+    NvRawFileDataChunkDelete(writer->data);
+    free(writer->buff);
+
+    memset(writer, 0, sizeof(NvRawWriter));
+}
+
+NvMediaStatus
+NvRawWriterBegin(NvRawWriter *writer,
+                 const char *fileName,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t dataSize)
+{
+    /* The header describes every image of the file */
+    if (writer->file &&
+        (writer->numImages >= writer->imagesPerFile ||
+         writer->width != width || writer->height != height ||
+         writer->dataSize != dataSize))
+        NvRawWriterClose(writer);
+
+    if (!writer->data || writer->dataSize != dataSize) {
+        NvRawFileDataChunkDelete(writer->data);
+        writer->data = NvRawFileDataChunkCreate(dataSize, false);
+        if (!writer->data) {
+            LOG_ERR("%s: NvRawFileDataChunkCreate failed\n", __func__);
+            writer->dataSize = 0;
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        writer->dataSize = dataSize;
+    }
+
+    if (!writer->file) {
+        writer->file = fopen(fileName, "wb");
+        if (!writer->file) {
+            LOG_ERR("%s: Failed to open file %s\n", __func__, fileName);
+            return NVMEDIA_STATUS_ERROR;
+        }
+        writer->width = width;
+        writer->height = height;
+        writer->numImages = 0;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+NvRawWriterGetBits(NvRawWriter *writer,
+                   NvMediaImage *image,
+                   uint32_t pitch)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    uint8_t *dstBuff[3] = {NULL};
+    uint32_t dstPitches[3] = {1};
+    uint32_t size;
+    NvMediaStatus status;
+
+    size = pitch * image->height;
+    size += image->embeddedDataTopSize;
+    size += image->embeddedDataBottomSize;
+
+    if (size > writer->buffSize) {
+        free(writer->buff);
+        writer->buffSize = 0;
+        if (!(writer->buff = malloc(size))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        writer->buffSize = size;
+    }
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    dstBuff[0] = writer->buff;
+    dstPitches[0] = pitch;
+    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+
+    return status;
+}
+
+NvMediaStatus
+NvRawWriterWrite(NvRawWriter *writer,
+                 NvMediaBool hdr)
+{
+    if (!writer->file || writer->dataSize > writer->buffSize) {
+        LOG_ERR("%s: No image started\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (!writer->numImages) {
+        if (NvRawFileHeaderChunkSetNumImages(writer->header, writer->imagesPerFile) != NvRawFileError_Success ||
+            NvRawFileHeaderChunkFileWrite(writer->header, writer->file) != NvRawFileError_Success) {
+            LOG_ERR("%s: Failed to write header chunk\n", __func__);
+            goto failed;
+        }
+    }
+
+    if (NvRawFileCaptureChunkFileWrite(writer->capture, writer->file) != NvRawFileError_Success ||
+        NvRawFileCameraStateChunkFileWrite(writer->cameraState, writer->file) != NvRawFileError_Success ||
+        NvRawFileSensorInfoChunkFileWrite(writer->sensorInfo, writer->file) != NvRawFileError_Success ||
+        (hdr && NvRawFileHDRChunkFileWrite(writer->hdr, writer->file) != NvRawFileError_Success) ||
+        NvRawFileDataChunkFileWrite(writer->data, writer->file, false) != NvRawFileError_Success) {
+        LOG_ERR("%s: Failed to write nvraw chunks\n", __func__);
+        goto failed;
+    }
+
+    if (fwrite(writer->buff, writer->dataSize, 1, writer->file) != 1) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        goto failed;
+    }
+
+    writer->numImages++;
+    if (writer->numImages >= writer->imagesPerFile)
+        NvRawWriterClose(writer);
+
+    return NVMEDIA_STATUS_OK;
+
+failed:
+    /* A partly written image leaves the file unreadable past it */
+    NvRawWriterClose(writer);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+void
+NvRawWriterClose(NvRawWriter *writer)
+{
+    if (!writer->file)
+        return;
+
+    /* The header was written for a full file */
+    if (writer->numImages && writer->numImages < writer->imagesPerFile) {
+        if (NvRawFileHeaderChunkSetNumImages(writer->header, writer->numImages) != NvRawFileError_Success ||
+            fseek(writer->file, 0, SEEK_SET) ||
+            NvRawFileHeaderChunkFileWrite(writer->header, writer->file) != NvRawFileError_Success)
+            LOG_WARN("%s: Failed to update the number of images\n", __func__);
+    }
+
+    fclose(writer->file);
+    writer->file = NULL;
+    writer->numImages = 0;
+}
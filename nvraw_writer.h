@@ -0,0 +1,84 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __NVRAW_WRITER_H__
+#define __NVRAW_WRITER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+#include "nvmedia_core.h"
+#include "nvmedia_image.h"
+#include "nvrawfile_interface.h"
+
+/* Writes nvraw files for one channel. The chunks and the staging buffer
+ * are kept from frame to frame, so the sensors only update the fields
+ * which change and nothing is allocated while the size holds. A file
+ * takes up to imagesPerFile images, each written with its own chunks
+ * after the one header. */
+typedef struct {
+    NvRawFileHeaderChunkHandle         *header;
+    NvRawFileCaptureChunkHandle        *capture;
+    NvRawFileCameraStateChunkHandle    *cameraState;
+    NvRawFileSensorInfoChunkHandle     *sensorInfo;
+    NvRawFileHDRChunkHandle            *hdr;
+    NvRawFileDataChunkHandle           *data;
+    uint32_t                            dataSize;       // size data was created for
+    uint8_t                            *buff;           // staging buffer
+    uint32_t                            buffSize;
+    FILE                               *file;
+    uint32_t                            width;          // layout of the open file
+    uint32_t                            height;
+    uint32_t                            imagesPerFile;
+    uint32_t                            numImages;      // images in the open file
+    NvMediaBool                         valid;
+} NvRawWriter;
+
+NvMediaStatus
+NvRawWriterInit(NvRawWriter *writer,
+                uint32_t imagesPerFile);
+
+/* Closes the open file. Safe on a zeroed writer. */
+void
+NvRawWriterDestroy(NvRawWriter *writer);
+
+/* Starts an image of dataSize bytes. A file named fileName is opened if
+ * none is, and the open one is closed first if it is full or was written
+ * with another image size. */
+NvMediaStatus
+NvRawWriterBegin(NvRawWriter *writer,
+                 const char *fileName,
+                 uint32_t width,
+                 uint32_t height,
+                 uint32_t dataSize);
+
+/* Copies image, embedded lines included, to the staging buffer */
+NvMediaStatus
+NvRawWriterGetBits(NvRawWriter *writer,
+                   NvMediaImage *image,
+                   uint32_t pitch);
+
+/* Writes the chunks as the sensor filled them, the HDR chunk only if hdr
+ * is set, followed by dataSize bytes of the staging buffer */
+NvMediaStatus
+NvRawWriterWrite(NvRawWriter *writer,
+                 NvMediaBool hdr);
+
+/* Finishes the open file, if any, with the number of images written */
+void
+NvRawWriterClose(NvRawWriter *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __NVRAW_WRITER_H__
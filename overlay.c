@@ -0,0 +1,486 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "overlay.h"
+#include "capture.h"
+#include "save.h"
+
+/* 5x7 font, one byte per row, bit 4 is the leftmost pixel.
+ * Only the characters used by the status panel are present;
+ * anything else is rendered as a space. */
+static const struct {
+    char        c;
+    uint8_t     rows[OVERLAY_GLYPH_HEIGHT];
+} overlayFont[] = {
+    { ' ', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { '0', { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E } },
+    { '1', { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E } },
+    { '2', { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F } },
+    { '3', { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E } },
+    { '4', { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 } },
+    { '5', { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E } },
+    { '6', { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E } },
+    { '7', { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 } },
+    { '8', { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E } },
+    { '9', { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C } },
+    { '.', { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C } },
+    { ':', { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 } },
+    { '-', { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 } },
+    { '/', { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 } },
+    { 'A', { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 } },
+    { 'C', { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E } },
+    { 'D', { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C } },
+    { 'F', { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 } },
+    { 'L', { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F } },
+    { 'M', { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 } },
+    { 'P', { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 } },
+    { 'R', { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 } },
+    { 'S', { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E } },
+    { 'T', { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 } },
+};
+
+#define OVERLAY_NUM_GLYPHS      (sizeof(overlayFont) / sizeof(overlayFont[0]))
+#define OVERLAY_CELL_SIZE       (OVERLAY_CELL_WIDTH * OVERLAY_CELL_HEIGHT * 4)
+
+static const uint8_t overlayForeground[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t overlayBackground[4] = { 0x00, 0x00, 0x00, 0xA0 };
+
+/* Rasterize every glyph once at the panel scale so that drawing text
+ * is nothing more than copying rows out of the atlas */
+static NvMediaStatus
+_BuildGlyphAtlas(NvOverlayContext *ctx)
+{
+    uint32_t g, x, y, gx, gy;
+    uint8_t *pixel;
+    NvMediaBool on;
+
+    ctx->atlas = malloc(OVERLAY_NUM_GLYPHS * OVERLAY_CELL_SIZE);
+    if (!ctx->atlas) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    memset(ctx->glyphIndex, 0, sizeof(ctx->glyphIndex));
+    for (g = 0; g < OVERLAY_NUM_GLYPHS; g++) {
+        ctx->glyphIndex[(uint8_t)overlayFont[g].c] = g;
+        pixel = ctx->atlas + g * OVERLAY_CELL_SIZE;
+        for (y = 0; y < OVERLAY_CELL_HEIGHT; y++) {
+            for (x = 0; x < OVERLAY_CELL_WIDTH; x++) {
+                gx = x / OVERLAY_GLYPH_SCALE;
+                gy = y / OVERLAY_GLYPH_SCALE;
+                on = (gx < OVERLAY_GLYPH_WIDTH) && (gy < OVERLAY_GLYPH_HEIGHT) &&
+                     ((overlayFont[g].rows[gy] >> (OVERLAY_GLYPH_WIDTH - 1 - gx)) & 1);
+                memcpy(pixel, on ? overlayForeground : overlayBackground, 4);
+                pixel += 4;
+            }
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+static NvMediaImage *
+_CreateOverlayImage(NvMediaDevice *device,
+                    uint32_t width,
+                    uint32_t height)
+{
+    NvMediaSurfAllocAttr surfAllocAttrs[3];
+
+    surfAllocAttrs[0].type = NVM_SURF_ATTR_WIDTH;
+    surfAllocAttrs[0].value = width;
+    surfAllocAttrs[1].type = NVM_SURF_ATTR_HEIGHT;
+    surfAllocAttrs[1].value = height;
+    surfAllocAttrs[2].type = NVM_SURF_ATTR_CPU_ACCESS;
+    surfAllocAttrs[2].value = NVM_SURF_ATTR_CPU_ACCESS_CACHED;
+
+    NVM_SURF_FMT_DEFINE_ATTR(surfFormatAttrs);
+    NVM_SURF_FMT_SET_ATTR_RGBA(surfFormatAttrs,RGBA,UINT,8,PL);
+
+    return NvMediaImageCreateNew(device,
+                                 NvMediaSurfaceFormatGetType(surfFormatAttrs, NVM_SURF_FMT_ATTR_MAX),
+                                 surfAllocAttrs,
+                                 3,
+                                 0);
+}
+
+static NvMediaStatus
+_WriteOverlayImage(NvMediaImage *image,
+                   uint8_t *buff,
+                   uint32_t pitch)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    NvMediaStatus status;
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) !=
+        NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    status = NvMediaImagePutBits(image, NULL, (void **)&buff, &pitch);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: NvMediaImagePutBits() failed\n", __func__);
+
+    return status;
+}
+
+static NvMediaStatus
+_RenderPanel(NvOverlayContext *ctx)
+{
+    uint32_t line, col, y, glyph, pitch = ctx->panelWidth * 4;
+    const uint8_t *src;
+    uint8_t *dst;
+    char c;
+    NvMediaStatus status;
+
+    for (line = 0; line < ctx->numLines; line++) {
+        for (col = 0; col < OVERLAY_LINE_LENGTH; col++) {
+            c = ctx->text[line][col];
+            glyph = ((uint8_t)c < 128) ? ctx->glyphIndex[(uint8_t)c] : 0;
+            src = ctx->atlas + glyph * OVERLAY_CELL_SIZE;
+            dst = ctx->panelBuff + line * OVERLAY_CELL_HEIGHT * pitch +
+                  col * OVERLAY_CELL_WIDTH * 4;
+            for (y = 0; y < OVERLAY_CELL_HEIGHT; y++) {
+                memcpy(dst, src, OVERLAY_CELL_WIDTH * 4);
+                src += OVERLAY_CELL_WIDTH * 4;
+                dst += pitch;
+            }
+        }
+    }
+
+    /* Write into the panel not used by the last blit */
+    status = _WriteOverlayImage(ctx->panel[ctx->activePanel ^ 1],
+                                ctx->panelBuff,
+                                pitch);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+
+    ctx->activePanel ^= 1;
+    ctx->panelValid = NVMEDIA_TRUE;
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+_UpdateStats(NvOverlayContext *ctx)
+{
+    uint64_t now = 0, td;
+    uint32_t frame, i;
+
+    GetTimeMicroSec(&now);
+    ctx->numComposited++;
+
+    if (!ctx->statsStartTimeUs) {
+        ctx->statsStartTimeUs = now;
+        for (i = 0; i < ctx->numVirtualChannels; i++)
+            ctx->statsStartFrame[i] = *ctx->captureFrame[i];
+        ctx->numComposited = 0;
+        return;
+    }
+
+    td = now - ctx->statsStartTimeUs;
+    if (td < OVERLAY_STATS_PERIOD_US)
+        return;
+
+    for (i = 0; i < ctx->numVirtualChannels; i++) {
+        frame = *ctx->captureFrame[i];
+        ctx->captureFpsX10[i] = (uint32_t)((uint64_t)(frame - ctx->statsStartFrame[i]) *
+                                           10000000ULL / td);
+        ctx->statsStartFrame[i] = frame;
+    }
+    ctx->displayFpsX10 = (uint32_t)((uint64_t)ctx->numComposited * 10000000ULL / td);
+    if (ctx->numLatencySamples)
+        ctx->latencyUsAvg = (uint32_t)(ctx->latencySumUs / ctx->numLatencySamples);
+
+    ctx->statsStartTimeUs = now;
+    ctx->numComposited = 0;
+    ctx->latencySumUs = 0;
+    ctx->numLatencySamples = 0;
+}
+
+/* Formats the status lines; returns NVMEDIA_TRUE if any of them changed */
+static NvMediaBool
+_FormatText(NvOverlayContext *ctx)
+{
+    char text[OVERLAY_MAX_LINES][OVERLAY_LINE_LENGTH + 1];
+    uint32_t i, line, drops = 0, skips = 0;
+    int32_t temperature;
+
+    for (i = 0; i < ctx->numVirtualChannels; i++) {
+        drops += *ctx->captureDropped[i] + *ctx->eventDropped[i];
+        skips += *ctx->displaySkipped[i];
+    }
+    if (ctx->compressDropped)
+        drops += *ctx->compressDropped;
+
+    memset(text, ' ', sizeof(text));
+    for (line = 0; line < ctx->numVirtualChannels; line++)
+        snprintf(text[line], OVERLAY_LINE_LENGTH + 1, "VC%u FPS %u.%u", line,
+                 ctx->captureFpsX10[line] / 10, ctx->captureFpsX10[line] % 10);
+    snprintf(text[line++], OVERLAY_LINE_LENGTH + 1, "DSP FPS %u.%u",
+             ctx->displayFpsX10 / 10, ctx->displayFpsX10 % 10);
+    snprintf(text[line++], OVERLAY_LINE_LENGTH + 1, "LAT %u.%uMS",
+             ctx->latencyUsAvg / 1000, (ctx->latencyUsAvg % 1000) / 100);
+    if (ctx->temperatureValid) {
+        temperature = ctx->temperature;
+        snprintf(text[line++], OVERLAY_LINE_LENGTH + 1, "TMP %s%d.%dC",
+                 (temperature < 0) ? "-" : "",
+                 abs(temperature) / 10, abs(temperature) % 10);
+    } else {
+        snprintf(text[line++], OVERLAY_LINE_LENGTH + 1, "TMP --.-C");
+    }
+    snprintf(text[line++], OVERLAY_LINE_LENGTH + 1, "DRP %u SKP %u", drops, skips);
+
+    /* Pad with spaces so every cell of the panel is drawn */
+    for (i = 0; i < ctx->numLines; i++) {
+        text[i][strlen(text[i])] = ' ';
+        text[i][OVERLAY_LINE_LENGTH] = '\0';
+    }
+
+    if (ctx->panelValid && !memcmp(text, ctx->text, sizeof(text)))
+        return NVMEDIA_FALSE;
+
+    memcpy(ctx->text, text, sizeof(text));
+    return NVMEDIA_TRUE;
+}
+
+static NvMediaStatus
+_BlitRect(NvMedia2D *i2d,
+          NvMedia2DBlitParameters *blitParams,
+          NvMediaImage *dstImage,
+          NvMediaImage *srcImage,
+          int32_t x0, int32_t y0,
+          int32_t x1, int32_t y1)
+{
+    NvMediaRect dstRect;
+    NvMediaStatus status;
+
+    /* Clip to the destination surface */
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 > (int32_t)dstImage->width) ? (int32_t)dstImage->width : x1;
+    y1 = (y1 > (int32_t)dstImage->height) ? (int32_t)dstImage->height : y1;
+    if ((x1 <= x0) || (y1 <= y0))
+        return NVMEDIA_STATUS_OK;
+
+    dstRect.x0 = x0;
+    dstRect.y0 = y0;
+    dstRect.x1 = x1;
+    dstRect.y1 = y1;
+
+    status = NvMedia2DBlitEx(i2d,
+                             dstImage,
+                             &dstRect,
+                             srcImage,
+                             NULL,
+                             blitParams,
+                             NULL);
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: NvMedia2DBlitEx failed\n", __func__);
+
+    return status;
+}
+
+NvMediaStatus
+OverlayCreate(NvMainContext *mainCtx,
+              NvMediaDevice *device,
+              NvOverlayContext **overlayCtx)
+{
+    NvOverlayContext *ctx = NULL;
+    NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    NvSaveContext *saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
+    TestArgs *testArgs = mainCtx->testArgs;
+    uint8_t *solidBuff = NULL;
+    uint32_t i;
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    ctx = calloc(1, sizeof(NvOverlayContext));
+    if (!ctx) {
+        LOG_ERR("%s: Failed to allocate memory for overlay context\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    ctx->statsEnabled = testArgs->overlayEnabled;
+    ctx->crosshairEnabled = testArgs->crosshairEnabled;
+    ctx->spotMeterEnabled = testArgs->spotMeterEnabled;
+    ctx->numVirtualChannels = testArgs->numVirtualChannels;
+    for (i = 0; i < ctx->numVirtualChannels; i++) {
+        ctx->captureFrame[i] = &captureCtx->threadCtx[i].currentFrame;
+        ctx->captureDropped[i] = &captureCtx->threadCtx[i].numDropped;
+        ctx->eventDropped[i] = &saveCtx->threadCtx[i].triggerRing.numDropped;
+        ctx->displaySkipped[i] = &saveCtx->threadCtx[i].numDisplaySkipped;
+    }
+    if (saveCtx->compressPool)
+        ctx->compressDropped = &saveCtx->compressPool->numDropped;
+    ctx->numLines = ctx->numVirtualChannels + 4;
+
+    status = _BuildGlyphAtlas(ctx);
+    if (status != NVMEDIA_STATUS_OK)
+        goto failed;
+
+    ctx->panelWidth = OVERLAY_LINE_LENGTH * OVERLAY_CELL_WIDTH;
+    ctx->panelHeight = ctx->numLines * OVERLAY_CELL_HEIGHT;
+    ctx->panelBuff = malloc(ctx->panelWidth * ctx->panelHeight * 4);
+    if (!ctx->panelBuff) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+        goto failed;
+    }
+
+    for (i = 0; i < 2; i++) {
+        ctx->panel[i] = _CreateOverlayImage(device, ctx->panelWidth, ctx->panelHeight);
+        if (!ctx->panel[i]) {
+            LOG_ERR("%s: Failed to create overlay panel\n", __func__);
+            status = NVMEDIA_STATUS_ERROR;
+            goto failed;
+        }
+    }
+
+    /* Shapes are drawn by scaling a small single colour image */
+    ctx->solid = _CreateOverlayImage(device, 8, 8);
+    solidBuff = malloc(8 * 8 * 4);
+    if (!ctx->solid || !solidBuff) {
+        LOG_ERR("%s: Failed to create overlay shape image\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+        goto failed;
+    }
+    for (i = 0; i < 8 * 8; i++)
+        memcpy(solidBuff + 4 * i, overlayForeground, 4);
+    status = _WriteOverlayImage(ctx->solid, solidBuff, 8 * 4);
+    if (status != NVMEDIA_STATUS_OK)
+        goto failed;
+    free(solidBuff);
+
+    *overlayCtx = ctx;
+    return NVMEDIA_STATUS_OK;
+failed:
+    if (solidBuff)
+        free(solidBuff);
+    OverlayDestroy(ctx);
+    LOG_ERR("%s: Failed to initialize overlay\n", __func__);
+    return status;
+}
+
+void
+OverlayDestroy(NvOverlayContext *overlayCtx)
+{
+    uint32_t i;
+
+    if (!overlayCtx)
+        return;
+
+    for (i = 0; i < 2; i++) {
+        if (overlayCtx->panel[i])
+            NvMediaImageDestroy(overlayCtx->panel[i]);
+    }
+    if (overlayCtx->solid)
+        NvMediaImageDestroy(overlayCtx->solid);
+    if (overlayCtx->panelBuff)
+        free(overlayCtx->panelBuff);
+    if (overlayCtx->atlas)
+        free(overlayCtx->atlas);
+
+    free(overlayCtx);
+}
+
+void
+OverlayAddLatency(NvOverlayContext *overlayCtx,
+                  uint64_t latencyUs)
+{
+    overlayCtx->latencySumUs += latencyUs;
+    overlayCtx->numLatencySamples++;
+}
+
+void
+OverlaySetTemperature(NvOverlayContext *overlayCtx,
+                      float celsius)
+{
+    if (!overlayCtx)
+        return;
+
+    overlayCtx->temperature = (int32_t)(celsius * 10.0f);
+    overlayCtx->temperatureValid = NVMEDIA_TRUE;
+}
+
+NvMediaStatus
+OverlayApply(NvOverlayContext *ctx,
+             NvMedia2D *i2d,
+             NvMedia2DBlitParameters *blitParams,
+             NvMediaImage *dstImage,
+             uint32_t vcWidth,
+             uint32_t vcHeight)
+{
+    NvMediaStatus status;
+    int32_t cx, cy, s, t;
+    uint32_t i;
+
+    if (ctx->statsEnabled) {
+        _UpdateStats(ctx);
+
+        /* Only touch the panel surface when a displayed value changed */
+        if (_FormatText(ctx)) {
+            status = _RenderPanel(ctx);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+        }
+
+        status = _BlitRect(i2d, blitParams, dstImage,
+                           ctx->panel[ctx->activePanel],
+                           OVERLAY_MARGIN,
+                           OVERLAY_MARGIN,
+                           OVERLAY_MARGIN + ctx->panelWidth,
+                           OVERLAY_MARGIN + ctx->panelHeight);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+    }
+
+    t = OVERLAY_LINE_THICKNESS;
+    for (i = 0; i < ctx->numVirtualChannels; i++) {
+        cx = vcWidth * i + vcWidth / 2;
+        cy = vcHeight / 2;
+
+        if (ctx->crosshairEnabled) {
+            s = OVERLAY_CROSSHAIR_SIZE / 2;
+            status = _BlitRect(i2d, blitParams, dstImage, ctx->solid,
+                               cx - s, cy - t / 2, cx + s, cy + t - t / 2);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+            status = _BlitRect(i2d, blitParams, dstImage, ctx->solid,
+                               cx - t / 2, cy - s, cx + t - t / 2, cy + s);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+        }
+
+        if (ctx->spotMeterEnabled) {
+            s = OVERLAY_SPOTMETER_SIZE / 2;
+            status = _BlitRect(i2d, blitParams, dstImage, ctx->solid,
+                               cx - s, cy - s, cx + s, cy - s + t);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+            status = _BlitRect(i2d, blitParams, dstImage, ctx->solid,
+                               cx - s, cy + s - t, cx + s, cy + s);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+            status = _BlitRect(i2d, blitParams, dstImage, ctx->solid,
+                               cx - s, cy - s, cx - s + t, cy + s);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+            status = _BlitRect(i2d, blitParams, dstImage, ctx->solid,
+                               cx + s - t, cy - s, cx + s, cy + s);
+            if (status != NVMEDIA_STATUS_OK)
+                return status;
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
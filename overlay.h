@@ -0,0 +1,111 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __OVERLAY_H__
+#define __OVERLAY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "cmdline.h"
+#include "nvmedia_2d.h"
+#include "nvmedia_icp.h"
+
+#define OVERLAY_GLYPH_WIDTH             5
+#define OVERLAY_GLYPH_HEIGHT            7
+#define OVERLAY_GLYPH_SCALE             2
+#define OVERLAY_CELL_WIDTH              ((OVERLAY_GLYPH_WIDTH + 1) * OVERLAY_GLYPH_SCALE)
+#define OVERLAY_CELL_HEIGHT             ((OVERLAY_GLYPH_HEIGHT + 1) * OVERLAY_GLYPH_SCALE)
+/* The capture rate of each channel, then the display rate, latency,
+ * temperature and drops */
+#define OVERLAY_MAX_LINES               (NVMEDIA_ICP_MAX_VIRTUAL_GROUPS + 4)
+#define OVERLAY_LINE_LENGTH             16
+#define OVERLAY_MARGIN                  4
+#define OVERLAY_STATS_PERIOD_US         500000 /* how often displayed values are refreshed */
+#define OVERLAY_LINE_THICKNESS          2
+#define OVERLAY_CROSSHAIR_SIZE          24
+#define OVERLAY_SPOTMETER_SIZE          16
+
+typedef struct {
+    /* Rendering resources */
+    uint8_t                    *atlas;          /* prebuilt RGBA glyph cells */
+    int8_t                      glyphIndex[128];
+    uint8_t                    *panelBuff;      /* CPU staging for the text panel */
+    NvMediaImage               *panel[2];       /* double buffered so a pending blit is not overwritten */
+    uint32_t                    activePanel;
+    NvMediaImage               *solid;          /* single colour source for shapes */
+    uint32_t                    panelWidth;
+    uint32_t                    panelHeight;
+    uint32_t                    numLines;
+    char                        text[OVERLAY_MAX_LINES][OVERLAY_LINE_LENGTH + 1];
+    NvMediaBool                 panelValid;
+
+    /* What to draw */
+    NvMediaBool                 statsEnabled;
+    NvMediaBool                 crosshairEnabled;
+    NvMediaBool                 spotMeterEnabled;
+
+    /* Value sources */
+    uint32_t                    numVirtualChannels;
+    uint32_t                   *captureFrame[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    /* Frames lost: by the capture, by the compression and by the event
+     * writer. The frames display pacing skips on purpose are apart. */
+    volatile uint32_t          *captureDropped[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    uint32_t                   *compressDropped;    /* NULL without compression */
+    volatile uint32_t          *eventDropped[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    uint32_t                   *displaySkipped[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    volatile int32_t            temperature;    /* in 1/10 degree C */
+    volatile NvMediaBool        temperatureValid;
+
+    /* Statistics gathered between refreshes */
+    uint64_t                    statsStartTimeUs;
+    uint32_t                    statsStartFrame[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    uint32_t                    numComposited;
+    uint64_t                    latencySumUs;
+    uint32_t                    numLatencySamples;
+    uint32_t                    captureFpsX10[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    uint32_t                    displayFpsX10;
+    uint32_t                    latencyUsAvg;
+} NvOverlayContext;
+
+NvMediaStatus
+OverlayCreate(NvMainContext *mainCtx,
+              NvMediaDevice *device,
+              NvOverlayContext **overlayCtx);
+
+void
+OverlayDestroy(NvOverlayContext *overlayCtx);
+
+/* Records the age of a frame when it reaches the composite stage */
+void
+OverlayAddLatency(NvOverlayContext *overlayCtx,
+                  uint64_t latencyUs);
+
+/* Updates the temperature readout; may be called from any thread */
+void
+OverlaySetTemperature(NvOverlayContext *overlayCtx,
+                      float celsius);
+
+/* Draws the overlay into the composited image. Each virtual channel
+ * occupies a vcWidth x vcHeight tile, side by side. */
+NvMediaStatus
+OverlayApply(NvOverlayContext *overlayCtx,
+             NvMedia2D *i2d,
+             NvMedia2DBlitParameters *blitParams,
+             NvMediaImage *dstImage,
+             uint32_t vcWidth,
+             uint32_t vcHeight);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OVERLAY_H__
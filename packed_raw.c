@@ -0,0 +1,203 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "packed_raw.h"
+#include "pixel_kernels.h"
+#include "log_utils.h"
+
+#define PACKED_RAW_BYTES_PER_SAMPLE     2
+
+/* Capture stores RAW10, 12 and 14 samples in bits 13 and down, like the
+ * S1.14 samples the nvraw writers realign */
+#define PACKED_RAW_SAMPLE_MSB           14
+
+NvMediaStatus
+PackedRawWriterInit(NvPackedRawWriter *writer,
+                    NvMediaSurfaceType surfType,
+                    uint32_t pixelOrder)
+{
+    NvMediaStatus status;
+
+    memset(writer, 0, sizeof(NvPackedRawWriter));
+
+    NVM_SURF_FMT_DEFINE_ATTR(attr);
+    status = NvMediaSurfaceFormatGetAttrs(surfType, attr, NVM_SURF_FMT_ATTR_MAX);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaSurfaceFormatGetAttrs failed\n", __func__);
+        return status;
+    }
+
+    if (attr[NVM_SURF_ATTR_SURF_TYPE].value != NVM_SURF_ATTR_SURF_TYPE_RAW) {
+        LOG_ERR("%s: Packing applies only to RAW captured images\n", __func__);
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+
+    switch (attr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value) {
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_10:
+            writer->bitsPerSample = 10;
+            break;
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_12:
+            writer->bitsPerSample = 12;
+            break;
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_14:
+            writer->bitsPerSample = 14;
+            break;
+        default:
+            LOG_ERR("%s: Packing supports only raw10, raw12 and raw14 input\n", __func__);
+            return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+
+    writer->sampleShift = PACKED_RAW_SAMPLE_MSB - writer->bitsPerSample;
+    writer->pixelOrder = pixelOrder;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+PackedRawWriterDestroy(NvPackedRawWriter *writer)
+{
+    free(writer->buff);
+    memset(writer, 0, sizeof(NvPackedRawWriter));
+}
+
+uint32_t
+PackedRawPackSamples(const NvPackedRawWriter *writer,
+                     uint16_t *samples,
+                     uint8_t *dst,
+                     uint32_t numSamples)
+{
+    PixelShiftRight16(samples, numSamples, writer->sampleShift,
+                      (1u << writer->bitsPerSample) - 1);
+    return PixelPack(samples, dst, numSamples, writer->bitsPerSample);
+}
+
+NvMediaStatus
+PackedRawWriteImage(NvPackedRawWriter *writer,
+                    const char *fileName,
+                    NvMediaImage *image,
+                    uint32_t frameNumber)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    PackedRawHeader header;
+    uint8_t *dstBuff[3] = {NULL};
+    uint32_t dstPitches[3] = {1};
+    uint32_t pitch, numSamples, size;
+    uint8_t *pixels;
+    FILE *file = NULL;
+    NvMediaStatus status;
+
+    pitch = image->width * PACKED_RAW_BYTES_PER_SAMPLE;
+    numSamples = image->width * image->height;
+    size = pitch * image->height + image->embeddedDataTopSize + image->embeddedDataBottomSize;
+
+    if (size > writer->buffSize) {
+        free(writer->buff);
+        writer->buffSize = 0;
+        if (!(writer->buff = malloc(size))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        writer->buffSize = size;
+    }
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    dstBuff[0] = writer->buff;
+    dstPitches[0] = pitch;
+    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+        return status;
+    }
+
+    /* The embedded lines are kept as captured around the packed pixels */
+    pixels = writer->buff + image->embeddedDataTopSize;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = PACKED_RAW_MAGIC;
+    header.version = PACKED_RAW_VERSION;
+    header.headerSize = sizeof(header);
+    header.width = image->width;
+    header.height = image->height;
+    header.bitsPerSample = writer->bitsPerSample;
+    header.sampleShift = writer->sampleShift;
+    header.pixelOrder = writer->pixelOrder;
+    header.embeddedTopSize = image->embeddedDataTopSize;
+    header.embeddedBottomSize = image->embeddedDataBottomSize;
+    header.packedSize = PackedRawPackSamples(writer, (uint16_t *)pixels, pixels, numSamples);
+    header.frameNumber = frameNumber;
+
+    file = fopen(fileName, "wb");
+    if (!file) {
+        LOG_ERR("%s: Failed to open file %s\n", __func__, fileName);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        (header.embeddedTopSize &&
+         fwrite(writer->buff, header.embeddedTopSize, 1, file) != 1) ||
+        fwrite(pixels, header.packedSize, 1, file) != 1 ||
+        (header.embeddedBottomSize &&
+         fwrite(pixels + numSamples * PACKED_RAW_BYTES_PER_SAMPLE,
+                header.embeddedBottomSize, 1, file) != 1)) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+    }
+
+    fclose(file);
+    return status;
+}
+
+NvMediaStatus
+PackedRawReadHeader(FILE *file,
+                    PackedRawHeader *header)
+{
+    if (fseek(file, 0, SEEK_SET) ||
+        fread(header, sizeof(PackedRawHeader), 1, file) != 1) {
+        LOG_ERR("%s: Failed to read header\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (header->magic != PACKED_RAW_MAGIC ||
+        header->version != PACKED_RAW_VERSION ||
+        header->headerSize < sizeof(PackedRawHeader) ||
+        header->packedSize != PixelPackedSize(header->width * header->height,
+                                              header->bitsPerSample)) {
+        LOG_ERR("%s: Not a packed raw file\n", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+PackedRawReadSamples(FILE *file,
+                     const PackedRawHeader *header,
+                     uint16_t *samples)
+{
+    /* Read into the start of samples and unpacked in place */
+    if (fseek(file, header->headerSize + header->embeddedTopSize, SEEK_SET) ||
+        fread(samples, header->packedSize, 1, file) != 1) {
+        LOG_ERR("%s: Failed to read pixels\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (!PixelUnpack((uint8_t *)samples, samples, header->width * header->height,
+                     header->bitsPerSample)) {
+        LOG_ERR("%s: Unsupported %u bits per sample\n", __func__, header->bitsPerSample);
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
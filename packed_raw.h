@@ -0,0 +1,95 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __PACKED_RAW_H__
+#define __PACKED_RAW_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "nvmedia_surface.h"
+#include "nvmedia_image.h"
+
+/* A .praw file holds one raw frame with its samples bit-packed by
+ * PixelPack. It starts with PackedRawHeader, in little endian order,
+ * followed by the top embedded lines as captured, the packed pixels and
+ * the bottom embedded lines as captured. */
+
+#define PACKED_RAW_MAGIC            0x57415250  /* "PRAW" */
+#define PACKED_RAW_VERSION          1
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    headerSize;     // offset of the top embedded lines
+    uint32_t                    width;
+    uint32_t                    height;         // pixel lines, without embedded ones
+    uint32_t                    bitsPerSample;  // 10, 12 or 14
+    uint32_t                    sampleShift;    // LSB of the samples as captured
+    uint32_t                    pixelOrder;     // capture component order
+    uint32_t                    embeddedTopSize;    // bytes
+    uint32_t                    embeddedBottomSize; // bytes
+    uint32_t                    packedSize;     // bytes of packed pixels
+    uint32_t                    frameNumber;
+} PackedRawHeader;
+
+typedef struct {
+    uint8_t                    *buff;           // staging buffer
+    uint32_t                    buffSize;
+    uint32_t                    bitsPerSample;
+    uint32_t                    sampleShift;
+    uint32_t                    pixelOrder;
+} NvPackedRawWriter;
+
+/* Fails for surfaces other than RAW10, RAW12 and RAW14 */
+NvMediaStatus
+PackedRawWriterInit(NvPackedRawWriter *writer,
+                    NvMediaSurfaceType surfType,
+                    uint32_t pixelOrder);
+
+/* Safe on a zeroed writer */
+void
+PackedRawWriterDestroy(NvPackedRawWriter *writer);
+
+/* Packs numSamples samples as captured into dst, which may be the same
+ * buffer. samples is realigned in place. Returns the bytes written. */
+uint32_t
+PackedRawPackSamples(const NvPackedRawWriter *writer,
+                     uint16_t *samples,
+                     uint8_t *dst,
+                     uint32_t numSamples);
+
+NvMediaStatus
+PackedRawWriteImage(NvPackedRawWriter *writer,
+                    const char *fileName,
+                    NvMediaImage *image,
+                    uint32_t frameNumber);
+
+/* Reads and checks the header of a .praw file */
+NvMediaStatus
+PackedRawReadHeader(FILE *file,
+                    PackedRawHeader *header);
+
+/* Reads the pixels of the file header was read from as LSB aligned
+ * samples. samples holds width * height samples. */
+NvMediaStatus
+PackedRawReadSamples(FILE *file,
+                     const PackedRawHeader *header,
+                     uint16_t *samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PACKED_RAW_H__
@@ -15,12 +15,13 @@
 #include "testutil_i2c.h"
 #include "log_utils.h"
 #include "parser.h"
+#include "script_cache.h"
 #include "nvmedia_image.h"
 
-NvMediaStatus
-ParseRegistersFile(char *filename,
-                   CaptureConfigParams *params,
-                   I2cCommands *allCommands)
+static NvMediaStatus
+_ParseRegistersText(char *filename,
+                    CaptureConfigParams *params,
+                    I2cCommands *allCommands)
 {
     char readLine [MAX_STRING_SIZE];
     char parsedLine [MAX_STRING_SIZE];
@@ -29,7 +30,8 @@ ParseRegistersFile(char *filename,
     int intBuf;
     NvMediaBool isGroupRegister = NVMEDIA_FALSE;
     NvMediaBool isInitialRegister = NVMEDIA_FALSE;
-    uint32_t numCommands = 0;
+    Command *cmd = NULL;
+    uint32_t lineNumber = 0;
     uint32_t i2cDevice = 0;
     uint32_t deviceAddress = 0;
     uint32_t address = 0;
@@ -37,7 +39,12 @@ ParseRegistersFile(char *filename,
     uint32_t arrayIndex = 0;
     uint32_t frameNumber = 0;
     uint32_t delayVal = 0;
-    char timeUnit[2];
+    char timeUnit[3];
+    char intervalUnit[3];
+    uint32_t intervalVal = 0;
+    uint32_t mask = 0;
+    PollCondition pollCond;
+    int numFields;
     char * memPointer = NULL;
     uint8_t i;
     uint8_t count;
@@ -56,8 +63,10 @@ ParseRegistersFile(char *filename,
     memset((void *)stringBuf, 0, MAX_STRING_SIZE);
 
     params->pixelOrder.uIntValue = NVMEDIA_RAW_PIXEL_ORDER_BGGR;  //default pixel order
+    I2cSetNumCommands(allCommands, 0);
 
     while (fgets(readLine, MAX_STRING_SIZE, file) != NULL) {
+        lineNumber++;
         deviceAddress = 0;
         address = 0;
         value = 0;
@@ -70,22 +79,105 @@ ParseRegistersFile(char *filename,
             *memPointer = '\0';
         strcpy(parsedLine, readLine);
 
+        // Any command on this line goes here, it is kept by counting it
+        cmd = I2cNewCommand(allCommands);
+        if (!cmd)
+            goto failed;
+
         // Set process type
         if (isGroupRegister) {
-            allCommands->commands[numCommands].processType = GROUP_REG;
+            cmd->processType = GROUP_REG;
         } else if (isInitialRegister) {
-            allCommands->commands[numCommands].processType = PRESET_REG;
+            cmd->processType = PRESET_REG;
         } else {
-            allCommands->commands[numCommands].processType = DEFAULT;
+            cmd->processType = DEFAULT;
         }
+        cmd->line = lineNumber;
+
+        // Parse for per device write delay "; Write delay DEV_ADDR TIME"
+        if (sscanf(parsedLine, "; Write delay %x %u%2s", &deviceAddress,
+                   &delayVal, timeUnit) == 3) {
+            if (strcmp(timeUnit, "ms") == 0) {
+                cmd->delay = delayVal*1000;
+            } else if (strcmp(timeUnit, "us") == 0) {
+                cmd->delay = delayVal;
+            } else {
+                LOG_ERR("%s: Unknown time unit found!\n", __func__);
+                goto failed;
+            }
+            cmd->buffer[0] = (uint8_t)(deviceAddress >> 1);
+            cmd->commandType = WRITE_DELAY;
+            allCommands->numCommands++;
+        // Parse for volatile registers "; Volatile DEV_ADDR SUB_ADDR [LAST_SUB_ADDR]"
+        } else if ((numFields = sscanf(parsedLine, "; Volatile %x %x %x",
+                   &deviceAddress, &address, &value)) >= 2) {
+            if (numFields == 2)
+                value = address;
+            if (value < address || value > 0xFFFF) {
+                LOG_ERR("%s: Invalid volatile register range on line %u\n",
+                        __func__, lineNumber);
+                goto failed;
+            }
+            cmd->deviceAddress = deviceAddress >> 1;
+            cmd->buffer[0] = (uint8_t)((address >> 8) & 0xFF);
+            cmd->buffer[1] = (uint8_t)(address & 0xFF);
+            cmd->buffer[2] = (uint8_t)((value >> 8) & 0xFF);
+            cmd->buffer[3] = (uint8_t)(value & 0xFF);
+            cmd->commandType = VOLATILE_REG;
+            allCommands->numCommands++;
+        // Parse for register poll
+        // "; Poll DEV_ADDR SUB_ADDR MASK VALUE TIMEOUT [INTERVAL]"
+        } else if ((numFields = sscanf(parsedLine, "; Poll %x %x %x %x %u%2s %u%2s",
+                   &deviceAddress, &address, &mask, &value, &delayVal, timeUnit,
+                   &intervalVal, intervalUnit)) >= 6) {
+            memset(&pollCond, 0, sizeof(pollCond));
+            pollCond.mask = (uint8_t)mask;
+            pollCond.value = (uint8_t)(value & mask);
+            pollCond.interval = DEFAULT_POLL_INTERVAL;
+            if (strcmp(timeUnit, "ms") == 0) {
+                pollCond.timeout = delayVal*1000;
+            } else if (strcmp(timeUnit, "us") == 0) {
+                pollCond.timeout = delayVal;
+            } else {
+                LOG_ERR("%s: Unknown time unit found!\n", __func__);
+                goto failed;
+            }
+            if (numFields == 8) {
+                if (strcmp(intervalUnit, "ms") == 0) {
+                    pollCond.interval = intervalVal*1000;
+                } else if (strcmp(intervalUnit, "us") == 0) {
+                    pollCond.interval = intervalVal;
+                } else {
+                    LOG_ERR("%s: Unknown time unit found!\n", __func__);
+                    goto failed;
+                }
+            }
+            cmd->deviceAddress = deviceAddress >> 1;
 
+            // check subAdd 1 or 2 bytes
+            sscanf(parsedLine,"%*s %*s %*s %s", subAdd);
+            if (subAdd[2]!='\0') {
+                cmd->commandType = POLL_REG_2;
+                cmd->buffer[arrayIndex] =
+                    (uint8_t)((address >> 8) & 0xFF);
+                cmd->buffer[++arrayIndex] =
+                    (uint8_t)(address & 0xFF);
+            } else {
+                cmd->commandType = POLL_REG_1;
+                cmd->buffer[arrayIndex] =
+                    (uint8_t)(address & 0xFF);
+            }
+            memcpy(&cmd->buffer[POLL_CONDITION_OFFSET],
+                   &pollCond, sizeof(pollCond));
+            cmd->dataLength = 1;
+            allCommands->numCommands++;
         // Parse for delay (starts with ';' symbol)
-        if (sscanf(parsedLine, "; Delay %u%s", &delayVal, timeUnit) == 2) {
+        } else if (sscanf(parsedLine, "; Delay %u%2s", &delayVal, timeUnit) == 2) {
             if (strcmp(timeUnit, "ms") == 0) {
                 // Convert time to microseconds
-                allCommands->commands[numCommands].delay = delayVal*1000;
+                cmd->delay = delayVal*1000;
             } else if (strcmp(timeUnit, "us") == 0) {
-                allCommands->commands[numCommands].delay = delayVal;
+                cmd->delay = delayVal;
             } else {
                 LOG_ERR("%s: Unknown time unit found!\n", __func__);
                 goto failed;
@@ -93,34 +185,34 @@ ParseRegistersFile(char *filename,
 
 #ifdef DEBUG
             LOG_DBG("%s: Delay %u microseconds\n", __func__,
-                    allCommands->commands[numCommands].delay);
+                    cmd->delay);
 #endif
 
-            allCommands->commands[numCommands].commandType = DELAY;
-            numCommands++;
+            cmd->commandType = DELAY;
+            allCommands->numCommands++;
         } else if (strstr(parsedLine, "; I2C Err on") != NULL) {
-            allCommands->commands[numCommands].commandType = I2C_ERR;
-            allCommands->commands[numCommands].i2cErr = NVMEDIA_TRUE;
+            cmd->commandType = I2C_ERR;
+            cmd->i2cErr = NVMEDIA_TRUE;
 #ifdef DEBUG
             LOG_DBG("%s: Check for I2C errors\n", __func__);
 #endif
-            numCommands++;
+            allCommands->numCommands++;
         } else if (strstr(parsedLine, "; I2C Err off") != NULL) {
-            allCommands->commands[numCommands].commandType = I2C_ERR;
-            allCommands->commands[numCommands].i2cErr = NVMEDIA_FALSE;
+            cmd->commandType = I2C_ERR;
+            cmd->i2cErr = NVMEDIA_FALSE;
 #ifdef DEBUG
             LOG_DBG("%s: Do not check for I2C errors\n", __func__);
 #endif
-            numCommands++;
+            allCommands->numCommands++;
         } else if (sscanf(parsedLine, "; I2C %u",
                   (uint32_t *)&i2cDevice) == 1) {
-            allCommands->commands[numCommands].commandType = I2C_DEVICE;
-            allCommands->commands[numCommands].i2cDevice = i2cDevice;
+            cmd->commandType = I2C_DEVICE;
+            cmd->i2cDevice = i2cDevice;
 #ifdef DEBUG
             LOG_DBG("%s: Open I2C Handle %u\n", __func__,
-                    allCommands->commands[numCommands].i2cDevice);
+                    cmd->i2cDevice);
 #endif
-            numCommands++;
+            allCommands->numCommands++;
         } else if (sscanf(parsedLine, "; Wait for frame %u",
                   &frameNumber) == 1) {
             if (frameNumber < 1) {
@@ -130,53 +222,53 @@ ParseRegistersFile(char *filename,
             }
 
             isGroupRegister = NVMEDIA_TRUE;
-            allCommands->commands[numCommands].commandType = SECTION_START;
-            allCommands->commands[numCommands].processType = GROUP_REG;
-            allCommands->commands[numCommands].triggerFrame = frameNumber;
-            numCommands++;
+            cmd->commandType = SECTION_START;
+            cmd->processType = GROUP_REG;
+            cmd->triggerFrame = frameNumber;
+            allCommands->numCommands++;
         } else if (sscanf(parsedLine, "; End frame %u regsiters",
                    &frameNumber) == 1) {
             isGroupRegister = NVMEDIA_FALSE;
-            allCommands->commands[numCommands].commandType = SECTION_STOP;
-            allCommands->commands[numCommands].processType = GROUP_REG;
-            allCommands->commands[numCommands].triggerFrame = -1;
-            numCommands++;
+            cmd->commandType = SECTION_STOP;
+            cmd->processType = GROUP_REG;
+            cmd->triggerFrame = -1;
+            allCommands->numCommands++;
         } else if (strstr(parsedLine, "; Begin preset registers") != NULL) {
             isInitialRegister = NVMEDIA_TRUE;
-            allCommands->commands[numCommands].commandType = SECTION_START;
-            allCommands->commands[numCommands].processType = PRESET_REG;
-            numCommands++;
+            cmd->commandType = SECTION_START;
+            cmd->processType = PRESET_REG;
+            allCommands->numCommands++;
         } else if (strstr(parsedLine, "; End preset registers") != NULL) {
             isInitialRegister = NVMEDIA_FALSE;
-            allCommands->commands[numCommands].commandType = SECTION_STOP;
-            allCommands->commands[numCommands].processType = PRESET_REG;
-            numCommands++;
+            cmd->commandType = SECTION_STOP;
+            cmd->processType = PRESET_REG;
+            allCommands->numCommands++;
         // Parse I2C read command in format "; r DEV_ADDR SUB_ADDR"
         // Only supports 1 byte data read
         } else if (sscanf(parsedLine, "; r %x %x", &deviceAddress, &address) == 2) {
-            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            cmd->deviceAddress = deviceAddress >> 1;
 
             // check subAdd 1 or 2 bytes
             sscanf(parsedLine,"%*s %*s %*s %s", subAdd);
             if (subAdd[2]!='\0') {
-                allCommands->commands[numCommands].commandType = READ_REG_2;
-                allCommands->commands[numCommands].buffer[arrayIndex] =
+                cmd->commandType = READ_REG_2;
+                cmd->buffer[arrayIndex] =
                     (uint8_t)((address >> 8) & 0xFF);
-                allCommands->commands[numCommands].buffer[++arrayIndex] =
+                cmd->buffer[++arrayIndex] =
                     (uint8_t)(address & 0xFF);
             } else {
-                allCommands->commands[numCommands].commandType = READ_REG_1;
-                allCommands->commands[numCommands].buffer[arrayIndex] =
+                cmd->commandType = READ_REG_1;
+                cmd->buffer[arrayIndex] =
                     (uint8_t)(address & 0xFF);
             }
             //save data length
-            allCommands->commands[numCommands].dataLength = 1;
-            numCommands++;
+            cmd->dataLength = 1;
+            allCommands->numCommands++;
         // Parse I2C read-write command in format "; rw DEV_ADDR SRC_ADDR DST_ADDR"
         // Only supports 1 byte data read-write
         } else if (sscanf(parsedLine, "; rw %x %x %x", &deviceAddress,
                           &readAddress, &writeAddress) == 3) {
-            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            cmd->deviceAddress = deviceAddress >> 1;
 
             // check source subAdd 1 or 2 bytes
             sscanf(parsedLine,"%*s %*s %*s %s", subAdd);
@@ -187,14 +279,14 @@ ParseRegistersFile(char *filename,
                     LOG_ERR("%s: I2C read-write must be same register size!\n", __func__);
                     goto failed;
                 }
-                allCommands->commands[numCommands].commandType = READ_WRITE_REG_2;
-                allCommands->commands[numCommands].buffer[arrayIndex] =
+                cmd->commandType = READ_WRITE_REG_2;
+                cmd->buffer[arrayIndex] =
                     (uint8_t)((readAddress >> 8) & 0xFF);
-                allCommands->commands[numCommands].buffer[++arrayIndex] =
+                cmd->buffer[++arrayIndex] =
                     (uint8_t)(readAddress & 0xFF);
-                allCommands->commands[numCommands].buffer[++arrayIndex] =
+                cmd->buffer[++arrayIndex] =
                     (uint8_t)((writeAddress >> 8) & 0xFF);
-                allCommands->commands[numCommands].buffer[++arrayIndex] =
+                cmd->buffer[++arrayIndex] =
                     (uint8_t)(writeAddress & 0xFF);
             } else {
                 sscanf(parsedLine,"%*s %*s %*s %*s %s", subAdd);
@@ -203,30 +295,30 @@ ParseRegistersFile(char *filename,
                     LOG_ERR("%s: I2C read-write must be same register size!\n", __func__);
                     goto failed;
                 }
-                allCommands->commands[numCommands].commandType = READ_WRITE_REG_1;
-                allCommands->commands[numCommands].buffer[arrayIndex] =
+                cmd->commandType = READ_WRITE_REG_1;
+                cmd->buffer[arrayIndex] =
                     (uint8_t)(readAddress & 0xFF);
-                allCommands->commands[numCommands].buffer[++arrayIndex] =
+                cmd->buffer[++arrayIndex] =
                     (uint8_t)(writeAddress & 0xFF);
             }
             //save data length
-            allCommands->commands[numCommands].dataLength = 1;
-            numCommands++;
+            cmd->dataLength = 1;
+            allCommands->numCommands++;
         } else if (sscanf(parsedLine,"%x %x %x", &deviceAddress, &address,
                          (uint32_t *)&value) == 3) {
-            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            cmd->deviceAddress = deviceAddress >> 1;
 
             // check subAdd 1 or 2 bytes
             sscanf(parsedLine,"%*s %s", subAdd);
             if (subAdd[2]!='\0') {
-                allCommands->commands[numCommands].commandType = WRITE_REG_2;
-                allCommands->commands[numCommands].buffer[arrayIndex] =
+                cmd->commandType = WRITE_REG_2;
+                cmd->buffer[arrayIndex] =
                     (uint8_t)((address >> 8) & 0xFF);
-                allCommands->commands[numCommands].buffer[++arrayIndex] =
+                cmd->buffer[++arrayIndex] =
                     (uint8_t)(address & 0xFF);
             } else {
-                allCommands->commands[numCommands].commandType = WRITE_REG_1;
-                allCommands->commands[numCommands].buffer[arrayIndex] =
+                cmd->commandType = WRITE_REG_1;
+                cmd->buffer[arrayIndex] =
                     (uint8_t)(address & 0xFF);
             }
 
@@ -235,30 +327,30 @@ ParseRegistersFile(char *filename,
                 if ((parsedLine[i] == ' ') && (parsedLine[i+1] != '\0')) {
                     if ((sscanf((parsedLine+i+1),"%x", (uint32_t *)&value)) >=1) {
                         count++;
-                        allCommands->commands[numCommands].buffer[++arrayIndex] =
+                        cmd->buffer[++arrayIndex] =
                         (uint8_t)(value & 0xFF);
                     }
                 }
             }
 
             //save data length
-            allCommands->commands[numCommands].dataLength = count;
+            cmd->dataLength = count;
 
 #ifdef DEBUG
-            if (allCommands->commands[numCommands].commandType == WRITE_REG_1) {
+            if (cmd->commandType == WRITE_REG_1) {
                 LOG_DBG("%s: %02x %02x %02x\n", __func__,
-                        allCommands->commands[numCommands].deviceAddress,
-                        allCommands->commands[numCommands].buffer[0],
-                        allCommands->commands[numCommands].buffer[1]);
+                        cmd->deviceAddress,
+                        cmd->buffer[0],
+                        cmd->buffer[1]);
             } else {
                 LOG_DBG("%s: %02x %02x%02x %02x\n", __func__,
-                        allCommands->commands[numCommands].deviceAddress,
-                        allCommands->commands[numCommands].buffer[0],
-                        allCommands->commands[numCommands].buffer[1],
-                        allCommands->commands[numCommands].buffer[2]);
+                        cmd->deviceAddress,
+                        cmd->buffer[0],
+                        cmd->buffer[1],
+                        cmd->buffer[2]);
             }
 #endif
-            numCommands++;
+            allCommands->numCommands++;
         } else if (sscanf(parsedLine, "; Interface: %s",
                   stringBuf) == 1) {
             params->interface.isUsed = NVMEDIA_TRUE;
@@ -344,7 +436,6 @@ ParseRegistersFile(char *filename,
         goto failed;
     }
 
-    allCommands->numCommands = numCommands;
     if (file)
         fclose(file);
     return NVMEDIA_STATUS_OK;
@@ -353,3 +444,27 @@ failed:
         fclose(file);
     return NVMEDIA_STATUS_ERROR;
 }
+
+NvMediaStatus
+ParseRegistersFile(char *filename,
+                   CaptureConfigParams *params,
+                   I2cCommands *allCommands)
+{
+    uint64_t hash = 0, size = 0;
+    NvMediaStatus status;
+
+    if (ScriptCacheHashFile(filename, &hash, &size) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to open file \"%s\"\n",__func__, filename);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    /* A compiled script skips parsing entirely */
+    if (ScriptCacheLoad(filename, hash, size, params, allCommands) == NVMEDIA_STATUS_OK)
+        return NVMEDIA_STATUS_OK;
+
+    status = _ParseRegistersText(filename, params, allCommands);
+    if (status == NVMEDIA_STATUS_OK)
+        ScriptCacheStore(filename, hash, size, params, allCommands);
+
+    return status;
+}
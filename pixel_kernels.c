@@ -0,0 +1,422 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include "pixel_kernels.h"
+
+/* PIXEL_KERNELS_DISABLE_NEON falls back to the scalar loops on ARM, to
+ * rule the NEON paths out when chasing a pixel difference */
+#if !defined(PIXEL_KERNELS_DISABLE_NEON) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define PIXEL_KERNELS_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXEL_KERNELS_SSE2
+#endif
+
+/* Samples per vector iteration */
+#define PIXEL_VECTOR_SAMPLES    16
+
+void
+PixelShiftRight16(uint16_t *samples,
+                  uint32_t numSamples,
+                  uint32_t shift,
+                  uint16_t mask)
+{
+    uint32_t i = 0;
+
+#if defined(PIXEL_KERNELS_NEON)
+    int16x8_t vShift = vdupq_n_s16(-(int16_t)shift);
+    uint16x8_t vMask = vdupq_n_u16(mask);
+    uint16x8_t v0, v1;
+
+    for (; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        v0 = vld1q_u16(samples + i);
+        v1 = vld1q_u16(samples + i + 8);
+        vst1q_u16(samples + i, vandq_u16(vshlq_u16(v0, vShift), vMask));
+        vst1q_u16(samples + i + 8, vandq_u16(vshlq_u16(v1, vShift), vMask));
+    }
+#elif defined(PIXEL_KERNELS_SSE2)
+    __m128i vShift = _mm_cvtsi32_si128(shift);
+    __m128i vMask = _mm_set1_epi16((short)mask);
+    __m128i v0, v1;
+
+    for (; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        v0 = _mm_loadu_si128((const __m128i *)(samples + i));
+        v1 = _mm_loadu_si128((const __m128i *)(samples + i + 8));
+        _mm_storeu_si128((__m128i *)(samples + i), _mm_and_si128(_mm_srl_epi16(v0, vShift), vMask));
+        _mm_storeu_si128((__m128i *)(samples + i + 8), _mm_and_si128(_mm_srl_epi16(v1, vShift), vMask));
+    }
+#endif
+
+    for (; i < numSamples; i++)
+        samples[i] = (samples[i] >> shift) & mask;
+}
+
+void
+PixelShiftLeft16(uint16_t *samples,
+                 uint32_t numSamples,
+                 uint32_t shift)
+{
+    uint32_t i = 0;
+
+#if defined(PIXEL_KERNELS_NEON)
+    int16x8_t vShift = vdupq_n_s16((int16_t)shift);
+
+    for (; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        vst1q_u16(samples + i, vshlq_u16(vld1q_u16(samples + i), vShift));
+        vst1q_u16(samples + i + 8, vshlq_u16(vld1q_u16(samples + i + 8), vShift));
+    }
+#elif defined(PIXEL_KERNELS_SSE2)
+    __m128i vShift = _mm_cvtsi32_si128(shift);
+
+    for (; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        _mm_storeu_si128((__m128i *)(samples + i),
+                         _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(samples + i)), vShift));
+        _mm_storeu_si128((__m128i *)(samples + i + 8),
+                         _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(samples + i + 8)), vShift));
+    }
+#endif
+
+    for (; i < numSamples; i++)
+        samples[i] = (uint16_t)(samples[i] << shift);
+}
+
+void
+PixelSwapBytes16(uint16_t *samples,
+                 uint32_t numSamples)
+{
+    uint32_t i = 0;
+
+#if defined(PIXEL_KERNELS_NEON)
+    uint8_t *bytes = (uint8_t *)samples;
+
+    for (; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        vst1q_u8(bytes + i * 2, vrev16q_u8(vld1q_u8(bytes + i * 2)));
+        vst1q_u8(bytes + i * 2 + 16, vrev16q_u8(vld1q_u8(bytes + i * 2 + 16)));
+    }
+#elif defined(PIXEL_KERNELS_SSE2)
+    __m128i v0, v1;
+
+    for (; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        v0 = _mm_loadu_si128((const __m128i *)(samples + i));
+        v1 = _mm_loadu_si128((const __m128i *)(samples + i + 8));
+        _mm_storeu_si128((__m128i *)(samples + i),
+                         _mm_or_si128(_mm_slli_epi16(v0, 8), _mm_srli_epi16(v0, 8)));
+        _mm_storeu_si128((__m128i *)(samples + i + 8),
+                         _mm_or_si128(_mm_slli_epi16(v1, 8), _mm_srli_epi16(v1, 8)));
+    }
+#endif
+
+    for (; i < numSamples; i++)
+        samples[i] = (uint16_t)((samples[i] << 8) | (samples[i] >> 8));
+}
+
+uint32_t
+PixelPackedSize(uint32_t numSamples,
+                uint32_t bits)
+{
+    return ((numSamples + 3) / 4) * (bits / 2);
+}
+
+/* Up to four samples become bits / 2 bytes */
+static inline void
+_PixelPackGroup(const uint16_t *src,
+                uint8_t *dst,
+                uint32_t num,
+                const uint32_t bits)
+{
+    const uint16_t mask = (1u << bits) - 1;
+    uint64_t group = 0;
+    uint32_t j;
+
+    for (j = 0; j < num; j++)
+        group |= (uint64_t)(src[j] & mask) << (bits * j);
+    for (j = 0; j < bits / 2; j++)
+        dst[j] = (uint8_t)(group >> (j * 8));
+}
+
+static inline void
+_PixelUnpackGroup(const uint8_t *src,
+                  uint16_t *dst,
+                  uint32_t num,
+                  const uint32_t bits)
+{
+    const uint16_t mask = (1u << bits) - 1;
+    uint64_t group = 0;
+    uint32_t j;
+
+    for (j = 0; j < bits / 2; j++)
+        group |= (uint64_t)src[j] << (j * 8);
+    for (j = 0; j < num; j++)
+        dst[j] = (uint16_t)(group >> (bits * j)) & mask;
+}
+
+/* A group of four samples takes bits / 2 bytes packed and 8 unpacked, so
+ * packing front to back and unpacking back to front only overwrite data
+ * already consumed, which makes both work in place. bits is a constant at
+ * each call, so the loops are specialized. */
+static inline void
+_PixelPackGroups(const uint16_t *src,
+                 uint8_t *dst,
+                 uint32_t first,
+                 uint32_t numSamples,
+                 const uint32_t bits)
+{
+    uint32_t i;
+
+    for (i = first; i + 4 <= numSamples; i += 4)
+        _PixelPackGroup(src + i, dst + (i / 4) * (bits / 2), 4, bits);
+    if (i < numSamples)
+        _PixelPackGroup(src + i, dst + (i / 4) * (bits / 2), numSamples - i, bits);
+}
+
+static inline void
+_PixelUnpackGroups(const uint8_t *src,
+                   uint16_t *dst,
+                   uint32_t first,
+                   uint32_t numSamples,
+                   const uint32_t bits)
+{
+    uint32_t i = numSamples & ~3u;
+
+    if (i < numSamples && i >= first)
+        _PixelUnpackGroup(src + (i / 4) * (bits / 2), dst + i, numSamples - i, bits);
+    while (i > first) {
+        i -= 4;
+        _PixelUnpackGroup(src + (i / 4) * (bits / 2), dst + i, 4, bits);
+    }
+}
+
+/* Two groups per 128-bit vector, each in a 64-bit lane: the lane masks
+ * pick the samples and the shifts close the gaps between them. A lane is
+ * stored as 8 bytes at its group, the bytes past bits / 2 land on the next
+ * group and get overwritten by it, so the vector loops stop while at least
+ * one sample follows. Packing still stays behind the samples it reads and
+ * unpacking ahead of the bytes it reads, so both keep working in place. */
+static inline void
+_PixelPackSamples(const uint16_t *src,
+                  uint8_t *dst,
+                  uint32_t numSamples,
+                  const uint32_t bits)
+{
+    const uint64_t mask = (1u << bits) - 1;
+    uint32_t i = 0;
+    uint32_t j;
+
+#if defined(PIXEL_KERNELS_NEON)
+    uint16x8_t vMask = vdupq_n_u16((uint16_t)mask);
+    uint64x2_t vLane[4];
+    int64x2_t vShift[4];
+    uint64x2_t w, g;
+
+    for (j = 0; j < 4; j++) {
+        vLane[j] = vdupq_n_u64(mask << (16 * j));
+        vShift[j] = vdupq_n_s64(-(int64_t)((16 - bits) * j));
+    }
+
+    for (; i + 8 < numSamples; i += 8) {
+        w = vreinterpretq_u64_u16(vandq_u16(vld1q_u16(src + i), vMask));
+        g = vandq_u64(w, vLane[0]);
+        for (j = 1; j < 4; j++)
+            g = vorrq_u64(g, vshlq_u64(vandq_u64(w, vLane[j]), vShift[j]));
+        vst1_u8(dst + (i / 4) * (bits / 2), vreinterpret_u8_u64(vget_low_u64(g)));
+        vst1_u8(dst + (i / 4 + 1) * (bits / 2), vreinterpret_u8_u64(vget_high_u64(g)));
+    }
+#elif defined(PIXEL_KERNELS_SSE2)
+    __m128i vMask = _mm_set1_epi16((short)mask);
+    __m128i vLane[4];
+    __m128i vShift[4];
+    __m128i w, g;
+
+    for (j = 0; j < 4; j++) {
+        vLane[j] = _mm_set1_epi64x((long long)(mask << (16 * j)));
+        vShift[j] = _mm_cvtsi32_si128((16 - bits) * j);
+    }
+
+    for (; i + 8 < numSamples; i += 8) {
+        w = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i)), vMask);
+        g = _mm_and_si128(w, vLane[0]);
+        for (j = 1; j < 4; j++)
+            g = _mm_or_si128(g, _mm_srl_epi64(_mm_and_si128(w, vLane[j]), vShift[j]));
+        _mm_storel_epi64((__m128i *)(dst + (i / 4) * (bits / 2)), g);
+        _mm_storel_epi64((__m128i *)(dst + (i / 4 + 1) * (bits / 2)), _mm_unpackhi_epi64(g, g));
+    }
+#else
+    (void)mask;
+    (void)j;
+#endif
+
+    _PixelPackGroups(src, dst, i, numSamples, bits);
+}
+
+static inline void
+_PixelUnpackSamples(const uint8_t *src,
+                    uint16_t *dst,
+                    uint32_t numSamples,
+                    const uint32_t bits)
+{
+    const uint64_t mask = (1u << bits) - 1;
+    uint32_t i = 0;
+    uint32_t j;
+#if defined(PIXEL_KERNELS_NEON)
+    uint64x2_t vLane[4];
+    int64x2_t vShift[4];
+    uint64x2_t w, g;
+#elif defined(PIXEL_KERNELS_SSE2)
+    __m128i vLane[4];
+    __m128i vShift[4];
+    __m128i w, g;
+#endif
+
+#if defined(PIXEL_KERNELS_NEON) || defined(PIXEL_KERNELS_SSE2)
+    if (numSamples)
+        i = (numSamples - 1) & ~7u;
+#endif
+    _PixelUnpackGroups(src, dst, i, numSamples, bits);
+
+#if defined(PIXEL_KERNELS_NEON)
+    for (j = 0; j < 4; j++) {
+        vLane[j] = vdupq_n_u64(mask << (16 * j));
+        vShift[j] = vdupq_n_s64((int64_t)((16 - bits) * j));
+    }
+
+    while (i) {
+        i -= 8;
+        g = vcombine_u64(vreinterpret_u64_u8(vld1_u8(src + (i / 4) * (bits / 2))),
+                         vreinterpret_u64_u8(vld1_u8(src + (i / 4 + 1) * (bits / 2))));
+        w = vandq_u64(g, vLane[0]);
+        for (j = 1; j < 4; j++)
+            w = vorrq_u64(w, vandq_u64(vshlq_u64(g, vShift[j]), vLane[j]));
+        vst1q_u16(dst + i, vreinterpretq_u16_u64(w));
+    }
+#elif defined(PIXEL_KERNELS_SSE2)
+    for (j = 0; j < 4; j++) {
+        vLane[j] = _mm_set1_epi64x((long long)(mask << (16 * j)));
+        vShift[j] = _mm_cvtsi32_si128((16 - bits) * j);
+    }
+
+    while (i) {
+        i -= 8;
+        g = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(src + (i / 4) * (bits / 2))),
+                               _mm_loadl_epi64((const __m128i *)(src + (i / 4 + 1) * (bits / 2))));
+        w = _mm_and_si128(g, vLane[0]);
+        for (j = 1; j < 4; j++)
+            w = _mm_or_si128(w, _mm_and_si128(_mm_sll_epi64(g, vShift[j]), vLane[j]));
+        _mm_storeu_si128((__m128i *)(dst + i), w);
+    }
+#else
+    (void)mask;
+    (void)j;
+#endif
+}
+
+#if defined(PIXEL_KERNELS_NEON)
+/* 12 bits split on byte boundaries, so NEON can do it with full vector
+ * stores instead: 16 samples, 24 bytes at a time: even samples give the first byte and
+ * the low nibble of the second, odd ones the high nibble and the third */
+static uint32_t
+_PixelPack12Neon(const uint16_t *src,
+                 uint8_t *dst,
+                 uint32_t numSamples)
+{
+    uint16x8_t vMask = vdupq_n_u16(0x0FFF);
+    uint16x8x2_t s;
+    uint16x8_t even, odd;
+    uint8x8x3_t b;
+    uint32_t i;
+
+    for (i = 0; i + PIXEL_VECTOR_SAMPLES <= numSamples; i += PIXEL_VECTOR_SAMPLES) {
+        s = vld2q_u16(src + i);
+        even = vandq_u16(s.val[0], vMask);
+        odd = vandq_u16(s.val[1], vMask);
+        b.val[0] = vmovn_u16(even);
+        b.val[1] = vmovn_u16(vorrq_u16(vshrq_n_u16(even, 8), vshlq_n_u16(odd, 4)));
+        b.val[2] = vshrn_n_u16(odd, 4);
+        vst3_u8(dst + i / 2 * 3, b);
+    }
+
+    return i;
+}
+
+static void
+_PixelUnpack12Neon(const uint8_t *src,
+                   uint16_t *dst,
+                   uint32_t numVectorSamples)
+{
+    uint16x8_t vNibble = vdupq_n_u16(0x0F);
+    uint16x8x2_t s;
+    uint16x8_t mid;
+    uint8x8x3_t b;
+    uint32_t i = numVectorSamples;
+
+    while (i) {
+        i -= PIXEL_VECTOR_SAMPLES;
+        b = vld3_u8(src + i / 2 * 3);
+        mid = vmovl_u8(b.val[1]);
+        s.val[0] = vorrq_u16(vmovl_u8(b.val[0]), vshlq_n_u16(vandq_u16(mid, vNibble), 8));
+        s.val[1] = vorrq_u16(vshrq_n_u16(mid, 4), vshlq_n_u16(vmovl_u8(b.val[2]), 4));
+        vst2q_u16(dst + i, s);
+    }
+}
+#endif
+
+uint32_t
+PixelPack(const uint16_t *src,
+          uint8_t *dst,
+          uint32_t numSamples,
+          uint32_t bits)
+{
+    switch (bits) {
+        case 10:
+            _PixelPackSamples(src, dst, numSamples, 10);
+            break;
+        case 12:
+#if defined(PIXEL_KERNELS_NEON)
+            _PixelPackGroups(src, dst, _PixelPack12Neon(src, dst, numSamples), numSamples, 12);
+#else
+            _PixelPackSamples(src, dst, numSamples, 12);
+#endif
+            break;
+        case 14:
+            _PixelPackSamples(src, dst, numSamples, 14);
+            break;
+        default:
+            return 0;
+    }
+
+    return PixelPackedSize(numSamples, bits);
+}
+
+uint32_t
+PixelUnpack(const uint8_t *src,
+            uint16_t *dst,
+            uint32_t numSamples,
+            uint32_t bits)
+{
+    switch (bits) {
+        case 10:
+            _PixelUnpackSamples(src, dst, numSamples, 10);
+            break;
+        case 12:
+#if defined(PIXEL_KERNELS_NEON)
+            _PixelUnpackGroups(src, dst, numSamples & ~(PIXEL_VECTOR_SAMPLES - 1), numSamples, 12);
+            _PixelUnpack12Neon(src, dst, numSamples & ~(PIXEL_VECTOR_SAMPLES - 1));
+#else
+            _PixelUnpackSamples(src, dst, numSamples, 12);
+#endif
+            break;
+        case 14:
+            _PixelUnpackSamples(src, dst, numSamples, 14);
+            break;
+        default:
+            return 0;
+    }
+
+    return PixelPackedSize(numSamples, bits);
+}
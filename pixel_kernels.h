@@ -0,0 +1,69 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __PIXEL_KERNELS_H__
+#define __PIXEL_KERNELS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Conversions of 16-bit raw samples, in the little endian order the
+ * capture hardware writes them. They use NEON or SSE2 when built for it,
+ * unless PIXEL_KERNELS_DISABLE_NEON is defined, and run in place. */
+
+/* sample = (sample >> shift) & mask, e.g. 2 and 0x0FFF to move the
+ * S1.14 aligned 12-bit samples of the capture to the LSBs */
+void
+PixelShiftRight16(uint16_t *samples,
+                  uint32_t numSamples,
+                  uint32_t shift,
+                  uint16_t mask);
+
+/* sample = sample << shift, to MSB align LSB aligned samples */
+void
+PixelShiftLeft16(uint16_t *samples,
+                 uint32_t numSamples,
+                 uint32_t shift);
+
+void
+PixelSwapBytes16(uint16_t *samples,
+                 uint32_t numSamples);
+
+/* Bytes taken by numSamples samples packed with PixelPack */
+uint32_t
+PixelPackedSize(uint32_t numSamples,
+                uint32_t bits);
+
+/* Packs LSB aligned samples of 10, 12 or 14 bits back to back, the first
+ * sample in the low bits of the first byte. Every four samples take
+ * bits / 2 bytes, a last partial group is padded with zeros. dst may be
+ * the same buffer as src. Returns the bytes written, 0 for other bit
+ * depths. */
+uint32_t
+PixelPack(const uint16_t *src,
+          uint8_t *dst,
+          uint32_t numSamples,
+          uint32_t bits);
+
+/* Reverses PixelPack. dst may be the same buffer as src if it is large
+ * enough for the unpacked samples. Returns the bytes read. */
+uint32_t
+PixelUnpack(const uint8_t *src,
+            uint16_t *dst,
+            uint32_t numSamples,
+            uint32_t bits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PIXEL_KERNELS_H__
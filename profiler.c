@@ -0,0 +1,222 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler.h"
+#include "cmdline.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+
+typedef struct {
+    const char                  *category;
+    char                         name[PROFILER_MAX_NAME];
+    uint64_t                     start;
+    uint64_t                     duration;
+    uint32_t                     line;
+    unsigned long                thread;
+} ProfilerEvent;
+
+typedef struct {
+    const char                  *category;
+    const char                  *name;
+    uint32_t                     count;
+    uint64_t                     total;
+    uint64_t                     max;
+} ProfilerStat;
+
+/* Written from every startup thread and from the group activation thread */
+static pthread_mutex_t profilerMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile NvMediaBool profilerEnabled = NVMEDIA_FALSE;
+static ProfilerEvent *profilerEvents = NULL;
+static uint32_t profilerNumEvents = 0;
+static uint32_t profilerNumDropped = 0;
+static uint64_t profilerOrigin = 0;
+static char profilerTraceFile[MAX_STRING_SIZE];
+
+NvMediaStatus
+ProfilerInit(const char *traceFile)
+{
+    pthread_mutex_lock(&profilerMutex);
+    profilerEvents = calloc(PROFILER_MAX_EVENTS, sizeof(ProfilerEvent));
+    if (!profilerEvents) {
+        pthread_mutex_unlock(&profilerMutex);
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    profilerNumEvents = 0;
+    profilerNumDropped = 0;
+    strncpy(profilerTraceFile, traceFile, MAX_STRING_SIZE - 1);
+    GetTimeMicroSec(&profilerOrigin);
+    profilerEnabled = NVMEDIA_TRUE;
+    pthread_mutex_unlock(&profilerMutex);
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaBool
+ProfilerEnabled(void)
+{
+    return profilerEnabled;
+}
+
+uint64_t
+ProfilerStart(void)
+{
+    uint64_t now = 0;
+
+    if (profilerEnabled)
+        GetTimeMicroSec(&now);
+    return now;
+}
+
+void
+ProfilerRecord(const char *category,
+               uint64_t start,
+               uint32_t line,
+               const char *nameFormat, ...)
+{
+    ProfilerEvent *event;
+    uint64_t now = 0;
+    va_list args;
+
+    if (!profilerEnabled)
+        return;
+
+    GetTimeMicroSec(&now);
+
+    pthread_mutex_lock(&profilerMutex);
+    if (!profilerEvents || profilerNumEvents == PROFILER_MAX_EVENTS) {
+        profilerNumDropped++;
+        pthread_mutex_unlock(&profilerMutex);
+        return;
+    }
+    event = &profilerEvents[profilerNumEvents++];
+    event->category = category;
+    event->start = start;
+    event->duration = now - start;
+    event->line = line;
+    event->thread = (unsigned long)pthread_self();
+    va_start(args, nameFormat);
+    vsnprintf(event->name, PROFILER_MAX_NAME, nameFormat, args);
+    va_end(args);
+    pthread_mutex_unlock(&profilerMutex);
+}
+
+static int
+_CompareStats(const void *a, const void *b)
+{
+    const ProfilerStat *statA = a, *statB = b;
+
+    if (statA->total != statB->total)
+        return (statA->total < statB->total) ? 1 : -1;
+    return strcmp(statA->name, statB->name);
+}
+
+static void
+_PrintReport(void)
+{
+    ProfilerStat *stats;
+    ProfilerEvent *event;
+    uint32_t i, j, numStats = 0;
+
+    stats = calloc(profilerNumEvents ? profilerNumEvents : 1, sizeof(ProfilerStat));
+    if (!stats) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return;
+    }
+
+    for (i = 0; i < profilerNumEvents; i++) {
+        event = &profilerEvents[i];
+        for (j = 0; j < numStats; j++) {
+            if (stats[j].category == event->category &&
+                !strcmp(stats[j].name, event->name))
+                break;
+        }
+        if (j == numStats) {
+            stats[j].category = event->category;
+            stats[j].name = event->name;
+            numStats++;
+        }
+        stats[j].count++;
+        stats[j].total += event->duration;
+        if (event->duration > stats[j].max)
+            stats[j].max = event->duration;
+    }
+
+    qsort(stats, numStats, sizeof(ProfilerStat), _CompareStats);
+
+    LOG_MSG("\nProfile (%u events, %u dropped):\n", profilerNumEvents, profilerNumDropped);
+    LOG_MSG("%-8s %-*s %8s %12s %12s\n", "category", PROFILER_MAX_NAME, "name",
+            "count", "total us", "max us");
+    for (i = 0; i < numStats; i++) {
+        LOG_MSG("%-8s %-*s %8u %12llu %12llu\n", stats[i].category,
+                PROFILER_MAX_NAME, stats[i].name, stats[i].count,
+                (unsigned long long)stats[i].total,
+                (unsigned long long)stats[i].max);
+    }
+
+    free(stats);
+}
+
+/* Chrome trace event format, loadable by chrome://tracing and Perfetto */
+static void
+_WriteTrace(void)
+{
+    ProfilerEvent *event;
+    FILE *file;
+    uint32_t i;
+
+    file = fopen(profilerTraceFile, "w");
+    if (!file) {
+        LOG_ERR("%s: Failed to open %s\n", __func__, profilerTraceFile);
+        return;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (i = 0; i < profilerNumEvents; i++) {
+        event = &profilerEvents[i];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                "\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%lu",
+                event->name, event->category,
+                (unsigned long long)(event->start - profilerOrigin),
+                (unsigned long long)event->duration, event->thread);
+        if (event->line)
+            fprintf(file, ",\"args\":{\"line\":%u}", event->line);
+        fprintf(file, "}%s\n", (i + 1 < profilerNumEvents) ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    if (fclose(file))
+        LOG_ERR("%s: Failed to write %s\n", __func__, profilerTraceFile);
+    else
+        LOG_MSG("Profile trace written to %s\n", profilerTraceFile);
+}
+
+void
+ProfilerFini(void)
+{
+    pthread_mutex_lock(&profilerMutex);
+    if (!profilerEnabled) {
+        pthread_mutex_unlock(&profilerMutex);
+        return;
+    }
+    profilerEnabled = NVMEDIA_FALSE;
+
+    _PrintReport();
+    _WriteTrace();
+
+    free(profilerEvents);
+    profilerEvents = NULL;
+    pthread_mutex_unlock(&profilerMutex);
+}
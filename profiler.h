@@ -0,0 +1,61 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "nvmedia_core.h"
+
+#define PROFILER_DEFAULT_TRACE      "nvmimg_cc_trace.json"
+#define PROFILER_MAX_EVENTS         65536
+#define PROFILER_MAX_NAME           48
+
+/* Event categories, also used as the "cat" of the trace */
+#define PROFILER_CAT_INIT           "init"
+#define PROFILER_CAT_SECTION        "section"
+#define PROFILER_CAT_DELAY          "delay"
+#define PROFILER_CAT_I2C            "i2c"
+#define PROFILER_CAT_COMPRESS       "compress"
+
+/* Starts recording. Until then, and after a failure here, every other
+ * call is a cheap no-op. */
+NvMediaStatus
+ProfilerInit(const char *traceFile);
+
+/* Logs the events aggregated by name, slowest total first, writes the
+ * trace and stops recording */
+void
+ProfilerFini(void);
+
+NvMediaBool
+ProfilerEnabled(void);
+
+/* Current time for the start of an event; 0 when not recording */
+uint64_t
+ProfilerStart(void);
+
+/* Records an event from start until now. Events with the same category and
+ * name are aggregated in the report, so names carry what the report should
+ * group by (device, script line, ...). A non-zero script line is kept with
+ * each event in the trace. */
+void
+ProfilerRecord(const char *category,
+               uint64_t start,
+               uint32_t line,
+               const char *nameFormat, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
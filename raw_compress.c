@@ -0,0 +1,543 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "raw_compress.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+#include "profiler.h"
+
+#define RAW_COMPRESS_R2(n)  n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define RAW_COMPRESS_R4(n)  RAW_COMPRESS_R2(n), RAW_COMPRESS_R2(n + 2 * 16), \
+                            RAW_COMPRESS_R2(n + 1 * 16), RAW_COMPRESS_R2(n + 3 * 16)
+#define RAW_COMPRESS_R6(n)  RAW_COMPRESS_R4(n), RAW_COMPRESS_R4(n + 2 * 4), \
+                            RAW_COMPRESS_R4(n + 1 * 4), RAW_COMPRESS_R4(n + 3 * 4)
+
+static const uint8_t bitReverse[256] = {
+    RAW_COMPRESS_R6(0), RAW_COMPRESS_R6(2), RAW_COMPRESS_R6(1), RAW_COMPRESS_R6(3)
+};
+
+static void
+_RawCompressTransform(uint16_t *samples,
+                      uint32_t numSamples,
+                      uint32_t transform)
+{
+    uint32_t i;
+    uint16_t word;
+
+    if (transform != RAW_COMPRESS_TRANSFORM_BIT_REVERSE)
+        return;
+
+    for (i = 0; i < numSamples; i++) {
+        word = (uint16_t)((bitReverse[samples[i] & 0xff] << 8) | bitReverse[samples[i] >> 8]);
+        samples[i] = (uint16_t)((word >> 2) | (word << 14));
+    }
+}
+
+static void
+_RawCompressUntransform(uint16_t *samples,
+                        uint32_t numSamples,
+                        uint32_t transform)
+{
+    uint32_t i;
+    uint16_t word;
+
+    if (transform != RAW_COMPRESS_TRANSFORM_BIT_REVERSE)
+        return;
+
+    for (i = 0; i < numSamples; i++) {
+        word = (uint16_t)((samples[i] << 2) | (samples[i] >> 14));
+        samples[i] = (uint16_t)(bitReverse[word >> 8] | (bitReverse[word & 0xff] << 8));
+    }
+}
+
+/* LOCO-I median edge detector */
+static inline uint32_t
+_RawCompressPredict(uint32_t left,
+                    uint32_t up,
+                    uint32_t upLeft)
+{
+    uint32_t lo = (left < up) ? left : up;
+    uint32_t hi = (left < up) ? up : left;
+
+    if (upLeft >= hi)
+        return lo;
+    if (upLeft <= lo)
+        return hi;
+    return left + up - upLeft;
+}
+
+/* Missing neighbours are taken from the ones present, so the first line
+ * is predicted from the left and the first column from above */
+#define RAW_COMPRESS_NEIGHBOURS(pixels, width, x, y, left, up, upLeft)             \
+    do {                                                                            \
+        up = (y) ? (pixels)[((y) - 1) * (width) + (x)] : 0;                         \
+        left = (x) ? (pixels)[(y) * (width) + (x) - 1] : up;                        \
+        if (!(y))                                                                   \
+            up = left;                                                              \
+        upLeft = ((x) && (y)) ? (pixels)[((y) - 1) * (width) + (x) - 1] : up;       \
+    } while (0)
+
+/* Residuals are zigzag coded so that small ones of either sign have a
+ * zero high byte, and stored as a plane of low bytes then one of high */
+static void
+_RawCompressEncode(const uint16_t *pixels,
+                   uint32_t width,
+                   uint32_t height,
+                   uint8_t *planes)
+{
+    uint32_t numSamples = width * height;
+    uint32_t x, y, left, up, upLeft;
+    uint16_t residual, coded;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            RAW_COMPRESS_NEIGHBOURS(pixels, width, x, y, left, up, upLeft);
+            residual = pixels[y * width + x] - _RawCompressPredict(left, up, upLeft);
+            coded = (uint16_t)(residual << 1) ^ (uint16_t)(-(residual >> 15));
+            planes[y * width + x] = coded & 0xff;
+            planes[numSamples + y * width + x] = coded >> 8;
+        }
+    }
+}
+
+static void
+_RawCompressDecode(const uint8_t *planes,
+                   uint32_t width,
+                   uint32_t height,
+                   uint16_t *pixels)
+{
+    uint32_t numSamples = width * height;
+    uint32_t x, y, left, up, upLeft;
+    uint16_t residual, coded;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            RAW_COMPRESS_NEIGHBOURS(pixels, width, x, y, left, up, upLeft);
+            coded = planes[y * width + x] | (planes[numSamples + y * width + x] << 8);
+            residual = (coded >> 1) ^ (uint16_t)(-(coded & 1));
+            pixels[y * width + x] = _RawCompressPredict(left, up, upLeft) + residual;
+        }
+    }
+}
+
+static NvMediaStatus
+_RawCompressReserve(uint8_t **buff,
+                    uint32_t *capacity,
+                    uint32_t size)
+{
+    if (size <= *capacity)
+        return NVMEDIA_STATUS_OK;
+
+    free(*buff);
+    *capacity = 0;
+    if (!(*buff = malloc(size))) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    *capacity = size;
+    return NVMEDIA_STATUS_OK;
+}
+
+static NvMediaStatus
+_RawCompressJob(RawCompressWorker *worker,
+                RawCompressJob *job)
+{
+    RawCompressHeader *header = &job->header;
+    uint32_t pixelsSize = header->rawSize - header->embeddedTopSize - header->embeddedBottomSize;
+    const uint8_t *input = job->raw;
+    FILE *file = NULL;
+    NvMediaStatus status;
+    int strategy = Z_DEFAULT_STRATEGY;
+
+    if (header->method == RAW_COMPRESS_PREDICTIVE) {
+        status = _RawCompressReserve(&worker->input, &worker->inputCapacity, header->rawSize);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+
+        /* The frame is a copy, the samples are transformed in place */
+        _RawCompressTransform((uint16_t *)(job->raw + header->embeddedTopSize),
+                              header->width * header->height, header->transform);
+        memcpy(worker->input, job->raw, header->embeddedTopSize);
+        _RawCompressEncode((const uint16_t *)(job->raw + header->embeddedTopSize),
+                           header->width, header->height,
+                           worker->input + header->embeddedTopSize);
+        memcpy(worker->input + header->embeddedTopSize + pixelsSize,
+               job->raw + header->embeddedTopSize + pixelsSize,
+               header->embeddedBottomSize);
+        input = worker->input;
+        /* The residuals are mostly runs of zero high bytes and a few
+         * distinct low ones, which need no match search */
+        strategy = Z_RLE;
+    }
+
+    status = _RawCompressReserve(&worker->output, &worker->outputCapacity,
+                                 deflateBound(&worker->stream, header->rawSize));
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+
+    if (deflateReset(&worker->stream) != Z_OK ||
+        deflateParams(&worker->stream, RAW_COMPRESS_LEVEL, strategy) != Z_OK) {
+        LOG_ERR("%s: Failed to reset deflate stream\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    worker->stream.next_in = (Bytef *)input;
+    worker->stream.avail_in = header->rawSize;
+    worker->stream.next_out = worker->output;
+    worker->stream.avail_out = worker->outputCapacity;
+    if (deflate(&worker->stream, Z_FINISH) != Z_STREAM_END) {
+        LOG_ERR("%s: deflate failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    header->compressedSize = worker->stream.total_out;
+
+    file = fopen(job->fileName, "wb");
+    if (!file) {
+        LOG_ERR("%s: Failed to open file %s\n", __func__, job->fileName);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (fwrite(header, sizeof(RawCompressHeader), 1, file) != 1 ||
+        fwrite(worker->output, header->compressedSize, 1, file) != 1) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+    }
+    fclose(file);
+
+    return status;
+}
+
+static uint32_t
+_RawCompressThreadFunc(void *data)
+{
+    RawCompressWorker *worker = data;
+    NvRawCompressPool *pool = worker->pool;
+    RawCompressJob *job = NULL;
+    uint64_t start = 0, end = 0;
+    NvMediaStatus status;
+
+    while (1) {
+        while (NvQueueGet(pool->workQueue, &job, RAW_COMPRESS_DEQUEUE_TIMEOUT) !=
+               NVMEDIA_STATUS_OK)
+            ;
+        /* NULL is the stop request, queued after the last frame */
+        if (!job)
+            break;
+
+        GetTimeMicroSec(&start);
+        status = _RawCompressJob(worker, job);
+        GetTimeMicroSec(&end);
+        ProfilerRecord(PROFILER_CAT_COMPRESS, start, 0, "frame");
+
+        pthread_mutex_lock(&pool->statsMutex);
+        if (status == NVMEDIA_STATUS_OK) {
+            pool->rawBytes += job->header.rawSize;
+            pool->compressedBytes += job->header.compressedSize;
+            pool->numFrames++;
+        } else {
+            pool->numFailed++;
+        }
+        pthread_mutex_unlock(&pool->statsMutex);
+
+        if (status == NVMEDIA_STATUS_OK)
+            LOG_DBG("%s: frame %u %u -> %u bytes (%.2f:1) in %llu us\n", __func__,
+                    job->header.frameNumber, job->header.rawSize,
+                    job->header.compressedSize,
+                    (double)job->header.rawSize / job->header.compressedSize,
+                    (unsigned long long)(end - start));
+        else
+            LOG_ERR("%s: Failed to write %s\n", __func__, job->fileName);
+
+        if (NvQueuePut(pool->freeQueue, &job, 0) != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to return job\n", __func__);
+    }
+
+    return 0;
+}
+
+NvMediaStatus
+RawCompressPoolCreate(NvRawCompressPool **pool,
+                      uint32_t numWorkers)
+{
+    NvRawCompressPool *newPool = NULL;
+    RawCompressJob *job;
+    uint32_t i;
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    if (!numWorkers || numWorkers > RAW_COMPRESS_MAX_WORKERS) {
+        LOG_ERR("%s: Number of workers must be 1 to %u\n", __func__,
+                RAW_COMPRESS_MAX_WORKERS);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    newPool = calloc(1, sizeof(NvRawCompressPool));
+    if (!newPool) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    if (pthread_mutex_init(&newPool->statsMutex, NULL)) {
+        LOG_ERR("%s: Failed to create mutex\n", __func__);
+        free(newPool);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    /* Every worker can have a frame in flight and one waiting */
+    newPool->numJobs = numWorkers * RAW_COMPRESS_JOBS_PER_WORKER;
+    newPool->jobs = calloc(newPool->numJobs, sizeof(RawCompressJob));
+    if (!newPool->jobs) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+        goto failed;
+    }
+
+    if (NvQueueCreate(&newPool->freeQueue, newPool->numJobs,
+                      sizeof(RawCompressJob *)) != NVMEDIA_STATUS_OK ||
+        NvQueueCreate(&newPool->workQueue, newPool->numJobs + numWorkers,
+                      sizeof(RawCompressJob *)) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create queues\n", __func__);
+        goto failed;
+    }
+    for (i = 0; i < newPool->numJobs; i++) {
+        job = &newPool->jobs[i];
+        if (NvQueuePut(newPool->freeQueue, &job, 0) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to queue job\n", __func__);
+            goto failed;
+        }
+    }
+
+    for (i = 0; i < numWorkers; i++) {
+        newPool->workers[i].pool = newPool;
+        if (deflateInit(&newPool->workers[i].stream, RAW_COMPRESS_LEVEL) != Z_OK) {
+            LOG_ERR("%s: Failed to create deflate stream\n", __func__);
+            goto failed;
+        }
+        newPool->workers[i].streamValid = NVMEDIA_TRUE;
+    }
+
+    for (i = 0; i < numWorkers; i++) {
+        if (NvThreadCreate(&newPool->threads[i], &_RawCompressThreadFunc,
+                           &newPool->workers[i], NV_THREAD_PRIORITY_NORMAL) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create compression thread %u\n", __func__, i);
+            goto failed;
+        }
+        newPool->numWorkers++;
+    }
+
+    LOG_INFO("%s: %u compression workers\n", __func__, numWorkers);
+    *pool = newPool;
+    return NVMEDIA_STATUS_OK;
+
+failed:
+    RawCompressPoolDestroy(newPool);
+    return status;
+}
+
+void
+RawCompressPoolDestroy(NvRawCompressPool *pool)
+{
+    RawCompressJob *job = NULL;
+    uint32_t i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->numWorkers; i++) {
+        if (NvQueuePut(pool->workQueue, &job, RAW_COMPRESS_DEQUEUE_TIMEOUT) != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to stop compression thread %u\n", __func__, i);
+    }
+    for (i = 0; i < pool->numWorkers; i++)
+        NvThreadDestroy(pool->threads[i]);
+
+    if (pool->numFrames)
+        LOG_INFO("%s: %u frames, %llu -> %llu bytes (%.2f:1), %u dropped, %u failed\n",
+                 __func__, pool->numFrames,
+                 (unsigned long long)pool->rawBytes,
+                 (unsigned long long)pool->compressedBytes,
+                 (double)pool->rawBytes / pool->compressedBytes,
+                 pool->numDropped, pool->numFailed);
+
+    for (i = 0; i < RAW_COMPRESS_MAX_WORKERS; i++) {
+        if (pool->workers[i].streamValid)
+            deflateEnd(&pool->workers[i].stream);
+        free(pool->workers[i].input);
+        free(pool->workers[i].output);
+    }
+    if (pool->jobs) {
+        for (i = 0; i < pool->numJobs; i++)
+            free(pool->jobs[i].raw);
+        free(pool->jobs);
+    }
+    if (pool->workQueue)
+        NvQueueDestroy(pool->workQueue);
+    if (pool->freeQueue)
+        NvQueueDestroy(pool->freeQueue);
+    pthread_mutex_destroy(&pool->statsMutex);
+    free(pool);
+}
+
+NvMediaStatus
+RawCompressSubmit(NvRawCompressPool *pool,
+                  NvMediaImage *image,
+                  uint32_t bytesPerSample,
+                  RawCompressTransform transform,
+                  uint32_t frameNumber,
+                  const char *fileName)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    RawCompressJob *job = NULL;
+    uint8_t *dstBuff[3] = {NULL};
+    uint32_t dstPitches[3] = {1};
+    uint32_t pitch, size;
+    NvMediaStatus status;
+
+    if (bytesPerSample != 1 && bytesPerSample != 2) {
+        LOG_ERR("%s: Compression applies only to RAW captured images\n", __func__);
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+
+    if (NvQueueGet(pool->freeQueue, &job, RAW_COMPRESS_JOB_TIMEOUT) != NVMEDIA_STATUS_OK) {
+        pthread_mutex_lock(&pool->statsMutex);
+        pool->numDropped++;
+        pthread_mutex_unlock(&pool->statsMutex);
+        LOG_WARN("%s: Compression is behind, frame %u dropped\n", __func__, frameNumber);
+        return NVMEDIA_STATUS_TIMED_OUT;
+    }
+
+    pitch = image->width * bytesPerSample;
+    size = pitch * image->height + image->embeddedDataTopSize + image->embeddedDataBottomSize;
+    status = _RawCompressReserve(&job->raw, &job->rawCapacity, size);
+    if (status != NVMEDIA_STATUS_OK)
+        goto failed;
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+        goto failed;
+    }
+    dstBuff[0] = job->raw;
+    dstPitches[0] = pitch;
+    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+        goto failed;
+    }
+
+    memset(&job->header, 0, sizeof(job->header));
+    job->header.magic = RAW_COMPRESS_MAGIC;
+    job->header.version = RAW_COMPRESS_VERSION;
+    job->header.headerSize = sizeof(RawCompressHeader);
+    job->header.width = image->width;
+    job->header.height = image->height;
+    job->header.bytesPerSample = bytesPerSample;
+    job->header.method = (bytesPerSample == 2) ? RAW_COMPRESS_PREDICTIVE : RAW_COMPRESS_DEFLATE;
+    job->header.embeddedTopSize = image->embeddedDataTopSize;
+    job->header.embeddedBottomSize = image->embeddedDataBottomSize;
+    job->header.rawSize = size;
+    job->header.frameNumber = frameNumber;
+    job->header.transform = (job->header.method == RAW_COMPRESS_PREDICTIVE) ?
+                            transform : RAW_COMPRESS_TRANSFORM_NONE;
+    strncpy(job->fileName, fileName, MAX_STRING_SIZE - 1);
+    job->fileName[MAX_STRING_SIZE - 1] = '\0';
+
+    /* Room for every job, so this does not block */
+    if (NvQueuePut(pool->workQueue, &job, 0) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to queue frame %u\n", __func__, frameNumber);
+        status = NVMEDIA_STATUS_ERROR;
+        goto failed;
+    }
+
+    return NVMEDIA_STATUS_OK;
+
+failed:
+    NvQueuePut(pool->freeQueue, &job, 0);
+    return status;
+}
+
+NvMediaStatus
+RawCompressReadHeader(FILE *file,
+                      RawCompressHeader *header)
+{
+    if (fseek(file, 0, SEEK_SET) ||
+        fread(header, sizeof(RawCompressHeader), 1, file) != 1) {
+        LOG_ERR("%s: Failed to read header\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    /* Version 1 headers end before the transform */
+    if (header->version == 1)
+        header->transform = RAW_COMPRESS_TRANSFORM_NONE;
+
+    if (header->magic != RAW_COMPRESS_MAGIC ||
+        header->version < 1 || header->version > RAW_COMPRESS_VERSION ||
+        header->headerSize < ((header->version == 1) ?
+                              offsetof(RawCompressHeader, transform) : sizeof(RawCompressHeader)) ||
+        (header->method == RAW_COMPRESS_PREDICTIVE && header->bytesPerSample != 2) ||
+        header->transform >= RAW_COMPRESS_TRANSFORM_END ||
+        (header->transform != RAW_COMPRESS_TRANSFORM_NONE &&
+         header->method != RAW_COMPRESS_PREDICTIVE) ||
+        header->rawSize != header->width * header->height * header->bytesPerSample +
+                           header->embeddedTopSize + header->embeddedBottomSize) {
+        LOG_ERR("%s: Not a compressed raw file\n", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+RawCompressReadFrame(FILE *file,
+                     const RawCompressHeader *header,
+                     uint8_t *buff)
+{
+    uint8_t *compressed = NULL, *planes = NULL;
+    uint32_t pixelsSize = header->rawSize - header->embeddedTopSize - header->embeddedBottomSize;
+    uLongf size = header->rawSize;
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    compressed = malloc(header->compressedSize);
+    if (!compressed) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    if (fseek(file, header->headerSize, SEEK_SET) ||
+        fread(compressed, header->compressedSize, 1, file) != 1) {
+        LOG_ERR("%s: Failed to read stream\n", __func__);
+        goto done;
+    }
+
+    if (uncompress(buff, &size, compressed, header->compressedSize) != Z_OK ||
+        size != header->rawSize) {
+        LOG_ERR("%s: Corrupt stream\n", __func__);
+        goto done;
+    }
+
+    if (header->method == RAW_COMPRESS_PREDICTIVE) {
+        planes = malloc(pixelsSize);
+        if (!planes) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+            goto done;
+        }
+        memcpy(planes, buff + header->embeddedTopSize, pixelsSize);
+        _RawCompressDecode(planes, header->width, header->height,
+                           (uint16_t *)(buff + header->embeddedTopSize));
+        _RawCompressUntransform((uint16_t *)(buff + header->embeddedTopSize),
+                                header->width * header->height, header->transform);
+    }
+    status = NVMEDIA_STATUS_OK;
+
+done:
+    free(compressed);
+    free(planes);
+    return status;
+}
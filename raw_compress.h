@@ -0,0 +1,150 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __RAW_COMPRESS_H__
+#define __RAW_COMPRESS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "nvmedia_core.h"
+#include "nvmedia_image.h"
+#include "thread_utils.h"
+#include "cmdline.h"
+
+/* A .zraw file holds one raw frame compressed losslessly. It starts with
+ * RawCompressHeader, in little endian order, followed by one deflate
+ * stream. With RAW_COMPRESS_PREDICTIVE the stream holds the top embedded
+ * lines, the low and then the high bytes of the prediction residuals of
+ * the pixels and the bottom embedded lines; otherwise it holds the frame
+ * as captured. The pixels are predicted after the sample transform of the
+ * header, which decoding inverts. */
+
+#define RAW_COMPRESS_MAGIC              0x5741525A  /* "ZRAW" */
+#define RAW_COMPRESS_VERSION            2           /* 1: no transform field */
+
+#define RAW_COMPRESS_MAX_WORKERS        8
+#define RAW_COMPRESS_JOBS_PER_WORKER    2
+#define RAW_COMPRESS_DEQUEUE_TIMEOUT    100
+#define RAW_COMPRESS_JOB_TIMEOUT        20     /* frames are dropped past it */
+#define RAW_COMPRESS_LEVEL              1
+
+typedef enum {
+    RAW_COMPRESS_DEFLATE = 0,
+    /* 16-bit samples, predicted from their left, upper and upper left
+     * neighbours by the LOCO-I median predictor */
+    RAW_COMPRESS_PREDICTIVE,
+} RawCompressMethod;
+
+/* Maps stored samples to values which are linear in the scene, so that
+ * neighbours predict each other. Lossless on all 16 bits. */
+typedef enum {
+    RAW_COMPRESS_TRANSFORM_NONE = 0,
+    /* Boson raw words: both bytes bit reversed, the value in bits 2 to 15
+     * of the result. The two spare bits are rotated to the top. */
+    RAW_COMPRESS_TRANSFORM_BIT_REVERSE,
+    RAW_COMPRESS_TRANSFORM_END
+} RawCompressTransform;
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    headerSize;     // offset of the stream
+    uint32_t                    width;
+    uint32_t                    height;         // pixel lines, without embedded ones
+    uint32_t                    bytesPerSample;
+    uint32_t                    method;
+    uint32_t                    embeddedTopSize;    // bytes
+    uint32_t                    embeddedBottomSize; // bytes
+    uint32_t                    rawSize;        // bytes of the frame as captured
+    uint32_t                    compressedSize; // bytes of the stream
+    uint32_t                    frameNumber;
+    uint32_t                    transform;      // RawCompressTransform, predictive only
+} RawCompressHeader;
+
+typedef struct {
+    RawCompressHeader           header;
+    uint8_t                    *raw;            // frame as captured
+    uint32_t                    rawCapacity;
+    char                        fileName[MAX_STRING_SIZE];
+} RawCompressJob;
+
+struct NvRawCompressPool;
+
+typedef struct {
+    struct NvRawCompressPool   *pool;
+    z_stream                    stream;
+    NvMediaBool                 streamValid;
+    uint8_t                    *input;          // stream input of a frame
+    uint32_t                    inputCapacity;
+    uint8_t                    *output;
+    uint32_t                    outputCapacity;
+} RawCompressWorker;
+
+/* Workers compressing and writing the frames the save threads submit */
+typedef struct NvRawCompressPool {
+    NvThread                   *threads[RAW_COMPRESS_MAX_WORKERS];
+    RawCompressWorker           workers[RAW_COMPRESS_MAX_WORKERS];
+    uint32_t                    numWorkers;
+    RawCompressJob             *jobs;
+    uint32_t                    numJobs;
+    NvQueue                    *freeQueue;      // jobs ready for a frame
+    NvQueue                    *workQueue;      // frames to compress, NULL stops a worker
+
+    /* Totals, reported when the pool is destroyed */
+    pthread_mutex_t             statsMutex;
+    uint64_t                    rawBytes;
+    uint64_t                    compressedBytes;
+    uint32_t                    numFrames;
+    uint32_t                    numDropped;
+    uint32_t                    numFailed;
+} NvRawCompressPool;
+
+NvMediaStatus
+RawCompressPoolCreate(NvRawCompressPool **pool,
+                      uint32_t numWorkers);
+
+/* Writes the frames still queued, stops the workers and reports the
+ * totals. Safe on NULL. */
+void
+RawCompressPoolDestroy(NvRawCompressPool *pool);
+
+/* Copies image and queues it to be written to fileName. The frame is
+ * dropped if no job frees up in RAW_COMPRESS_JOB_TIMEOUT ms. transform
+ * applies to 16-bit samples only. */
+NvMediaStatus
+RawCompressSubmit(NvRawCompressPool *pool,
+                  NvMediaImage *image,
+                  uint32_t bytesPerSample,
+                  RawCompressTransform transform,
+                  uint32_t frameNumber,
+                  const char *fileName);
+
+/* Reads and checks the header of a .zraw file */
+NvMediaStatus
+RawCompressReadHeader(FILE *file,
+                      RawCompressHeader *header);
+
+/* Reads the frame of the file header was read from, as captured. buff
+ * holds rawSize bytes. */
+NvMediaStatus
+RawCompressReadFrame(FILE *file,
+                     const RawCompressHeader *header,
+                     uint8_t *buff);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RAW_COMPRESS_H__
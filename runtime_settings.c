@@ -10,6 +10,7 @@
 #include "runtime_settings.h"
 #include "capture.h"
 #include "os_common.h"
+#include "shutdown.h"
 
 #define MAX_COMMAND_LINE_SIZE 500
 
@@ -91,40 +92,190 @@ failed:
     return status;
 }
 
+/* Finds the value reg holds before command of setting index runs, once the
+ * settings go round-robin: the last write to it earlier in the setting,
+ * else in the settings before, else later in the setting itself in the
+ * previous round */
+static NvMediaBool
+_FindPreviousWrite(NvRuntimeSettingsContext *runtimeCtx,
+                   uint32_t index,
+                   uint32_t command,
+                   uint32_t deviceAddress,
+                   uint32_t reg,
+                   uint8_t *value)
+{
+    RuntimeSettings *settings;
+    uint32_t k;
+
+    if (I2cFindLastWrite(runtimeCtx->rtSettings[index].cmds, command,
+                         deviceAddress, reg, value))
+        return NVMEDIA_TRUE;
+
+    for (k = 1; k <= runtimeCtx->numRtSettings; k++) {
+        settings = &runtimeCtx->rtSettings[(index + runtimeCtx->numRtSettings - k) %
+                                           runtimeCtx->numRtSettings];
+        if (I2cFindLastWrite(settings->cmds, settings->cmds->numCommands,
+                             deviceAddress, reg, value))
+            return NVMEDIA_TRUE;
+    }
+
+    return NVMEDIA_FALSE;
+}
+
+/* Builds the commands which take the sensor from the previous setting to
+ * setting index: writes which leave every register as it was are dropped,
+ * other commands are kept unless no write is left. Writes to registers the
+ * shadow treats as volatile, like FIFO ports, always count. */
+static NvMediaStatus
+_BuildSettingsDiff(NvRuntimeSettingsContext *runtimeCtx,
+                   uint32_t index)
+{
+    RuntimeSettings *settings = &runtimeCtx->rtSettings[index];
+    Command *cmd, *diffCmd;
+    uint32_t i, j, addrLen, reg, numWrites = 0;
+    uint8_t value;
+    NvMediaBool changed;
+
+    for (i = 0; i < settings->cmds->numCommands; i++) {
+        cmd = I2C_COMMAND(settings->cmds, i);
+        if (cmd->commandType == WRITE_REG_1 || cmd->commandType == WRITE_REG_2) {
+            addrLen = (cmd->commandType == WRITE_REG_1) ? 1 : 2;
+            reg = (addrLen == 1) ? cmd->buffer[0] : ((cmd->buffer[0] << 8) | cmd->buffer[1]);
+            changed = NVMEDIA_FALSE;
+            for (j = 0; j < cmd->dataLength && !changed; j++) {
+                if (I2cShadowIsVolatile(runtimeCtx->calParam->i2cDevice,
+                                        cmd->deviceAddress, reg + j) ||
+                    !_FindPreviousWrite(runtimeCtx, index, i, cmd->deviceAddress,
+                                        reg + j, &value) ||
+                    value != cmd->buffer[addrLen + j])
+                    changed = NVMEDIA_TRUE;
+            }
+            if (!changed)
+                continue;
+            numWrites++;
+        }
+
+        diffCmd = I2cNewCommand(&settings->diff);
+        if (!diffCmd)
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        *diffCmd = *cmd;
+        settings->diff.numCommands++;
+    }
+
+    if (!numWrites)
+        I2cSetNumCommands(&settings->diff, 0);
+
+    LOG_INFO("%s: Setting %u writes %u of %u commands after setting %u\n", __func__,
+             index, settings->diff.numCommands, settings->cmds->numCommands,
+             (index + runtimeCtx->numRtSettings - 1) % runtimeCtx->numRtSettings);
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Applies setting i and records the first frame captured with it. Writes
+ * finished during a frame take effect from the next one. The sensor state
+ * is only read after whole settings, diffs end in the same state. */
+static void
+_ApplySettings(NvRuntimeSettingsContext *runtimeCtx,
+               uint32_t i,
+               NvMediaBool full)
+{
+    RuntimeSettings *settings = &runtimeCtx->rtSettings[i];
+    RuntimeSettingsChange *change;
+    uint32_t firstFrame;
+
+    I2cProcessCommands(full ? settings->cmds : &settings->diff, I2C_WRITE,
+                       runtimeCtx->calParam->i2cDevice);
+    firstFrame = *runtimeCtx->currentFrame + 1;
+
+    pthread_mutex_lock(&runtimeCtx->historyMutex);
+    change = &runtimeCtx->history[runtimeCtx->numChanges % RUNTIME_SETTINGS_HISTORY];
+    change->firstFrame = firstFrame;
+    change->setting = i;
+    runtimeCtx->numChanges++;
+    pthread_mutex_unlock(&runtimeCtx->historyMutex);
+
+    if (full || !settings->state.valid)
+        SensorStateRefresh(runtimeCtx->sensorState, firstFrame, &settings->state);
+    else
+        SensorStatePublish(runtimeCtx->sensorState, firstFrame, &settings->state);
+
+    runtimeCtx->currentRtSettings = i;
+}
+
 static uint32_t
 _RuntimeSettingsThreadFunc(void *data)
 {
     NvRuntimeSettingsContext *runtimeCtx  =(NvRuntimeSettingsContext *)data;
-    RuntimeSettings *settings;
-    uint32_t i = 0, frameNum = 0;
+    uint32_t i = 0, frame, frameNum = 0, selected;
+    /* Diffs assume the registers hold what the previous settings left, so
+     * whole settings are applied for a round at start and after a jump */
+    uint32_t numFull = runtimeCtx->numRtSettings;
 
-    settings = &runtimeCtx->rtSettings[0];
+    frame = *runtimeCtx->currentFrame;
     while(!(*runtimeCtx->quit)) {
+        _ApplySettings(runtimeCtx, i, numFull ? NVMEDIA_TRUE : NVMEDIA_FALSE);
+        if(numFull)
+            numFull--;
+
         // Wait till required number of frames are captured
-        frameNum += settings->numFrames;
-        while(*runtimeCtx->currentFrame < frameNum) {
-            nvsleep(1000);
+        frameNum += runtimeCtx->rtSettings[i].numFrames;
+        selected = runtimeCtx->numRtSettings;
+        while(frame < frameNum) {
+            frame = FrameEventWait(runtimeCtx->frameEvent, frame + 1,
+                                   RUNTIME_SETTINGS_WAIT_TIMEOUT, NULL);
             if(*runtimeCtx->quit)
                 goto done;
+            // A set selected over the control socket applies at the next frame
+            if(MailboxTake(&runtimeCtx->mailbox) & MAILBOX_BIT(MAILBOX_MSG_SELECT_SETTINGS)) {
+                selected = MailboxArg(&runtimeCtx->mailbox, MAILBOX_MSG_SELECT_SETTINGS);
+                break;
+            }
         }
 
-        i++;
-        // Reset to 0 since its round-robin
-        if(i == runtimeCtx->numRtSettings) {
-            i = 0;
+        if(selected < runtimeCtx->numRtSettings) {
+            // Round-robin resumes after a full interval of the selected set
+            i = selected;
+            frameNum = frame;
+            numFull = runtimeCtx->numRtSettings;
+        } else {
+            i++;
+            // Reset to 0 since its round-robin
+            if(i == runtimeCtx->numRtSettings) {
+                i = 0;
+            }
         }
-
-        settings = &runtimeCtx->rtSettings[i];
-        // Apply settings
-        I2cProcessCommands(settings->cmds, I2C_WRITE, runtimeCtx->calParam->i2cDevice);
-        runtimeCtx->currentRtSettings = i;
     }
 done:
-    runtimeCtx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&runtimeCtx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 
 }
 
+uint32_t
+RuntimeSettingsGetFrameSetting(NvRuntimeSettingsContext *runtimeCtx,
+                               uint32_t frame)
+{
+    RuntimeSettingsChange *change;
+    uint32_t i, numKept, setting = 0;
+
+    if(!runtimeCtx->historyValid)
+        return 0;
+
+    /* Frames older than the history get its oldest setting */
+    pthread_mutex_lock(&runtimeCtx->historyMutex);
+    numKept = (runtimeCtx->numChanges < RUNTIME_SETTINGS_HISTORY) ?
+              runtimeCtx->numChanges : RUNTIME_SETTINGS_HISTORY;
+    for(i = 1; i <= numKept; i++) {
+        change = &runtimeCtx->history[(runtimeCtx->numChanges - i) % RUNTIME_SETTINGS_HISTORY];
+        setting = change->setting;
+        if(change->firstFrame <= frame)
+            break;
+    }
+    pthread_mutex_unlock(&runtimeCtx->historyMutex);
+
+    return setting;
+}
+
 NvMediaStatus
 RuntimeSettingsInit(NvMainContext *mainCtx)
 {
@@ -152,7 +303,9 @@ RuntimeSettingsInit(NvMainContext *mainCtx)
     runtimeCtx->quit = &mainCtx->quit;
     runtimeCtx->exitedFlag = NVMEDIA_TRUE;
     runtimeCtx->currentFrame =  &captureCtx->threadCtx[0].currentFrame;
+    runtimeCtx->frameEvent = &captureCtx->threadCtx[0].frameEvent;
     runtimeCtx->calParam = &captureCtx->calParams;
+    runtimeCtx->sensorState = &captureCtx->sensorState;
 
     if(!mainCtx->testArgs->rtSettings.isUsed)
         return NVMEDIA_STATUS_OK;
@@ -201,6 +354,23 @@ RuntimeSettingsInit(NvMainContext *mainCtx)
     }
 
     free(properties);
+    properties = NULL;
+
+    /* Only register changes are written while going round-robin */
+    for(i = 0; i < runtimeCtx->numRtSettings; i++) {
+        status = _BuildSettingsDiff(runtimeCtx, i);
+        if(status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("Failed to build settings diff\n");
+            goto failed;
+        }
+    }
+
+    if(pthread_mutex_init(&runtimeCtx->historyMutex, NULL)) {
+        LOG_ERR("%s: Failed to create mutex\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+        goto failed;
+    }
+    runtimeCtx->historyValid = NVMEDIA_TRUE;
 
     return NVMEDIA_STATUS_OK;
 failed:
@@ -228,10 +398,10 @@ RuntimeSettingsFini(NvMainContext *mainCtx)
         return NVMEDIA_STATUS_OK;
 
     /* Wait for thread to exit */
-    while(!runtimeCtx->exitedFlag) {
-        LOG_DBG("%s: Waiting for runtime settings thread to quit\n", __func__);
-    }
-    *runtimeCtx->quit = NVMEDIA_TRUE;
+    if(runtimeCtx->runtimeSettingsThread &&
+       IsFailed(ShutdownWaitExit(&runtimeCtx->exitedFlag, "Runtime settings thread")))
+        return NVMEDIA_STATUS_TIMED_OUT;
+
     if(runtimeCtx->runtimeSettingsThread) {
         status = NvThreadDestroy(runtimeCtx->runtimeSettingsThread);
         if(status != NVMEDIA_STATUS_OK)
@@ -243,8 +413,11 @@ RuntimeSettingsFini(NvMainContext *mainCtx)
         settings = &runtimeCtx->rtSettings[i];
         if(!settings)
             break;
-        if(settings->cmds)
+        if(settings->cmds) {
+            I2cFreeCommands(settings->cmds);
             free(settings->cmds);
+        }
+        I2cFreeCommands(&settings->diff);
         for (j = 0; j < settings->argc; j++) {
             if (settings->argv[j])
                 free(settings->argv[j]);
@@ -254,6 +427,9 @@ RuntimeSettingsFini(NvMainContext *mainCtx)
     if(runtimeCtx->rtSettings)
         free(runtimeCtx->rtSettings);
 
+    if(runtimeCtx->historyValid)
+        pthread_mutex_destroy(&runtimeCtx->historyMutex);
+
     free(runtimeCtx);
     return NVMEDIA_STATUS_OK;
 }
@@ -13,19 +13,33 @@
 #include "main.h"
 #include "sensor_info.h"
 #include "thread_utils.h"
+#include "mailbox.h"
+#include "frame_event.h"
+#include "sensor_state.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define RUNTIME_SETTINGS_WAIT_TIMEOUT   100    /* ms between checks of the quit flag */
+#define RUNTIME_SETTINGS_HISTORY        64     /* setting changes kept for tagging frames */
+
 typedef struct {
     int                         argc;
     char                        *argv[50];
     uint32_t                    numFrames;
     I2cCommands                 *cmds;
+    I2cCommands                 diff;           // writes of cmds which change registers
+                                                // after the previous setting
+    SensorState                 state;          // read when last applied in full
     char                        outputFileName[MAX_STRING_SIZE];
 } RuntimeSettings;
 
+typedef struct {
+    uint32_t                    firstFrame;     // first frame captured with the setting
+    uint32_t                    setting;
+} RuntimeSettingsChange;
+
 typedef struct {
     NvThread                   *runtimeSettingsThread;
     NvMediaBool                 exitedFlag;
@@ -33,8 +47,17 @@ typedef struct {
     RuntimeSettings            *rtSettings;
     uint32_t                    numRtSettings;
     uint32_t                    currentRtSettings;
+    NvMailbox                   mailbox;
     uint32_t                   *currentFrame;
+    NvFrameEvent               *frameEvent;
     CalibrationParameters      *calParam;
+    NvSensorStateStore         *sensorState;
+
+    /* Settings applied, for looking up the setting of a frame */
+    pthread_mutex_t             historyMutex;
+    RuntimeSettingsChange       history[RUNTIME_SETTINGS_HISTORY];
+    uint32_t                    numChanges;
+    NvMediaBool                 historyValid;
 } NvRuntimeSettingsContext;
 
 NvMediaStatus
@@ -46,6 +69,11 @@ RuntimeSettingsFini(NvMainContext *mainCtx);
 NvMediaStatus
 RuntimeSettingsProc(NvMainContext *mainCtx);
 
+/* Returns the setting the sensor was running when frame was captured */
+uint32_t
+RuntimeSettingsGetFrameSetting(NvRuntimeSettingsContext *runtimeCtx,
+                               uint32_t frame);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,8 @@
 #include "capture.h"
 #include "save.h"
 #include "composite.h"
+#include "shutdown.h"
+#include "image_time.h"
 
 #define CONV_GET_X_OFFSET(xoffsets, red, green1, green2, blue) \
             xoffsets[red] = 0;\
@@ -46,45 +48,6 @@ enum PixelColor {
     NUM_PIXEL_COLORS
 };
 
-/* @@@@ ----------------- FLIR BOSON ONLY ------------------ */
-
-// We are  reordering the bits
-// Boson Data: x.x.N4.N4:N3.N3.N3.N3 - N2.N2.N2.N2:N1.N1.N1.N1
-// byteH -> N2.N2.N3.N3:N3.N3.N4.N4  (has the most significant bits)
-// byteL -> x.x.N1.N1:N1.N1.N2.N2  (has the less significant bits)
-short int reverse_16bits(unsigned char byteH, unsigned char byteL) {
-    short int valor;
-    int x=0;
-
-    valor = 0;
-
-    for (x=0; x<8; x++) {
-        valor   = ( valor << 1) + ( byteH & 0x01 ) ;
-        byteH = ( byteH >> 1) ;
-    }
-    for (x=0; x<6; x++) {
-        valor   = ( valor << 1) + ( byteL & 0x01 ) ;
-        byteL = ( byteL >> 1) ;
-    }
-
-    return valor;
-
-}
-
-void write_raw_to_file(uint8_t *data, int stride, int height, 
-    char *filename)
-{
-    FILE *f = fopen(filename, "w+");
-    fwrite(data, sizeof(uint8_t), stride * height, f);
-}
-
-uint8_t raw12_to_byte(uint8_t *data, int idx) {
-    uint16_t pixel = (data[idx + 1] << 8) + data[idx];
-    return (pixel >> 4) & 0xFF;
-}
-/* @@@@ END -------------- FLIR BOSON ONLY ------------------ */
-
-
 static NvMediaStatus
 _ConvGetPixelOffsets(NvMediaRawPixelOrder pixelOrder,
                      uint32_t *xOffsets,
@@ -132,15 +95,6 @@ _ConvRawToRgba(NvMediaImage *imgSrc,
     uint32_t x = 0, y = 0;
     uint32_t xOffsets[NUM_PIXEL_COLORS] = {0}, yOffsets[NUM_PIXEL_COLORS] = {0};
 
-    /* @@@@ ----------------- FLIR BOSON ONLY ------------------ */
-    /* @@@@ Auxiliary vars to re-order bits and perform simple AGC */
-    unsigned short value;
-    int min=0xFFFF;
-    int max=0;
-    unsigned char tmpH, tmpL;
-    /* @@@@ END -------------- FLIR BOSON ONLY ------------------ */
-    
-
     NVM_SURF_FMT_DEFINE_ATTR(srcAttr);
     NVM_SURF_FMT_DEFINE_ATTR(dstAttr);
 
@@ -191,12 +145,12 @@ _ConvRawToRgba(NvMediaImage *imgSrc,
         goto done;
     }
 
-    // set height skip telemetry line
-    dstHeight = srcHeight - 1;
-    dstWidth  = srcWidth;
+    /* One RGBA pixel per 2x2 Bayer quad */
+    dstHeight = srcHeight / 2;
+    dstWidth  = srcWidth / 2;
 
     if (dstAttr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RGBA) {
-        dstPitch = dstWidth;
+        dstPitch = dstWidth * 4;
         dstImageSize = dstHeight * dstPitch;
     } else {
         LOG_ERR("%s: Unsupported destination surface type\n", __func__);
@@ -211,7 +165,6 @@ _ConvRawToRgba(NvMediaImage *imgSrc,
     }
 
     pTmp = pDstBuff;
-    /* Convert to grayscale */
 
     /* Y is starting at valid pixel, skipping embedded lines from top */
     y = imgSrc->embeddedDataTopSize / srcPitch;
@@ -220,7 +173,7 @@ _ConvRawToRgba(NvMediaImage *imgSrc,
     status = _ConvGetPixelOffsets(pixelOrder, xOffsets, yOffsets);
     if (status != NVMEDIA_STATUS_OK) {
         LOG_ERR("%s: Failed to get PixelOffsets\n", __func__);
-        return status;
+        goto done;
     }
 
     if ((srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_12) &&
@@ -242,97 +195,6 @@ _ConvRawToRgba(NvMediaImage *imgSrc,
                 pTmp++;
             }
         }
-    }
-    // @@@@ ------------------ 12 Bit grayscale ----------------- 
-    else if (((srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_10) ||
-                (srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_12) ||
-                (srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_16)) &&
-               (srcAttr[NVM_SURF_ATTR_DATA_TYPE].value == NVM_SURF_ATTR_DATA_TYPE_UINT)) {
-        
-        // ANIL EDIT: start from 1st row (skip telemetry line)
-        for (y = 1; y < srcHeight; y++) {
-            for (x = 0; x < srcPitch; x += 2) {
-                *pTmp = raw12_to_byte(pSrcBuff, y * srcPitch + x);
-                pTmp++;
-            }
-        }
-    }
-    // @@@@ ------------ 8 bit grayscale -----------------
-    else if (srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_8 &&
-               srcAttr[NVM_SURF_ATTR_DATA_TYPE].value == NVM_SURF_ATTR_DATA_TYPE_UINT) {
-        
-        // ANIL EDIT: start from 1st row (skip telemetry line)
-        for (y = 1; y < srcHeight; y++) {
-            for (x = 0; x < srcWidth; x++) {
-                *pTmp = pSrcBuff[y * srcPitch + x];
-                pTmp++;
-            }
-        }
-    }
-    /* @@@@ ----------------- FLIR BOSON ONLY ------------------ */
-    else if ((srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_14) && 
-            (srcAttr[NVM_SURF_ATTR_DATA_TYPE].value == NVM_SURF_ATTR_DATA_TYPE_INT)) {
-    
-        // reverse and order bits
-  
-        // Boson Data: x.x.N4.N4:N3.N3.N3.N3 - N2.N2.N2.N2:N1.N1.N1.N1
-        // At reception:
-        // byteH ( Buff[ n   ] ) -> N2.N2.N3.N3:N3.N3.N4.N4  (has the most significant bits)
-        // byteL ( Buff[ n+1 ] ) -> x.x.N1.N1:N1.N1.N2.N2  (has the less significant bits)
-  
-        // Very important to discard first line which is TELEMETRY !!!
-        // We will re-order bits, but not taking into account for AGC
-        for (y=0; y< srcWidth; y++) {
-            // short int reverse_16bits(unsigned char byteH, unsigned char byteL) {
-            value = reverse_16bits( pSrcBuff[ y*2  ], pSrcBuff[ y*2 + 1 ] ) ;
-      
-            // Write back the reversed bytes and swap (LSB / MSB )
-            // Store reversed order
-            tmpL= value & 0xFF;
-            tmpH= (value & 0xFF00) >> 8;
-      
-            pSrcBuff[ y*2 ]     = tmpH;
-            pSrcBuff[ y*2 + 1 ] = tmpL;
-        }
-  
-        // We continue with the rest of the IMAGE.
-        // We need to order first, and we will perform a basic AGC after
-        for (y=srcWidth; y< srcHeight*srcWidth; y++) {
-            // short int reverse_16bits(unsigned char byteH, unsigned char byteL) {
-            value = reverse_16bits( pSrcBuff[ y*2  ], pSrcBuff[ y*2 + 1 ] ) ;
-          
-            // Write back the reversed bytes and swap (LSB / MSB )
-            // Store reversed order
-            tmpL= value & 0xFF;
-            tmpH= (value & 0xFF00) >> 8;
-              
-            pSrcBuff[ y*2 ]     = tmpH;
-            pSrcBuff[ y*2 + 1 ] = tmpL;
-              
-            // find max, min of the pixels.
-            // We will use this information to run a Linear AGC.
-            // If a different AGC you can delete these lines.
-            if ( value <= min ) {
-                min=value;
-            }
-            if ( value >= max ) {
-                max=value;
-            }
-        
-        }
-          
-        // Do AGC in LUMA
-        for (y=srcWidth; y<srcWidth * srcHeight; y++) {
-            value =  ( (pSrcBuff[y*2]<<8) + pSrcBuff[y*2 + 1]) & 0xFFFF  ;
-            value = ( ( ( 255 * ( value - min ) ) ) / (max-min) ) & 0xFF   ;
-                    
-            pDstBuff[ y * 4     ] = value;  //R
-            pDstBuff[ y * 4 + 1 ] = value;  //G
-            pDstBuff[ y * 4 + 2 ] = value;  //B
-            pDstBuff[ y * 4 + 3 ] = alpha;
-        }
-    // @@@@ END----------------- FLIR BOSON ONLY ------------------
-
     } else {
         LOG_ERR("%s: Unsupported input raw format\n", __func__);
         status = NVMEDIA_STATUS_ERROR;
@@ -354,8 +216,6 @@ _ConvRawToRgba(NvMediaImage *imgSrc,
         goto done;
     }
 
-    // write_raw_to_file(pDstBuff, dstWidth, dstHeight, "rawOut.raw");
-
     status = NVMEDIA_STATUS_OK;
 done:
     if (pSrcBuff)
@@ -371,7 +231,7 @@ _CreateOutputFileName(char *saveFilePrefix,
                       char *calSettings,
                       uint32_t virtualGroupIndex,
                       uint32_t frame,
-                      NvMediaBool useNvRawFormat,
+                      const char *extension,
                       char *outputFileName)
 {
     char buf[MAX_STRING_SIZE] = {0};
@@ -386,10 +246,7 @@ _CreateOutputFileName(char *saveFilePrefix,
     strcat(outputFileName, "_");
     sprintf(buf, "%02d", frame);
     strcat(outputFileName, buf);
-    if (useNvRawFormat)
-        strcat(outputFileName, ".nvraw");
-    else
-        strcat(outputFileName, ".raw");
+    strcat(outputFileName, extension);
 }
 
 static NvMediaStatus
@@ -427,7 +284,11 @@ _CreateImageQueue(NvMediaDevice *device,
             goto failed;
         }
 
-        image->tag = *queue;
+        status = ImageContextCreate(image, *queue);
+        if (IsFailed(status)) {
+            NvMediaImageDestroy(image);
+            goto failed;
+        }
 
         if (IsFailed(NvQueuePut(*queue,
                                 (void *)&image,
@@ -443,30 +304,27 @@ failed:
     return status;
 }
 
-static uint32_t
-_GetSettingNum(RuntimeSettings *rtSettings,
-               uint32_t numRtSettings,
-               uint32_t currentFrame)
+/* Decides whether the current frame should go down the display path.
+ * Called before the frame is converted, so that frames which would be
+ * superseded before the next display refresh are never converted. */
+static NvMediaBool
+_IsDisplayFrameDue(SaveThreadCtx *threadCtx)
 {
-    uint32_t i = 0, totalFrames = 0;
-    RuntimeSettings *settings;
+    uint64_t now = 0;
 
-    for(i = 0; i < numRtSettings; i++) {
-        settings = &rtSettings[i];
-        totalFrames += settings->numFrames;
-    }
+    if (!threadCtx->displayPacingEnabled || !threadCtx->displayIntervalUs)
+        return NVMEDIA_TRUE;
 
-    currentFrame = currentFrame % totalFrames;
-    for(i = 0; i < numRtSettings; i++) {
-        settings = &rtSettings[i];
-        if(settings->numFrames > currentFrame) {
-            return i;
-        } else {
-            currentFrame -= settings->numFrames;
-        }
-    }
-    return -1;
+    GetTimeMicroSec(&now);
+    if (now < threadCtx->nextDisplayTimeUs)
+        return NVMEDIA_FALSE;
 
+    /* Keep the schedule anchored unless we fell more than a period behind */
+    threadCtx->nextDisplayTimeUs += threadCtx->displayIntervalUs;
+    if (threadCtx->nextDisplayTimeUs <= now)
+        threadCtx->nextDisplayTimeUs = now + threadCtx->displayIntervalUs;
+
+    return NVMEDIA_TRUE;
 }
 
 static uint32_t
@@ -480,6 +338,9 @@ _SaveThreadFunc(void *data)
     char outputFileName[MAX_STRING_SIZE];
     char buf[MAX_STRING_SIZE] = {0};
     char *calSettings = NULL;
+    uint32_t frame = 0, setting = 0;
+    SensorState sensorState;
+    uint32_t messages;
 
     NVM_SURF_FMT_DEFINE_ATTR(attr);
 
@@ -493,20 +354,65 @@ _SaveThreadFunc(void *data)
             if (*threadCtx->quit)
                 goto loop_done;
         }
+        /* NULL is the shutdown wakeup */
+        if (!image)
+            goto loop_done;
+
+        /* Settings of the frame, kept from the last one if its number is lost */
+        if (threadCtx->inputFrameQueue) {
+            if (NvQueueGet(threadCtx->inputFrameQueue, &frame,
+                           SAVE_FRAME_DEQUEUE_TIMEOUT) == NVMEDIA_STATUS_OK) {
+                if (*threadCtx->numRtSettings)
+                    setting = RuntimeSettingsGetFrameSetting(threadCtx->runtimeCtx, frame);
+            } else
+                LOG_ERR("%s: No frame number for image on channel %d\n",
+                        __func__, threadCtx->virtualGroupIndex);
+        }
 
-        if (threadCtx->saveEnabled) {
+        /* Recording is switched between frames so files stay complete */
+        messages = MailboxTake(&threadCtx->mailbox);
+        if (messages & MAILBOX_BIT(MAILBOX_MSG_RECORD)) {
+            threadCtx->saveEnabled = MailboxArg(&threadCtx->mailbox, MAILBOX_MSG_RECORD) ?
+                                     NVMEDIA_TRUE : NVMEDIA_FALSE;
+            if (!threadCtx->saveEnabled) {
+                NvRawWriterClose(&threadCtx->nvrawWriter);
+                SegmentRecorderClose(&threadCtx->segmentRecorder);
+            }
+            LOG_INFO("%s: Recording %s on channel %d\n", __func__,
+                     threadCtx->saveEnabled ? "started" : "stopped",
+                     threadCtx->virtualGroupIndex);
+        }
+        if (messages & MAILBOX_BIT(MAILBOX_MSG_TRIGGER))
+            TriggerRingTrigger(&threadCtx->triggerRing,
+                               MailboxArg(&threadCtx->mailbox, MAILBOX_MSG_TRIGGER));
+
+        /* Kept whether or not recording, for the frames before a trigger */
+        if (threadCtx->triggerRing.valid &&
+            TriggerRingPush(&threadCtx->triggerRing, image, totalSavedFrames) != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to keep frame %u of channel %d\n", __func__,
+                    totalSavedFrames, threadCtx->virtualGroupIndex);
+
+        if (threadCtx->saveEnabled && threadCtx->segmentRecorder.numSlots) {
+            status = SegmentRecorderWrite(&threadCtx->segmentRecorder,
+                                          image,
+                                          threadCtx->rawBytesPerPixel,
+                                          totalSavedFrames);
+            if (status != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: Failed to record frame %u of channel %d\n", __func__,
+                        totalSavedFrames, threadCtx->virtualGroupIndex);
+                ShutdownRequest(__func__);
+                goto loop_done;
+            }
+        } else if (threadCtx->saveEnabled) {
             if (*threadCtx->numRtSettings) {
-                calSettings = threadCtx->rtSettings[_GetSettingNum(threadCtx->rtSettings,
-                                                                  *threadCtx->numRtSettings,
-                                                                  totalSavedFrames)
-                                                  ].outputFileName;
+                calSettings = threadCtx->rtSettings[setting].outputFileName;
             } else if (threadCtx->sensorInfo) {
                 memset(buf, 0 , MAX_STRING_SIZE);
                 status = threadCtx->sensorInfo->AppendOutputFilename(buf,
                                                                      threadCtx->sensorProperties);
                 if (status != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to append output filename\n", __func__);
-                    *threadCtx->quit = NVMEDIA_TRUE;
+                    ShutdownRequest(__func__);
                     goto loop_done;
                 }
                 calSettings = buf;
@@ -519,7 +425,9 @@ _SaveThreadFunc(void *data)
                                   calSettings,
                                   threadCtx->virtualGroupIndex,
                                   totalSavedFrames,
-                                  threadCtx->useNvRawFormat,
+                                  threadCtx->useNvRawFormat ? ".nvraw" :
+                                  threadCtx->usePackedFormat ? ".praw" :
+                                  threadCtx->compressPool ? ".zraw" : ".raw",
                                   outputFileName);
 
             LOG_INFO("%s: Write image. res [%u:%u] (file: %s)\n",
@@ -532,21 +440,41 @@ _SaveThreadFunc(void *data)
                                                       NVM_SURF_FMT_ATTR_MAX);
                 if (status != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s:NvMediaSurfaceFormatGetAttrs failed\n", __func__);
-                   *threadCtx->quit = NVMEDIA_TRUE;
+                   ShutdownRequest(__func__);
                     goto loop_done;
                 }
 
                 if (threadCtx->sensorInfo && (attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW)) {
+                    if (!SensorStateGet(threadCtx->sensorState, frame, &sensorState))
+                        sensorState.valid = NVMEDIA_FALSE;
                     threadCtx->sensorInfo->WriteNvRawImage(&threadCtx->settingsCommands,
                                                            threadCtx->calParams,
+                                                           &sensorState,
+                                                           &threadCtx->nvrawWriter,
                                                            image,
                                                            totalSavedFrames,
                                                            outputFileName);
                 } else {
                     LOG_ERR("%s: NvRawFormat applicable only for RAW captured image \n", __func__);
-                    *threadCtx->quit = NVMEDIA_TRUE;
+                    ShutdownRequest(__func__);
                     goto loop_done;
                 }
+            } else if (threadCtx->usePackedFormat) {
+                status = PackedRawWriteImage(&threadCtx->packedWriter,
+                                             outputFileName,
+                                             image,
+                                             totalSavedFrames);
+                if (status != NVMEDIA_STATUS_OK)
+                    LOG_ERR("%s: Failed to write packed image %s\n", __func__,
+                            outputFileName);
+            } else if (threadCtx->compressPool) {
+                /* Dropped frames are counted by the pool */
+                RawCompressSubmit(threadCtx->compressPool,
+                                  image,
+                                  threadCtx->rawBytesPerPixel,
+                                  threadCtx->compressTransform,
+                                  totalSavedFrames,
+                                  outputFileName);
             } else {
                 WriteImage(outputFileName,
                            image,
@@ -557,49 +485,95 @@ _SaveThreadFunc(void *data)
            }
         }
 
+        if (threadCtx->frameServer) {
+            status = FrameServerPublish(threadCtx->frameServer,
+                                        threadCtx->frameServerChannel,
+                                        image,
+                                        totalSavedFrames);
+            if (status != NVMEDIA_STATUS_OK)
+                LOG_WARN("%s: Failed to publish frame %u of channel %d\n",
+                         __func__, totalSavedFrames, threadCtx->virtualGroupIndex);
+        }
+
         totalSavedFrames++;
 
-        if (threadCtx->displayEnabled) {
+        if (threadCtx->displayEnabled && !_IsDisplayFrameDue(threadCtx)) {
+            threadCtx->numDisplaySkipped++;
+        } else if (threadCtx->displayEnabled) {
 
             status = NvMediaSurfaceFormatGetAttrs(threadCtx->surfType,
                                                   attr,
                                                   NVM_SURF_FMT_ATTR_MAX);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s:NvMediaSurfaceFormatGetAttrs failed\n", __func__);
-               *threadCtx->quit = NVMEDIA_TRUE;
+               ShutdownRequest(__func__);
                 goto loop_done;
             }
 
             if (attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW) {
                 /* Acquire image for storing converting images */
-                while (NvQueueGet(threadCtx->conversionQueue,
-                                  (void *)&convertedImage,
-                                  SAVE_DEQUEUE_TIMEOUT) != NVMEDIA_STATUS_OK) {
-                    LOG_ERR("%s: conversionQueue is empty\n", __func__);
-                    if (*threadCtx->quit)
-                        goto loop_done;
-                }
-
-                status = _ConvRawToRgba(image,
-                                        convertedImage,
-                                        threadCtx->rawBytesPerPixel,
-                                        threadCtx->pixelOrder);
-                if (status != NVMEDIA_STATUS_OK) {
-                    LOG_ERR("%s: convRawToRgba failed for image %d in saveThread %d\n",
-                            __func__, totalSavedFrames, threadCtx->virtualGroupIndex);
-                    *threadCtx->quit = NVMEDIA_TRUE;
-                    goto loop_done;
+                if (threadCtx->displayPacingEnabled) {
+                    /* All conversion buffers still queued for display means the
+                     * display has not caught up; this frame would be superseded */
+                    if (NvQueueGet(threadCtx->conversionQueue,
+                                   (void *)&convertedImage,
+                                   0) != NVMEDIA_STATUS_OK)
+                        convertedImage = NULL;
+                } else {
+                    while (NvQueueGet(threadCtx->conversionQueue,
+                                      (void *)&convertedImage,
+                                      SAVE_DEQUEUE_TIMEOUT) != NVMEDIA_STATUS_OK) {
+                        LOG_ERR("%s: conversionQueue is empty\n", __func__);
+                        if (*threadCtx->quit)
+                            goto loop_done;
+                    }
                 }
 
-                while (NvQueuePut(threadCtx->outputQueue,
-                                  &convertedImage,
-                                  SAVE_ENQUEUE_TIMEOUT) != NVMEDIA_STATUS_OK) {
-                    LOG_DBG("%s: savethread output queue %d is full\n",
-                             __func__, threadCtx->virtualGroupIndex);
-                    if (*threadCtx->quit)
+                if (convertedImage) {
+                    status = NVMEDIA_STATUS_NOT_SUPPORTED;
+                    if (threadCtx->sensorInfo && threadCtx->sensorInfo->ConvertRawToRgba) {
+                        status = threadCtx->sensorInfo->ConvertRawToRgba(threadCtx->sensorConversion,
+                                                                         image,
+                                                                         convertedImage,
+                                                                         &threadCtx->frameInfo);
+                        if (status == NVMEDIA_STATUS_OK && threadCtx->frameInfo.valid)
+                            OverlaySetTemperature(threadCtx->overlayCtx,
+                                                  threadCtx->frameInfo.temperature);
+                    }
+                    if (status == NVMEDIA_STATUS_NOT_SUPPORTED)
+                        status = _ConvRawToRgba(image,
+                                                convertedImage,
+                                                threadCtx->rawBytesPerPixel,
+                                                threadCtx->pixelOrder);
+                    if (status != NVMEDIA_STATUS_OK) {
+                        LOG_ERR("%s: convRawToRgba failed for image %d in saveThread %d\n",
+                                __func__, totalSavedFrames, threadCtx->virtualGroupIndex);
+                        ShutdownRequest(__func__);
                         goto loop_done;
+                    }
+                    ImageTimeCopy(convertedImage, image);
+
+                    while (NvQueuePut(threadCtx->outputQueue,
+                                      &convertedImage,
+                                      SAVE_ENQUEUE_TIMEOUT) != NVMEDIA_STATUS_OK) {
+                        LOG_DBG("%s: savethread output queue %d is full\n",
+                                 __func__, threadCtx->virtualGroupIndex);
+                        if (*threadCtx->quit)
+                            goto loop_done;
+                    }
+                    convertedImage = NULL;
+                } else {
+                    threadCtx->numDisplaySkipped++;
+                }
+            } else if (threadCtx->displayPacingEnabled) {
+                /* Never hold up recording waiting for the display */
+                if (NvQueuePut(threadCtx->outputQueue,
+                               &image,
+                               0) == NVMEDIA_STATUS_OK) {
+                    image = NULL;
+                } else {
+                    threadCtx->numDisplaySkipped++;
                 }
-                convertedImage = NULL;
             } else {
                 while (NvQueuePut(threadCtx->outputQueue,
                                   &image,
@@ -615,31 +589,35 @@ _SaveThreadFunc(void *data)
 
         if (threadCtx->numFramesToSave &&
            (totalSavedFrames == threadCtx->numFramesToSave)) {
-            *threadCtx->quit = NVMEDIA_TRUE;
+            ShutdownRequest(__func__);
             goto loop_done;
         }
     loop_done:
         if (image) {
-            if (NvQueuePut((NvQueue *)image->tag,
+            if (NvQueuePut(IMAGE_QUEUE(image),
                            (void *)&image,
                            0) != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back in queue\n", __func__);
-                *threadCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
             };
             image = NULL;
         }
         if (convertedImage) {
-            if (NvQueuePut((NvQueue *)convertedImage->tag,
+            if (NvQueuePut(IMAGE_QUEUE(convertedImage),
                            (void *)&convertedImage,
                            0) != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back in conversionQueue\n", __func__);
-                *threadCtx->quit = NVMEDIA_TRUE;
+                ShutdownRequest(__func__);
             }
             convertedImage = NULL;
         }
     }
+    if (threadCtx->displayPacingEnabled)
+        LOG_INFO("%s: Save thread %d skipped display of %u of %u frames\n",
+                 __func__, threadCtx->virtualGroupIndex,
+                 threadCtx->numDisplaySkipped, totalSavedFrames);
     LOG_INFO("%s: Save thread exited\n", __func__);
-    threadCtx->exitedFlag = NVMEDIA_TRUE;
+    ShutdownThreadExited(&threadCtx->exitedFlag);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -697,6 +675,9 @@ SaveInit(NvMainContext *mainCtx)
         saveCtx->threadCtx[i].surfType = captureCtx->threadCtx[i].surfType;
         saveCtx->threadCtx[i].pixelOrder = captureCtx->threadCtx[i].pixelOrder;
         saveCtx->threadCtx[i].rawBytesPerPixel = captureCtx->threadCtx[i].rawBytesPerPixel;
+        saveCtx->threadCtx[i].displayPacingEnabled = testArgs->displayFps.isUsed;
+        saveCtx->threadCtx[i].displayIntervalUs = (testArgs->displayFps.uIntValue)?
+                                                   1000000 / testArgs->displayFps.uIntValue : 0;
         NVM_SURF_FMT_DEFINE_ATTR(attr);
         status = NvMediaSurfaceFormatGetAttrs(captureCtx->threadCtx[i].surfType,
                                               attr,
@@ -711,6 +692,8 @@ SaveInit(NvMainContext *mainCtx)
                                            captureCtx->threadCtx[i].height/2 : captureCtx->threadCtx[i].height;
         saveCtx->threadCtx[i].rtSettings = runtimeCtx->rtSettings;
         saveCtx->threadCtx[i].numRtSettings = &runtimeCtx->numRtSettings;
+        saveCtx->threadCtx[i].runtimeCtx = runtimeCtx;
+        saveCtx->threadCtx[i].sensorState = &captureCtx->sensorState;
         saveCtx->threadCtx[i].sensorProperties = testArgs->sensorProperties;
         if (NvQueueCreate(&saveCtx->threadCtx[i].inputQueue,
                          saveCtx->inputQueueSize,
@@ -720,6 +703,88 @@ SaveInit(NvMainContext *mainCtx)
             status = NVMEDIA_STATUS_ERROR;
             goto failed;
         }
+        if (ShutdownRegisterQueue(saveCtx->threadCtx[i].inputQueue) != NVMEDIA_STATUS_OK) {
+            status = NVMEDIA_STATUS_ERROR;
+            goto failed;
+        }
+        if (testArgs->usePackedFormat) {
+            saveCtx->threadCtx[i].usePackedFormat = NVMEDIA_TRUE;
+            status = PackedRawWriterInit(&saveCtx->threadCtx[i].packedWriter,
+                                         captureCtx->threadCtx[i].surfType,
+                                         captureCtx->threadCtx[i].pixelOrder);
+            if (status != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: Failed to create packed raw writer %d\n", __func__, i);
+                goto failed;
+            }
+        }
+        if (testArgs->useNvRawFormat) {
+            status = NvRawWriterInit(&saveCtx->threadCtx[i].nvrawWriter,
+                                     testArgs->nvrawImagesPerFile);
+            if (status != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: Failed to create nvraw writer %d\n", __func__, i);
+                goto failed;
+            }
+        }
+        if (testArgs->segmentSizeMB) {
+            if (!saveCtx->threadCtx[i].rawBytesPerPixel) {
+                LOG_ERR("%s: Segments apply only to RAW captured images\n", __func__);
+                status = NVMEDIA_STATUS_NOT_SUPPORTED;
+                goto failed;
+            }
+            /* The budget is shared evenly by the channels */
+            status = SegmentRecorderInit(&saveCtx->threadCtx[i].segmentRecorder,
+                                         testArgs->filePrefix,
+                                         i,
+                                         (uint64_t)testArgs->segmentSizeMB << 20,
+                                         testArgs->diskBudgetMB ?
+                                         ((uint64_t)testArgs->diskBudgetMB << 20) /
+                                         saveCtx->numVirtualChannels :
+                                         ((uint64_t)testArgs->segmentSizeMB << 20) *
+                                         SEGMENT_DEFAULT_SLOTS,
+                                         testArgs->usePackedFormat ?
+                                         &saveCtx->threadCtx[i].packedWriter : NULL);
+            if (status != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: Failed to create segment recorder %d\n", __func__, i);
+                goto failed;
+            }
+        }
+        if (testArgs->preTriggerSeconds) {
+            /* The memory is shared evenly by the channels */
+            status = TriggerRingInit(&saveCtx->threadCtx[i].triggerRing,
+                                     testArgs->filePrefix,
+                                     i,
+                                     captureCtx->threadCtx[i].surfType,
+                                     saveCtx->threadCtx[i].rawBytesPerPixel,
+                                     ((uint64_t)testArgs->triggerMemoryMB << 20) /
+                                     saveCtx->numVirtualChannels,
+                                     testArgs->preTriggerSeconds,
+                                     testArgs->postTriggerSeconds);
+            if (status != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: Failed to create pre-trigger ring %d\n", __func__, i);
+                goto failed;
+            }
+            if (testArgs->triggerTemperature.isUsed || testArgs->triggerOnFfc)
+                saveCtx->threadCtx[i].triggerRing.ParseFrameInfo =
+                    testArgs->sensorInfo->ParseFrameInfo;
+            if (testArgs->triggerTemperature.isUsed) {
+                saveCtx->threadCtx[i].triggerRing.triggerOnTemperature = NVMEDIA_TRUE;
+                saveCtx->threadCtx[i].triggerRing.temperatureThreshold =
+                    testArgs->triggerTemperature.floatValue;
+            }
+            saveCtx->threadCtx[i].triggerRing.triggerOnFfc = testArgs->triggerOnFfc;
+        }
+        /* Runtime settings and the sensor state are looked up by the frame
+         * number of each image. The save thread takes an image before its
+         * number, so there can be one number more than images. */
+        if ((runtimeCtx->numRtSettings || captureCtx->sensorState.valid) &&
+            NvQueueCreate(&saveCtx->threadCtx[i].inputFrameQueue,
+                          saveCtx->inputQueueSize + 1,
+                          sizeof(uint32_t)) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create save inputFrameQueue %d\n",
+                    __func__, i);
+            status = NVMEDIA_STATUS_ERROR;
+            goto failed;
+        }
         if (testArgs->displayEnabled) {
             if (attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW ) {
                 /* For RAW images, create conversion queue for converting RAW to RGB images */
@@ -751,9 +816,55 @@ SaveInit(NvMainContext *mainCtx)
                         __func__, i, saveCtx->threadCtx[i].width,
                         saveCtx->threadCtx[i].height,
                         saveCtx->inputQueueSize);
+
+                if (testArgs->sensorInfo && testArgs->sensorInfo->CreateConversion) {
+                    status = testArgs->sensorInfo->CreateConversion(testArgs->sensorProperties,
+                                                                    &saveCtx->threadCtx[i].sensorConversion);
+                    if (status != NVMEDIA_STATUS_OK) {
+                        LOG_ERR("%s: Failed to create sensor conversion %d\n", __func__, i);
+                        goto failed;
+                    }
+                }
+            }
+        }
+    }
+
+    if (testArgs->shmName.isUsed) {
+        status = FrameServerCreate(mainCtx, &saveCtx->frameServer);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create frame server\n", __func__);
+            goto failed;
+        }
+        for (i = 0; i < saveCtx->numVirtualChannels; i++) {
+            saveCtx->threadCtx[i].frameServer = saveCtx->frameServer;
+            saveCtx->threadCtx[i].frameServerChannel = i;
+        }
+    }
+
+    if (testArgs->compressWorkers) {
+        for (i = 0; i < saveCtx->numVirtualChannels; i++) {
+            if (!saveCtx->threadCtx[i].rawBytesPerPixel) {
+                LOG_ERR("%s: Compression applies only to RAW captured images\n", __func__);
+                status = NVMEDIA_STATUS_NOT_SUPPORTED;
+                goto failed;
             }
         }
+        status = RawCompressPoolCreate(&saveCtx->compressPool,
+                                       testArgs->compressWorkers);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create compression pool\n", __func__);
+            goto failed;
+        }
+        /* Bit reversed samples are predicted on their linear values */
+        for (i = 0; i < saveCtx->numVirtualChannels; i++) {
+            saveCtx->threadCtx[i].compressPool = saveCtx->compressPool;
+            saveCtx->threadCtx[i].compressTransform =
+                (testArgs->sensorInfo && testArgs->sensorInfo->IsRawBitReversed &&
+                 testArgs->sensorInfo->IsRawBitReversed(saveCtx->threadCtx[i].surfType)) ?
+                RAW_COMPRESS_TRANSFORM_BIT_REVERSE : RAW_COMPRESS_TRANSFORM_NONE;
+        }
     }
+
     return NVMEDIA_STATUS_OK;
 failed:
     LOG_ERR("%s: Failed to initialize Save\n",__func__);
@@ -778,15 +889,15 @@ SaveFini(NvMainContext *mainCtx)
     /* Wait for threads to exit */
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
         if (saveCtx->saveThread[i]) {
-            while (!saveCtx->threadCtx[i].exitedFlag) {
-                LOG_DBG("%s: Waiting for save thread %d to quit\n",
+            if (IsFailed(ShutdownWaitExit(&saveCtx->threadCtx[i].exitedFlag,
+                                          "Save thread"))) {
+                LOG_ERR("%s: Save thread %d still running, not releasing resources\n",
                         __func__, i);
+                return NVMEDIA_STATUS_TIMED_OUT;
             }
         }
     }
 
-    *saveCtx->quit = NVMEDIA_TRUE;
-
     /* Destroy threads */
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
         if (saveCtx->saveThread[i]) {
@@ -802,6 +913,7 @@ SaveFini(NvMainContext *mainCtx)
         if (saveCtx->threadCtx[i].conversionQueue) {
             while (IsSucceed(NvQueueGet(saveCtx->threadCtx[i].conversionQueue, &image, 0))) {
                 if (image) {
+                    ImageContextDestroy(image);
                     NvMediaImageDestroy(image);
                     image = NULL;
                 }
@@ -810,12 +922,15 @@ SaveFini(NvMainContext *mainCtx)
             NvQueueDestroy(saveCtx->threadCtx[i].conversionQueue);
         }
 
+        if (saveCtx->threadCtx[i].sensorConversion)
+            saveCtx->threadCtx[i].sensorInfo->DestroyConversion(saveCtx->threadCtx[i].sensorConversion);
+
         /*Flush and destroy the input queues*/
         if (saveCtx->threadCtx[i].inputQueue) {
             LOG_DBG("%s: Flushing the save input queue %d\n", __func__, i);
             while (IsSucceed(NvQueueGet(saveCtx->threadCtx[i].inputQueue, &image, 0))) {
                 if (image) {
-                    if (NvQueuePut((NvQueue *)image->tag,
+                    if (NvQueuePut(IMAGE_QUEUE(image),
                                    (void *)&image,
                                    0) != NVMEDIA_STATUS_OK) {
                         LOG_ERR("%s: Failed to put image back in queue\n", __func__);
@@ -824,10 +939,25 @@ SaveFini(NvMainContext *mainCtx)
                 }
                 image=NULL;
             }
+            ShutdownUnregisterQueue(saveCtx->threadCtx[i].inputQueue);
             NvQueueDestroy(saveCtx->threadCtx[i].inputQueue);
         }
+
+        if (saveCtx->threadCtx[i].inputFrameQueue)
+            NvQueueDestroy(saveCtx->threadCtx[i].inputFrameQueue);
+
+        NvRawWriterDestroy(&saveCtx->threadCtx[i].nvrawWriter);
+        PackedRawWriterDestroy(&saveCtx->threadCtx[i].packedWriter);
+        SegmentRecorderDestroy(&saveCtx->threadCtx[i].segmentRecorder);
+        TriggerRingDestroy(&saveCtx->threadCtx[i].triggerRing);
+        I2cFreeCommands(&saveCtx->threadCtx[i].settingsCommands);
     }
 
+    FrameServerDestroy(saveCtx->frameServer);
+
+    /* The save threads have exited, so no frame is submitted any more */
+    RawCompressPoolDestroy(saveCtx->compressPool);
+
     if (saveCtx->device)
         NvMediaDeviceDestroy(saveCtx->device);
 
@@ -858,6 +988,7 @@ SaveProc(NvMainContext *mainCtx)
     if (saveCtx->displayEnabled) {
         for (i = 0; i < saveCtx->numVirtualChannels; i++) {
             saveCtx->threadCtx[i].outputQueue = compositeCtx->inputQueue[i];
+            saveCtx->threadCtx[i].overlayCtx = compositeCtx->overlayCtx;
         }
     }
 
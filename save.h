@@ -19,18 +19,28 @@ extern "C" {
 #include "thread_utils.h"
 #include "surf_utils.h"
 #include "runtime_settings.h"
+#include "frame_server.h"
+#include "mailbox.h"
+#include "overlay.h"
+#include "packed_raw.h"
+#include "raw_compress.h"
+#include "segment_recorder.h"
+#include "trigger_ring.h"
 
 #define SAVE_QUEUE_SIZE                 3      /* min no. of buffers to be in circulation at any point */
 #define SAVE_DEQUEUE_TIMEOUT            1000
 #define SAVE_ENQUEUE_TIMEOUT            100
+#define SAVE_FRAME_DEQUEUE_TIMEOUT      100    /* the frame number is queued right after the image */
 
 typedef struct {
     NvQueue                    *inputQueue;
+    NvQueue                    *inputFrameQueue;
     NvQueue                    *outputQueue;
     volatile NvMediaBool       *quit;
     NvMediaBool                 displayEnabled;
     NvMediaBool                 saveEnabled;
     NvMediaBool                 exitedFlag;
+    NvMailbox                   mailbox;
 
     /* save params */
     SensorInfo                 *sensorInfo;
@@ -40,17 +50,39 @@ typedef struct {
     uint32_t                    pixelOrder;
     char                       *saveFilePrefix;
     NvMediaBool                 useNvRawFormat;
+    NvRawWriter                 nvrawWriter;
+    NvMediaBool                 usePackedFormat;
+    NvPackedRawWriter           packedWriter;
+    NvRawCompressPool          *compressPool;   // shared by all channels
+    RawCompressTransform        compressTransform;
+    NvSegmentRecorder           segmentRecorder;
+    NvTriggerRing               triggerRing;
     uint32_t                    numFramesToSave;
     uint32_t                    virtualGroupIndex;
     RuntimeSettings            *rtSettings;
     uint32_t                   *numRtSettings;
+    NvRuntimeSettingsContext   *runtimeCtx;
+    NvSensorStateStore         *sensorState;
     SensorProperties           *sensorProperties;
+    SensorFrameInfo             frameInfo;
+
+    /* Shared memory publishing */
+    NvFrameServer              *frameServer;
+    uint32_t                    frameServerChannel;
 
     /* Raw2Rgb conversion params */
     NvQueue                    *conversionQueue;
+    SensorConversion           *sensorConversion;   // NULL: the sensor keeps no state
     NvMediaSurfaceType          surfType;
     uint32_t                    width;
     uint32_t                    height;
+    NvOverlayContext           *overlayCtx;
+
+    /* Display pacing params */
+    NvMediaBool                 displayPacingEnabled;
+    uint64_t                    displayIntervalUs;   /* 0: pace to display consumption */
+    uint64_t                    nextDisplayTimeUs;
+    uint32_t                    numDisplaySkipped;
 } SaveThreadCtx;
 
 typedef struct {
@@ -65,6 +97,8 @@ typedef struct {
     NvMediaBool                 displayEnabled;
     uint32_t                    numVirtualChannels;
     uint32_t                    inputQueueSize;
+    NvFrameServer              *frameServer;
+    NvRawCompressPool          *compressPool;
 } NvSaveContext;
 
 NvMediaStatus
@@ -0,0 +1,266 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log_utils.h"
+#include "script_cache.h"
+
+#define SCRIPT_CACHE_FNV_OFFSET     0xCBF29CE484222325ULL
+#define SCRIPT_CACHE_FNV_PRIME      0x00000100000001B3ULL
+#define SCRIPT_CACHE_READ_SIZE      4096
+
+/* Number of buffer bytes a freshly parsed command uses */
+static uint32_t
+_BufferLength(const Command *cmd)
+{
+    switch (cmd->commandType) {
+        case WRITE_REG_1:
+            return 1 + cmd->dataLength;
+        case WRITE_REG_2:
+            return 2 + cmd->dataLength;
+        case READ_REG_1:
+            return 1;
+        case READ_REG_2:
+        case READ_WRITE_REG_1:
+            return 2;
+        case READ_WRITE_REG_2:
+            return 4;
+        case WRITE_DELAY:
+            return 1;
+        case POLL_REG_1:
+        case POLL_REG_2:
+            return POLL_CONDITION_OFFSET + sizeof(PollCondition);
+        case VOLATILE_REG:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+static void
+_CachePath(const char *filename,
+           char *path,
+           size_t size)
+{
+    snprintf(path, size, "%s%s", filename, SCRIPT_CACHE_SUFFIX);
+}
+
+NvMediaStatus
+ScriptCacheHashFile(const char *filename,
+                    uint64_t *hash,
+                    uint64_t *size)
+{
+    uint8_t buf[SCRIPT_CACHE_READ_SIZE];
+    uint64_t h = SCRIPT_CACHE_FNV_OFFSET, total = 0;
+    size_t n, i;
+    FILE *file;
+
+    file = fopen(filename, "rb");
+    if (!file)
+        return NVMEDIA_STATUS_ERROR;
+
+    /* FNV-1a */
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        for (i = 0; i < n; i++) {
+            h ^= buf[i];
+            h *= SCRIPT_CACHE_FNV_PRIME;
+        }
+        total += n;
+    }
+    fclose(file);
+
+    *hash = h;
+    *size = total;
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+ScriptCacheLoad(const char *filename,
+                uint64_t sourceHash,
+                uint64_t sourceSize,
+                CaptureConfigParams *params,
+                I2cCommands *allCommands)
+{
+    char path[MAX_STRING_SIZE + sizeof(SCRIPT_CACHE_SUFFIX)];
+    const ScriptCacheHeader *header;
+    ScriptCacheRecord record;
+    const uint8_t *base = NULL, *pos, *end;
+    Command *cmd;
+    struct stat st;
+    uint32_t i;
+    int fd;
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    _CachePath(filename, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NVMEDIA_STATUS_ERROR;
+
+    if (fstat(fd, &st) < 0 ||
+        (uint64_t)st.st_size < sizeof(ScriptCacheHeader) + sizeof(CaptureConfigParams))
+        goto done;
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        base = NULL;
+        goto done;
+    }
+
+    header = (const ScriptCacheHeader *)base;
+    if (header->magic != SCRIPT_CACHE_MAGIC ||
+        header->version != SCRIPT_CACHE_VERSION ||
+        header->paramsSize != sizeof(CaptureConfigParams) ||
+        header->sourceHash != sourceHash ||
+        header->sourceSize != sourceSize ||
+        header->numCommands > header->streamSize / sizeof(ScriptCacheRecord) ||
+        header->streamSize != (uint64_t)st.st_size - sizeof(ScriptCacheHeader) - sizeof(CaptureConfigParams)) {
+        LOG_DBG("%s: %s is stale\n", __func__, path);
+        goto done;
+    }
+
+    pos = base + sizeof(ScriptCacheHeader);
+    memcpy(params, pos, sizeof(CaptureConfigParams));
+    pos += sizeof(CaptureConfigParams);
+    end = pos + header->streamSize;
+
+    I2cSetNumCommands(allCommands, 0);
+    for (i = 0; i < header->numCommands; i++) {
+        if (pos + sizeof(record) > end)
+            goto corrupt;
+        memcpy(&record, pos, sizeof(record));
+        pos += sizeof(record);
+        if (record.bufferLength > MAX_BUF_LENGTH || pos + record.bufferLength > end ||
+            record.commandType > VOLATILE_REG || record.processType > PRESET_REG)
+            goto corrupt;
+
+        cmd = I2cNewCommand(allCommands);
+        if (!cmd)
+            goto failed;
+        cmd->commandType = record.commandType;
+        cmd->processType = record.processType;
+        cmd->dataLength = record.dataLength;
+        cmd->deviceAddress = record.value;
+        cmd->line = record.line;
+        memcpy(cmd->buffer, pos, record.bufferLength);
+        pos += record.bufferLength;
+        allCommands->numCommands++;
+    }
+    if (pos != end)
+        goto corrupt;
+
+    LOG_DBG("%s: Loaded %u commands from %s\n", __func__, header->numCommands, path);
+    status = NVMEDIA_STATUS_OK;
+    goto done;
+
+corrupt:
+    LOG_WARN("%s: Ignoring corrupt cache %s\n", __func__, path);
+failed:
+    /* The caller parses the script into the same list next */
+    I2cSetNumCommands(allCommands, 0);
+done:
+    if (base)
+        munmap((void *)base, st.st_size);
+    close(fd);
+    return status;
+}
+
+NvMediaStatus
+ScriptCacheStore(const char *filename,
+                 uint64_t sourceHash,
+                 uint64_t sourceSize,
+                 CaptureConfigParams *params,
+                 I2cCommands *allCommands)
+{
+    char path[MAX_STRING_SIZE + sizeof(SCRIPT_CACHE_SUFFIX)];
+    char tmpPath[sizeof(path) + 8];
+    ScriptCacheHeader header;
+    ScriptCacheRecord record;
+    const Command *cmd;
+    uint8_t *image = NULL, *pos;
+    uint64_t size;
+    uint32_t i;
+    FILE *file = NULL;
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SCRIPT_CACHE_MAGIC;
+    header.version = SCRIPT_CACHE_VERSION;
+    header.paramsSize = sizeof(CaptureConfigParams);
+    header.numCommands = allCommands->numCommands;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    for (i = 0; i < allCommands->numCommands; i++)
+        header.streamSize += sizeof(record) + _BufferLength(I2C_COMMAND(allCommands, i));
+
+    size = sizeof(header) + sizeof(CaptureConfigParams) + header.streamSize;
+    image = malloc(size);
+    if (!image) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    pos = image;
+    memcpy(pos, &header, sizeof(header));
+    pos += sizeof(header);
+    memcpy(pos, params, sizeof(CaptureConfigParams));
+    pos += sizeof(CaptureConfigParams);
+    for (i = 0; i < allCommands->numCommands; i++) {
+        cmd = I2C_COMMAND(allCommands, i);
+        record.commandType = cmd->commandType;
+        record.processType = cmd->processType;
+        record.dataLength = cmd->dataLength;
+        record.bufferLength = _BufferLength(cmd);
+        record.value = cmd->deviceAddress;
+        record.line = cmd->line;
+        memcpy(pos, &record, sizeof(record));
+        pos += sizeof(record);
+        memcpy(pos, cmd->buffer, record.bufferLength);
+        pos += record.bufferLength;
+    }
+
+    /* Write aside and rename so a reader never maps a partial cache */
+    _CachePath(filename, path, sizeof(path));
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    file = fopen(tmpPath, "wb");
+    if (!file) {
+        LOG_DBG("%s: Cannot create %s\n", __func__, tmpPath);
+        goto done;
+    }
+    if (fwrite(image, size, 1, file) != 1) {
+        LOG_WARN("%s: Failed to write %s\n", __func__, tmpPath);
+        goto done;
+    }
+    if (fclose(file)) {
+        file = NULL;
+        LOG_WARN("%s: Failed to write %s\n", __func__, tmpPath);
+        goto done;
+    }
+    file = NULL;
+    if (rename(tmpPath, path)) {
+        LOG_WARN("%s: Failed to rename %s\n", __func__, tmpPath);
+        goto done;
+    }
+
+    LOG_DBG("%s: Compiled %u commands to %s\n", __func__, allCommands->numCommands, path);
+    status = NVMEDIA_STATUS_OK;
+done:
+    if (file)
+        fclose(file);
+    if (status != NVMEDIA_STATUS_OK)
+        unlink(tmpPath);
+    free(image);
+    return status;
+}
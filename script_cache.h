@@ -0,0 +1,68 @@
+/* Copyright (c) 2014-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef _SCRIPT_CACHE_H_
+#define _SCRIPT_CACHE_H_
+
+#include "parser.h"
+
+/* A parsed register script is compiled to "<script>.cache":
+ *
+ *   ScriptCacheHeader | CaptureConfigParams | command records
+ *
+ * Each record is a ScriptCacheRecord followed by bufferLength bytes of the
+ * command buffer. The header carries a hash of the script text, so the
+ * cache is ignored as soon as the script changes. */
+#define SCRIPT_CACHE_SUFFIX     ".cache"
+#define SCRIPT_CACHE_MAGIC      0x31434353  /* "SCC1" */
+#define SCRIPT_CACHE_VERSION    3
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    paramsSize;     /* sizeof(CaptureConfigParams) of the writer */
+    uint32_t                    numCommands;
+    uint64_t                    sourceHash;
+    uint64_t                    sourceSize;
+    uint64_t                    streamSize;     /* bytes of command records */
+} ScriptCacheHeader;
+
+typedef struct {
+    uint8_t                     commandType;
+    uint8_t                     processType;
+    uint8_t                     dataLength;
+    uint8_t                     bufferLength;
+    uint32_t                    value;          /* address, delay, device, ... */
+    uint32_t                    line;
+} ScriptCacheRecord;
+
+/* Hashes the script text */
+NvMediaStatus
+ScriptCacheHashFile(const char *filename,
+                    uint64_t *hash,
+                    uint64_t *size);
+
+/* Loads the compiled script if its cache exists and matches the source */
+NvMediaStatus
+ScriptCacheLoad(const char *filename,
+                uint64_t sourceHash,
+                uint64_t sourceSize,
+                CaptureConfigParams *params,
+                I2cCommands *allCommands);
+
+/* Compiles a parsed script into its cache. Failing to write the cache,
+ * e.g. in a read-only directory, only costs the next startup a parse. */
+NvMediaStatus
+ScriptCacheStore(const char *filename,
+                 uint64_t sourceHash,
+                 uint64_t sourceSize,
+                 CaptureConfigParams *params,
+                 I2cCommands *allCommands);
+
+#endif
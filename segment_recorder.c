@@ -0,0 +1,518 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "segment_recorder.h"
+#include "pixel_kernels.h"
+#include "log_utils.h"
+
+static uint64_t
+_SegmentTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void
+_SegmentSlotFileName(NvSegmentRecorder *recorder,
+                     uint32_t slot,
+                     char *fileName)
+{
+    snprintf(fileName, MAX_STRING_SIZE, "%s_seg%03u.rseg", recorder->prefix, slot);
+}
+
+/* Lists the closed segments oldest first. Written aside and renamed so a
+ * reader never sees a partial index. */
+static NvMediaStatus
+_SegmentWriteIndex(NvSegmentRecorder *recorder)
+{
+    char fileName[MAX_STRING_SIZE];
+    char tmpFileName[MAX_STRING_SIZE + 4];
+    SegmentIndexEntry *entry;
+    FILE *file;
+    uint32_t sequence = 0;
+    uint32_t slot, next;
+
+    snprintf(tmpFileName, sizeof(tmpFileName), "%s.tmp", recorder->indexFileName);
+    file = fopen(tmpFileName, "w");
+    if (!file) {
+        LOG_ERR("%s: Failed to open file %s\n", __func__, tmpFileName);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    fprintf(file, "# sequence first_frame last_frame frames start_us end_us file\n");
+    while (1) {
+        /* The next segment by sequence, the slots are no longer in order
+         * once a run resumed with another budget */
+        entry = NULL;
+        for (slot = 0; slot < recorder->numSlots; slot++) {
+            if (recorder->index[slot].valid && recorder->index[slot].sequence > sequence &&
+                (!entry || recorder->index[slot].sequence < entry->sequence)) {
+                entry = &recorder->index[slot];
+                next = slot;
+            }
+        }
+        if (!entry)
+            break;
+        sequence = entry->sequence;
+        _SegmentSlotFileName(recorder, next, fileName);
+        fprintf(file, "%u %u %u %u %llu %llu %s\n", entry->sequence,
+                entry->firstFrame, entry->lastFrame, entry->numFrames,
+                (unsigned long long)entry->startTime,
+                (unsigned long long)entry->endTime, fileName);
+    }
+
+    if (fclose(file) || rename(tmpFileName, recorder->indexFileName)) {
+        LOG_ERR("%s: Failed to write index %s\n", __func__, recorder->indexFileName);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Marks the end of the frames, so a segment that is not closed does not
+ * run into the frames an older run left in the slot with its sequence
+ * number. Leaves the file where the next frame goes. */
+static NvMediaStatus
+_SegmentTerminate(NvSegmentRecorder *recorder)
+{
+    SegmentFrameHeader end;
+    SegmentHeader *header = &recorder->header;
+
+    if (header->headerSize + header->dataSize + sizeof(end) > recorder->segmentSize)
+        return NVMEDIA_STATUS_OK;
+
+    memset(&end, 0, sizeof(end));
+    if (fwrite(&end, sizeof(end), 1, recorder->file) != 1 ||
+        fseek(recorder->file, -(long)sizeof(end), SEEK_CUR)) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+/* An empty slot, looking from the current one on, or else the one of
+ * the oldest segment */
+static uint32_t
+_SegmentNextSlot(NvSegmentRecorder *recorder)
+{
+    uint32_t i, slot;
+    uint32_t oldest = 0;
+
+    for (i = 1; i <= recorder->numSlots; i++) {
+        slot = (recorder->slot + i) % recorder->numSlots;
+        if (!recorder->index[slot].valid)
+            return slot;
+        if (recorder->index[slot].sequence < recorder->index[oldest].sequence)
+            oldest = slot;
+    }
+
+    return oldest;
+}
+
+static NvMediaStatus
+_SegmentOpen(NvSegmentRecorder *recorder)
+{
+    char fileName[MAX_STRING_SIZE];
+    NvMediaStatus status;
+
+    recorder->sequence++;
+    recorder->slot = _SegmentNextSlot(recorder);
+
+    /* Drop the segment being overwritten from the index first */
+    if (recorder->index[recorder->slot].valid) {
+        LOG_DBG("%s: Reusing the slot of segment %u\n", __func__,
+                recorder->index[recorder->slot].sequence);
+        recorder->index[recorder->slot].valid = NVMEDIA_FALSE;
+        status = _SegmentWriteIndex(recorder);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+    }
+
+    _SegmentSlotFileName(recorder, recorder->slot, fileName);
+    /* Not truncated, to keep the blocks allocated */
+    recorder->file = fopen(fileName, "r+b");
+    if (!recorder->file) {
+        LOG_ERR("%s: Failed to open file %s\n", __func__, fileName);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    memset(&recorder->header, 0, sizeof(SegmentHeader));
+    recorder->header.magic = SEGMENT_MAGIC;
+    recorder->header.version = SEGMENT_VERSION;
+    recorder->header.headerSize = sizeof(SegmentHeader);
+    recorder->header.sequence = recorder->sequence;
+    if (fwrite(&recorder->header, sizeof(SegmentHeader), 1, recorder->file) != 1 ||
+        _SegmentTerminate(recorder) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        fclose(recorder->file);
+        recorder->file = NULL;
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Indexes the segment a previous run left in a slot. One it did not
+ * close is completed in place from the frames carrying its sequence
+ * number; the last of them may be cut short if the run was killed while
+ * writing it. */
+static void
+_SegmentScanSlot(NvSegmentRecorder *recorder,
+                 int fd,
+                 uint32_t slot)
+{
+    SegmentIndexEntry *entry = &recorder->index[slot];
+    SegmentFrameHeader frameHeader;
+    SegmentHeader header;
+    uint64_t offset;
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != SEGMENT_MAGIC ||
+        header.version != SEGMENT_VERSION ||
+        header.headerSize < sizeof(SegmentHeader) ||
+        !header.sequence)
+        return;
+
+    if (!header.numFrames) {
+        offset = header.headerSize;
+        while (offset + sizeof(frameHeader) <= recorder->segmentSize &&
+               pread(fd, &frameHeader, sizeof(frameHeader), offset) == sizeof(frameHeader) &&
+               frameHeader.magic == SEGMENT_FRAME_MAGIC &&
+               frameHeader.sequence == header.sequence &&
+               offset + sizeof(frameHeader) + frameHeader.size <= recorder->segmentSize) {
+            if (!header.numFrames) {
+                header.firstFrame = frameHeader.frameNumber;
+                header.startTime = frameHeader.timestamp;
+            }
+            header.numFrames++;
+            header.lastFrame = frameHeader.frameNumber;
+            header.endTime = frameHeader.timestamp;
+            offset += sizeof(frameHeader) + frameHeader.size;
+        }
+        if (!header.numFrames)
+            return;
+        header.dataSize = offset - header.headerSize;
+        if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            LOG_WARN("%s: Failed to complete segment %u\n", __func__, header.sequence);
+            return;
+        }
+        LOG_INFO("%s: Completed segment %u left open, frames %u to %u\n", __func__,
+                 header.sequence, header.firstFrame, header.lastFrame);
+    }
+
+    /* Cut by a smaller segment size than it was recorded with */
+    if (header.headerSize + header.dataSize > recorder->segmentSize)
+        return;
+
+    entry->valid = NVMEDIA_TRUE;
+    entry->sequence = header.sequence;
+    entry->numFrames = header.numFrames;
+    entry->firstFrame = header.firstFrame;
+    entry->lastFrame = header.lastFrame;
+    entry->startTime = header.startTime;
+    entry->endTime = header.endTime;
+
+    /* Carry on after the newest one */
+    if (header.sequence > recorder->sequence) {
+        recorder->sequence = header.sequence;
+        recorder->slot = slot;
+    }
+}
+
+NvMediaStatus
+SegmentRecorderInit(NvSegmentRecorder *recorder,
+                    const char *prefix,
+                    uint32_t virtualGroupIndex,
+                    uint64_t segmentSize,
+                    uint64_t budget,
+                    const NvPackedRawWriter *packer)
+{
+    char fileName[MAX_STRING_SIZE];
+    uint32_t slot, numSegments = 0;
+    int fd, err;
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    memset(recorder, 0, sizeof(NvSegmentRecorder));
+
+    if (segmentSize <= sizeof(SegmentHeader) + sizeof(SegmentFrameHeader) ||
+        budget / segmentSize < SEGMENT_MIN_SLOTS) {
+        LOG_ERR("%s: Disk budget must hold at least %u segments\n", __func__,
+                SEGMENT_MIN_SLOTS);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    snprintf(recorder->prefix, MAX_STRING_SIZE, "%s_vc%u", prefix, virtualGroupIndex);
+    snprintf(recorder->indexFileName, MAX_STRING_SIZE, "%s_segments.txt", recorder->prefix);
+    recorder->segmentSize = segmentSize;
+    recorder->packer = packer;
+
+    recorder->index = calloc(budget / segmentSize, sizeof(SegmentIndexEntry));
+    if (!recorder->index) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    recorder->numSlots = budget / segmentSize;
+    /* With no segment left, the first one goes to slot 0 */
+    recorder->slot = recorder->numSlots - 1;
+
+    /* Allocating the blocks now keeps the file system from doing it
+     * while frames are written */
+    for (slot = 0; slot < recorder->numSlots; slot++) {
+        _SegmentSlotFileName(recorder, slot, fileName);
+        fd = open(fileName, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            LOG_ERR("%s: Failed to open file %s\n", __func__, fileName);
+            goto failed;
+        }
+        _SegmentScanSlot(recorder, fd, slot);
+        if (recorder->index[slot].valid)
+            numSegments++;
+        err = ftruncate(fd, segmentSize) ? errno : posix_fallocate(fd, 0, segmentSize);
+        close(fd);
+        if (err) {
+            LOG_ERR("%s: Failed to preallocate %s: %s\n", __func__, fileName,
+                    strerror(err));
+            goto failed;
+        }
+    }
+
+    status = _SegmentWriteIndex(recorder);
+    if (status != NVMEDIA_STATUS_OK)
+        goto failed;
+
+    LOG_INFO("%s: %u segments of %llu bytes in %s_seg*.rseg\n", __func__,
+             recorder->numSlots, (unsigned long long)segmentSize, recorder->prefix);
+    if (numSegments)
+        LOG_INFO("%s: Kept %u segments of a previous run, resuming after segment %u\n",
+                 __func__, numSegments, recorder->sequence);
+    return NVMEDIA_STATUS_OK;
+
+failed:
+    SegmentRecorderDestroy(recorder);
+    return status;
+}
+
+void
+SegmentRecorderDestroy(NvSegmentRecorder *recorder)
+{
+    if (recorder->numSlots)
+        SegmentRecorderClose(recorder);
+
+    free(recorder->index);
+    free(recorder->buff);
+    memset(recorder, 0, sizeof(NvSegmentRecorder));
+}
+
+NvMediaStatus
+SegmentRecorderWrite(NvSegmentRecorder *recorder,
+                     NvMediaImage *image,
+                     uint32_t bytesPerSample,
+                     uint32_t frameNumber)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    SegmentFrameHeader frameHeader;
+    SegmentHeader *header = &recorder->header;
+    uint8_t *dstBuff[3] = {NULL};
+    uint32_t dstPitches[3] = {1};
+    uint32_t pitch, numSamples, size, keptSize;
+    uint32_t top = image->embeddedDataTopSize;
+    uint32_t bottom = image->embeddedDataBottomSize;
+    uint64_t recordSize;
+    NvMediaStatus status;
+
+    pitch = image->width * bytesPerSample;
+    numSamples = image->width * image->height;
+    size = pitch * image->height + top + bottom;
+    keptSize = recorder->packer ?
+               top + PixelPackedSize(numSamples, recorder->packer->bitsPerSample) + bottom : size;
+    recordSize = sizeof(SegmentFrameHeader) + keptSize;
+    if (sizeof(SegmentHeader) + recordSize > recorder->segmentSize) {
+        LOG_ERR("%s: A frame of %u bytes does not fit in a segment\n", __func__, keptSize);
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+
+    if (recorder->file &&
+        header->headerSize + header->dataSize + recordSize > recorder->segmentSize) {
+        status = SegmentRecorderClose(recorder);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+    }
+    if (!recorder->file) {
+        status = _SegmentOpen(recorder);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+    }
+
+    if (size > recorder->buffSize) {
+        free(recorder->buff);
+        recorder->buffSize = 0;
+        if (!(recorder->buff = malloc(size))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        recorder->buffSize = size;
+    }
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    dstBuff[0] = recorder->buff;
+    dstPitches[0] = pitch;
+    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+        return status;
+    }
+
+    /* Packed in place, the bottom lines moved up behind the pixels */
+    if (recorder->packer) {
+        PackedRawPackSamples(recorder->packer, (uint16_t *)(recorder->buff + top),
+                             recorder->buff + top, numSamples);
+        memmove(recorder->buff + keptSize - bottom, recorder->buff + size - bottom, bottom);
+    }
+
+    memset(&frameHeader, 0, sizeof(frameHeader));
+    frameHeader.magic = SEGMENT_FRAME_MAGIC;
+    frameHeader.sequence = header->sequence;
+    frameHeader.frameNumber = frameNumber;
+    frameHeader.width = image->width;
+    frameHeader.height = image->height;
+    frameHeader.bytesPerSample = bytesPerSample;
+    frameHeader.embeddedTopSize = top;
+    frameHeader.embeddedBottomSize = bottom;
+    frameHeader.timestamp = _SegmentTime();
+    frameHeader.size = keptSize;
+    frameHeader.packedBits = recorder->packer ? recorder->packer->bitsPerSample : 0;
+
+    if (fwrite(&frameHeader, sizeof(frameHeader), 1, recorder->file) != 1 ||
+        fwrite(recorder->buff, keptSize, 1, recorder->file) != 1) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        /* Back to the end of the last complete frame */
+        fseek(recorder->file, header->headerSize + header->dataSize, SEEK_SET);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (!header->numFrames) {
+        header->firstFrame = frameNumber;
+        header->startTime = frameHeader.timestamp;
+    }
+    header->numFrames++;
+    header->lastFrame = frameNumber;
+    header->endTime = frameHeader.timestamp;
+    header->dataSize += recordSize;
+
+    return _SegmentTerminate(recorder);
+}
+
+NvMediaStatus
+SegmentRecorderClose(NvSegmentRecorder *recorder)
+{
+    SegmentIndexEntry *entry = &recorder->index[recorder->slot];
+    SegmentHeader *header = &recorder->header;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+
+    if (!recorder->file)
+        return NVMEDIA_STATUS_OK;
+
+    if (fseek(recorder->file, 0, SEEK_SET) ||
+        fwrite(header, sizeof(SegmentHeader), 1, recorder->file) != 1) {
+        LOG_ERR("%s: Failed to complete segment %u\n", __func__, header->sequence);
+        status = NVMEDIA_STATUS_ERROR;
+    }
+    if (fclose(recorder->file)) {
+        LOG_ERR("%s: Failed to close segment %u\n", __func__, header->sequence);
+        status = NVMEDIA_STATUS_ERROR;
+    }
+    recorder->file = NULL;
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+
+    if (!header->numFrames)
+        return NVMEDIA_STATUS_OK;
+
+    entry->valid = NVMEDIA_TRUE;
+    entry->sequence = header->sequence;
+    entry->numFrames = header->numFrames;
+    entry->firstFrame = header->firstFrame;
+    entry->lastFrame = header->lastFrame;
+    entry->startTime = header->startTime;
+    entry->endTime = header->endTime;
+    LOG_INFO("%s: Segment %u closed, frames %u to %u\n", __func__,
+             header->sequence, header->firstFrame, header->lastFrame);
+
+    return _SegmentWriteIndex(recorder);
+}
+
+NvMediaStatus
+SegmentReadHeader(FILE *file,
+                  SegmentHeader *header)
+{
+    if (fseek(file, 0, SEEK_SET) ||
+        fread(header, sizeof(SegmentHeader), 1, file) != 1) {
+        LOG_ERR("%s: Failed to read header\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (header->magic != SEGMENT_MAGIC ||
+        header->version != SEGMENT_VERSION ||
+        header->headerSize < sizeof(SegmentHeader) ||
+        fseek(file, header->headerSize, SEEK_SET)) {
+        LOG_ERR("%s: Not a segment file\n", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+SegmentReadFrame(FILE *file,
+                 const SegmentHeader *header,
+                 SegmentFrameHeader *frameHeader,
+                 uint8_t *buff,
+                 uint32_t buffSize)
+{
+    long offset = ftell(file);
+
+    if (offset < 0)
+        return NVMEDIA_STATUS_ERROR;
+
+    /* A closed segment ends after dataSize bytes, one that was not at
+     * the end marker */
+    if (header->numFrames &&
+        (uint64_t)offset >= header->headerSize + header->dataSize)
+        return NVMEDIA_STATUS_NONE_PENDING;
+    if (fread(frameHeader, sizeof(SegmentFrameHeader), 1, file) != 1 ||
+        frameHeader->magic != SEGMENT_FRAME_MAGIC ||
+        frameHeader->sequence != header->sequence)
+        return NVMEDIA_STATUS_NONE_PENDING;
+
+    if (frameHeader->size > buffSize) {
+        LOG_ERR("%s: Frame of %u bytes does not fit the buffer\n", __func__,
+                frameHeader->size);
+        return NVMEDIA_STATUS_INSUFFICIENT_BUFFERING;
+    }
+    if (fread(buff, frameHeader->size, 1, file) != 1) {
+        LOG_ERR("%s: Failed to read frame\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
@@ -0,0 +1,150 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __SEGMENT_RECORDER_H__
+#define __SEGMENT_RECORDER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "nvmedia_image.h"
+#include "cmdline.h"
+#include "packed_raw.h"
+
+/* Circular recording of a channel into a fixed set of preallocated .rseg
+ * files, the slots. When the current segment is full the recorder moves on
+ * to the slot of the oldest segment and overwrites it, so the recording
+ * never takes more than the disk budget. Sequence numbers carry on from
+ * the segments a previous run left in the slots.
+ *
+ * A segment starts with SegmentHeader, in little endian order, followed by
+ * its frames, each a SegmentFrameHeader and the frame as captured, or
+ * with its pixels packed when packedBits says so. The
+ * header is completed when the segment is closed; the frames of a segment
+ * that was not closed are those carrying its sequence number. The index
+ * file, <prefix>_vc<n>_segments.txt, lists the closed segments oldest
+ * first with their frame and time ranges. */
+
+#define SEGMENT_MAGIC                   0x47455352  /* "RSEG" */
+#define SEGMENT_FRAME_MAGIC             0x4D415246  /* "FRAM" */
+#define SEGMENT_VERSION                 1
+
+#define SEGMENT_MIN_SLOTS               2
+#define SEGMENT_DEFAULT_SLOTS           8      /* budget when none is given */
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    headerSize;     // offset of the first frame
+    uint32_t                    sequence;       // counts segments from 1
+    uint32_t                    numFrames;      // 0 until closed
+    uint32_t                    firstFrame;
+    uint32_t                    lastFrame;
+    uint32_t                    reserved;
+    uint64_t                    dataSize;       // bytes of frames
+    uint64_t                    startTime;      // us since the epoch
+    uint64_t                    endTime;
+} SegmentHeader;
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    sequence;       // of the segment holding it
+    uint32_t                    frameNumber;
+    uint32_t                    width;
+    uint32_t                    height;         // pixel lines, without embedded ones
+    uint32_t                    bytesPerSample;
+    uint32_t                    embeddedTopSize;    // bytes
+    uint32_t                    embeddedBottomSize; // bytes
+    uint64_t                    timestamp;      // us since the epoch
+    uint32_t                    size;           // bytes of the frame
+    uint32_t                    packedBits;     // 0: as captured, else the pixels are
+                                                // packed like those of a .praw file
+} SegmentFrameHeader;
+
+typedef struct {
+    NvMediaBool                 valid;          // holds a closed segment
+    uint32_t                    sequence;
+    uint32_t                    numFrames;
+    uint32_t                    firstFrame;
+    uint32_t                    lastFrame;
+    uint64_t                    startTime;
+    uint64_t                    endTime;
+} SegmentIndexEntry;
+
+typedef struct {
+    char                        prefix[MAX_STRING_SIZE];   // of the slot files
+    char                        indexFileName[MAX_STRING_SIZE];
+    uint64_t                    segmentSize;
+    uint32_t                    numSlots;       // 0: not recording in segments
+    SegmentIndexEntry          *index;          // by slot
+
+    /* Current segment */
+    FILE                       *file;
+    uint32_t                    slot;
+    SegmentHeader               header;
+
+    uint32_t                    sequence;       // of the last segment opened
+    const NvPackedRawWriter    *packer;         // NULL: frames as captured
+    uint8_t                    *buff;           // staging buffer
+    uint32_t                    buffSize;
+} NvSegmentRecorder;
+
+/* Creates and preallocates budget / segmentSize slots, so a budget the
+ * disk cannot hold fails here rather than during the recording. The
+ * segments already in the slots are indexed again, those a previous run
+ * did not close completed from their frames. Frames are packed by packer
+ * when it is not NULL; it must outlive the recorder. */
+NvMediaStatus
+SegmentRecorderInit(NvSegmentRecorder *recorder,
+                    const char *prefix,
+                    uint32_t virtualGroupIndex,
+                    uint64_t segmentSize,
+                    uint64_t budget,
+                    const NvPackedRawWriter *packer);
+
+/* Closes the current segment. Safe on a zeroed recorder. */
+void
+SegmentRecorderDestroy(NvSegmentRecorder *recorder);
+
+NvMediaStatus
+SegmentRecorderWrite(NvSegmentRecorder *recorder,
+                     NvMediaImage *image,
+                     uint32_t bytesPerSample,
+                     uint32_t frameNumber);
+
+/* Completes the current segment and updates the index. The next frame
+ * starts a new segment. */
+NvMediaStatus
+SegmentRecorderClose(NvSegmentRecorder *recorder);
+
+/* Reads and checks the header of a .rseg file */
+NvMediaStatus
+SegmentReadHeader(FILE *file,
+                  SegmentHeader *header);
+
+/* Reads the frame following the last one read, or the first one after
+ * SegmentReadHeader. buff holds buffSize bytes. Returns
+ * NVMEDIA_STATUS_NONE_PENDING past the last frame of the segment. */
+NvMediaStatus
+SegmentReadFrame(FILE *file,
+                 const SegmentHeader *header,
+                 SegmentFrameHeader *frameHeader,
+                 uint8_t *buff,
+                 uint32_t buffSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SEGMENT_RECORDER_H__
@@ -9,6 +9,7 @@
 
 #include "cmdline.h"
 #include "sensorInfo_ar0231.h"
+#include "pixel_kernels.h"
 #include "os_common.h"
 
 typedef enum {
@@ -75,6 +76,64 @@ static const float aGainTbl[15] = {
     8.0000  //14 - 8/1x
 };
 
+#define AR0231_SWAP_BYTES(val)  ((((val) >> 8) & 0xff) | (((val) << 8) & 0xff00))
+
+/* Exposure times from the row and pclk integration times of each exposure */
+static void
+SetExposureTimes(NvRawSensorHDRInfo_v2 *sensorInfo,
+    uint32_t numExposures,
+    const uint16_t *coarseTime,
+    const uint16_t *fineIntTime,
+    uint16_t lineLenPck)
+{
+    uint32_t i;
+
+    for (i = 0; i < numExposures; i++) {
+        sensorInfo[i].exposure.exposureTime = 1.0/AR0231_1928X1208_PCLK *
+                     (((float)coarseTime[i] - 1)*lineLenPck + fineIntTime[i]);  //seconds
+    }
+}
+
+/* Gains of each exposure. Like in the nvraw files captured with IPP, all
+ * of them are folded into the digital gain. */
+static void
+SetExposureGains(NvRawSensorHDRInfo_v2 *sensorInfo,
+    uint32_t numExposures,
+    uint16_t dGain,
+    uint16_t aGain,
+    uint16_t cGain)
+{
+    uint32_t i, aGainIdx;
+
+    for (i = 0; i < numExposures; i++){
+        aGainIdx = (aGain >> i*4) & 0xf;
+        if (aGainIdx >= sizeof(aGainTbl)/sizeof(aGainTbl[0]))
+            aGainIdx = sizeof(aGainTbl)/sizeof(aGainTbl[0]) - 1;
+
+        sensorInfo[i].exposure.digitalGain = (1.0/ AR0231_ONE_DGAIN_VAL) * dGain *
+                                             (((cGain >> i) & 0x1) ? 3.0 : 1.0) *
+                                             aGainTbl[aGainIdx];
+        sensorInfo[i].exposure.analogGain = 1.0;
+        sensorInfo[i].exposure.conversionGain = 1.0;
+    }
+}
+
+/* White balance gains, in the register order Gr, B, R, Gb */
+static void
+SetWbGains(NvRawSensorHDRInfo_v2 *sensorInfo,
+    uint32_t numExposures,
+    const uint16_t *wbGains)
+{
+    uint32_t j;
+
+    for (j = 0; j < numExposures; j++) {
+        sensorInfo[j].wbGain.value[1] = wbGains[0] * (1.0 / AR0231_ONE_COLOR_DGAIN_VAL); // Gr
+        sensorInfo[j].wbGain.value[3] = wbGains[1] * (1.0 / AR0231_ONE_COLOR_DGAIN_VAL); // B
+        sensorInfo[j].wbGain.value[0] = wbGains[2] * (1.0 / AR0231_ONE_COLOR_DGAIN_VAL); // R
+        sensorInfo[j].wbGain.value[2] = wbGains[3] * (1.0 / AR0231_ONE_COLOR_DGAIN_VAL); // Gb
+    }
+}
+
 static NvMediaStatus
 ReadSensorVersionInfo(I2cCommands *settings,
     CalibrationParameters *calParam,
@@ -127,9 +186,8 @@ ReadSensorExposureInfo(I2cCommands *settings,
 {
     NvMediaStatus status = NVMEDIA_STATUS_OK;
     RegisterSetup rgstrArrayExp[9], rgstrArrayGain[4];
-    float expTime[AR0231_NUM_EXPOSURES] = {0.0},
-          coarseTime[AR0231_NUM_EXPOSURES] = {0.0},
-          fineIntTime[AR0231_NUM_EXPOSURES] = {0.0};
+    uint16_t coarseTime[AR0231_NUM_EXPOSURES] = {0},
+             fineIntTime[AR0231_NUM_EXPOSURES] = {0};
     uint16_t lineLenPck;
     uint32_t i = 0;
     uint32_t prevNumCommands = I2cGetNumCommands(settings);
@@ -174,22 +232,18 @@ ReadSensorExposureInfo(I2cCommands *settings,
     }
 
     //lineLenPck
-    lineLenPck = (*rgstrArrayExp[8].rgstrVal >> 8) + (*rgstrArrayExp[8].rgstrVal << 8);
+    lineLenPck = AR0231_SWAP_BYTES(*rgstrArrayExp[8].rgstrVal);
 
-    // calculate exposure time (us)
+    // calculate exposure time
     for (i = 0; i < numExposures; i++) {
-        coarseTime[i] = ((*rgstrArrayExp[i].rgstrVal >> 8) & 0xff) |
-                         ((*rgstrArrayExp[i].rgstrVal << 8) & 0xff00);
-        fineIntTime[i] = ((*rgstrArrayExp[i+4].rgstrVal >> 8) & 0xff) |
-                          ((*rgstrArrayExp[i+4].rgstrVal << 8) & 0xff00);
-        expTime[i] = 1.0/AR0231_1928X1208_PCLK *
-                     ((coarseTime[i] - 1)*lineLenPck + fineIntTime[i]);
-        sensorInfo[i].exposure.exposureTime = expTime[i];  //seconds
+        coarseTime[i] = AR0231_SWAP_BYTES(*rgstrArrayExp[i].rgstrVal);
+        fineIntTime[i] = AR0231_SWAP_BYTES(*rgstrArrayExp[i+4].rgstrVal);
     }
+    SetExposureTimes(sensorInfo, numExposures, coarseTime, fineIntTime, lineLenPck);
 
     LOG_INFO("%s: Sensor exposure time readback: \n", __func__);
     for (i = 0; i < numExposures; i++) {
-        LOG_INFO(" T%d: %f\n", i + 1,expTime[i]);
+        LOG_INFO(" T%d: %f\n", i + 1, sensorInfo[i].exposure.exposureTime);
     }
 
 
@@ -229,25 +283,10 @@ ReadSensorExposureInfo(I2cCommands *settings,
         goto failed;
     }
 
-    for (i = 0; i < numExposures; i++){
-
-        sensorInfo[i].exposure.digitalGain = (1.0/ AR0231_ONE_DGAIN_VAL) *
-                                             (((*rgstrArrayGain[0].rgstrVal >> 8) & 0xff) |
-                                             ((*rgstrArrayGain[0].rgstrVal << 8) & 0xff00));
-
-        sensorInfo[i].exposure.conversionGain = ((((((*rgstrArrayGain[2].rgstrVal >> 8) & 0xff) |
-                                                ((*rgstrArrayGain[2].rgstrVal << 8) & 0xff00)) & (0x1 << i)) >> i) & 0x1) ? 3.0 : 1.0;
-
-
-        sensorInfo[i].exposure.analogGain = aGainTbl[(((((*rgstrArrayGain[1].rgstrVal >> 8) & 0xff) |
-                                                     ((*rgstrArrayGain[1].rgstrVal << 8) & 0xff00)) & (0xf << i*4)) >> i*4 ) & 0xf];
-
-        sensorInfo[i].exposure.digitalGain = sensorInfo[i].exposure.digitalGain *
-                                             sensorInfo[i].exposure.conversionGain *
-                                             sensorInfo[i].exposure.analogGain;
-        sensorInfo[i].exposure.analogGain = 1.0;
-        sensorInfo[i].exposure.conversionGain = 1.0;
-     }
+    SetExposureGains(sensorInfo, numExposures,
+                     AR0231_SWAP_BYTES(*rgstrArrayGain[0].rgstrVal),
+                     AR0231_SWAP_BYTES(*rgstrArrayGain[1].rgstrVal),
+                     AR0231_SWAP_BYTES(*rgstrArrayGain[2].rgstrVal));
 
 failed:
     /* Restore prevNumCommands since numCommands member of 'settings' is modified by I2cSetupRegister().
@@ -264,9 +303,9 @@ ReadSensorWbGainsInfo(I2cCommands *settings,
 {
     NvMediaStatus status = NVMEDIA_STATUS_OK;
     uint8_t address[2];
-    float_t val;
+    uint16_t wbGains[4];
     RegisterSetup rgstr;
-    uint32_t i = 0, j = 0;
+    uint32_t i = 0;
     uint32_t prevNumCommands = I2cGetNumCommands(settings);
 
     for (i = 0; i < 4; i++) {  //Gr, B, R, Gb
@@ -296,21 +335,11 @@ ReadSensorWbGainsInfo(I2cCommands *settings,
             goto failed;
         }
 
-        val = (((*rgstr.rgstrVal >> 8) & 0xff) |
-               ((*rgstr.rgstrVal << 8) & 0xff00)) * (1.0 / AR0231_ONE_COLOR_DGAIN_VAL);
-
-        for (j = 0; j < numExposures; j++) {
-            if (i == 0)
-                sensorInfo[j].wbGain.value[1] = val; // Gr
-            else if (i == 1)
-                sensorInfo[j].wbGain.value[3] = val; // B
-            else if (i == 2)
-                sensorInfo[j].wbGain.value[0] = val; // R
-            else
-                sensorInfo[j].wbGain.value[2] = val; // Gb
-        }
+        wbGains[i] = AR0231_SWAP_BYTES(*rgstr.rgstrVal);
     }
 
+    SetWbGains(sensorInfo, numExposures, wbGains);
+
 failed:
     /* Restore prevNumCommands since numCommands member of 'settings' is modified by I2cSetupRegister().
      * This has the effect of removing the new command(s) added in the function from 'settings'*/
@@ -1892,30 +1921,225 @@ failed:
     return (outputCompressionFormat + 1);
 }
 
+/* Registers taken from the embedded lines */
+enum {
+    EMB_FRAME_COUNT_HI = 0,
+    EMB_FRAME_COUNT_LO,
+    EMB_COARSE_T1,
+    EMB_FINE_T1 = EMB_COARSE_T1 + AR0231_NUM_EXPOSURES,
+    EMB_LINE_LENGTH = EMB_FINE_T1 + AR0231_NUM_EXPOSURES,
+    EMB_DGAIN,
+    EMB_AGAIN,
+    EMB_CGAIN,
+    EMB_WB_GR,
+    EMB_TEMP = EMB_WB_GR + 4,
+    EMB_TEMP_CALIB1,
+    EMB_TEMP_CALIB2,
+    EMB_NUM_REGS
+};
+
+typedef struct {
+    uint16_t value[EMB_NUM_REGS];
+    uint8_t found[EMB_NUM_REGS];    // bit 1: high byte, bit 0: low byte
+} EmbeddedRegisters;
+
+#define EMB_FOUND(regs, reg)    ((regs)->found[reg] == 0x3)
+
+static uint16_t
+EmbeddedRegisterAddress(uint32_t reg)
+{
+    if (reg == EMB_FRAME_COUNT_HI || reg == EMB_FRAME_COUNT_LO)
+        return AR0231_REG_FRAME_COUNT + (reg - EMB_FRAME_COUNT_HI) * 2;
+    if (reg >= EMB_COARSE_T1 && reg < EMB_FINE_T1)
+        return AR0231_REG_EXP_TIME_T1_ROW + (reg - EMB_COARSE_T1) * 2;
+    if (reg >= EMB_FINE_T1 && reg < EMB_LINE_LENGTH)
+        return AR0231_REG_FINE_EXP_TIME_T1_PCLK + (reg - EMB_FINE_T1) * 2;
+    if (reg >= EMB_WB_GR && reg < EMB_TEMP)
+        return AR0231_REG_DGAIN_GR + (reg - EMB_WB_GR) * 2;
+
+    switch (reg) {
+        case EMB_LINE_LENGTH:
+            return AR0231_REG_LINE_LENGTH_PCK;
+        case EMB_DGAIN:
+            return AR0231_REG_DGAIN;
+        case EMB_AGAIN:
+            return AR0231_REG_AGAIN;
+        case EMB_CGAIN:
+            return AR0231_REG_CGAIN;
+        case EMB_TEMP:
+            return AR0231_REG_TEMPSENS0_DATA;
+        case EMB_TEMP_CALIB1:
+            return AR0231_REG_TEMPSENS0_CALIB1;
+        default:
+            return AR0231_REG_TEMPSENS0_CALIB2;
+    }
+}
+
+static void
+RecordEmbeddedByte(EmbeddedRegisters *regs,
+    const uint16_t *addresses,
+    uint16_t address,
+    uint8_t data)
+{
+    uint32_t i;
+
+    for (i = 0; i < EMB_NUM_REGS; i++) {
+        if (address == addresses[i]) {
+            regs->value[i] = (regs->value[i] & 0x00ff) | (data << 8);
+            regs->found[i] |= 0x2;
+        } else if (address == (uint16_t)(addresses[i] + 1)) {
+            regs->value[i] = (regs->value[i] & 0xff00) | data;
+            regs->found[i] |= 0x1;
+        }
+    }
+}
+
+/* Decodes the register lines among the size bytes of top embedded lines
+ * and updates state and frameInfo with what the frame was captured with.
+ * Values missing from the lines are left as they are. Returns
+ * NVMEDIA_FALSE if there are no register lines. */
+static NvMediaBool
+ParseEmbeddedData(const uint8_t *data,
+    uint32_t size,
+    uint32_t pitch,
+    uint32_t numExposures,
+    SensorState *state,
+    SensorFrameInfo *frameInfo)
+{
+    EmbeddedRegisters regs;
+    uint16_t addresses[EMB_NUM_REGS];
+    uint16_t coarseTime[AR0231_NUM_EXPOSURES], fineIntTime[AR0231_NUM_EXPOSURES], wbGains[4];
+    uint16_t address = 0;
+    uint32_t line, i, numSamples = pitch / 2;
+    const uint8_t *sample;
+    uint8_t tag, value;
+    NvMediaBool found = NVMEDIA_FALSE, allFound;
+
+    memset(&regs, 0, sizeof(regs));
+    for (i = 0; i < EMB_NUM_REGS; i++)
+        addresses[i] = EmbeddedRegisterAddress(i);
+
+#define EMB_BYTE(s)     ((uint8_t)((((s)[1] << 8) | (s)[0]) >> AR0231_EMB_DATA_SHIFT))
+
+    for (line = 0; pitch && line < size / pitch; line++) {
+        sample = data + line * pitch;
+        if (EMB_BYTE(sample) != AR0231_EMB_DATA_FORMAT)
+            continue;
+        found = NVMEDIA_TRUE;
+
+        for (i = 1; i + 1 < numSamples; i += 2) {
+            tag = EMB_BYTE(sample + i * 2);
+            value = EMB_BYTE(sample + (i + 1) * 2);
+            if (tag == AR0231_EMB_TAG_ADDR_MSB) {
+                address = (address & 0x00ff) | (value << 8);
+            } else if (tag == AR0231_EMB_TAG_ADDR_LSB) {
+                address = (address & 0xff00) | value;
+            } else if (tag == AR0231_EMB_TAG_DATA) {
+                RecordEmbeddedByte(&regs, addresses, address, value);
+                address++;
+            } else {
+                break;
+            }
+        }
+    }
+#undef EMB_BYTE
+
+    if (!found)
+        return NVMEDIA_FALSE;
+
+    allFound = EMB_FOUND(&regs, EMB_LINE_LENGTH);
+    for (i = 0; i < numExposures; i++) {
+        allFound = allFound && EMB_FOUND(&regs, EMB_COARSE_T1 + i) && EMB_FOUND(&regs, EMB_FINE_T1 + i);
+        coarseTime[i] = regs.value[EMB_COARSE_T1 + i];
+        fineIntTime[i] = regs.value[EMB_FINE_T1 + i];
+    }
+    if (allFound)
+        SetExposureTimes(state->sensorData, numExposures, coarseTime, fineIntTime,
+                         regs.value[EMB_LINE_LENGTH]);
+
+    if (EMB_FOUND(&regs, EMB_DGAIN) && EMB_FOUND(&regs, EMB_AGAIN) && EMB_FOUND(&regs, EMB_CGAIN))
+        SetExposureGains(state->sensorData, numExposures, regs.value[EMB_DGAIN],
+                         regs.value[EMB_AGAIN], regs.value[EMB_CGAIN]);
+
+    allFound = NVMEDIA_TRUE;
+    for (i = 0; i < 4; i++) {
+        allFound = allFound && EMB_FOUND(&regs, EMB_WB_GR + i);
+        wbGains[i] = regs.value[EMB_WB_GR + i];
+    }
+    if (allFound)
+        SetWbGains(state->sensorData, numExposures, wbGains);
+
+    frameInfo->valid = NVMEDIA_FALSE;
+    if (EMB_FOUND(&regs, EMB_FRAME_COUNT_HI) && EMB_FOUND(&regs, EMB_FRAME_COUNT_LO) &&
+        EMB_FOUND(&regs, EMB_TEMP) && EMB_FOUND(&regs, EMB_TEMP_CALIB1) &&
+        EMB_FOUND(&regs, EMB_TEMP_CALIB2) &&
+        regs.value[EMB_TEMP_CALIB1] != regs.value[EMB_TEMP_CALIB2]) {
+        frameInfo->frameCounter = ((uint32_t)regs.value[EMB_FRAME_COUNT_HI] << 16) |
+                                  regs.value[EMB_FRAME_COUNT_LO];
+        // Linear between the readings calibrated at 55 and 70 C
+        frameInfo->temperature = 55.0f + 15.0f *
+                                 ((float)regs.value[EMB_TEMP] - regs.value[EMB_TEMP_CALIB2]) /
+                                 ((float)regs.value[EMB_TEMP_CALIB1] - regs.value[EMB_TEMP_CALIB2]);
+        frameInfo->valid = NVMEDIA_TRUE;
+    }
+
+    return NVMEDIA_TRUE;
+}
+
+static NvMediaStatus
+ReadSensorState(I2cCommands *settings,
+    CalibrationParameters *calParam,
+    SensorState *state)
+{
+    NvMediaStatus status;
+    uint32_t numExposures;
+
+    state->rawFormat = ReadRawCompressionFormat(settings, calParam);
+    numExposures = (state->rawFormat == 3) ? 3 : 1;
+
+    status = ReadSensorExposureInfo(settings, calParam, state->sensorData, numExposures);
+    if (status != NVMEDIA_STATUS_OK){
+        LOG_ERR("%s: ReadSensorExposureInfo failed\n", __func__);
+        return status;
+    }
+
+    status = ReadSensorWbGainsInfo(settings, calParam, state->sensorData, numExposures);
+    if (status != NVMEDIA_STATUS_OK){
+        LOG_ERR("%s: ReadSensorWbGainsInfo failed\n", __func__);
+        return status;
+    }
+
+    status = ReadSensorLUTInfo(settings, calParam, state->sensorData, state->lut);
+    if (status != NVMEDIA_STATUS_OK){
+        LOG_ERR("%s: ReadSensorLUTInfo failed\n", __func__);
+        return status;
+    }
+
+    status = ReadEmbeddedLinesInfo(settings, calParam, &state->embeddedLinesTop,
+                                   &state->embeddedLinesBottom);
+    if (status != NVMEDIA_STATUS_OK){
+        LOG_ERR("%s: ReadEmbeddedLinesInfo failed\n", __func__);
+        return status;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
 static NvMediaStatus
 WriteNvRawImage(
     I2cCommands *settings,
     CalibrationParameters *calParam,
+    SensorState *state,
+    NvRawWriter *writer,
     NvMediaImage *image,
     int32_t frameNumber,
     char *outputFileName)
 {
-
-    FILE *file = NULL;
-    NvRawFileHeaderChunkHandle *pNvrfHeader = NULL;
-    NvRawFileCaptureChunkHandle *pNvrfCapture = NULL;
-    NvRawFileCameraStateChunkHandle *pNvrfCameraState = NULL;
-    NvRawFileSensorInfoChunkHandle *pNvrfSensorInfo = NULL;
-    NvRawFileDataChunkHandle *pNvrfData = NULL;
-    NvRawFileHDRChunkHandle *pNvrfHDR = NULL;
     NvMediaStatus status = NVMEDIA_STATUS_OK;
-    NvRawFileErrorStatus nvrawStatus = NvRawFileError_Success;
     uint32_t numExposures = AR0231_NUM_EXPOSURES -1;
     uint32_t imageWidth = 0, imageHeight = 0;
-    NvMediaImageSurfaceMap surfaceMap;
     NvRawSensorHDRInfo_v2 *sensorData = NULL;
-    unsigned char *buff = NULL, *dstBuff[3] = {NULL};
-    unsigned int dstPitches[3] = {1};
+    unsigned char *buff = NULL;
     uint32_t pitch = 0;
     uint32_t rawBytesPerPixel = 0, imageSize = 0;
     uint32_t compressionFormat = 0, nvrawCompressionFormat = 0, linearMode = 0;
@@ -1925,8 +2149,8 @@ WriteNvRawImage(
     uint32_t BayerPhase[2][2] = { {NVRAWDUMP_BAYER_ORDERING_RGGB, NVRAWDUMP_BAYER_ORDERING_GRBG},
                                {NVRAWDUMP_BAYER_ORDERING_GBRG, NVRAWDUMP_BAYER_ORDERING_BGGR}};
 
-    uint32_t embeddedLinesTop = 0, embeddedLinesBottom = 0;
-    float_t LUTData[256] = {0.0};
+    SensorState current;
+    SensorFrameInfo frameInfo;
     float_t iso;
 
     if (image == NULL) {
@@ -1937,40 +2161,19 @@ WriteNvRawImage(
         imageHeight = image->height;
     }
 
-    pNvrfHeader = NvRawFileHeaderChunkCreate();
-    if (pNvrfHeader == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
-
-    pNvrfCapture = NvRawFileCaptureChunkCreate();
-    if (pNvrfCapture == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
-
-    pNvrfCameraState = NvRawFileCameraStateChunkCreate();
-    if (pNvrfCameraState == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileCameraStateChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
-
-
-    pNvrfSensorInfo = NvRawFileSensorInfoChunkCreate();
-    if (pNvrfSensorInfo == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
+    /* The sensor is only read here if its state is not known */
+    if (state && state->valid) {
+        current = *state;
+    } else {
+        memset(&current, 0, sizeof(current));
+        status = ReadSensorState(settings, calParam, &current);
+        if (status != NVMEDIA_STATUS_OK){
+            LOG_ERR("WriteNvRawImage: ReadSensorState failed\n");
+            return status;
+        }
     }
 
-    compressionFormat = ReadRawCompressionFormat(settings, calParam);
+    compressionFormat = current.rawFormat;
     switch (compressionFormat) {
         case 1:
             nvrawCompressionFormat = NvRawCompressionFormat_12BitLinear;
@@ -1978,7 +2181,6 @@ WriteNvRawImage(
             numExposures = 1;
             rawBytesPerPixel = 2;
             inputFormatWidthMultiplier = 1;
-            nvrawStatus = NvRawFileHeaderChunkSetBitsPerSample(pNvrfHeader,12);
             break;
         case 3:
             nvrawCompressionFormat = NvRawCompressionFormat_12BitCombinedCompressed;
@@ -1986,323 +2188,175 @@ WriteNvRawImage(
             numExposures = 3;
             rawBytesPerPixel = 2;
             inputFormatWidthMultiplier = 1;
-            nvrawStatus = NvRawFileHeaderChunkSetBitsPerSample(pNvrfHeader,12);
             break;
         default:
            LOG_ERR("WriteNvRawImage: Unsupported nvraw compression mode\n");
-           nvrawStatus = NvRawFileError_BadParameter;
-           break;
+           return NVMEDIA_STATUS_ERROR;
     }
 
-    if (nvrawStatus != NvRawFileError_Success){
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
+    //Image EmbeddedData is only known for captured frames
+    if (frameNumber < 0){
+        memset(current.sensorData, 0, sizeof(current.sensorData));
+        memset(current.lut, 0, sizeof(current.lut));
+        current.embeddedLinesTop = 0;
+        current.embeddedLinesBottom = 0;
     }
+    sensorData = current.sensorData;
 
-    sensorData = (NvRawSensorHDRInfo_v2*)calloc(numExposures, sizeof(NvRawSensorHDRInfo_v2));
-    //Get Image EmbeddedData
-    if (frameNumber >= 0){
-        status = ReadSensorExposureInfo(settings, calParam, sensorData, numExposures);
-        if (status != NVMEDIA_STATUS_OK){
-            LOG_ERR("WriteNvRawImage: ReadSensorExposureInfo failed\n");
-            goto done;
-        }
+    pitch = imageWidth * rawBytesPerPixel;
+    imageSize = pitch * imageHeight;
+    imageSize += image->embeddedDataTopSize;
+    imageSize += image->embeddedDataBottomSize;
 
-        status = ReadSensorWbGainsInfo(settings, calParam, sensorData, numExposures);
-        if (status != NVMEDIA_STATUS_OK){
-            LOG_ERR("WriteNvRawImage: ReadSensorWbGainsInfo failed\n");
-            goto done;
+    status = NvRawWriterBegin(writer, outputFileName, imageWidth, imageHeight, imageSize);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+
+    status = NvRawWriterGetBits(writer, image, pitch);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+    buff = writer->buff;
+
+    /* The embedded lines carry the registers this frame was exposed with,
+     * which the cached state may be a frame or two behind of */
+    memset(&frameInfo, 0, sizeof(frameInfo));
+    if (frameNumber >= 0 &&
+        ParseEmbeddedData(buff, image->embeddedDataTopSize, pitch, numExposures,
+                          &current, &frameInfo) && frameInfo.valid) {
+        LOG_DBG("WriteNvRawImage: frame %d sensor frame %u temperature %.1f C\n",
+                frameNumber, frameInfo.frameCounter, frameInfo.temperature);
+    }
+
+    /* The header and sensor info only change with the file */
+    if (!writer->numImages) {
+        if (NvRawFileHeaderChunkSetBitsPerSample(writer->header, 12) != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetBitsPerSample failed \n");
+            return NVMEDIA_STATUS_ERROR;
         }
 
-        status = ReadSensorLUTInfo(settings, calParam, sensorData, LUTData);
-        if (status != NVMEDIA_STATUS_OK){
-            LOG_ERR("WriteNvRawImage: ReadSensorLUTInfo failed\n");
-            goto done;
+        if (NvRawFileHeaderChunkSetSamplesPerPixel(writer->header, inputFormatWidthMultiplier) != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetSamplesPerPixel failed \n");
+            return NVMEDIA_STATUS_ERROR;
         }
 
-        status = ReadEmbeddedLinesInfo(settings, calParam, &embeddedLinesTop, &embeddedLinesBottom);
-        if (status != NVMEDIA_STATUS_OK){
-            LOG_ERR("WriteNvRawImage: ReadEmbeddedLinesInfo failed\n");
-            goto done;
+        if (NvRawFileHeaderChunkSetProcessingFlags(writer->header, 0)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetProcessingFlags failed \n");
+            return NVMEDIA_STATUS_ERROR;
         }
-    }
-
-    if (nvrawStatus != NvRawFileError_Success){
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetBitsPerSample failed \n");
-        goto done;
-    }
-
-    if (NvRawFileHeaderChunkSetSamplesPerPixel(pNvrfHeader,inputFormatWidthMultiplier) != NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetSamplesPerPixel failed \n");
-        goto done;
-    }
 
-    if (NvRawFileHeaderChunkSetNumImages(pNvrfHeader,1)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetNumImages failed \n");
-        goto done;
-    }
-
-    if (NvRawFileHeaderChunkSetProcessingFlags(pNvrfHeader,0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetProcessingFlags failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetDataFormat(writer->header, BayerPhase[0][1])!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetDataFormat failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetDataFormat(pNvrfHeader, BayerPhase[0][1])!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetDataFormat failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetImageWidth(writer->header, imageWidth)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageWidth failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetImageWidth(pNvrfHeader, imageWidth)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageWidth failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetImageHeight(writer->header, imageHeight)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageHeight failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetImageHeight(pNvrfHeader, imageHeight)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageHeight failed \n");
-        goto done;
+        //set Fuse-ID
+        fuseBuffer[0] = '\0';
+        if (NvRawFileSensorInfoChunkSetFuse(writer->sensorInfo, (const char *)fuseBuffer)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkSetFuse failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
     }
 
-    if (NvRawFileCaptureChunkSetExposureTime(pNvrfCapture,sensorData[linearMode].exposure.exposureTime)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetExposureTime(writer->capture, sensorData[linearMode].exposure.exposureTime)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetExposureTime failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
     iso = sensorData[linearMode].exposure.analogGain * 100;
-    if (NvRawFileCaptureChunkSetISO(pNvrfCapture, iso)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetISO(writer->capture, iso)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetISO failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetFocusPosition(pNvrfCapture,0.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetFocusPosition(writer->capture, 0.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetFocusPosition failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetFlashPower(pNvrfCapture, 0.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetFlashPower(writer->capture, 0.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetFlashPower failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
     for (i = 0; i< 4; i++) {
         sensorGains[i] = sensorData[linearMode].exposure.digitalGain * sensorData[linearMode].wbGain.value[i];
     }
 
-    if (NvRawFileCaptureChunkSetSensorGain(pNvrfCapture, sensorGains)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetSensorGain(writer->capture, sensorGains)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetSensorGain failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetIspDigitalGain(pNvrfCapture, 1.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetIspDigitalGain(writer->capture, 1.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetIspDigitalGain failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetOutputDataFormat(pNvrfCapture, nvrawCompressionFormat)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetOutputDataFormat(writer->capture, nvrawCompressionFormat)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetOutputDataFormat failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetPixelEndianness(pNvrfCapture, true)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetPixelEndianness(writer->capture, true)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetPixelEndianness failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetEmbeddedLineCountTop(pNvrfCapture, embeddedLinesTop)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetEmbeddedLineCountTop(writer->capture, current.embeddedLinesTop)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetEmbeddedLineCountTop failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetEmbeddedLineCountBottom(pNvrfCapture,embeddedLinesBottom)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetEmbeddedLineCountBottom(writer->capture, current.embeddedLinesBottom)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetEmbeddedLineCountBottom failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetLux(pNvrfCapture, 0.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetLux(writer->capture, 0.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetLux failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
     if (nvrawCompressionFormat == NvRawCompressionFormat_12BitCombinedCompressed ||
        nvrawCompressionFormat == NvRawCompressionFormat_12BitCombinedCompressedExtended){
-        if (NvRawFileCaptureChunkSetLut(pNvrfCapture, (uint8_t*)LUTData, sizeof(LUTData))!= NvRawFileError_Success) {
-            status = NVMEDIA_STATUS_ERROR;
+        if (NvRawFileCaptureChunkSetLut(writer->capture, (uint8_t*)current.lut, sizeof(current.lut))!= NvRawFileError_Success) {
             LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetLut failed \n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
     }
 
-    //set Fuse-ID
-    fuseBuffer[0] = '\0';
-    if (NvRawFileSensorInfoChunkSetFuse(pNvrfSensorInfo, (const char *)fuseBuffer)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkSetFuse failed \n");
-        goto done;
-    }
-
     if (numExposures > 1) {
-        pNvrfHDR = NvRawFileHDRChunkCreate();
-        if (NvRawFileHDRChunkSetNumberOfExposures(pNvrfHDR, numExposures)!= NvRawFileError_Success){
-            status = NVMEDIA_STATUS_ERROR;
+        if (NvRawFileHDRChunkSetNumberOfExposures(writer->hdr, numExposures)!= NvRawFileError_Success){
             LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkSetNumberOfExposures failed \n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
 
-        if (NvRawFileHDRChunkSetReadoutScheme(pNvrfHDR, "A\nA\nA\nA")!= NvRawFileError_Success){
+        if (NvRawFileHDRChunkSetReadoutScheme(writer->hdr, "A\nA\nA\nA")!= NvRawFileError_Success){
             LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkSetReadoutScheme failed \n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
 
-        if (NvRawFileHDRChunkSetExposureInfo_v2(pNvrfHDR, sensorData)!= NvRawFileError_Success){
+        if (NvRawFileHDRChunkSetExposureInfo_v2(writer->hdr, sensorData)!= NvRawFileError_Success){
             LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkSetExposureInfo_v2 failed \n");
-            goto done;
-        }
-    }
-
-    pitch = imageWidth * rawBytesPerPixel;
-    imageSize = pitch * imageHeight;
-    imageSize += image->embeddedDataTopSize;
-    imageSize += image->embeddedDataBottomSize;
-
-    pNvrfData = NvRawFileDataChunkCreate(imageSize, false);
-    if (pNvrfData == NULL) {
-        LOG_ERR("WriteNvRawImage: NvRawFileDataChunkCreate failed\n");
-        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
-        goto done;
-    }
-
-    // Write to an output file
-    file = fopen(outputFileName, "wb");
-    if (file == NULL) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: Failed to open file\n");
-        goto done;
-    }
-
-    NVM_SURF_FMT_DEFINE_ATTR(attr);
-
-    status = NvMediaSurfaceFormatGetAttrs(image->type,
-                                          attr,
-                                          7);
-    if (status != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s:NvMediaSurfaceFormatGetAttrs failed\n", __func__);
-        goto done;
-    }
-
-    if(attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW){
-        // write full chunks and the partial data chunk.
-        if ( NvRawFileHeaderChunkFileWrite(pNvrfHeader, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (NvRawFileCaptureChunkFileWrite(pNvrfCapture, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (NvRawFileCameraStateChunkFileWrite(pNvrfCameraState, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileCameraStateChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (NvRawFileSensorInfoChunkFileWrite(pNvrfSensorInfo, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (pNvrfHDR != NULL) {
-            if (NvRawFileHDRChunkFileWrite(pNvrfHDR, file)!= NvRawFileError_Success) {
-                LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkFileWrite failed\n");
-                status = NVMEDIA_STATUS_ERROR;
-                goto done;
-            }
-        }
-
-        if (NvRawFileDataChunkFileWrite(pNvrfData, file, false)!= NvRawFileError_Success){
-            status = NVMEDIA_STATUS_ERROR;
-            LOG_ERR("WriteNvRawImage: NvRawFileDataChunkFileWrite failed\n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
-
-    }
-
-    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK){
-        LOG_ERR("WriteNvRawImage: NvMediaImageLock failed\n");
-        return NVMEDIA_STATUS_ERROR;
-    }
-
-    if (!(buff = malloc(imageSize))) {
-        LOG_ERR("WriteNvRawImage: Out of memory\n");
-        fclose(file);
-        return NVMEDIA_STATUS_OUT_OF_MEMORY;
-    }
-
-    dstBuff[0] = buff;
-    dstPitches[0] = pitch;
-    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
-    NvMediaImageUnlock(image);
-    if (status != NVMEDIA_STATUS_OK) {
-        LOG_ERR("WriteNvRawImage: NvMediaVideoSurfaceGetBits() failed\n");
-        goto done;
     }
 
     // re-align 12bit (S1.14 format) pixel data
     // to LSB (right shift by 2) for display/nvraw-viewer
-    for (i = 0; i < (imageSize/2); i++) {
-        // LSB
-        buff[2*i] = buff[2*i] >> 2;
-        buff[2*i] |= (buff[(2*i)+1] & 0x03) << 6;
-        //MSB
-        buff[(2*i)+1] = (buff[(2*i)+1] >> 2) & 0x0F;
-    }
-
-    if (fwrite(dstBuff[0], imageSize, 1, file) != 1) {
-        LOG_ERR("WriteNvRawImage: file write failed\n");
-        goto done;
-    }
-
+    PixelShiftRight16((uint16_t *)buff, imageSize / 2, 2, 0x0FFF);
 
-done:
-    NvRawFileHeaderChunkDelete(pNvrfHeader);
-    NvRawFileCaptureChunkDelete(pNvrfCapture);
-    NvRawFileCameraStateChunkDelete(pNvrfCameraState);
-    NvRawFileSensorInfoChunkDelete(pNvrfSensorInfo);
-    NvRawFileHDRChunkDelete(pNvrfHDR);
-    NvRawFileDataChunkDelete(pNvrfData);
-
-    if (file != NULL){
-        fclose(file);
-    }
-
-    if (sensorData)
-        free(sensorData);
-
-    if (buff)
-        free(buff);
-
-    return status;
+    return NvRawWriterWrite(writer, numExposures > 1 ? NVMEDIA_TRUE : NVMEDIA_FALSE);
 }
 
 static void
@@ -2357,6 +2411,7 @@ static SensorInfo ar0231Info = {
     .AppendOutputFilename = AppendOutputFilename,
     .WriteNvRawImage = WriteNvRawImage,
     .PrintSensorCaliUsage = PrintSensorCaliUsage,
+    .ReadSensorState = ReadSensorState,
 };
 
 SensorInfo*
@@ -57,6 +57,22 @@
 #define AR0231_SENSOR_FUSE_ID_SIZE   16
 #define AR0231_REG_CHIP_VER          0x31FE
 
+#define AR0231_REG_FRAME_COUNT       0x2000 // 32 bit frame counter
+#define AR0231_REG_TEMPSENS0_DATA    0x20B0 // Temperature sensor reading
+#define AR0231_REG_TEMPSENS0_CALIB1  0x30C6 // Temperature sensor reading at 70 C
+#define AR0231_REG_TEMPSENS0_CALIB2  0x30C8 // Temperature sensor reading at 55 C
+
+// Embedded register lines: a line starts with the data format code, then
+// each byte is preceded by a tag. Data bytes go to consecutive addresses.
+#define AR0231_EMB_DATA_FORMAT       0x0A
+#define AR0231_EMB_TAG_ADDR_MSB      0xAA
+#define AR0231_EMB_TAG_ADDR_LSB      0xA5
+#define AR0231_EMB_TAG_DATA          0x5A
+#define AR0231_EMB_TAG_END           0x07
+// Each byte is the top 8 bits of a 12 bit sample, stored like the pixels
+// in 16 bits with the 12 bits starting at bit 2
+#define AR0231_EMB_DATA_SHIFT        6
+
 typedef struct {
     uint16_t hts;
     uint16_t vts;
@@ -0,0 +1,632 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include "cmdline.h"
+#include "sensorInfo_boson.h"
+#include "boson_cmd.h"
+#include "os_common.h"
+
+typedef struct {
+    CmdlineParameter        ffc;
+    CmdlineParameter        palette;
+    CmdlineParameter        agcTail;
+} BosonProperties;
+
+static char *bosonSupportedArgs[] = {
+    "-ffc",
+    "-palette",
+    "-agc_tail"
+};
+
+// Boson sends every pixel bit reversed:
+// Boson Data: x.x.N4.N4:N3.N3.N3.N3 - N2.N2.N2.N2:N1.N1.N1.N1
+// byteH -> N2.N2.N3.N3:N3.N3.N4.N4  (has the most significant bits)
+// byteL -> x.x.N1.N1:N1.N1.N2.N2  (has the less significant bits)
+#define R2(n)   n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n)   R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n)   R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+
+static const uint8_t bitReverse[256] = { R6(0), R6(2), R6(1), R6(3) };
+
+static inline uint16_t
+DecodePixel(const uint8_t *src)
+{
+    return ((uint16_t)bitReverse[src[0]] << 6) | (bitReverse[src[1]] >> 2);
+}
+
+static void
+ParseTelemetry(const uint8_t *line,
+               uint32_t width,
+               SensorFrameInfo *frameInfo)
+{
+    uint32_t fpaTemp;
+
+    frameInfo->valid = NVMEDIA_FALSE;
+    if (width < BOSON_TELEMETRY_MIN_WORDS)
+        return;
+
+    frameInfo->frameCounter =
+        ((uint32_t)DecodePixel(&line[BOSON_TELEMETRY_FRAME_COUNTER * BOSON_BYTES_PER_PIXEL]) << 16) |
+        DecodePixel(&line[(BOSON_TELEMETRY_FRAME_COUNTER + 1) * BOSON_BYTES_PER_PIXEL]);
+    fpaTemp = DecodePixel(&line[BOSON_TELEMETRY_FPA_TEMP * BOSON_BYTES_PER_PIXEL]);
+    frameInfo->temperature = fpaTemp / 10.0f - BOSON_KELVIN_OFFSET;
+    switch (DecodePixel(&line[BOSON_TELEMETRY_FFC_STATE * BOSON_BYTES_PER_PIXEL])) {
+        case BOSON_FFC_STATE_NONE:
+        case BOSON_FFC_STATE_COMPLETE:
+            frameInfo->ffcState = SENSOR_FFC_IDLE;
+            break;
+        case BOSON_FFC_STATE_IMMINENT:
+            frameInfo->ffcState = SENSOR_FFC_IMMINENT;
+            break;
+        case BOSON_FFC_STATE_IN_PROGRESS:
+            frameInfo->ffcState = SENSOR_FFC_IN_PROGRESS;
+            break;
+        default:
+            frameInfo->ffcState = SENSOR_FFC_UNKNOWN;
+            break;
+    }
+    frameInfo->valid = NVMEDIA_TRUE;
+}
+
+static NvMediaStatus
+ParseFrameInfo(const uint8_t *buff,
+               uint32_t width,
+               uint32_t pitch,
+               uint32_t embeddedTopSize,
+               SensorFrameInfo *frameInfo)
+{
+    ParseTelemetry(buff + (embeddedTopSize / pitch) * pitch, width, frameInfo);
+    return frameInfo->valid ? NVMEDIA_STATUS_OK : NVMEDIA_STATUS_NOT_SUPPORTED;
+}
+
+/* Display conversion of one channel. The buffers are kept from frame to
+ * frame and only grow when the resolution does. */
+typedef struct {
+    BosonProperties        *properties;
+    uint8_t                *srcBuff;
+    uint32_t                srcSize;
+    uint16_t               *samples;
+    uint8_t                *dstBuff;
+    uint32_t                numPixels;
+    uint32_t                histogram[BOSON_NUM_PIXEL_VALUES];
+    uint8_t                 lut[BOSON_NUM_PIXEL_VALUES];
+} BosonConversion;
+
+/* Reads the whole frame, embedded lines included, into buff, growing it
+ * when the frame does not fit */
+static NvMediaStatus
+GetImageBits(NvMediaImage *image,
+             uint32_t bytesPerPixel,
+             uint8_t **buff,
+             uint32_t *buffSize,
+             uint32_t *width,
+             uint32_t *height,
+             uint32_t *pitch)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    uint8_t *newBuff;
+    uint32_t size;
+    NvMediaStatus status;
+
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    *width = surfaceMap.width;
+    *height = surfaceMap.height;
+    *pitch = *width * bytesPerPixel;
+    size = *pitch * *height + image->embeddedDataTopSize + image->embeddedDataBottomSize;
+
+    if (size > *buffSize) {
+        if (!(newBuff = realloc(*buff, size))) {
+            NvMediaImageUnlock(image);
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        *buff = newBuff;
+        *buffSize = size;
+    }
+
+    status = NvMediaImageGetBits(image, NULL, (void **)buff, pitch);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+
+    return status;
+}
+
+static NvMediaStatus
+AddBosonCommand(I2cCommands *commands,
+                uint32_t address,
+                uint32_t functionId,
+                const uint8_t *payload,
+                uint32_t payloadSize)
+{
+    uint8_t frame[BOSON_CMD_MAX_FRAME_SIZE];
+    uint8_t dataReg = BOSON_BRIDGE_DATA_REG, ctrlReg = BOSON_BRIDGE_CTRL_REG;
+    uint8_t ctrl;
+    uint32_t size = 0, i;
+
+    if (BosonCmdEncode(0, functionId, payload, payloadSize, frame, &size) != NVMEDIA_STATUS_OK)
+        return NVMEDIA_STATUS_ERROR;
+
+    ctrl = BOSON_BRIDGE_CTRL_BEGIN;
+    if (!I2cSetupRegister(commands, WRITE_REG_1, address, &ctrlReg, &ctrl, 1))
+        return NVMEDIA_STATUS_ERROR;
+
+    for (i = 0; i < size; i++) {
+        if (!I2cSetupRegister(commands, WRITE_REG_1, address, &dataReg, &frame[i], 1))
+            return NVMEDIA_STATUS_ERROR;
+    }
+
+    ctrl = BOSON_BRIDGE_CTRL_SEND;
+    if (!I2cSetupRegister(commands, WRITE_REG_1, address, &ctrlReg, &ctrl, 1))
+        return NVMEDIA_STATUS_ERROR;
+
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Boson settings are camera commands rather than registers; they are added
+ * to the register script as writes to the serializer bridge */
+static NvMediaStatus
+CalibrateSensor(I2cCommands *commands, CalibrationParameters *calParam, SensorProperties *properties)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    BosonProperties *bosonProperties = (BosonProperties *)properties;
+    uint8_t payload[4];
+
+    /* Repeated bytes of a command must all reach the FIFO */
+    BosonCmdSetVolatile(calParam->i2cDevice, calParam->sensorAddress);
+
+    if (bosonProperties->palette.isUsed == NVMEDIA_TRUE) {
+        payload[0] = bosonProperties->palette.uIntValue >> 24;
+        payload[1] = bosonProperties->palette.uIntValue >> 16;
+        payload[2] = bosonProperties->palette.uIntValue >> 8;
+        payload[3] = bosonProperties->palette.uIntValue;
+        status = AddBosonCommand(commands, calParam->sensorAddress, BOSON_FN_COLORLUT_SET_ID,
+                                 payload, sizeof(payload));
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to set color LUT\n", __func__);
+            goto failed;
+        }
+        LOG_DBG("%s: Color LUT %u\n", __func__, bosonProperties->palette.uIntValue);
+    }
+
+    if (bosonProperties->ffc.isUsed == NVMEDIA_TRUE) {
+        status = AddBosonCommand(commands, calParam->sensorAddress, BOSON_FN_RUN_FFC, NULL, 0);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to run FFC\n", __func__);
+            goto failed;
+        }
+        LOG_DBG("%s: FFC requested\n", __func__);
+    }
+
+failed:
+    return status;
+}
+
+static NvMediaStatus
+ProcessCmdline(int argc, char *argv[], SensorProperties *properties)
+{
+    NvMediaBool bLastArg = NVMEDIA_FALSE;
+    NvMediaBool bDataAvailable = NVMEDIA_FALSE;
+    int i;
+    BosonProperties *bosonProperties = (BosonProperties *)properties;
+
+    for (i = 1; i < argc; i++) {
+        // Check if this is the last argument
+        bLastArg = ((argc - i) == 1);
+
+        // Check if there is data available to be parsed
+        bDataAvailable = (!bLastArg) && !(argv[i+1][0] == '-');
+
+        if (!strcasecmp(argv[i], "-ffc")) {
+            bosonProperties->ffc.isUsed = NVMEDIA_TRUE;
+        } else if (!strcasecmp(argv[i], "-palette")) {
+            if (bDataAvailable) {
+                char *arg = argv[++i];
+                bosonProperties->palette.isUsed = NVMEDIA_TRUE;
+                bosonProperties->palette.uIntValue = atoi(arg);
+            } else {
+                LOG_ERR("-palette must be followed by a color LUT index\n");
+                return NVMEDIA_STATUS_ERROR;
+            }
+        } else if (!strcasecmp(argv[i], "-agc_tail")) {
+            if (bDataAvailable) {
+                char *arg = argv[++i];
+                bosonProperties->agcTail.isUsed = NVMEDIA_TRUE;
+                bosonProperties->agcTail.floatValue = atof(arg);
+                if (bosonProperties->agcTail.floatValue < 0.0 ||
+                    bosonProperties->agcTail.floatValue >= 50.0) {
+                    LOG_ERR("-agc_tail must be at least 0 and less than 50 percent\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else {
+                LOG_ERR("-agc_tail must be followed by a percentage\n");
+                return NVMEDIA_STATUS_ERROR;
+            }
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+static NvMediaStatus
+AppendOutputFilename(char *filename, SensorProperties *properties)
+{
+    char buf[16] = {0};
+    BosonProperties *bosonProperties = (BosonProperties *)properties;
+
+    if (!filename)
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    if (bosonProperties->palette.isUsed) {
+        strcat(filename, "_palette_");
+        sprintf(buf, "%u", bosonProperties->palette.uIntValue);
+        strcat(filename, buf);
+    }
+
+    if (bosonProperties->ffc.isUsed)
+        strcat(filename, "_ffc");
+
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Linear AGC over the histogram of the displayed pixels. agcTail percent
+ * of the pixels at either end are clipped so hot or cold spots do not
+ * flatten the rest of the scene. */
+static void
+BuildAgcLut(const uint32_t *histogram,
+            uint32_t numPixels,
+            float agcTail,
+            uint8_t *lut)
+{
+    uint32_t clip = (uint32_t)(numPixels * agcTail / 100.0f);
+    uint32_t low = 0, high = BOSON_NUM_PIXEL_VALUES - 1, sum, i;
+
+    for (sum = 0; low < high; low++) {
+        sum += histogram[low];
+        if (sum > clip)
+            break;
+    }
+    for (sum = 0; high > low; high--) {
+        sum += histogram[high];
+        if (sum > clip)
+            break;
+    }
+
+    for (i = 0; i < BOSON_NUM_PIXEL_VALUES; i++) {
+        if (i <= low)
+            lut[i] = 0;
+        else if (i >= high)
+            lut[i] = 0xFF;
+        else
+            lut[i] = (255 * (i - low)) / (high - low);
+    }
+}
+
+static NvMediaStatus
+CreateConversion(SensorProperties *properties,
+                 SensorConversion **conversion)
+{
+    BosonConversion *bosonConversion;
+
+    if (!(bosonConversion = calloc(1, sizeof(BosonConversion)))) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    bosonConversion->properties = (BosonProperties *)properties;
+    *conversion = bosonConversion;
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+DestroyConversion(SensorConversion *conversion)
+{
+    BosonConversion *bosonConversion = (BosonConversion *)conversion;
+
+    if (!bosonConversion)
+        return;
+
+    free(bosonConversion->srcBuff);
+    free(bosonConversion->samples);
+    free(bosonConversion->dstBuff);
+    free(bosonConversion);
+}
+
+/* The raw 14 bit output gets the AGC of BuildAgcLut. The post-AGC outputs
+ * are already grayscale: 8 bit as is, 10, 12 and 16 bit as bits 4 to 11. */
+static NvMediaStatus
+ConvertRawToRgba(SensorConversion *conversion,
+                 NvMediaImage *srcImage,
+                 NvMediaImage *dstImage,
+                 SensorFrameInfo *frameInfo)
+{
+    BosonConversion *bosonConversion = (BosonConversion *)conversion;
+    BosonProperties *bosonProperties;
+    NvMediaImageSurfaceMap surfaceMap;
+    uint8_t *dst, *buff;
+    const uint8_t *line, *src;
+    uint16_t *samples, *sample;
+    uint32_t srcWidth = 0, srcHeight = 0, srcPitch = 0, firstLine, numLines;
+    uint32_t dstWidth = dstImage->width, dstHeight = dstImage->height, dstPitch;
+    uint32_t x, y, xStep, numPixels, bytesPerPixel;
+    NvMediaBool agc;
+    NvMediaStatus status;
+
+    NVM_SURF_FMT_DEFINE_ATTR(srcAttr);
+
+    if (!bosonConversion)
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+    bosonProperties = bosonConversion->properties;
+
+    status = NvMediaSurfaceFormatGetAttrs(srcImage->type,
+                                          srcAttr,
+                                          NVM_SURF_FMT_ATTR_MAX);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s:NvMediaSurfaceFormatGetAttrs failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    if (srcAttr[NVM_SURF_ATTR_SURF_TYPE].value != NVM_SURF_ATTR_SURF_TYPE_RAW)
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+
+    switch (srcAttr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value) {
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_14:
+            agc = NVMEDIA_TRUE;
+            bytesPerPixel = BOSON_BYTES_PER_PIXEL;
+            break;
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_10:
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_12:
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_16:
+            agc = NVMEDIA_FALSE;
+            bytesPerPixel = 2;
+            break;
+        case NVM_SURF_ATTR_BITS_PER_COMPONENT_8:
+            agc = NVMEDIA_FALSE;
+            bytesPerPixel = 1;
+            break;
+        default:
+            return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+    if (!agc && srcAttr[NVM_SURF_ATTR_DATA_TYPE].value != NVM_SURF_ATTR_DATA_TYPE_UINT)
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+
+    status = GetImageBits(srcImage,
+                          bytesPerPixel,
+                          &bosonConversion->srcBuff,
+                          &bosonConversion->srcSize,
+                          &srcWidth,
+                          &srcHeight,
+                          &srcPitch);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+
+    firstLine = srcImage->embeddedDataTopSize / srcPitch;
+    if (srcHeight <= BOSON_TELEMETRY_LINES || !dstWidth || !dstHeight) {
+        LOG_ERR("%s: Unsupported frame size %ux%u\n", __func__, srcWidth, srcHeight);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    numLines = srcHeight - BOSON_TELEMETRY_LINES;
+
+    /* The telemetry words are only decoded in the raw output */
+    if (frameInfo) {
+        if (agc)
+            ParseTelemetry(bosonConversion->srcBuff + firstLine * srcPitch, srcWidth, frameInfo);
+        else
+            frameInfo->valid = NVMEDIA_FALSE;
+    }
+
+    numPixels = dstWidth * dstHeight;
+    dstPitch = dstWidth * 4;
+    if (numPixels > bosonConversion->numPixels) {
+        if (!(samples = realloc(bosonConversion->samples, numPixels * sizeof(uint16_t)))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        bosonConversion->samples = samples;
+        if (!(buff = realloc(bosonConversion->dstBuff, numPixels * 4))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        bosonConversion->dstBuff = buff;
+        bosonConversion->numPixels = numPixels;
+    }
+    samples = bosonConversion->samples;
+    if (agc)
+        memset(bosonConversion->histogram, 0, sizeof(bosonConversion->histogram));
+
+    /* Only the pixels which are displayed are decoded and counted */
+    xStep = (srcWidth << 16) / dstWidth;
+    sample = samples;
+    for (y = 0; y < dstHeight; y++) {
+        line = bosonConversion->srcBuff +
+               (firstLine + BOSON_TELEMETRY_LINES + y * numLines / dstHeight) * srcPitch;
+        for (x = 0; x < dstWidth; x++) {
+            src = &line[((x * xStep) >> 16) * bytesPerPixel];
+            if (agc) {
+                *sample = DecodePixel(src);
+                bosonConversion->histogram[*sample]++;
+            } else if (bytesPerPixel == 1) {
+                *sample = src[0];
+            } else {
+                *sample = ((((uint16_t)src[1] << 8) | src[0]) >> 4) & 0xFF;
+            }
+            sample++;
+        }
+    }
+
+    if (agc)
+        BuildAgcLut(bosonConversion->histogram,
+                    numPixels,
+                    bosonProperties->agcTail.isUsed ? bosonProperties->agcTail.floatValue : 0.0f,
+                    bosonConversion->lut);
+
+    dst = bosonConversion->dstBuff;
+    for (x = 0; x < numPixels; x++) {
+        dst[0] = dst[1] = dst[2] = agc ? bosonConversion->lut[samples[x]] : (uint8_t)samples[x];
+        dst[3] = 0xFF;
+        dst += 4;
+    }
+
+    if (NvMediaImageLock(dstImage, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) !=
+       NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    status = NvMediaImagePutBits(dstImage, NULL, (void **)&bosonConversion->dstBuff, &dstPitch);
+    NvMediaImageUnlock(dstImage);
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: NvMediaImagePutBits() failed\n", __func__);
+
+    return status;
+}
+
+/* Only the raw 14 bit output is sent bit reversed */
+static NvMediaBool
+IsRawBitReversed(NvMediaSurfaceType surfType)
+{
+    NVM_SURF_FMT_DEFINE_ATTR(attr);
+
+    if (NvMediaSurfaceFormatGetAttrs(surfType, attr, NVM_SURF_FMT_ATTR_MAX) != NVMEDIA_STATUS_OK)
+        return NVMEDIA_FALSE;
+
+    return (attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW &&
+            attr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_14) ?
+           NVMEDIA_TRUE : NVMEDIA_FALSE;
+}
+
+static NvMediaStatus
+WriteNvRawImage(
+    I2cCommands *settings,
+    CalibrationParameters *calParam,
+    SensorState *state,
+    NvRawWriter *writer,
+    NvMediaImage *image,
+    int32_t frameNumber,
+    char *outputFileName)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    SensorFrameInfo frameInfo;
+    uint8_t *buff = NULL;
+    uint16_t *pixels = NULL;
+    uint32_t width = 0, height = 0, pitch = 0, firstLine, numPixels, i;
+    float_t sensorGains[4] = {1.0, 1.0, 1.0, 1.0};
+
+    (void)settings;
+    (void)calParam;
+    (void)state;
+
+    if (image == NULL) {
+        LOG_DBG("%s: Error: Input image is null\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    width = image->width;
+    height = image->height;
+    pitch = width * BOSON_BYTES_PER_PIXEL;
+    if (height <= BOSON_TELEMETRY_LINES) {
+        LOG_ERR("WriteNvRawImage: Unsupported frame height %u\n", height);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    numPixels = width * height;
+    status = NvRawWriterBegin(writer, outputFileName, width, height,
+                              numPixels * sizeof(uint16_t));
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+
+    status = NvRawWriterGetBits(writer, image, pitch);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+    buff = writer->buff;
+
+    firstLine = image->embeddedDataTopSize / pitch;
+    ParseTelemetry(buff + firstLine * pitch, width, &frameInfo);
+    if (frameInfo.valid)
+        LOG_DBG("WriteNvRawImage: frame %d camera frame %u FPA %.1f C\n",
+                frameNumber, frameInfo.frameCounter, frameInfo.temperature);
+
+    // The telemetry line is kept as an embedded line and, like the pixels,
+    // stored LSB aligned in little endian order for the nvraw viewer.
+    // Decoded in place: a pixel never lands past the bytes it comes from.
+    pixels = (uint16_t *)buff;
+    for (i = 0; i < numPixels; i++)
+        pixels[i] = DecodePixel(&buff[firstLine * pitch + i * BOSON_BYTES_PER_PIXEL]);
+
+    // Boson is monochrome; the Bayer phase is only there to satisfy the format
+    if (!writer->numImages) {
+        if (NvRawFileHeaderChunkSetBitsPerSample(writer->header, BOSON_BITS_PER_PIXEL) != NvRawFileError_Success ||
+            NvRawFileHeaderChunkSetSamplesPerPixel(writer->header, 1) != NvRawFileError_Success ||
+            NvRawFileHeaderChunkSetProcessingFlags(writer->header, 0) != NvRawFileError_Success ||
+            NvRawFileHeaderChunkSetDataFormat(writer->header, NVRAWDUMP_BAYER_ORDERING_RGGB) != NvRawFileError_Success ||
+            NvRawFileHeaderChunkSetImageWidth(writer->header, width) != NvRawFileError_Success ||
+            NvRawFileHeaderChunkSetImageHeight(writer->header, height - BOSON_TELEMETRY_LINES) != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: Failed to fill header chunk\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (NvRawFileSensorInfoChunkSetFuse(writer->sensorInfo, "") != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkSetFuse failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if (NvRawFileCaptureChunkSetExposureTime(writer->capture, 0.0) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetISO(writer->capture, 100.0) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetFocusPosition(writer->capture, 0.0) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetFlashPower(writer->capture, 0.0) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetSensorGain(writer->capture, sensorGains) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetIspDigitalGain(writer->capture, 1.0) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetPixelEndianness(writer->capture, true) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetEmbeddedLineCountTop(writer->capture, BOSON_TELEMETRY_LINES) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetEmbeddedLineCountBottom(writer->capture, 0) != NvRawFileError_Success ||
+            NvRawFileCaptureChunkSetLux(writer->capture, 0.0) != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: Failed to fill capture chunk\n");
+            return NVMEDIA_STATUS_ERROR;
+        }
+    }
+
+    return NvRawWriterWrite(writer, NVMEDIA_FALSE);
+}
+
+static void
+PrintSensorCaliUsage(void)
+{
+    LOG_MSG("===========================================================\n");
+    LOG_MSG("===            Boson calibration commands               ===\n");
+    LOG_MSG("-ffc              Run a flat field correction before capturing\n");
+    LOG_MSG("-palette [n]      Color LUT (int) of the camera's post-AGC video\n");
+    LOG_MSG("-agc_tail [p]     Percentage (float) of pixels clipped at each end by the display AGC\n");
+    LOG_MSG("                  Valid values are from 0 (plain min/max stretch) to below 50\n");
+}
+
+static SensorInfo bosonInfo = {
+    .name = "boson",
+    .supportedArgs = bosonSupportedArgs,
+    .numSupportedArgs = sizeof(bosonSupportedArgs)/sizeof(bosonSupportedArgs[0]),
+    .sizeOfSensorProperties = sizeof(BosonProperties),
+    .CalibrateSensor = CalibrateSensor,
+    .ProcessCmdline = ProcessCmdline,
+    .AppendOutputFilename = AppendOutputFilename,
+    .WriteNvRawImage = WriteNvRawImage,
+    .PrintSensorCaliUsage = PrintSensorCaliUsage,
+    .CreateConversion = CreateConversion,
+    .DestroyConversion = DestroyConversion,
+    .ConvertRawToRgba = ConvertRawToRgba,
+    .IsRawBitReversed = IsRawBitReversed,
+    .ParseFrameInfo = ParseFrameInfo,
+};
+
+SensorInfo*
+GetSensorInfo_boson(void) {
+    return &bosonInfo;
+}
@@ -0,0 +1,37 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef _SENSOR_INFO_BOSON_H_
+#define _SENSOR_INFO_BOSON_H_
+
+#include "sensor_info.h"
+
+#define BOSON_BITS_PER_PIXEL              14
+#define BOSON_NUM_PIXEL_VALUES            (1 << BOSON_BITS_PER_PIXEL)
+#define BOSON_BYTES_PER_PIXEL             2
+
+// The first line of every frame carries telemetry instead of pixels
+#define BOSON_TELEMETRY_LINES             1
+
+// Word offsets into the decoded telemetry line
+#define BOSON_TELEMETRY_FRAME_COUNTER     42     // 2 words, most significant first
+#define BOSON_TELEMETRY_FPA_TEMP          47     // Kelvin x 10
+#define BOSON_TELEMETRY_FFC_STATE         52     // BOSON_FFC_STATE_*, any FFC, automatic or not
+#define BOSON_TELEMETRY_MIN_WORDS         53
+
+#define BOSON_FFC_STATE_NONE              0      // none since power up
+#define BOSON_FFC_STATE_IMMINENT          1
+#define BOSON_FFC_STATE_IN_PROGRESS       2
+#define BOSON_FFC_STATE_COMPLETE          3
+
+#define BOSON_KELVIN_OFFSET               273.15f
+
+SensorInfo *GetSensorInfo_boson(void);
+
+#endif /* _SENSOR_INFO_BOSON_H_ */
@@ -9,6 +9,7 @@
 
 #include "cmdline.h"
 #include "sensorInfo_ov10640.h"
+#include "pixel_kernels.h"
 
 typedef struct {
     CmdlineParameter             etl;
@@ -908,26 +909,45 @@ ProcessCmdline(int argc, char *argv[], SensorProperties *properties)
     return NVMEDIA_STATUS_OK;
 }
 
+static NvMediaStatus
+ReadSensorState(I2cCommands *settings,
+                CalibrationParameters *calParam,
+                SensorState *state)
+{
+    NvMediaStatus status;
+
+    state->rawFormat = ReadRawCompressionFormat(calParam);
+    if (state->rawFormat == 4)
+        state->rawMode = ReadRawCompressionMode(calParam);
+
+    status = ReadSensorExposureInfo(settings, calParam, state->sensorData);
+    if (status != NVMEDIA_STATUS_OK){
+        LOG_ERR("%s: ReadSensorExposureInfo failed\n", __func__);
+        return status;
+    }
+
+    status = ReadSensorWbGainsInfo(settings, calParam, state->sensorData);
+    if (status != NVMEDIA_STATUS_OK){
+        LOG_ERR("%s: ReadSensorWbGainsInfo failed\n", __func__);
+        return status;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
 static NvMediaStatus
 WriteNvRawImage(I2cCommands *settings,
                 CalibrationParameters *calParam,
+                SensorState *state,
+                NvRawWriter *writer,
                 NvMediaImage *image, int32_t frameNumber, char *outputFileName)
 {
-    FILE *file = NULL;
-    NvRawFileHeaderChunkHandle *pNvrfHeader = NULL;
-    NvRawFileCaptureChunkHandle *pNvrfCapture = NULL;
-    NvRawFileCameraStateChunkHandle *pNvrfCameraState = NULL;
-    NvRawFileSensorInfoChunkHandle *pNvrfSensorInfo = NULL;
-    NvRawFileDataChunkHandle *pNvrfData = NULL;
-    NvRawFileHDRChunkHandle *pNvrfHDR = NULL;
     NvMediaStatus status = NVMEDIA_STATUS_OK;
-    NvRawFileErrorStatus nvrawStatus = NvRawFileError_Success;
     uint32_t numExposures = OV10640_MAX_EXPOSURES;
     uint32_t imageWidth = 0, imageHeight = 0;
-    NvMediaImageSurfaceMap surfaceMap;
     NvRawSensorHDRInfo_v2 *sensorData = NULL;
-    unsigned char *buff = NULL, *dstBuff[3] = {NULL};
-    unsigned int dstPitches[3] = {1};
+    SensorState current;
+    unsigned char *buff = NULL;
     uint32_t pitch = 0;
     uint32_t rawBytesPerPixel = 0, imageSize = 0;
     uint32_t compressionFormat = 0, nvrawCompressionFormat = 0, linearMode = 0;
@@ -945,41 +965,19 @@ WriteNvRawImage(I2cCommands *settings,
         imageHeight = image->height;
     }
 
-    pNvrfHeader = NvRawFileHeaderChunkCreate();
-    if (pNvrfHeader == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
-
-    pNvrfCapture = NvRawFileCaptureChunkCreate();
-    if (pNvrfCapture == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
-
-    pNvrfCameraState = NvRawFileCameraStateChunkCreate();
-    if (pNvrfCameraState == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileCameraStateChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
-
-
-    pNvrfSensorInfo = NvRawFileSensorInfoChunkCreate();
-    if (pNvrfSensorInfo == NULL)
-    {
-        LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkCreate failed\n");
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
+    /* The sensor is only read here if its state is not known */
+    if (state && state->valid) {
+        current = *state;
+    } else {
+        memset(&current, 0, sizeof(current));
+        status = ReadSensorState(settings, calParam, &current);
+        if (status != NVMEDIA_STATUS_OK){
+            LOG_ERR("WriteNvRawImage: ReadSensorState failed\n");
+            return status;
+        }
     }
 
-    compressionFormat = ReadRawCompressionFormat(calParam);
-
+    compressionFormat = current.rawFormat;
 
     switch (compressionFormat) {
         case 5:
@@ -988,7 +986,6 @@ WriteNvRawImage(I2cCommands *settings,
             numExposures = 1;
             rawBytesPerPixel = 2;
             inputFormatWidthMultiplier = 1;
-            nvrawStatus = NvRawFileHeaderChunkSetBitsPerSample(pNvrfHeader,12);
             break;
         case 6:
             nvrawCompressionFormat = NvRawCompressionFormat_12BitLinear;
@@ -996,7 +993,6 @@ WriteNvRawImage(I2cCommands *settings,
             numExposures = 1;
             rawBytesPerPixel = 2;
             inputFormatWidthMultiplier = 1;
-            nvrawStatus = NvRawFileHeaderChunkSetBitsPerSample(pNvrfHeader,12);
             break;
         case 7:
             nvrawCompressionFormat = NvRawCompressionFormat_12BitLinear;
@@ -1004,316 +1000,169 @@ WriteNvRawImage(I2cCommands *settings,
             numExposures = 1;
             rawBytesPerPixel = 2;
             inputFormatWidthMultiplier = 1;
-            nvrawStatus = NvRawFileHeaderChunkSetBitsPerSample(pNvrfHeader,12);
             break;
         case 4:
-            if (ReadRawCompressionMode(calParam))
+            if (current.rawMode)
                 nvrawCompressionFormat = NvRawCompressionFormat_12BitCombinedCompressedExtended;
             else
                 nvrawCompressionFormat = NvRawCompressionFormat_12BitCombinedCompressed;
             numExposures = 3;
             rawBytesPerPixel = 2;
             inputFormatWidthMultiplier = 1;
-            nvrawStatus = NvRawFileHeaderChunkSetBitsPerSample(pNvrfHeader,12);
             break;
         default:
            LOG_ERR("WriteNvRawImage: Unsupported nvraw compression format\n");
-           nvrawStatus = NvRawFileError_BadParameter;
-           break;
+           return NVMEDIA_STATUS_ERROR;
     }
 
-    if (nvrawStatus != NvRawFileError_Success){
-        status = NVMEDIA_STATUS_ERROR;
-        goto done;
-    }
+    //Image EmbeddedData is only known for captured frames
+    if (frameNumber < 0)
+        memset(current.sensorData, 0, sizeof(current.sensorData));
+    sensorData = current.sensorData;
 
-    sensorData = (NvRawSensorHDRInfo_v2*)calloc(OV10640_MAX_EXPOSURES, sizeof(NvRawSensorHDRInfo_v2));
-    //Get Image EmbeddedData
-    if (frameNumber >= 0){
-        status = ReadSensorExposureInfo(settings, calParam, sensorData);
-        if (status != NVMEDIA_STATUS_OK){
-            LOG_ERR("WriteNvRawImage: ReadSensorExposureInfo failed\n");
-            goto done;
-        }
+    pitch = imageWidth * rawBytesPerPixel;
+    imageSize = pitch * imageHeight;
+    imageSize += image->embeddedDataTopSize;
+    imageSize += image->embeddedDataBottomSize;
 
-        status = ReadSensorWbGainsInfo(settings, calParam, sensorData);
-        if (status != NVMEDIA_STATUS_OK){
-            LOG_ERR("WriteNvRawImage: ReadSensorWbGainsInfo failed\n");
-            goto done;
-        }
-    }
+    status = NvRawWriterBegin(writer, outputFileName, imageWidth, imageHeight, imageSize);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
 
-    if (nvrawStatus != NvRawFileError_Success){
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetBitsPerSample failed \n");
-        goto done;
-    }
+    /* The header and sensor info only change with the file */
+    if (!writer->numImages) {
+        if (NvRawFileHeaderChunkSetBitsPerSample(writer->header, 12) != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetBitsPerSample failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetSamplesPerPixel(pNvrfHeader,inputFormatWidthMultiplier) != NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetSamplesPerPixel failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetSamplesPerPixel(writer->header, inputFormatWidthMultiplier) != NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetSamplesPerPixel failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetNumImages(pNvrfHeader,1)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetNumImages failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetProcessingFlags(writer->header, 0)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetProcessingFlags failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetProcessingFlags(pNvrfHeader,0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetProcessingFlags failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetDataFormat(writer->header, BayerPhase[1][1])!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetDataFormat failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetDataFormat(pNvrfHeader, BayerPhase[1][1])!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetDataFormat failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetImageWidth(writer->header, imageWidth)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageWidth failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetImageWidth(pNvrfHeader, imageWidth)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageWidth failed \n");
-        goto done;
-    }
+        if (NvRawFileHeaderChunkSetImageHeight(writer->header, imageHeight)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageHeight failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
 
-    if (NvRawFileHeaderChunkSetImageHeight(pNvrfHeader, imageHeight)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkSetImageHeight failed \n");
-        goto done;
+        //set Fuse-ID
+        fuseBuffer[0] = '\0';
+        if (NvRawFileSensorInfoChunkSetFuse(writer->sensorInfo, (const char *)fuseBuffer)!= NvRawFileError_Success) {
+            LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkSetFuse failed \n");
+            return NVMEDIA_STATUS_ERROR;
+        }
     }
 
-    if (NvRawFileCaptureChunkSetExposureTime(pNvrfCapture,sensorData[linearMode].exposure.exposureTime)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetExposureTime(writer->capture, sensorData[linearMode].exposure.exposureTime)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetExposureTime failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetISO(pNvrfCapture,sensorData[linearMode].exposure.analogGain * 100)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetISO(writer->capture, sensorData[linearMode].exposure.analogGain * 100)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetISO failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetFocusPosition(pNvrfCapture,0.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetFocusPosition(writer->capture, 0.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetFocusPosition failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetFlashPower(pNvrfCapture, 0.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetFlashPower(writer->capture, 0.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetFlashPower failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
     for (i = 0; i< 4; i++) {
         sensorGains[i] = sensorData[linearMode].exposure.digitalGain;
     }
 
-    if (NvRawFileCaptureChunkSetSensorGain(pNvrfCapture, sensorGains)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetSensorGain(writer->capture, sensorGains)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetSensorGain failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetIspDigitalGain(pNvrfCapture, 1.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetIspDigitalGain(writer->capture, 1.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetIspDigitalGain failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetOutputDataFormat(pNvrfCapture, nvrawCompressionFormat)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetOutputDataFormat(writer->capture, nvrawCompressionFormat)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetOutputDataFormat failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetPixelEndianness(pNvrfCapture, true)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetPixelEndianness(writer->capture, true)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetPixelEndianness failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetEmbeddedLineCountTop(pNvrfCapture,image->embeddedDataTopSize)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetEmbeddedLineCountTop(writer->capture, image->embeddedDataTopSize)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetEmbeddedLineCountTop failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetEmbeddedLineCountBottom(pNvrfCapture,image->embeddedDataBottomSize)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetEmbeddedLineCountBottom(writer->capture, image->embeddedDataBottomSize)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetEmbeddedLineCountBottom failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
-    if (NvRawFileCaptureChunkSetLux(pNvrfCapture, 0.0)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
+    if (NvRawFileCaptureChunkSetLux(writer->capture, 0.0)!= NvRawFileError_Success) {
         LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetLux failed \n");
-        goto done;
+        return NVMEDIA_STATUS_ERROR;
     }
 
     if (nvrawCompressionFormat == NvRawCompressionFormat_12BitCombinedCompressed ||
        nvrawCompressionFormat == NvRawCompressionFormat_12BitCombinedCompressedExtended){
-        if (NvRawFileCaptureChunkSetLut(pNvrfCapture, (uint8_t*)OV10640_DecompressionLutCurve, sizeof(OV10640_DecompressionLutCurve))!= NvRawFileError_Success) {
-            status = NVMEDIA_STATUS_ERROR;
+        if (NvRawFileCaptureChunkSetLut(writer->capture, (uint8_t*)OV10640_DecompressionLutCurve, sizeof(OV10640_DecompressionLutCurve))!= NvRawFileError_Success) {
             LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkSetLut failed \n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
     }
 
-    //set Fuse-ID
-    fuseBuffer[0] = '\0';
-    if (NvRawFileSensorInfoChunkSetFuse(pNvrfSensorInfo, (const char *)fuseBuffer)!= NvRawFileError_Success) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkSetFuse failed \n");
-        goto done;
-    }
-
     if (numExposures > 1) {
-        pNvrfHDR = NvRawFileHDRChunkCreate();
-        if (NvRawFileHDRChunkSetNumberOfExposures(pNvrfHDR, numExposures)!= NvRawFileError_Success){
-            status = NVMEDIA_STATUS_ERROR;
+        if (NvRawFileHDRChunkSetNumberOfExposures(writer->hdr, numExposures)!= NvRawFileError_Success){
             LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkSetNumberOfExposures failed \n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
 
-        if (NvRawFileHDRChunkSetReadoutScheme(pNvrfHDR, "A\nA\nA\nA")!= NvRawFileError_Success){
+        if (NvRawFileHDRChunkSetReadoutScheme(writer->hdr, "A\nA\nA\nA")!= NvRawFileError_Success){
             LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkSetReadoutScheme failed \n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
 
-        if (NvRawFileHDRChunkSetExposureInfo_v2(pNvrfHDR, sensorData)!= NvRawFileError_Success){
+        if (NvRawFileHDRChunkSetExposureInfo_v2(writer->hdr, sensorData)!= NvRawFileError_Success){
             LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkSetExposureInfo failed \n");
-            goto done;
-        }
-    }
-
-    pitch = imageWidth * rawBytesPerPixel;
-    imageSize = pitch * imageHeight;
-    imageSize += image->embeddedDataTopSize;
-    imageSize += image->embeddedDataBottomSize;
-
-    pNvrfData = NvRawFileDataChunkCreate(imageSize, false);
-    if (pNvrfData == NULL) {
-        LOG_ERR("WriteNvRawImage: NvRawFileDataChunkCreate failed\n");
-        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
-        goto done;
-    }
-
-    // Write to an output file
-    file = fopen(outputFileName, "wb");
-    if (file == NULL) {
-        status = NVMEDIA_STATUS_ERROR;
-        LOG_ERR("WriteNvRawImage: Failed to open file\n");
-        goto done;
-    }
-
-    NVM_SURF_FMT_DEFINE_ATTR(attr);
-
-    status = NvMediaSurfaceFormatGetAttrs(image->type,
-                                          attr,
-                                          7);
-    if (status != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s:NvMediaSurfaceFormatGetAttrs failed\n", __func__);
-        goto done;
-    }
-
-    if(attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW){
-        // write full chunks and the partial data chunk.
-        if ( NvRawFileHeaderChunkFileWrite(pNvrfHeader, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileHeaderChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (NvRawFileCaptureChunkFileWrite(pNvrfCapture, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileCaptureChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (NvRawFileCameraStateChunkFileWrite(pNvrfCameraState, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileCameraStateChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (NvRawFileSensorInfoChunkFileWrite(pNvrfSensorInfo, file)!= NvRawFileError_Success){
-            LOG_ERR("WriteNvRawImage: NvRawFileSensorInfoChunkFileWrite failed\n");
-            status = NVMEDIA_STATUS_ERROR;
-            goto done;
-        }
-
-        if (pNvrfHDR != NULL) {
-            if (NvRawFileHDRChunkFileWrite(pNvrfHDR, file)!= NvRawFileError_Success) {
-                LOG_ERR("WriteNvRawImage: NvRawFileHDRChunkFileWrite failed\n");
-                status = NVMEDIA_STATUS_ERROR;
-                goto done;
-            }
-        }
-
-        if (NvRawFileDataChunkFileWrite(pNvrfData, file, false)!= NvRawFileError_Success){
-            status = NVMEDIA_STATUS_ERROR;
-            LOG_ERR("WriteNvRawImage: NvRawFileDataChunkFileWrite failed\n");
-            goto done;
+            return NVMEDIA_STATUS_ERROR;
         }
-
     }
 
-    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK){
-        LOG_ERR("WriteNvRawImage: NvMediaImageLock failed\n");
-        return NVMEDIA_STATUS_ERROR;
-    }
-
-    if (!(buff = malloc(imageSize))) {
-        LOG_ERR("WriteNvRawImage: Out of memory\n");
-        fclose(file);
-        return NVMEDIA_STATUS_OUT_OF_MEMORY;
-    }
-
-    dstBuff[0] = buff;
-    dstPitches[0] = pitch;
-    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
-    NvMediaImageUnlock(image);
-    if (status != NVMEDIA_STATUS_OK) {
-        LOG_ERR("WriteNvRawImage: NvMediaVideoSurfaceGetBits() failed\n");
-        goto done;
-    }
+    status = NvRawWriterGetBits(writer, image, pitch);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
+    buff = writer->buff;
 
     // re-align 12bit (S1.14 format) pixel data
     // to LSB (right shift by 2) for display/nvraw-viewer
-    for (i = 0; i < (imageSize/2); i++) {
-        // LSB
-        buff[2*i] = buff[2*i] >> 2;
-        buff[2*i] |= (buff[(2*i)+1] & 0x03) << 6;
-        //MSB
-        buff[(2*i)+1] = (buff[(2*i)+1] >> 2) & 0x0F;
-    }
+    PixelShiftRight16((uint16_t *)buff, imageSize / 2, 2, 0x0FFF);
 
-    if (fwrite(dstBuff[0], imageSize, 1, file) != 1) {
-        LOG_ERR("WriteNvRawImage: file write failed\n");
-        goto done;
-    }
-
-done:
-    NvRawFileHeaderChunkDelete(pNvrfHeader);
-    NvRawFileCaptureChunkDelete(pNvrfCapture);
-    NvRawFileCameraStateChunkDelete(pNvrfCameraState);
-    NvRawFileSensorInfoChunkDelete(pNvrfSensorInfo);
-    NvRawFileHDRChunkDelete(pNvrfHDR);
-    NvRawFileDataChunkDelete(pNvrfData);
-
-    if (file != NULL){
-        fclose(file);
-    }
-
-    if (sensorData)
-        free(sensorData);
-
-    return status;
+    return NvRawWriterWrite(writer, numExposures > 1 ? NVMEDIA_TRUE : NVMEDIA_FALSE);
 }
 
 static NvMediaStatus
@@ -1420,6 +1269,7 @@ static SensorInfo ov10640Info = {
     .AppendOutputFilename = AppendOutputFilename,
     .WriteNvRawImage = WriteNvRawImage,
     .PrintSensorCaliUsage = PrintSensorCaliUsage,
+    .ReadSensorState = ReadSensorState,
 };
 
 SensorInfo*
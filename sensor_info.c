@@ -12,6 +12,7 @@
 #include "sensor_info.h"
 #include "sensorInfo_ov10640.h"
 #include "sensorInfo_ar0231.h"
+#include "sensorInfo_boson.h"
 
 SensorInfo *
 GetSensorInfo(char *sensorName)
@@ -19,7 +20,8 @@ GetSensorInfo(char *sensorName)
     uint32_t i;
     SensorInfo *sensorInfo[] = {
         GetSensorInfo_ov10640(),
-        GetSensorInfo_ar0231()
+        GetSensorInfo_ar0231(),
+        GetSensorInfo_boson()
     };
 
     if (!sensorName) {
@@ -16,6 +16,7 @@
 #include "nvmedia_image.h"
 #include "i2cCommands.h"
 #include "nvrawfile_interface.h"
+#include "nvraw_writer.h"
 
 #define BAYER_ORDERING(a,b,c,d) ((a) << 24 | (b) << 16 | (c) << 8 | (d))
 #define NVRAWDUMP_BAYER_ORDERING_RGGB BAYER_ORDERING('R', 'G', 'G', 'B')
@@ -30,12 +31,46 @@ typedef struct {
 
 typedef void SensorProperties;
 
+/* Display conversion state of one channel, owned by the sensor plugin */
+typedef void SensorConversion;
+
 typedef struct {
     int32_t i2cDevice;
     uint32_t sensorAddress;
     uint32_t crystalFrequency;
 } CalibrationParameters;
 
+/* Flat field correction state, of sensors that run them */
+typedef enum {
+    SENSOR_FFC_UNKNOWN = 0,
+    SENSOR_FFC_IDLE,
+    SENSOR_FFC_IMMINENT,
+    SENSOR_FFC_IN_PROGRESS,
+} SensorFfcState;
+
+/* Information a sensor reports inside each frame */
+typedef struct {
+    NvMediaBool valid;
+    uint32_t frameCounter;
+    float temperature;      // degrees Celsius
+    SensorFfcState ffcState;
+} SensorFrameInfo;
+
+#define SENSOR_STATE_MAX_EXPOSURES 4
+#define SENSOR_STATE_LUT_SIZE 256
+
+/* Sensor state the nvraw writer needs. Read when the settings change
+ * instead of for every frame. */
+typedef struct {
+    NvMediaBool valid;
+    uint32_t rawFormat;     // sensor specific output format
+    uint32_t rawMode;       // sensor specific compression mode
+    NvRawSensorHDRInfo_v2 sensorData[SENSOR_STATE_MAX_EXPOSURES];
+    float_t lut[SENSOR_STATE_LUT_SIZE];
+    uint32_t embeddedLinesTop;
+    uint32_t embeddedLinesBottom;
+} SensorState;
+
 typedef struct {
     char *name;
     char **supportedArgs;
@@ -44,9 +79,33 @@ typedef struct {
     NvMediaStatus (*CalibrateSensor)(I2cCommands *settings, CalibrationParameters *calParam, SensorProperties *properties);
     NvMediaStatus (*ProcessCmdline)(int argc, char *argv[], SensorProperties *properties);
     NvMediaStatus (*AppendOutputFilename)(char *filename, SensorProperties *properties);
+    /* state is what the sensor was set to for the frame, if known. Without
+     * it the sensor is read, which is too slow to keep up with capture.
+     * The image goes to the file of writer, which is opened as fileName
+     * when a new one is needed. */
     NvMediaStatus (*WriteNvRawImage)(I2cCommands *settings, CalibrationParameters *calParam,
-                                     NvMediaImage *image, int32_t frameNumber, char *fileName);
+                                     SensorState *state, NvRawWriter *writer,
+                                     NvMediaImage *image, int32_t frameNumber,
+                                     char *fileName);
     void (*PrintSensorCaliUsage)(void);
+    /* Optional. Creates the state ConvertRawToRgba keeps from frame to frame,
+     * one per displayed channel */
+    NvMediaStatus (*CreateConversion)(SensorProperties *properties, SensorConversion **conversion);
+    void (*DestroyConversion)(SensorConversion *conversion);
+    /* Optional. Converts a captured raw frame for display and fills frameInfo
+     * if the sensor embeds it; NOT_SUPPORTED falls back to the generic conversion */
+    NvMediaStatus (*ConvertRawToRgba)(SensorConversion *conversion, NvMediaImage *srcImage,
+                                      NvMediaImage *dstImage, SensorFrameInfo *frameInfo);
+    /* Optional. Reads the state the nvraw writer needs from the sensor */
+    NvMediaStatus (*ReadSensorState)(I2cCommands *settings, CalibrationParameters *calParam,
+                                     SensorState *state);
+    /* Optional. Whether raw captures of surfType arrive with the bits of
+     * each byte of a sample reversed */
+    NvMediaBool (*IsRawBitReversed)(NvMediaSurfaceType surfType);
+    /* Optional. Reads what the sensor reports inside a frame read as captured,
+     * embedded lines included */
+    NvMediaStatus (*ParseFrameInfo)(const uint8_t *buff, uint32_t width, uint32_t pitch,
+                                    uint32_t embeddedTopSize, SensorFrameInfo *frameInfo);
 } SensorInfo;
 
 SensorInfo *GetSensorInfo(char *sensorName);
@@ -0,0 +1,127 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <string.h>
+
+#include "sensor_state.h"
+#include "log_utils.h"
+
+NvMediaStatus
+SensorStateInit(NvSensorStateStore *store,
+                SensorInfo *sensorInfo,
+                CalibrationParameters *calParam)
+{
+    memset(store, 0, sizeof(NvSensorStateStore));
+
+    if (!sensorInfo || !sensorInfo->ReadSensorState)
+        return NVMEDIA_STATUS_OK;
+
+    if (pthread_mutex_init(&store->mutex, NULL)) {
+        LOG_ERR("%s: Failed to create mutex\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (pthread_mutex_init(&store->readMutex, NULL)) {
+        LOG_ERR("%s: Failed to create mutex\n", __func__);
+        pthread_mutex_destroy(&store->mutex);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    store->sensorInfo = sensorInfo;
+    store->calParam = calParam;
+    store->valid = NVMEDIA_TRUE;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+SensorStateDestroy(NvSensorStateStore *store)
+{
+    if (!store->valid)
+        return;
+
+    I2cFreeCommands(&store->readCommands);
+    pthread_mutex_destroy(&store->readMutex);
+    pthread_mutex_destroy(&store->mutex);
+    store->valid = NVMEDIA_FALSE;
+}
+
+NvMediaStatus
+SensorStateRefresh(NvSensorStateStore *store,
+                   uint32_t firstFrame,
+                   SensorState *state)
+{
+    SensorState current;
+    NvMediaStatus status;
+
+    if (!store->valid)
+        return NVMEDIA_STATUS_OK;
+
+    /* Frames keep the previous state while the sensor is read */
+    pthread_mutex_lock(&store->readMutex);
+    memset(&current, 0, sizeof(current));
+    status = store->sensorInfo->ReadSensorState(&store->readCommands,
+                                                store->calParam,
+                                                &current);
+    pthread_mutex_unlock(&store->readMutex);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to read sensor state\n", __func__);
+        return status;
+    }
+
+    current.valid = NVMEDIA_TRUE;
+    SensorStatePublish(store, firstFrame, &current);
+    if (state)
+        *state = current;
+
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+SensorStatePublish(NvSensorStateStore *store,
+                   uint32_t firstFrame,
+                   SensorState *state)
+{
+    SensorStateEntry *entry;
+
+    if (!store->valid || !state->valid)
+        return;
+
+    pthread_mutex_lock(&store->mutex);
+    entry = &store->entries[store->numEntries % SENSOR_STATE_HISTORY];
+    entry->firstFrame = firstFrame;
+    entry->state = *state;
+    store->numEntries++;
+    pthread_mutex_unlock(&store->mutex);
+}
+
+NvMediaBool
+SensorStateGet(NvSensorStateStore *store,
+               uint32_t frame,
+               SensorState *state)
+{
+    SensorStateEntry *entry = NULL;
+    uint32_t i, numKept;
+
+    if (!store->valid)
+        return NVMEDIA_FALSE;
+
+    /* Frames older than the history get its oldest state */
+    pthread_mutex_lock(&store->mutex);
+    numKept = (store->numEntries < SENSOR_STATE_HISTORY) ?
+              store->numEntries : SENSOR_STATE_HISTORY;
+    for (i = 1; i <= numKept; i++) {
+        entry = &store->entries[(store->numEntries - i) % SENSOR_STATE_HISTORY];
+        if (entry->firstFrame <= frame)
+            break;
+    }
+    if (entry)
+        *state = entry->state;
+    pthread_mutex_unlock(&store->mutex);
+
+    return entry ? NVMEDIA_TRUE : NVMEDIA_FALSE;
+}
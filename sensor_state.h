@@ -0,0 +1,77 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __SENSOR_STATE_H__
+#define __SENSOR_STATE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+
+#include "sensor_info.h"
+
+#define SENSOR_STATE_HISTORY    8       /* states kept for frames still in flight */
+
+typedef struct {
+    uint32_t                    firstFrame;     // first frame captured with the state
+    SensorState                 state;
+} SensorStateEntry;
+
+/* Snapshots of the sensor state, taken by the stages which change the
+ * sensor settings and looked up by frame number by the stages which
+ * record the frames */
+typedef struct {
+    pthread_mutex_t             mutex;          // protects the entries
+    pthread_mutex_t             readMutex;      // serializes sensor reads
+    SensorInfo                 *sensorInfo;
+    CalibrationParameters      *calParam;
+    I2cCommands                 readCommands;
+    SensorStateEntry            entries[SENSOR_STATE_HISTORY];
+    uint32_t                    numEntries;
+    NvMediaBool                 valid;
+} NvSensorStateStore;
+
+/* The store stays disabled, and refreshing it does nothing, if the sensor
+ * cannot read its state */
+NvMediaStatus
+SensorStateInit(NvSensorStateStore *store,
+                SensorInfo *sensorInfo,
+                CalibrationParameters *calParam);
+
+/* Safe on a zeroed store */
+void
+SensorStateDestroy(NvSensorStateStore *store);
+
+/* Reads the sensor state, which applies from firstFrame on. Called after
+ * the settings change. The state is also copied to state if not NULL. */
+NvMediaStatus
+SensorStateRefresh(NvSensorStateStore *store,
+                   uint32_t firstFrame,
+                   SensorState *state);
+
+/* Publishes a state read earlier for settings which are applied again */
+void
+SensorStatePublish(NvSensorStateStore *store,
+                   uint32_t firstFrame,
+                   SensorState *state);
+
+/* Copies the state frame was captured with. Returns NVMEDIA_FALSE if
+ * there is none. */
+NvMediaBool
+SensorStateGet(NvSensorStateStore *store,
+               uint32_t frame,
+               SensorState *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SENSOR_STATE_H__
@@ -0,0 +1,177 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "shutdown.h"
+#include "event_loop.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+
+/* The coordinator is process wide so that any stage can request shutdown
+ * without having the main context at hand */
+static pthread_mutex_t shutdownMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shutdownCond;
+static NvMediaBool shutdownCondValid = NVMEDIA_FALSE;
+static NvMainContext *shutdownMainCtx = NULL;
+static NvQueue *shutdownQueues[SHUTDOWN_MAX_QUEUES];
+static uint32_t shutdownNumQueues = 0;
+static const char *shutdownReason = NULL;
+static uint64_t shutdownRequestTimeUs = 0;
+
+NvMediaStatus
+ShutdownInit(NvMainContext *mainCtx)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    /* Exit deadlines must not move with the wall clock */
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&shutdownCond, &attr)) {
+        pthread_condattr_destroy(&attr);
+        LOG_ERR("%s: Failed to create condition variable\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&shutdownMutex);
+    shutdownCondValid = NVMEDIA_TRUE;
+    shutdownMainCtx = mainCtx;
+    shutdownNumQueues = 0;
+    shutdownReason = NULL;
+    pthread_mutex_unlock(&shutdownMutex);
+
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+ShutdownFini(void)
+{
+    pthread_mutex_lock(&shutdownMutex);
+    if (shutdownCondValid)
+        pthread_cond_destroy(&shutdownCond);
+    shutdownCondValid = NVMEDIA_FALSE;
+    shutdownMainCtx = NULL;
+    shutdownNumQueues = 0;
+    pthread_mutex_unlock(&shutdownMutex);
+}
+
+void
+ShutdownRequest(const char *reason)
+{
+    NvMediaImage *sentinel = NULL;
+    uint32_t i;
+
+    pthread_mutex_lock(&shutdownMutex);
+    if (!shutdownMainCtx) {
+        pthread_mutex_unlock(&shutdownMutex);
+        return;
+    }
+
+    if (!shutdownReason) {
+        shutdownReason = reason ? reason : "unknown";
+        GetTimeMicroSec(&shutdownRequestTimeUs);
+        LOG_INFO("%s: Shutdown requested by %s\n", __func__, shutdownReason);
+
+        shutdownMainCtx->quit = NVMEDIA_TRUE;
+
+        /* A full queue has no consumer blocked on it, so a failed put is fine */
+        for (i = 0; i < shutdownNumQueues; i++)
+            NvQueuePut(shutdownQueues[i], (void *)&sentinel, 0);
+    }
+    pthread_mutex_unlock(&shutdownMutex);
+
+    EventLoopWakeup();
+}
+
+NvMediaStatus
+ShutdownRegisterQueue(NvQueue *queue)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+
+    pthread_mutex_lock(&shutdownMutex);
+    if (shutdownNumQueues == SHUTDOWN_MAX_QUEUES) {
+        LOG_ERR("%s: Too many queues registered\n", __func__);
+        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+    } else {
+        shutdownQueues[shutdownNumQueues++] = queue;
+    }
+    pthread_mutex_unlock(&shutdownMutex);
+
+    return status;
+}
+
+void
+ShutdownUnregisterQueue(NvQueue *queue)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&shutdownMutex);
+    for (i = 0; i < shutdownNumQueues; i++) {
+        if (shutdownQueues[i] == queue) {
+            shutdownQueues[i] = shutdownQueues[--shutdownNumQueues];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shutdownMutex);
+}
+
+void
+ShutdownThreadExited(volatile NvMediaBool *exitedFlag)
+{
+    pthread_mutex_lock(&shutdownMutex);
+    *exitedFlag = NVMEDIA_TRUE;
+    if (shutdownCondValid)
+        pthread_cond_broadcast(&shutdownCond);
+    pthread_mutex_unlock(&shutdownMutex);
+}
+
+NvMediaStatus
+ShutdownWaitExit(volatile NvMediaBool *exitedFlag,
+                 const char *stage)
+{
+    struct timespec deadline;
+    uint64_t now = 0;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    int err = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += SHUTDOWN_JOIN_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (SHUTDOWN_JOIN_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&shutdownMutex);
+    while (!*exitedFlag && err != ETIMEDOUT) {
+        if (!shutdownCondValid) {
+            err = ETIMEDOUT;
+            break;
+        }
+        err = pthread_cond_timedwait(&shutdownCond, &shutdownMutex, &deadline);
+    }
+
+    GetTimeMicroSec(&now);
+    if (*exitedFlag) {
+        LOG_DBG("%s: %s exited %llu us after shutdown request\n", __func__, stage,
+                shutdownReason ? (unsigned long long)(now - shutdownRequestTimeUs) : 0ULL);
+    } else {
+        LOG_ERR("%s: %s did not exit within %d ms (shutdown requested by %s %llu us ago)\n",
+                __func__, stage, SHUTDOWN_JOIN_TIMEOUT_MS,
+                shutdownReason ? shutdownReason : "nobody",
+                shutdownReason ? (unsigned long long)(now - shutdownRequestTimeUs) : 0ULL);
+        status = NVMEDIA_STATUS_TIMED_OUT;
+    }
+    pthread_mutex_unlock(&shutdownMutex);
+
+    return status;
+}
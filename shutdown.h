@@ -0,0 +1,61 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __SHUTDOWN_H__
+#define __SHUTDOWN_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "thread_utils.h"
+
+/* Upper bound for a single stage to notice the quit flag. Capture threads
+ * can sit in NvMediaICPGetFrame for CAPTURE_GET_FRAME_TIMEOUT. */
+#define SHUTDOWN_JOIN_TIMEOUT_MS        3000
+#define SHUTDOWN_MAX_QUEUES             16
+
+NvMediaStatus
+ShutdownInit(NvMainContext *mainCtx);
+
+void
+ShutdownFini(void);
+
+/* Sets the quit flag, wakes the main event loop and puts a NULL image into
+ * every registered queue so that blocked consumers return at once.
+ * Only the first request is logged with its reason. Not signal safe. */
+void
+ShutdownRequest(const char *reason);
+
+/* Registers a queue whose consumer blocks in NvQueueGet. The consumer must
+ * treat a NULL image as a request to re-check the quit flag. */
+NvMediaStatus
+ShutdownRegisterQueue(NvQueue *queue);
+
+/* Must be called before the queue is destroyed */
+void
+ShutdownUnregisterQueue(NvQueue *queue);
+
+/* Called by a stage thread as its last action */
+void
+ShutdownThreadExited(volatile NvMediaBool *exitedFlag);
+
+/* Waits up to SHUTDOWN_JOIN_TIMEOUT_MS for a stage thread to set its exit
+ * flag. Returns NVMEDIA_STATUS_TIMED_OUT if it did not, in which case the
+ * caller must not release anything the thread may still be using. */
+NvMediaStatus
+ShutdownWaitExit(volatile NvMediaBool *exitedFlag,
+                 const char *stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SHUTDOWN_H__
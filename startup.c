@@ -0,0 +1,217 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "startup.h"
+#include "capture.h"
+#include "save.h"
+#include "composite.h"
+#include "display.h"
+#include "grp_activate.h"
+#include "capture_status.h"
+#include "runtime_settings.h"
+#include "control.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+#include "profiler.h"
+
+enum {
+    STARTUP_CAPTURE = 0,
+    STARTUP_SENSOR,
+    STARTUP_RUNTIME_SETTINGS,
+    STARTUP_SAVE,
+    STARTUP_COMPOSITE,
+    STARTUP_DISPLAY,
+    STARTUP_GRP_ACTIVATION,
+    STARTUP_CAPTURE_STATUS,
+    STARTUP_CONTROL,
+    STARTUP_NUM_TASKS,
+};
+
+#define STARTUP_DEP(task)       (1u << (task))
+
+typedef enum {
+    STARTUP_PENDING = 0,
+    STARTUP_RUNNING,
+    STARTUP_DONE,
+    STARTUP_FAILED,
+    STARTUP_SKIPPED,
+} StartupState;
+
+typedef struct {
+    const char                  *name;
+    NvMediaStatus              (*init)(NvMainContext *mainCtx);
+    uint32_t                     deps;
+} StartupTask;
+
+/* An Init may only read the contexts of the tasks in its deps. One which
+ * touches the sensors, the parsed script or the register shadow must wait
+ * for Sensor, which powers the sensors up and runs the script. */
+static const StartupTask startupTasks[STARTUP_NUM_TASKS] = {
+    [STARTUP_CAPTURE]          = { "Capture", CaptureInit, 0 },
+    [STARTUP_SENSOR]           = { "Sensor", CaptureSensorInit,
+                                   STARTUP_DEP(STARTUP_CAPTURE) },
+    [STARTUP_RUNTIME_SETTINGS] = { "RuntimeSettings", RuntimeSettingsInit,
+                                   STARTUP_DEP(STARTUP_CAPTURE) |
+                                   STARTUP_DEP(STARTUP_SENSOR) },
+    [STARTUP_SAVE]             = { "Save", SaveInit,
+                                   STARTUP_DEP(STARTUP_CAPTURE) |
+                                   STARTUP_DEP(STARTUP_RUNTIME_SETTINGS) },
+    [STARTUP_COMPOSITE]        = { "Composite", CompositeInit,
+                                   STARTUP_DEP(STARTUP_CAPTURE) |
+                                   STARTUP_DEP(STARTUP_SAVE) },
+    [STARTUP_DISPLAY]          = { "Display", DisplayInit, 0 },
+    [STARTUP_GRP_ACTIVATION]   = { "GrpActivation", GrpActivationInit,
+                                   STARTUP_DEP(STARTUP_CAPTURE) |
+                                   STARTUP_DEP(STARTUP_SENSOR) },
+    [STARTUP_CAPTURE_STATUS]   = { "CaptureStatus", CaptureStatusInit,
+                                   STARTUP_DEP(STARTUP_CAPTURE) },
+    [STARTUP_CONTROL]          = { "Control", ControlInit, 0 },
+};
+
+typedef struct {
+    NvMainContext               *mainCtx;
+    pthread_mutex_t              mutex;
+    pthread_cond_t               cond;
+    StartupState                 state[STARTUP_NUM_TASKS];
+    pthread_t                    thread[STARTUP_NUM_TASKS];
+    NvMediaBool                  threadValid[STARTUP_NUM_TASKS];
+    uint32_t                     numRunning;
+    NvMediaBool                  failed;
+} StartupGraph;
+
+typedef struct {
+    StartupGraph                *graph;
+    uint32_t                     task;
+} StartupThreadArgs;
+
+static void *
+_StartupThreadFunc(void *data)
+{
+    StartupThreadArgs *args = data;
+    StartupGraph *graph = args->graph;
+    const StartupTask *task = &startupTasks[args->task];
+    uint64_t start = 0, end = 0;
+    NvMediaStatus status;
+
+    GetTimeMicroSec(&start);
+    status = task->init(graph->mainCtx);
+    GetTimeMicroSec(&end);
+    ProfilerRecord(PROFILER_CAT_INIT, start, 0, "%s", task->name);
+
+    if (status != NVMEDIA_STATUS_OK)
+        LOG_ERR("%s: Failed to Initialize %s\n", __func__, task->name);
+    else
+        LOG_DBG("%s: %s initialized in %llu us\n", __func__, task->name,
+                (unsigned long long)(end - start));
+
+    pthread_mutex_lock(&graph->mutex);
+    graph->state[args->task] = (status == NVMEDIA_STATUS_OK) ? STARTUP_DONE : STARTUP_FAILED;
+    if (status != NVMEDIA_STATUS_OK)
+        graph->failed = NVMEDIA_TRUE;
+    graph->numRunning--;
+    pthread_cond_signal(&graph->cond);
+    pthread_mutex_unlock(&graph->mutex);
+
+    return NULL;
+}
+
+/* Starts every pending task whose dependencies are done. Called with the
+ * mutex held. Returns the number of tasks still pending. */
+static uint32_t
+_StartupLaunchReady(StartupGraph *graph,
+                    StartupThreadArgs *args)
+{
+    uint32_t i, j, numPending = 0;
+    NvMediaBool ready;
+
+    for (i = 0; i < STARTUP_NUM_TASKS; i++) {
+        if (graph->state[i] != STARTUP_PENDING)
+            continue;
+
+        if (graph->failed) {
+            graph->state[i] = STARTUP_SKIPPED;
+            continue;
+        }
+
+        ready = NVMEDIA_TRUE;
+        for (j = 0; j < STARTUP_NUM_TASKS; j++) {
+            if ((startupTasks[i].deps & STARTUP_DEP(j)) &&
+                graph->state[j] != STARTUP_DONE)
+                ready = NVMEDIA_FALSE;
+        }
+        if (!ready) {
+            numPending++;
+            continue;
+        }
+
+        args[i].graph = graph;
+        args[i].task = i;
+        graph->state[i] = STARTUP_RUNNING;
+        graph->numRunning++;
+        if (pthread_create(&graph->thread[i], NULL, _StartupThreadFunc, &args[i])) {
+            LOG_ERR("%s: Failed to create thread for %s\n", __func__,
+                    startupTasks[i].name);
+            graph->state[i] = STARTUP_FAILED;
+            graph->numRunning--;
+            graph->failed = NVMEDIA_TRUE;
+            continue;
+        }
+        graph->threadValid[i] = NVMEDIA_TRUE;
+    }
+
+    return numPending;
+}
+
+NvMediaStatus
+StartupInitComponents(NvMainContext *mainCtx)
+{
+    StartupGraph graph;
+    StartupThreadArgs args[STARTUP_NUM_TASKS];
+    uint32_t i, numPending;
+
+    memset(&graph, 0, sizeof(graph));
+    graph.mainCtx = mainCtx;
+    if (pthread_mutex_init(&graph.mutex, NULL)) {
+        LOG_ERR("%s: Failed to create mutex\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (pthread_cond_init(&graph.cond, NULL)) {
+        LOG_ERR("%s: Failed to create condition variable\n", __func__);
+        pthread_mutex_destroy(&graph.mutex);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    pthread_mutex_lock(&graph.mutex);
+    while (1) {
+        numPending = _StartupLaunchReady(&graph, args);
+        if (!graph.numRunning)
+            break;
+        pthread_cond_wait(&graph.cond, &graph.mutex);
+    }
+    pthread_mutex_unlock(&graph.mutex);
+
+    for (i = 0; i < STARTUP_NUM_TASKS; i++) {
+        if (graph.threadValid[i])
+            pthread_join(graph.thread[i], NULL);
+    }
+
+    pthread_cond_destroy(&graph.cond);
+    pthread_mutex_destroy(&graph.mutex);
+
+    /* Nothing running and tasks left means a dependency never completed */
+    if (numPending && !graph.failed) {
+        LOG_ERR("%s: Unresolvable initialization dependencies\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    return graph.failed ? NVMEDIA_STATUS_ERROR : NVMEDIA_STATUS_OK;
+}
@@ -0,0 +1,31 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __STARTUP_H__
+#define __STARTUP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+
+/* Runs the Init function of every component. Each one starts on its own
+ * thread as soon as the components it reads from are initialized, so the
+ * sensor bring-up over I2C overlaps display creation and the surface
+ * allocations of the other stages. Returns once every started Init has
+ * finished; after a failure no further Init is started. */
+NvMediaStatus
+StartupInitComponents(NvMainContext *mainCtx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
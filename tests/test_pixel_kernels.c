@@ -0,0 +1,215 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/* Checks the NEON or SSE2 pixel kernels against plain scalar versions,
+ * for every length up to a few vectors so that each remainder tail is
+ * covered, out of place and in place. Built with "make test". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../pixel_kernels.h"
+
+#define TEST_MAX_SAMPLES        300
+#define TEST_LONG_SAMPLES       (1920 * 4 + 13)
+/* Bytes past the end of an output that no kernel may touch */
+#define TEST_GUARD_BYTES        32
+#define TEST_GUARD              0xA5
+
+static uint32_t testSeed = 1;
+
+static uint16_t
+_Random16(void)
+{
+    testSeed = testSeed * 1103515245 + 12345;
+    return (uint16_t)(testSeed >> 8);
+}
+
+static void
+_RefPack(const uint16_t *src,
+         uint8_t *dst,
+         uint32_t numSamples,
+         uint32_t bits)
+{
+    uint32_t bit, i, j;
+
+    memset(dst, 0, PixelPackedSize(numSamples, bits));
+    for (i = 0; i < numSamples; i++) {
+        for (j = 0; j < bits; j++) {
+            if (!(src[i] & (1u << j)))
+                continue;
+            bit = i * bits + j;
+            dst[bit / 8] |= (uint8_t)(1u << (bit % 8));
+        }
+    }
+}
+
+static int
+_CheckGuard(const uint8_t *guard,
+            const char *name,
+            uint32_t numSamples)
+{
+    uint32_t i;
+
+    for (i = 0; i < TEST_GUARD_BYTES; i++) {
+        if (guard[i] != TEST_GUARD) {
+            printf("FAIL: %s of %u samples wrote past its output\n", name, numSamples);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+_CheckSamples(const uint16_t *got,
+              const uint16_t *expected,
+              const char *name,
+              uint32_t numSamples)
+{
+    uint32_t i;
+
+    for (i = 0; i < numSamples; i++) {
+        if (got[i] != expected[i]) {
+            printf("FAIL: %s of %u samples: sample %u is 0x%04x, not 0x%04x\n",
+                   name, numSamples, i, got[i], expected[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+_TestShiftSwap(uint16_t *in,
+               uint16_t *buf,
+               uint16_t *ref,
+               uint32_t numSamples)
+{
+    static const uint32_t shifts[] = { 0, 2, 4, 6 };
+    uint32_t i, s;
+    int failures = 0;
+
+    for (s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++) {
+        for (i = 0; i < numSamples; i++)
+            ref[i] = (in[i] >> shifts[s]) & 0x0FFF;
+        memcpy(buf, in, numSamples * sizeof(uint16_t));
+        PixelShiftRight16(buf, numSamples, shifts[s], 0x0FFF);
+        failures += _CheckSamples(buf, ref, "PixelShiftRight16", numSamples);
+
+        for (i = 0; i < numSamples; i++)
+            ref[i] = (uint16_t)(in[i] << shifts[s]);
+        memcpy(buf, in, numSamples * sizeof(uint16_t));
+        PixelShiftLeft16(buf, numSamples, shifts[s]);
+        failures += _CheckSamples(buf, ref, "PixelShiftLeft16", numSamples);
+    }
+
+    for (i = 0; i < numSamples; i++)
+        ref[i] = (uint16_t)((in[i] << 8) | (in[i] >> 8));
+    memcpy(buf, in, numSamples * sizeof(uint16_t));
+    PixelSwapBytes16(buf, numSamples);
+    failures += _CheckSamples(buf, ref, "PixelSwapBytes16", numSamples);
+
+    return failures;
+}
+
+static int
+_TestPack(uint16_t *in,
+          uint8_t *buf,
+          uint8_t *packed,
+          uint16_t *ref,
+          uint32_t numSamples,
+          uint32_t bits)
+{
+    uint32_t size = PixelPackedSize(numSamples, bits);
+    uint16_t *samples = (uint16_t *)buf;
+    uint32_t i;
+    int failures = 0;
+
+    _RefPack(in, packed, numSamples, bits);
+    for (i = 0; i < numSamples; i++)
+        ref[i] = in[i] & ((1u << bits) - 1);
+
+    memset(buf, TEST_GUARD, size + TEST_GUARD_BYTES);
+    if (PixelPack(in, buf, numSamples, bits) != size || memcmp(buf, packed, size)) {
+        printf("FAIL: PixelPack %u bits of %u samples\n", bits, numSamples);
+        failures++;
+    }
+    failures += _CheckGuard(buf + size, "PixelPack", numSamples);
+
+    memcpy(buf, in, numSamples * sizeof(uint16_t));
+    if (PixelPack(samples, buf, numSamples, bits) != size || memcmp(buf, packed, size)) {
+        printf("FAIL: PixelPack %u bits of %u samples in place\n", bits, numSamples);
+        failures++;
+    }
+
+    memset(buf, TEST_GUARD, numSamples * sizeof(uint16_t) + TEST_GUARD_BYTES);
+    PixelUnpack(packed, samples, numSamples, bits);
+    failures += _CheckSamples(samples, ref, "PixelUnpack", numSamples);
+    failures += _CheckGuard(buf + numSamples * sizeof(uint16_t), "PixelUnpack", numSamples);
+
+    memcpy(buf, packed, size);
+    PixelUnpack(buf, samples, numSamples, bits);
+    failures += _CheckSamples(samples, ref, "PixelUnpack in place", numSamples);
+
+    return failures;
+}
+
+static int
+_TestLength(uint32_t numSamples)
+{
+    static const uint32_t bits[] = { 10, 12, 14 };
+    /* A partial group packs to more bytes than its samples take */
+    uint32_t bufSize = (numSamples + 4) * sizeof(uint16_t) + TEST_GUARD_BYTES;
+    uint16_t *in = malloc(numSamples * sizeof(uint16_t) + 1);
+    uint16_t *ref = malloc(numSamples * sizeof(uint16_t) + 1);
+    uint8_t *buf = malloc(bufSize);
+    uint8_t *packed = malloc(bufSize);
+    uint32_t i;
+    int failures = 0;
+
+    if (!in || !ref || !buf || !packed) {
+        printf("FAIL: out of memory\n");
+        failures++;
+        goto failed;
+    }
+
+    /* Bits above the sample width too, which the kernels must drop */
+    for (i = 0; i < numSamples; i++)
+        in[i] = _Random16();
+
+    failures += _TestShiftSwap(in, (uint16_t *)buf, ref, numSamples);
+    for (i = 0; i < sizeof(bits) / sizeof(bits[0]); i++)
+        failures += _TestPack(in, buf, packed, ref, numSamples, bits[i]);
+
+failed:
+    free(in);
+    free(ref);
+    free(buf);
+    free(packed);
+    return failures;
+}
+
+int main(int argc,
+         char *argv[])
+{
+    uint32_t n;
+    int failures = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (n = 0; n <= TEST_MAX_SAMPLES; n++)
+        failures += _TestLength(n);
+    failures += _TestLength(TEST_LONG_SAMPLES);
+
+    printf("%s: %s\n", __FILE__, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+/* Checks the runtime settings diff against Boson commands, which stream
+ * their bytes through one FIFO register. Built with "make test". */
+
+#include "../runtime_settings.c"
+
+#define TEST_NUM_SETTINGS       2
+#define TEST_I2C_DEVICE         7
+#define TEST_SENSOR_ADDRESS     (0xD8 >> 1)
+/* 0x11111111: the four payload bytes written in a row are the same */
+#define TEST_PALETTE            "286331153"
+
+static NvMediaStatus
+_SetupSettings(NvRuntimeSettingsContext *runtimeCtx,
+               CalibrationParameters *calParams)
+{
+    SensorInfo *sensorInfo = GetSensorInfo("boson");
+    RuntimeSettings *settings;
+    SensorProperties *properties;
+    char *argv[] = { "", "-palette", TEST_PALETTE };
+    uint32_t i;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+
+    if (!sensorInfo)
+        return NVMEDIA_STATUS_ERROR;
+
+    properties = malloc(sensorInfo->sizeOfSensorProperties);
+    if (!properties)
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+
+    /* Both settings send the same command, as when only the frame count
+     * of a setting differs */
+    for (i = 0; i < TEST_NUM_SETTINGS; i++) {
+        settings = &runtimeCtx->rtSettings[i];
+        memset(properties, 0, sensorInfo->sizeOfSensorProperties);
+        settings->cmds = calloc(1, sizeof(I2cCommands));
+        if (!settings->cmds) {
+            status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+            goto failed;
+        }
+        status = sensorInfo->ProcessCmdline(3, argv, properties);
+        if (status != NVMEDIA_STATUS_OK)
+            goto failed;
+        status = sensorInfo->CalibrateSensor(settings->cmds, calParams, properties);
+        if (status != NVMEDIA_STATUS_OK)
+            goto failed;
+    }
+
+failed:
+    free(properties);
+    return status;
+}
+
+/* Every command of a Boson setting must survive the diff unchanged */
+static int
+_CheckDiff(RuntimeSettings *settings,
+           uint32_t index)
+{
+    Command *cmd, *diffCmd;
+    uint32_t i;
+
+    if (settings->diff.numCommands != settings->cmds->numCommands) {
+        printf("FAIL: setting %u diff has %u of %u commands\n", index,
+               settings->diff.numCommands, settings->cmds->numCommands);
+        return 1;
+    }
+
+    for (i = 0; i < settings->cmds->numCommands; i++) {
+        cmd = I2C_COMMAND(settings->cmds, i);
+        diffCmd = I2C_COMMAND(&settings->diff, i);
+        if (memcmp(cmd, diffCmd, sizeof(Command))) {
+            printf("FAIL: setting %u command %u differs in the diff\n", index, i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc,
+         char *argv[])
+{
+    RuntimeSettings rtSettings[TEST_NUM_SETTINGS];
+    NvRuntimeSettingsContext runtimeCtx;
+    CalibrationParameters calParams;
+    uint32_t i;
+    int failures = 0;
+
+    (void)argc;
+    (void)argv;
+
+    memset(rtSettings, 0, sizeof(rtSettings));
+    memset(&runtimeCtx, 0, sizeof(runtimeCtx));
+    memset(&calParams, 0, sizeof(calParams));
+    calParams.i2cDevice = TEST_I2C_DEVICE;
+    calParams.sensorAddress = TEST_SENSOR_ADDRESS;
+    runtimeCtx.rtSettings = rtSettings;
+    runtimeCtx.numRtSettings = TEST_NUM_SETTINGS;
+    runtimeCtx.calParam = &calParams;
+
+    if (_SetupSettings(&runtimeCtx, &calParams) != NVMEDIA_STATUS_OK) {
+        printf("FAIL: could not build the Boson settings\n");
+        return 1;
+    }
+
+    for (i = 0; i < TEST_NUM_SETTINGS; i++) {
+        if (_BuildSettingsDiff(&runtimeCtx, i) != NVMEDIA_STATUS_OK) {
+            printf("FAIL: could not build the diff of setting %u\n", i);
+            return 1;
+        }
+        failures += _CheckDiff(&rtSettings[i], i);
+    }
+
+    for (i = 0; i < TEST_NUM_SETTINGS; i++) {
+        I2cFreeCommands(rtSettings[i].cmds);
+        free(rtSettings[i].cmds);
+        I2cFreeCommands(&rtSettings[i].diff);
+    }
+    I2cShadowFini();
+
+    printf("%s: %s\n", __FILE__, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
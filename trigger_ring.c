@@ -0,0 +1,450 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trigger_ring.h"
+#include "pixel_kernels.h"
+#include "log_utils.h"
+
+typedef enum {
+    TRIGGER_RING_JOB_FRAME = 0,
+    TRIGGER_RING_JOB_END,           /* closes the event file */
+    TRIGGER_RING_JOB_STOP,          /* stops the writer thread */
+} TriggerRingJobType;
+
+typedef struct {
+    TriggerRingJobType          type;
+    uint32_t                    event;
+    TriggerRingFrame           *frame;
+} TriggerRingJob;
+
+static const char *triggerSourceNames[] = {
+    "command",
+    "FFC",
+    "telemetry",
+};
+
+static uint64_t
+_TriggerRingTime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void
+_TriggerRingCloseEvent(NvTriggerRing *ring)
+{
+    SegmentHeader *header = &ring->eventHeader;
+
+    if (!ring->eventFile)
+        return;
+
+    if (fseek(ring->eventFile, 0, SEEK_SET) ||
+        fwrite(header, sizeof(SegmentHeader), 1, ring->eventFile) != 1)
+        LOG_ERR("%s: Failed to complete event %u\n", __func__, header->sequence);
+    fclose(ring->eventFile);
+    ring->eventFile = NULL;
+
+    LOG_INFO("%s: Event %u written, %u frames from frame %u\n", __func__,
+             header->sequence, header->numFrames, header->firstFrame);
+}
+
+static void
+_TriggerRingOpenEvent(NvTriggerRing *ring,
+                      uint32_t event)
+{
+    char fileName[MAX_STRING_SIZE];
+    SegmentHeader *header = &ring->eventHeader;
+
+    snprintf(fileName, MAX_STRING_SIZE, "%s_event%03u.rseg", ring->prefix, event);
+    memset(header, 0, sizeof(SegmentHeader));
+    header->magic = SEGMENT_MAGIC;
+    header->version = SEGMENT_VERSION;
+    header->headerSize = sizeof(SegmentHeader);
+    header->sequence = event;
+
+    ring->eventFile = fopen(fileName, "wb");
+    if (!ring->eventFile) {
+        LOG_ERR("%s: Failed to open file %s\n", __func__, fileName);
+        return;
+    }
+    if (fwrite(header, sizeof(SegmentHeader), 1, ring->eventFile) != 1) {
+        LOG_ERR("%s: file write failed\n", __func__);
+        fclose(ring->eventFile);
+        ring->eventFile = NULL;
+    }
+}
+
+static void
+_TriggerRingWriteFrame(NvTriggerRing *ring,
+                       TriggerRingFrame *frame)
+{
+    SegmentHeader *header = &ring->eventHeader;
+    SegmentFrameHeader frameHeader = frame->header;
+
+    frameHeader.sequence = header->sequence;
+    if (fwrite(&frameHeader, sizeof(frameHeader), 1, ring->eventFile) != 1 ||
+        fwrite(frame->data, frameHeader.size, 1, ring->eventFile) != 1) {
+        LOG_ERR("%s: Failed to write frame %u of event %u\n", __func__,
+                frameHeader.frameNumber, header->sequence);
+        fseek(ring->eventFile, header->headerSize + header->dataSize, SEEK_SET);
+        return;
+    }
+
+    if (!header->numFrames) {
+        header->firstFrame = frameHeader.frameNumber;
+        header->startTime = frameHeader.timestamp;
+    }
+    header->numFrames++;
+    header->lastFrame = frameHeader.frameNumber;
+    header->endTime = frameHeader.timestamp;
+    header->dataSize += sizeof(frameHeader) + frameHeader.size;
+}
+
+static uint32_t
+_TriggerRingWriterFunc(void *data)
+{
+    NvTriggerRing *ring = data;
+    TriggerRingJob job;
+
+    while (1) {
+        while (NvQueueGet(ring->writerQueue, &job, TRIGGER_RING_DEQUEUE_TIMEOUT) !=
+               NVMEDIA_STATUS_OK)
+            ;
+
+        if (job.type == TRIGGER_RING_JOB_STOP)
+            break;
+
+        if (job.type == TRIGGER_RING_JOB_END) {
+            _TriggerRingCloseEvent(ring);
+            continue;
+        }
+
+        if (!ring->eventFile || ring->eventHeader.sequence != job.event) {
+            _TriggerRingCloseEvent(ring);
+            _TriggerRingOpenEvent(ring, job.event);
+        }
+        if (ring->eventFile)
+            _TriggerRingWriteFrame(ring, job.frame);
+        /* The frame can take a new image */
+        __atomic_store_n(&job.frame->writing, 0, __ATOMIC_RELEASE);
+    }
+
+    _TriggerRingCloseEvent(ring);
+    return 0;
+}
+
+static void
+_TriggerRingQueue(NvTriggerRing *ring,
+                  TriggerRingJobType type,
+                  TriggerRingFrame *frame)
+{
+    TriggerRingJob job;
+
+    job.type = type;
+    job.event = ring->event;
+    job.frame = frame;
+    if (frame)
+        __atomic_store_n(&frame->writing, 1, __ATOMIC_RELAXED);
+
+    /* Every frame is queued once at most, with at most one end after it */
+    if (NvQueuePut(ring->writerQueue, &job, 0) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to queue to the event writer\n", __func__);
+        if (frame) {
+            __atomic_store_n(&frame->writing, 0, __ATOMIC_RELAXED);
+            ring->numDropped++;
+        }
+    }
+}
+
+/* Sizes the ring for frames of frameSize bytes as kept and starts the
+ * writer thread */
+static NvMediaStatus
+_TriggerRingStart(NvTriggerRing *ring,
+                  uint32_t frameSize)
+{
+    if (ring->memoryBudget / frameSize < TRIGGER_RING_MIN_FRAMES) {
+        LOG_ERR("%s: Memory budget must hold at least %u frames of %u bytes\n",
+                __func__, TRIGGER_RING_MIN_FRAMES, frameSize);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    ring->frames = calloc(ring->memoryBudget / frameSize, sizeof(TriggerRingFrame));
+    if (!ring->frames) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    ring->numFrames = ring->memoryBudget / frameSize;
+
+    if (NvQueueCreate(&ring->writerQueue, ring->numFrames * 2 + 2,
+                      sizeof(TriggerRingJob)) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create event writer queue\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (NvThreadCreate(&ring->writerThread, &_TriggerRingWriterFunc, ring,
+                       NV_THREAD_PRIORITY_NORMAL) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create event writer thread\n", __func__);
+        ring->writerThread = NULL;
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    LOG_INFO("%s: Keeping %u frames of %u bytes for %s\n", __func__,
+             ring->numFrames, frameSize, ring->prefix);
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+TriggerRingInit(NvTriggerRing *ring,
+                const char *prefix,
+                uint32_t virtualGroupIndex,
+                NvMediaSurfaceType surfType,
+                uint32_t bytesPerSample,
+                uint64_t memoryBudget,
+                uint32_t preSeconds,
+                uint32_t postSeconds)
+{
+    NvMediaStatus status;
+
+    memset(ring, 0, sizeof(NvTriggerRing));
+
+    if (!bytesPerSample) {
+        LOG_ERR("%s: Pre-trigger ring applies only to RAW captured images\n", __func__);
+        return NVMEDIA_STATUS_NOT_SUPPORTED;
+    }
+
+    NVM_SURF_FMT_DEFINE_ATTR(attr);
+    status = NvMediaSurfaceFormatGetAttrs(surfType, attr, NVM_SURF_FMT_ATTR_MAX);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaSurfaceFormatGetAttrs failed\n", __func__);
+        return status;
+    }
+
+    /* Other depths are kept as captured */
+    if (attr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_10 ||
+        attr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_12 ||
+        attr[NVM_SURF_ATTR_BITS_PER_COMPONENT].value == NVM_SURF_ATTR_BITS_PER_COMPONENT_14) {
+        status = PackedRawWriterInit(&ring->packer, surfType, 0);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+        ring->packed = NVMEDIA_TRUE;
+    }
+
+    snprintf(ring->prefix, MAX_STRING_SIZE, "%s_vc%u", prefix, virtualGroupIndex);
+    ring->bytesPerSample = bytesPerSample;
+    ring->memoryBudget = memoryBudget;
+    ring->preUs = (uint64_t)preSeconds * 1000000;
+    ring->postUs = (uint64_t)postSeconds * 1000000;
+    ring->valid = NVMEDIA_TRUE;
+
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+TriggerRingDestroy(NvTriggerRing *ring)
+{
+    TriggerRingJob job = { TRIGGER_RING_JOB_STOP, 0, NULL };
+    uint32_t i;
+
+    if (ring->writerThread) {
+        if (ring->event)
+            _TriggerRingQueue(ring, TRIGGER_RING_JOB_END, NULL);
+        if (NvQueuePut(ring->writerQueue, &job, TRIGGER_RING_DEQUEUE_TIMEOUT) !=
+            NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to stop event writer\n", __func__);
+        else
+            NvThreadDestroy(ring->writerThread);
+    }
+    if (ring->numEvents || ring->numDropped)
+        LOG_INFO("%s: %u events, %u frames dropped\n", __func__,
+                 ring->numEvents, ring->numDropped);
+
+    if (ring->writerQueue)
+        NvQueueDestroy(ring->writerQueue);
+    if (ring->frames) {
+        for (i = 0; i < ring->numFrames; i++)
+            free(ring->frames[i].data);
+        free(ring->frames);
+    }
+    free(ring->buff);
+    PackedRawWriterDestroy(&ring->packer);
+    memset(ring, 0, sizeof(NvTriggerRing));
+}
+
+void
+TriggerRingTrigger(NvTriggerRing *ring,
+                   TriggerSource source)
+{
+    TriggerRingFrame *frame;
+    uint64_t now = _TriggerRingTime();
+    uint32_t i, numQueued = 0;
+
+    if (!ring->valid)
+        return;
+
+    ring->postEnd = now + ring->postUs;
+    if (ring->event) {
+        LOG_INFO("%s: Event %u of %s extended by %s\n", __func__, ring->event,
+                 ring->prefix, triggerSourceNames[source]);
+        return;
+    }
+
+    ring->event = ++ring->numEvents;
+    /* Oldest first. Frames still being written for the last event are
+     * in its file already. */
+    for (i = 0; i < ring->numFrames; i++) {
+        frame = &ring->frames[(ring->next + i) % ring->numFrames];
+        if (!frame->used || frame->header.timestamp + ring->preUs < now ||
+            __atomic_load_n(&frame->writing, __ATOMIC_ACQUIRE))
+            continue;
+        _TriggerRingQueue(ring, TRIGGER_RING_JOB_FRAME, frame);
+        numQueued++;
+    }
+
+    LOG_INFO("%s: Event %u of %s triggered by %s, %u frames before\n", __func__,
+             ring->event, ring->prefix, triggerSourceNames[source], numQueued);
+}
+
+NvMediaStatus
+TriggerRingPush(NvTriggerRing *ring,
+                NvMediaImage *image,
+                uint32_t frameNumber)
+{
+    NvMediaImageSurfaceMap surfaceMap;
+    SensorFrameInfo frameInfo;
+    TriggerRingFrame *frame;
+    uint8_t *dstBuff[3] = {NULL};
+    uint32_t dstPitches[3] = {1};
+    uint32_t pitch, numSamples, size, keptSize;
+    uint32_t top = image->embeddedDataTopSize;
+    uint32_t bottom = image->embeddedDataBottomSize;
+    uint8_t *captured;
+    NvMediaStatus status;
+
+    if (!ring->valid)
+        return NVMEDIA_STATUS_OK;
+
+    pitch = image->width * ring->bytesPerSample;
+    numSamples = image->width * image->height;
+    size = pitch * image->height + top + bottom;
+    keptSize = ring->packed ?
+               top + PixelPackedSize(numSamples, ring->packer.bitsPerSample) + bottom : size;
+
+    if (!ring->frames) {
+        status = _TriggerRingStart(ring, keptSize);
+        if (status != NVMEDIA_STATUS_OK) {
+            ring->valid = NVMEDIA_FALSE;
+            return status;
+        }
+    }
+
+    /* The writer has not caught up with the frame this image would replace */
+    frame = &ring->frames[ring->next];
+    if (__atomic_load_n(&frame->writing, __ATOMIC_ACQUIRE)) {
+        ring->numDropped++;
+        if (ring->event)
+            LOG_WARN("%s: Frame %u of event %u dropped\n", __func__, frameNumber,
+                     ring->event);
+        return NVMEDIA_STATUS_OK;
+    }
+
+    if (keptSize > frame->capacity) {
+        free(frame->data);
+        frame->capacity = 0;
+        frame->used = NVMEDIA_FALSE;
+        if (!(frame->data = malloc(keptSize))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        frame->capacity = keptSize;
+    }
+    if (ring->packed && size > ring->buffSize) {
+        free(ring->buff);
+        ring->buffSize = 0;
+        if (!(ring->buff = malloc(size))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        ring->buffSize = size;
+    }
+
+    /* Packed frames are staged, the others read straight into the ring */
+    captured = ring->packed ? ring->buff : frame->data;
+    if (NvMediaImageLock(image, NVMEDIA_IMAGE_ACCESS_WRITE, &surfaceMap) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageLock failed\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    dstBuff[0] = captured;
+    dstPitches[0] = pitch;
+    status = NvMediaImageGetBits(image, NULL, (void **)dstBuff, dstPitches);
+    NvMediaImageUnlock(image);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaImageGetBits() failed\n", __func__);
+        frame->used = NVMEDIA_FALSE;
+        return status;
+    }
+
+    /* Before packing realigns the samples */
+    memset(&frameInfo, 0, sizeof(frameInfo));
+    if (ring->ParseFrameInfo)
+        ring->ParseFrameInfo(captured, image->width, pitch, top, &frameInfo);
+
+    if (ring->packed) {
+        memcpy(frame->data, captured, top);
+        PackedRawPackSamples(&ring->packer, (uint16_t *)(captured + top),
+                             frame->data + top, numSamples);
+        memcpy(frame->data + keptSize - bottom, captured + size - bottom, bottom);
+    }
+
+    memset(&frame->header, 0, sizeof(frame->header));
+    frame->header.magic = SEGMENT_FRAME_MAGIC;
+    frame->header.frameNumber = frameNumber;
+    frame->header.width = image->width;
+    frame->header.height = image->height;
+    frame->header.bytesPerSample = ring->bytesPerSample;
+    frame->header.embeddedTopSize = top;
+    frame->header.embeddedBottomSize = bottom;
+    frame->header.timestamp = _TriggerRingTime();
+    frame->header.size = keptSize;
+    frame->header.packedBits = ring->packed ? ring->packer.bitsPerSample : 0;
+    frame->used = NVMEDIA_TRUE;
+    ring->next = (ring->next + 1) % ring->numFrames;
+
+    if (ring->event) {
+        if (frame->header.timestamp <= ring->postEnd) {
+            _TriggerRingQueue(ring, TRIGGER_RING_JOB_FRAME, frame);
+        } else {
+            _TriggerRingQueue(ring, TRIGGER_RING_JOB_END, NULL);
+            ring->event = 0;
+        }
+    }
+
+    /* Only a rise triggers, not starting above the threshold */
+    if (frameInfo.valid && ring->triggerOnTemperature) {
+        if (frameInfo.temperature > ring->temperatureThreshold &&
+            ring->temperatureKnown && !ring->aboveThreshold)
+            TriggerRingTrigger(ring, TRIGGER_SOURCE_TELEMETRY);
+        ring->aboveThreshold = frameInfo.temperature > ring->temperatureThreshold;
+        ring->temperatureKnown = NVMEDIA_TRUE;
+    }
+
+    /* Likewise an FFC under way at the first frame does not trigger */
+    if (frameInfo.valid && ring->triggerOnFfc && frameInfo.ffcState != SENSOR_FFC_UNKNOWN) {
+        if (frameInfo.ffcState == SENSOR_FFC_IN_PROGRESS &&
+            ring->ffcState != SENSOR_FFC_UNKNOWN && ring->ffcState != SENSOR_FFC_IN_PROGRESS)
+            TriggerRingTrigger(ring, TRIGGER_SOURCE_FFC);
+        ring->ffcState = frameInfo.ffcState;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
@@ -0,0 +1,132 @@
+/* Copyright (c) 2016-2018, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * NVIDIA CORPORATION and its licensors retain all intellectual property
+ * and proprietary rights in and to this software, related documentation
+ * and any modifications thereto.  Any use, reproduction, disclosure or
+ * distribution of this software and related documentation without an express
+ * license agreement from NVIDIA CORPORATION is strictly prohibited.
+ */
+
+#ifndef __TRIGGER_RING_H__
+#define __TRIGGER_RING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "nvmedia_surface.h"
+#include "nvmedia_image.h"
+#include "thread_utils.h"
+#include "cmdline.h"
+#include "sensor_info.h"
+#include "packed_raw.h"
+#include "segment_recorder.h"
+
+/* Keeps the latest frames of a channel in memory, bit-packed when the
+ * capture is RAW10, 12 or 14, and on a trigger writes those of the last
+ * preUs and the frames of the following postUs to an event file,
+ * <prefix>_vc<n>_event<k>.rseg, laid out like a segment whose sequence
+ * number is the event number. Files are written by a thread of the ring
+ * so the save thread never waits for the disk. */
+
+#define TRIGGER_RING_DEQUEUE_TIMEOUT    100
+#define TRIGGER_RING_MIN_FRAMES         2
+#define TRIGGER_RING_DEFAULT_MEMORY_MB  256
+#define TRIGGER_RING_DEFAULT_POST_SECONDS 2
+
+typedef enum {
+    TRIGGER_SOURCE_COMMAND = 0,
+    TRIGGER_SOURCE_FFC,             // from the telemetry
+    TRIGGER_SOURCE_TELEMETRY,
+} TriggerSource;
+
+typedef struct {
+    SegmentFrameHeader          header;         // size is the bytes held
+    uint8_t                    *data;
+    uint32_t                    capacity;
+    NvMediaBool                 used;
+    volatile uint32_t           writing;        // queued to the writer thread
+} TriggerRingFrame;
+
+typedef struct {
+    NvMediaBool                 valid;
+    char                        prefix[MAX_STRING_SIZE];   // of the event files
+    uint64_t                    memoryBudget;   // bytes
+    uint64_t                    preUs;
+    uint64_t                    postUs;
+    uint32_t                    bytesPerSample;
+    NvPackedRawWriter           packer;
+    NvMediaBool                 packed;
+
+    /* Sized by the first frame */
+    TriggerRingFrame           *frames;
+    uint32_t                    numFrames;
+    uint32_t                    next;           // frame the next image goes to
+    uint8_t                    *buff;           // staging buffer
+    uint32_t                    buffSize;
+
+    /* Event being recorded, 0 if none */
+    uint32_t                    event;
+    uint64_t                    postEnd;
+
+    /* Optional telemetry triggers, on the temperature rising above the
+     * threshold and on the sensor starting a flat field correction, its
+     * own automatic ones included */
+    NvMediaStatus             (*ParseFrameInfo)(const uint8_t *buff, uint32_t width,
+                                                uint32_t pitch, uint32_t embeddedTopSize,
+                                                SensorFrameInfo *frameInfo);
+    NvMediaBool                 triggerOnTemperature;
+    float                       temperatureThreshold;
+    NvMediaBool                 temperatureKnown;
+    NvMediaBool                 aboveThreshold;
+    NvMediaBool                 triggerOnFfc;
+    SensorFfcState              ffcState;       // of the last frame
+
+    NvThread                   *writerThread;
+    NvQueue                    *writerQueue;
+    FILE                       *eventFile;      // writer thread only
+    SegmentHeader               eventHeader;    // writer thread only
+
+    /* Counters, read by the stats command */
+    volatile uint32_t           numEvents;
+    volatile uint32_t           numDropped;     // frames the writer was too late for
+} NvTriggerRing;
+
+/* Fails for captures other than RAW */
+NvMediaStatus
+TriggerRingInit(NvTriggerRing *ring,
+                const char *prefix,
+                uint32_t virtualGroupIndex,
+                NvMediaSurfaceType surfType,
+                uint32_t bytesPerSample,
+                uint64_t memoryBudget,
+                uint32_t preSeconds,
+                uint32_t postSeconds);
+
+/* Writes the event being recorded and stops the writer thread. Safe on a
+ * zeroed ring. */
+void
+TriggerRingDestroy(NvTriggerRing *ring);
+
+/* Keeps image, and queues it to be written while an event is recorded.
+ * Triggers an event itself when the telemetry condition is met. */
+NvMediaStatus
+TriggerRingPush(NvTriggerRing *ring,
+                NvMediaImage *image,
+                uint32_t frameNumber);
+
+/* Starts an event with the frames kept, or extends the one being recorded.
+ * Called from the thread pushing the frames. */
+void
+TriggerRingTrigger(NvTriggerRing *ring,
+                   TriggerSource source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TRIGGER_RING_H__